@@ -4,8 +4,9 @@
 #include <boost/asio.hpp>
 #include <boost/multi_array.hpp>
 
-#include "camodocal/calib/AtomicData.h"
+#include "camodocal/calib/FrameQueue.h"
 #include "camodocal/calib/PoseSource.h"
+#include "camodocal/calib/MonotonicSensorDataBuffer.h"
 #include "camodocal/calib/SensorDataBuffer.h"
 #include "camodocal/camera_systems/CameraSystem.h"
 #include "camodocal/sparse_graph/SparseGraph.h"
@@ -31,11 +32,15 @@ public:
     public:
         Options()
          : mode(OFFLINE)
+         , frameQueueSize(4)
+         , onlineOverflowPolicy(FrameQueue::DROP_OLDEST)
          , poseSource(ODOMETRY)
          , nMotions(200)
          , minKeyframeDistance(0.2)
          , minVOSegmentSize(15)
          , windowDistance(3.0)
+         , rectMapTolerance(0.0)
+         , rayLookupTableStep(0)
          , preprocessImages(false)
          , saveWorkingData(true)
          , beginStage(0)
@@ -43,6 +48,10 @@ public:
          , verbose(false) {};
 
         Mode mode;
+        size_t frameQueueSize;   // Number of images that are queued per camera.
+        FrameQueue::OverflowPolicy onlineOverflowPolicy; // What addFrame does with an image when
+                                                         // the queue is full in online mode.
+                                                         // In offline mode, addFrame waits.
         PoseSource poseSource;
         int nMotions;            // Once we reach a number of keyframes for each camera
                                  // such that there are <nMotion> relative motions between
@@ -60,6 +69,14 @@ public:
                                  // <windowDistance> distance that the vehicle travels
                                  // from the beginning of the window to the end of the window.
                                  // The larger the distance, the longer the local matching takes.
+        double rectMapTolerance; // If positive, the rectification maps used in local matching are
+                                 // cached and reused for rectifying rotations that agree up to
+                                 // <rectMapTolerance> radians. This trades accuracy for speed.
+
+        int rayLookupTableStep;  // If positive, image points are lifted to rays by interpolating
+                                 // between rays precomputed every <rayLookupTableStep> pixels
+                                 // (see Camera::enableRayLookupTable) instead of with the exact
+                                 // camera model. This is enabled on the cameras passed in.
 
         bool preprocessImages;
         bool saveWorkingData;
@@ -73,6 +90,8 @@ public:
                          const Options& options);
     virtual ~CamRigOdoCalibration();
 
+    // The image data is shared, not copied, so it must not be written to
+    // after the call.
     void addFrame(int cameraIdx, const cv::Mat& image, uint64_t timestamp);
     void addFrameSet(const std::vector<cv::Mat>& images, uint64_t timestamp);
 
@@ -110,12 +129,12 @@ private:
     CameraSystem m_cameraSystem;
     SparseGraph m_graph;
 
-    std::vector<AtomicData<cv::Mat>* > m_images;
+    std::vector<FrameQueue*> m_frameQueues;
     std::vector<CameraPtr> m_cameras;
-    SensorDataBuffer<OdometryPtr> m_odometryBuffer;
+    MonotonicSensorDataBuffer<OdometryPtr> m_odometryBuffer;
     SensorDataBuffer<OdometryPtr> m_interpOdometryBuffer;
     boost::mutex m_odometryBufferMutex;
-    SensorDataBuffer<PosePtr> m_gpsInsBuffer;
+    MonotonicSensorDataBuffer<PosePtr> m_gpsInsBuffer;
     SensorDataBuffer<PosePtr> m_interpGpsInsBuffer;
     boost::mutex m_gpsInsBufferMutex;
 
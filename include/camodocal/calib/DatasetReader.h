@@ -0,0 +1,107 @@
+#ifndef DATASETREADER_H
+#define DATASETREADER_H
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <opencv2/core/core.hpp>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace camodocal
+{
+
+// forward declarations
+class TaskGroup;
+class TaskScheduler;
+
+/**
+ * Replays a recorded dataset of image files and pose measurements in
+ * timestamp order, e.g. to feed CamRigOdoCalibration in offline mode.
+ * A pool of threads decodes the images in replay order, up to a
+ * lookahead window ahead of the consumer, so that decoding overlaps with
+ * the processing of earlier images.
+ *
+ * The poses are not stored; the reader only places their timestamps in
+ * the replay order, and the caller looks up the measurement.
+ */
+class DatasetReader
+{
+public:
+    typedef struct
+    {
+        // camera of an image, or -1 for a pose
+        int cameraId;
+        uint64_t timestamp;
+        // decoded image; empty for a pose or a file that cannot be read
+        cv::Mat image;
+        std::string filename;
+    } Event;
+
+    /**
+     * @param threadCount number of decoding threads; 0 means one per
+     *        hardware thread
+     * @param lookahead maximum number of images that are decoded ahead of
+     *        the consumer
+     */
+    explicit DatasetReader(int threadCount = 0, size_t lookahead = 16);
+    ~DatasetReader();
+
+    // must be called before the first call to next()
+    void addImage(int cameraId, uint64_t timestamp, const std::string& filename);
+    void addPose(uint64_t timestamp);
+
+    /**
+     * Returns the next event. Poses are replayed in timestamp order, and
+     * an image is replayed after the first pose that is newer than the
+     * image, so that it can be interpolated between the poses. Images
+     * that are older than the first pose or newer than the last pose are
+     * skipped.
+     * @return false after the last event
+     */
+    bool next(Event& event);
+
+    // number of events that next() returns in total
+    size_t eventCount(void);
+
+private:
+    typedef struct
+    {
+        int cameraId;
+        uint64_t timestamp;
+        std::string filename;
+        cv::Mat image;
+        bool decoded;
+    } Item;
+
+    void buildSequence(void);
+    void prefetch(void);
+    void decode(size_t itemId);
+
+    const size_t k_lookahead;
+
+    boost::shared_ptr<TaskScheduler> m_scheduler;
+    boost::shared_ptr<TaskGroup> m_decodeGroup;
+
+    std::vector<Item> m_images;
+    std::vector<uint64_t> m_poses;
+
+    // replay order; an entry is an index into m_images, or -1 - i for
+    // pose i
+    std::vector<long int> m_sequence;
+    bool m_sequenceBuilt;
+    size_t m_nextEvent;
+
+    // images in m_sequence up to here have been submitted for decoding
+    size_t m_prefetchEnd;
+    size_t m_prefetchCount;
+
+    bool m_stop;
+    boost::mutex m_mutex;
+    boost::condition_variable m_decodedCond;
+};
+
+}
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef FRAMEQUEUE_H
+#define FRAMEQUEUE_H
+
+#include <boost/circular_buffer.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <opencv2/core/core.hpp>
+#include <stdint.h>
+
+namespace camodocal
+{
+
+/**
+ * Bounded queue of the images of one camera between the thread that adds
+ * them and the thread that processes them. A queued image shares its
+ * pixel data with the pushed image, so the producer must not write to an
+ * image once it has been pushed.
+ *
+ * When the queue is full, push() either waits for the consumer or drops a
+ * frame, depending on the overflow policy. close() wakes all threads that
+ * wait on the queue; the frames queued until then can still be popped.
+ */
+class FrameQueue
+{
+public:
+    enum OverflowPolicy
+    {
+        BLOCK,          // wait until the consumer has popped a frame
+        DROP_OLDEST,    // replace the oldest queued frame
+        DROP_NEWEST     // discard the pushed frame
+    };
+
+    FrameQueue(size_t capacity, OverflowPolicy policy);
+
+    // false if the frame was dropped or the queue is closed
+    bool push(const cv::Mat& image, uint64_t timestamp);
+
+    // waits for the oldest frame; false once the queue is closed and empty
+    bool pop(cv::Mat& image, uint64_t& timestamp);
+
+    // push() fails from now on, and pop() once the queued frames are gone
+    void close(void);
+    bool closed(void) const;
+
+    size_t size(void) const;
+    size_t capacity(void) const;
+    OverflowPolicy policy(void) const;
+
+    // number of frames dropped because the queue was full
+    size_t droppedCount(void) const;
+
+private:
+    typedef struct
+    {
+        cv::Mat image;
+        uint64_t timestamp;
+    } QueuedFrame;
+
+    boost::circular_buffer<QueuedFrame> m_frames;
+    const OverflowPolicy m_policy;
+    bool m_closed;
+    size_t m_droppedCount;
+
+    mutable boost::mutex m_mutex;
+    boost::condition_variable m_notEmptyCond;
+    boost::condition_variable m_notFullCond;
+};
+
+}
+
+#endif
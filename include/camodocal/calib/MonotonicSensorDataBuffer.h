@@ -0,0 +1,470 @@
+#ifndef MONOTONICSENSORDATABUFFER_H
+#define MONOTONICSENSORDATABUFFER_H
+
+#include <algorithm>
+#include <boost/atomic.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread_time.hpp>
+#include <stdint.h>
+
+namespace camodocal
+{
+
+/**
+ * Ring buffer of sensor samples for a feed with one writer thread and
+ * increasing timestamps, e.g. odometry or GPS/INS. It has the lookup
+ * interface of SensorDataBuffer, but the lookups binary-search the
+ * timestamps without taking a mutex.
+ *
+ * The timestamps are guarded by a sequence lock: the writer makes the
+ * sequence number odd while it updates them, and a reader retries its
+ * search if the number changed in the meantime. Samples are stored as
+ * immutable entries that are swapped with atomic shared_ptr operations,
+ * so a reader that races with the writer gets either the old or the new
+ * entry of a slot and detects the latter by its position. These
+ * operations are not lock-free: boost guards them with a spinlock from a
+ * small pool, held only while the pointer is copied, so loading an entry
+ * briefly contends with push() and with other readers.
+ *
+ * A reader that needs data which has not arrived yet can block in
+ * timedWaitForData() until push() notifies it. push() only takes the
+ * wait mutex when a reader is waiting.
+ *
+ * push() and clear() must only be called from the writer thread. Samples
+ * that are not newer than the newest one in the buffer are dropped.
+ */
+template <class T>
+class MonotonicSensorDataBuffer : private boost::noncopyable
+{
+public:
+    explicit MonotonicSensorDataBuffer(size_t size = 100);
+
+    void clear(void);
+    bool empty(void) const;
+    size_t size(void) const;
+
+    // latest sample older than timestamp, if a sample at or after
+    // timestamp exists
+    bool before(uint64_t timestamp, T& data) const;
+    // sample that follows before(timestamp)
+    bool after(uint64_t timestamp, T& data) const;
+
+    bool nearest(uint64_t timestamp, T& data) const;
+    // samples on either side of timestamp, as before() and after()
+    bool nearest(uint64_t timestamp, T& dataBefore, T& dataAfter) const;
+
+    bool current(T& data) const;
+    void push(uint64_t timestamp, const T& data);
+
+    bool find(uint64_t timestamp, T& data) const;
+
+    // waits until a sample at or after timestamp is in the buffer; false if
+    // there is none at timeout
+    bool timedWaitForData(uint64_t timestamp, const boost::system_time& timeout) const;
+
+private:
+    typedef struct
+    {
+        // number of samples pushed before this one; never reused, so it
+        // identifies the sample in its slot
+        uint64_t position;
+        T data;
+    } Entry;
+
+    typedef boost::shared_ptr<const Entry> EntryPtr;
+
+    // result of a search in a consistent state of the buffer
+    typedef struct
+    {
+        // positions of the samples in the buffer are [begin, end)
+        uint64_t begin;
+        uint64_t end;
+        // first sample not older than the timestamp searched for
+        uint64_t position;
+        // timestamps of the samples at position - 1 and position, if any
+        uint64_t timestampBefore;
+        uint64_t timestampAfter;
+    } Bound;
+
+    void window(uint64_t& begin, uint64_t& end) const;
+    Bound lowerBound(uint64_t timestamp) const;
+
+    uint64_t timestampAt(uint64_t position) const;
+
+    // false if the slot has been overwritten since the position was found
+    bool dataAt(uint64_t position, T& data) const;
+
+    const size_t mCapacity;
+
+    boost::atomic<unsigned int> mSequence;
+    boost::atomic<uint64_t> mBegin;
+    boost::atomic<uint64_t> mEnd;
+    boost::scoped_array<boost::atomic<uint64_t> > mTimestamps;
+    boost::scoped_array<EntryPtr> mEntries;
+
+    mutable boost::atomic<unsigned int> mWaiterCount;
+    mutable boost::condition_variable mWaitCond;
+    mutable boost::mutex mWaitMutex;
+};
+
+template <class T>
+MonotonicSensorDataBuffer<T>::MonotonicSensorDataBuffer(size_t size)
+ : mCapacity(std::max(size, static_cast<size_t>(1)))
+ , mSequence(0)
+ , mBegin(0)
+ , mEnd(0)
+ , mTimestamps(new boost::atomic<uint64_t>[mCapacity])
+ , mEntries(new EntryPtr[mCapacity])
+ , mWaiterCount(0)
+{
+    for (size_t i = 0; i < mCapacity; ++i)
+    {
+        mTimestamps[i].store(0, boost::memory_order_relaxed);
+    }
+}
+
+template <class T>
+void
+MonotonicSensorDataBuffer<T>::clear(void)
+{
+    unsigned int sequence = mSequence.load(boost::memory_order_relaxed);
+    mSequence.store(sequence + 1, boost::memory_order_relaxed);
+    boost::atomic_thread_fence(boost::memory_order_release);
+
+    // the positions keep counting so that old entries stay distinguishable
+    mBegin.store(mEnd.load(boost::memory_order_relaxed), boost::memory_order_relaxed);
+
+    mSequence.store(sequence + 2, boost::memory_order_release);
+}
+
+template <class T>
+bool
+MonotonicSensorDataBuffer<T>::empty(void) const
+{
+    return size() == 0;
+}
+
+template <class T>
+size_t
+MonotonicSensorDataBuffer<T>::size(void) const
+{
+    uint64_t begin, end;
+    window(begin, end);
+
+    return end - begin;
+}
+
+template <class T>
+bool
+MonotonicSensorDataBuffer<T>::before(uint64_t timestamp, T& data) const
+{
+    for (;;)
+    {
+        Bound bound = lowerBound(timestamp);
+
+        if (bound.position == bound.begin || bound.position == bound.end)
+        {
+            return false;
+        }
+
+        if (dataAt(bound.position - 1, data))
+        {
+            return true;
+        }
+    }
+}
+
+template <class T>
+bool
+MonotonicSensorDataBuffer<T>::after(uint64_t timestamp, T& data) const
+{
+    for (;;)
+    {
+        Bound bound = lowerBound(timestamp);
+
+        if (bound.position == bound.begin || bound.position == bound.end)
+        {
+            return false;
+        }
+
+        if (dataAt(bound.position, data))
+        {
+            return true;
+        }
+    }
+}
+
+template <class T>
+bool
+MonotonicSensorDataBuffer<T>::nearest(uint64_t timestamp, T& data) const
+{
+    for (;;)
+    {
+        Bound bound = lowerBound(timestamp);
+
+        if (bound.begin == bound.end)
+        {
+            return false;
+        }
+
+        // the nearest sample is on one side of the lower bound, and the
+        // earlier one wins a tie
+        uint64_t pos = bound.position;
+        if (pos == bound.end ||
+            (pos > bound.begin &&
+             timestamp - bound.timestampBefore <= bound.timestampAfter - timestamp))
+        {
+            --pos;
+        }
+
+        if (dataAt(pos, data))
+        {
+            return true;
+        }
+    }
+}
+
+template <class T>
+bool
+MonotonicSensorDataBuffer<T>::nearest(uint64_t timestamp, T& dataBefore, T& dataAfter) const
+{
+    for (;;)
+    {
+        Bound bound = lowerBound(timestamp);
+
+        if (bound.position == bound.begin || bound.position == bound.end)
+        {
+            return false;
+        }
+
+        if (dataAt(bound.position - 1, dataBefore) && dataAt(bound.position, dataAfter))
+        {
+            return true;
+        }
+    }
+}
+
+template <class T>
+bool
+MonotonicSensorDataBuffer<T>::current(T& data) const
+{
+    for (;;)
+    {
+        uint64_t begin, end;
+        window(begin, end);
+
+        if (begin == end)
+        {
+            return false;
+        }
+
+        if (dataAt(end - 1, data))
+        {
+            return true;
+        }
+    }
+}
+
+template <class T>
+void
+MonotonicSensorDataBuffer<T>::push(uint64_t timestamp, const T& data)
+{
+    // only the writer modifies the window, so it can be read without the
+    // sequence lock here
+    uint64_t begin = mBegin.load(boost::memory_order_relaxed);
+    uint64_t end = mEnd.load(boost::memory_order_relaxed);
+
+    if (end > begin && timestamp <= timestampAt(end - 1))
+    {
+        return;
+    }
+
+    boost::shared_ptr<Entry> entry = boost::make_shared<Entry>();
+    entry->position = end;
+    entry->data = data;
+
+    size_t slot = end % mCapacity;
+
+    unsigned int sequence = mSequence.load(boost::memory_order_relaxed);
+    mSequence.store(sequence + 1, boost::memory_order_relaxed);
+    boost::atomic_thread_fence(boost::memory_order_release);
+
+    mTimestamps[slot].store(timestamp, boost::memory_order_relaxed);
+    boost::atomic_store(&mEntries[slot], EntryPtr(entry));
+    if (end + 1 - begin > mCapacity)
+    {
+        mBegin.store(end + 1 - mCapacity, boost::memory_order_relaxed);
+    }
+    mEnd.store(end + 1, boost::memory_order_relaxed);
+
+    mSequence.store(sequence + 2, boost::memory_order_release);
+
+    // pairs with the fence in timedWaitForData(): either the waiter sees
+    // the new sample, or the writer sees the waiter
+    boost::atomic_thread_fence(boost::memory_order_seq_cst);
+    if (mWaiterCount.load(boost::memory_order_relaxed) > 0)
+    {
+        // a waiter holds the mutex from its check until it waits, so
+        // taking it here ensures that the notification is not lost
+        {
+            boost::lock_guard<boost::mutex> lock(mWaitMutex);
+        }
+
+        mWaitCond.notify_all();
+    }
+}
+
+template <class T>
+bool
+MonotonicSensorDataBuffer<T>::find(uint64_t timestamp, T& data) const
+{
+    for (;;)
+    {
+        Bound bound = lowerBound(timestamp);
+
+        if (bound.position == bound.end || bound.timestampAfter != timestamp)
+        {
+            return false;
+        }
+
+        if (dataAt(bound.position, data))
+        {
+            return true;
+        }
+    }
+}
+
+template <class T>
+bool
+MonotonicSensorDataBuffer<T>::timedWaitForData(uint64_t timestamp,
+                                               const boost::system_time& timeout) const
+{
+    Bound bound = lowerBound(timestamp);
+    if (bound.position != bound.end)
+    {
+        return true;
+    }
+
+    boost::unique_lock<boost::mutex> lock(mWaitMutex);
+
+    mWaiterCount.fetch_add(1, boost::memory_order_relaxed);
+    boost::atomic_thread_fence(boost::memory_order_seq_cst);
+
+    bool covered = false;
+    for (;;)
+    {
+        bound = lowerBound(timestamp);
+        if (bound.position != bound.end)
+        {
+            covered = true;
+            break;
+        }
+
+        if (!mWaitCond.timed_wait(lock, timeout))
+        {
+            bound = lowerBound(timestamp);
+            covered = bound.position != bound.end;
+            break;
+        }
+    }
+
+    mWaiterCount.fetch_sub(1, boost::memory_order_relaxed);
+
+    return covered;
+}
+
+template <class T>
+void
+MonotonicSensorDataBuffer<T>::window(uint64_t& begin, uint64_t& end) const
+{
+    for (;;)
+    {
+        unsigned int sequence = mSequence.load(boost::memory_order_acquire);
+        if (sequence & 1)
+        {
+            continue;
+        }
+
+        begin = mBegin.load(boost::memory_order_relaxed);
+        end = mEnd.load(boost::memory_order_relaxed);
+
+        boost::atomic_thread_fence(boost::memory_order_acquire);
+        if (mSequence.load(boost::memory_order_relaxed) == sequence)
+        {
+            return;
+        }
+    }
+}
+
+template <class T>
+typename MonotonicSensorDataBuffer<T>::Bound
+MonotonicSensorDataBuffer<T>::lowerBound(uint64_t timestamp) const
+{
+    Bound bound;
+    for (;;)
+    {
+        unsigned int sequence = mSequence.load(boost::memory_order_acquire);
+        if (sequence & 1)
+        {
+            continue;
+        }
+
+        bound.begin = mBegin.load(boost::memory_order_relaxed);
+        bound.end = mEnd.load(boost::memory_order_relaxed);
+
+        uint64_t lo = bound.begin;
+        uint64_t hi = bound.end;
+        while (lo < hi)
+        {
+            uint64_t mid = lo + (hi - lo) / 2;
+            if (timestampAt(mid) < timestamp)
+            {
+                lo = mid + 1;
+            }
+            else
+            {
+                hi = mid;
+            }
+        }
+
+        bound.position = lo;
+        bound.timestampBefore = lo > bound.begin ? timestampAt(lo - 1) : 0;
+        bound.timestampAfter = lo < bound.end ? timestampAt(lo) : 0;
+
+        boost::atomic_thread_fence(boost::memory_order_acquire);
+        if (mSequence.load(boost::memory_order_relaxed) == sequence)
+        {
+            return bound;
+        }
+    }
+}
+
+template <class T>
+uint64_t
+MonotonicSensorDataBuffer<T>::timestampAt(uint64_t position) const
+{
+    return mTimestamps[position % mCapacity].load(boost::memory_order_relaxed);
+}
+
+template <class T>
+bool
+MonotonicSensorDataBuffer<T>::dataAt(uint64_t position, T& data) const
+{
+    EntryPtr entry = boost::atomic_load(&mEntries[position % mCapacity]);
+    if (!entry || entry->position != position)
+    {
+        return false;
+    }
+
+    data = entry->data;
+    return true;
+}
+
+}
+
+#endif
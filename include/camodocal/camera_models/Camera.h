@@ -20,6 +20,13 @@ public:
         SCARAMUZZA
     };
 
+    // point sets with one point per row; each coordinate is stored
+    // contiguously in its own column
+    typedef Eigen::Matrix<double, Eigen::Dynamic, 3> Points3D;
+    typedef Eigen::Matrix<double, Eigen::Dynamic, 2> Points2D;
+
+    Camera();
+
     class Parameters
     {
     public:
@@ -78,6 +85,14 @@ public:
     virtual void spaceToPlane(const Eigen::Vector3d& P, Eigen::Vector2d& p) const = 0;
     //%output p
 
+    // Batched versions of spaceToPlane and liftSphere. The default
+    // implementations loop over the single-point functions; camera models
+    // override them with vectorized kernels.
+    virtual void spaceToPlaneBatch(const Points3D& P, Points2D& p) const;
+    //%output p
+    virtual void liftSphereBatch(const Points2D& p, Points3D& P) const;
+    //%output P
+
     // Projects 3D points to the image plane (Pi function)
     // and calculates jacobian
     //virtual void spaceToPlane(const Eigen::Vector3d& P, Eigen::Vector2d& p,
@@ -128,8 +143,53 @@ public:
                        const cv::Mat& rvec,
                        const cv::Mat& tvec,
                        std::vector<cv::Point2f>& imagePoints) const;
+
+    /**
+     * \brief Enables a precomputed table of unit rays for liftSphere and
+     *        liftProjective
+     *
+     * Rays are sampled every step pixels and bilinearly interpolated.
+     * liftProjective scales the interpolated ray like the exact model does.
+     * Points outside the image fall back to the exact model. The table is
+     * rebuilt whenever the intrinsics change through setParameters or
+     * readParameters. Enabling, disabling and changing parameters must not
+     * run concurrently with lifting.
+     *
+     * \param step sampling interval in pixels
+     */
+    void enableRayLookupTable(int step = 2);
+    void disableRayLookupTable(void);
+    bool rayLookupTableEnabled(void) const;
+
+    /**
+     * \brief Angular error of the lookup table relative to the exact model
+     *
+     * Measured at the centres of the table cells when the table is built.
+     *
+     * \param maxError maximum angular error in radians
+     * \param avgError mean angular error in radians
+     * \return false if the lookup table is disabled
+     */
+    bool rayLookupTableAccuracy(double& maxError, double& avgError) const;
+
 protected:
+    /**
+     * \brief Lifts a point to the unit sphere with the lookup table
+     *
+     * \return false if the table is disabled or p lies outside the table
+     */
+    bool liftSphereFromTable(const Eigen::Vector2d& p, Eigen::Vector3d& P) const;
+
+    // to be called by derived classes whenever their intrinsics change
+    void updateRayLookupTable(void);
+
     cv::Mat m_mask;
+
+private:
+    class RayLookupTable;
+
+    boost::shared_ptr<const RayLookupTable> m_rayTable;
+    int m_rayTableStep;
 };
 
 typedef boost::shared_ptr<Camera> CameraPtr;
@@ -101,6 +101,10 @@ public:
     void spaceToPlane(const Eigen::Vector3d& P, Eigen::Vector2d& p) const;
     //%output p
 
+    // Batched Pi function, vectorized over the point set
+    void spaceToPlaneBatch(const Points3D& P, Points2D& p) const;
+    //%output p
+
     // Projects 3D points to the image plane (Pi function)
     // and calculates jacobian
     void spaceToPlane(const Eigen::Vector3d& P, Eigen::Vector2d& p,
@@ -93,6 +93,12 @@ public:
     void spaceToPlane(const Eigen::Vector3d& P, Eigen::Vector2d& p) const;
     //%output p
 
+    // Batched Pi function and lifting, vectorized over the point set
+    void spaceToPlaneBatch(const Points3D& P, Points2D& p) const;
+    //%output p
+    void liftSphereBatch(const Points2D& p, Points3D& P) const;
+    //%output P
+
     // Projects 3D points to the image plane (Pi function)
     // and calculates jacobian
     void spaceToPlane(const Eigen::Vector3d& P, Eigen::Vector2d& p,
@@ -112,6 +118,8 @@ public:
     void distortion(const Eigen::Vector2d& p_u, Eigen::Vector2d& d_u) const;
     void distortion(const Eigen::Vector2d& p_u, Eigen::Vector2d& d_u,
                     Eigen::Matrix2d& J) const;
+    void distortionBatch(const Eigen::ArrayXd& mx_u, const Eigen::ArrayXd& my_u,
+                         Eigen::ArrayXd& dx_u, Eigen::ArrayXd& dy_u) const;
 
     void initUndistortMap(cv::Mat& map1, cv::Mat& map2, double fScale = 1.0) const;
     cv::Mat initUndistortRectifyMap(cv::Mat& map1, cv::Mat& map2,
@@ -92,6 +92,12 @@ public:
     void spaceToPlane(const Eigen::Vector3d& P, Eigen::Vector2d& p) const;
     //%output p
 
+    // Batched Pi function and lifting, vectorized over the point set
+    void spaceToPlaneBatch(const Points3D& P, Points2D& p) const;
+    //%output p
+    void liftSphereBatch(const Points2D& p, Points3D& P) const;
+    //%output P
+
     // Projects 3D points to the image plane (Pi function)
     // and calculates jacobian
     //void spaceToPlane(const Eigen::Vector3d& P, Eigen::Vector2d& p,
@@ -2,6 +2,7 @@
 #define INFRASTRUCTURECALIBRATION_H
 
 #include <boost/thread.hpp>
+#include <list>
 
 #include "camodocal/camera_systems/CameraSystem.h"
 #include "camodocal/sparse_graph/SparseGraph.h"
@@ -13,7 +14,8 @@
 namespace camodocal
 {
 
-// forward declaration
+// forward declarations
+class DescriptorIndex;
 class LocationRecognition;
 
 class InfrastructureCalibration
@@ -36,16 +38,25 @@ public:
 
     const CameraSystem& cameraSystem(void) const;
 
+    // number of descriptors compared per feature when matching a frame
+    // against the map; trades recall for speed, and 0 searches
+    // exhaustively (default: 64)
+    void setDescriptorSearchChecks(int checks);
+
+    // number of reference frames whose descriptor indices are kept between
+    // frame sets; the least recently used index is dropped first
+    // (default: 256)
+    void setReferenceIndexCacheSize(size_t size);
+
 private:
     void estimateCameraPose(const cv::Mat& image, uint64_t timestamp,
                             FramePtr& frame, bool preprocess = false);
     void optimize(bool optimizeScenePoints);
 
-    cv::Mat buildDescriptorMat(const std::vector<Point2DFeaturePtr>& features,
-                               std::vector<size_t>& indices,
-                               bool hasScenePoint) const;
-    std::vector<cv::DMatch> matchFeatures(const std::vector<Point2DFeaturePtr>& queryFeatures,
-                                          const std::vector<Point2DFeaturePtr>& trainFeatures) const;
+    boost::shared_ptr<const DescriptorIndex> referenceIndex(const FramePtr& frame);
+    void evictReferenceIndices(void);
+    std::vector<cv::DMatch> matchFeatures(const DescriptorIndex& queryIndex,
+                                          const DescriptorIndex& trainIndex) const;
 
     void solveP3PRansac(const FrameConstPtr& frame1,
                         const FrameConstPtr& frame2,
@@ -108,10 +119,19 @@ private:
     boost::shared_ptr<LocationRecognition> m_locrec;
     boost::mutex m_feature3DMapMutex;
     boost::unordered_map<Point3DFeature*, Point3DFeaturePtr> m_feature3DMap;
+    // descriptor indices of the reference frames, built on first use and
+    // kept in LRU order
+    typedef std::list<const Frame*> RefIndexLRUList;
+    typedef boost::unordered_map<const Frame*, std::pair<boost::shared_ptr<const DescriptorIndex>, RefIndexLRUList::iterator> > RefIndexMap;
+    boost::mutex m_refIndexMutex;
+    RefIndexLRUList m_refIndexLRU;
+    RefIndexMap m_refIndices;
+    size_t m_refIndexCacheSize;
     std::vector<FrameSet> m_framesets;
     double m_x_last;
     double m_y_last;
     double m_distance;
+    int m_descriptorSearchChecks;
     bool m_verbose;
 
 #ifdef VCHARGE_VIZ
@@ -3,31 +3,58 @@
 
 #include <camodocal/camera_systems/CameraSystem.h>
 #include <camodocal/pose_graph/DirectedEdge.h>
-#include <camodocal/sparse_graph/SparseGraph.h>
+#include <camodocal/sparse_graph/GraphView.h>
 #include <vector>
 
 namespace camodocal
 {
 
-// forward declaration
+// forward declarations
+class DescriptorIndex;
 class LocationRecognition;
 
+/**
+ * Pose graph of the system poses of a graph, with odometry edges between
+ * consecutive frame sets and loop closure edges found by location
+ * recognition. The graph is only read through a GraphView, so it can be
+ * a SparseGraph or a CompactSparseGraph; optimize() updates the system
+ * poses of the graph in place.
+ */
 class PoseGraph
 {
 public:
+    // pair of a feature of a query frame and a feature of the matched frame
+    // whose scene point the query feature corresponds to
+    typedef std::pair<FeatureTag, FeatureTag> Correspondence2D3D;
+
     PoseGraph(CameraSystem& cameraSystem,
               SparseGraph& graph,
               float maxDistanceRatio,
               int minLoopCorrespondences2D3D,
               int nImageMatches);
 
+    PoseGraph(CameraSystem& cameraSystem,
+              CompactSparseGraph& graph,
+              float maxDistanceRatio,
+              int minLoopCorrespondences2D3D,
+              int nImageMatches);
+
     void setVerbose(bool onoff);
 
+    // use hand-derived instead of automatic Jacobians for the edge errors
+    // (default: on)
+    void setAnalyticJacobians(bool onoff);
+
+    // number of descriptors compared per feature when matching loop
+    // closure candidates; trades recall for speed, and 0 searches
+    // exhaustively (default: 64)
+    void setDescriptorSearchChecks(int checks);
+
     void buildEdges(void);
 
     void optimize(bool useRobustOptimization);
 
-    std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> > getCorrespondences2D3D(void) const;
+    std::vector<Correspondence2D3D> getCorrespondences2D3D(void) const;
 
 private:
     enum EdgeSwitchState
@@ -39,33 +66,35 @@ private:
 
     typedef DirectedEdge<Transform, Odometry> Edge;
 
+    class EMProblem;
+
     std::vector<Edge, Eigen::aligned_allocator<Edge> > findOdometryEdges(void) const;
     void findLoopClosures(std::vector<Edge, Eigen::aligned_allocator<Edge> >& loopClosureEdges,
-                          std::vector<std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> > >& correspondences2D3D,
+                          std::vector<std::vector<Correspondence2D3D> >& correspondences2D3D,
                           double reprojErrorThresh = 2.0) const;
 
     void findLoopClosuresHelper(FrameTag frameTagQuery,
                                 boost::shared_ptr<LocationRecognition> locRec,
                                 PoseGraph::Edge* edge,
-                                std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> >* correspondences2D3D,
+                                std::vector<Correspondence2D3D>* correspondences2D3D,
                                 double reprojErrorThresh) const;
 
-    bool iterateEM(bool useRobustOptimization);
+    bool iterateEM(EMProblem& problem);
     void classifySwitches(void);
 
-    void solveP3PRansac(const FrameConstPtr& frame1,
-                        const FrameConstPtr& frame2,
+    void solveP3PRansac(const FrameTag& frame1,
+                        const FrameTag& frame2,
                         const std::vector<cv::DMatch>& matches,
                         Eigen::Matrix4d& H,
                         std::vector<cv::DMatch>& inliers,
                         double reprojErrorThresh = 2.0) const;
 
-    cv::Mat buildDescriptorMat(const std::vector<Point2DFeaturePtr>& features,
+    cv::Mat buildDescriptorMat(const FrameTag& frame,
                                std::vector<size_t>& indices,
                                bool hasScenePoint) const;
 
-    std::vector<cv::DMatch> matchFeatures(const std::vector<Point2DFeaturePtr>& features1,
-                                          const std::vector<Point2DFeaturePtr>& features2,
+    std::vector<cv::DMatch> matchFeatures(const FrameTag& frame1,
+                                          const DescriptorIndex& index2,
                                           float maxDistanceRatio) const;
 
 #ifdef VCHARGE_VIZ
@@ -73,17 +102,19 @@ private:
 #endif
 
     CameraSystem m_cameraSystem;
-    SparseGraph& m_graph;
+    boost::shared_ptr<GraphView> m_graph;
     std::vector<Edge, Eigen::aligned_allocator<Edge> > m_odometryEdges;
     std::vector<Edge, Eigen::aligned_allocator<Edge> > m_loopClosureEdges;
     std::vector<EdgeSwitchState> m_loopClosureEdgeSwitches;
-    std::vector<std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> > > m_correspondences2D3D;
+    std::vector<std::vector<Correspondence2D3D> > m_correspondences2D3D;
 
     const double k_lossWidth;
     const int k_minLoopCorrespondences2D3D;
     const float k_maxDistanceRatio;
     const int k_nImageMatches;
 
+    bool m_analyticJacobians;
+    int m_descriptorSearchChecks;
     bool m_verbose;
 };
 
@@ -0,0 +1,194 @@
+#ifndef COMPACTSPARSEGRAPH_H
+#define COMPACTSPARSEGRAPH_H
+
+#include <boost/thread/mutex.hpp>
+#include <camodocal/sparse_graph/SparseGraph.h>
+
+namespace camodocal
+{
+
+/**
+ * Arena-backed alternative to SparseGraph for large graphs.
+ *
+ * The features of a frame are stored in parallel arrays, and their
+ * descriptors in one matrix per frame with one row per feature. Features
+ * have graph-wide ids; the features of a frame have the consecutive ids
+ * featureOffset, ..., featureOffset + keypoints.size() - 1. Frames, scene
+ * points and features refer to each other by id instead of by
+ * shared_ptr/weak_ptr, and the variable-length match and observation lists
+ * are ranges into a single link array. An id of -1 denotes a missing
+ * reference throughout.
+ *
+ * Descriptors are assumed to be single rows of the same type and length
+ * within a frame, as produced by the feature detectors.
+ *
+ * CompactSparseGraphView (see GraphView.h) traverses the graph read-only
+ * in the same way as SparseGraphView traverses a SparseGraph, so
+ * PoseGraph and LocationRecognition, which only read the graph through a
+ * GraphView, run on the compact representation directly; the system poses
+ * are the shared Odometry objects and are optimized in place. CameraRigBA
+ * still changes the structure of the graph, e.g. when merging scene points,
+ * and works on SparseGraph only. toSparseGraph() builds a SparseGraph from
+ * the compact representation, and fromSparseGraph() goes the other way.
+ * Callers that hand the graph to CameraRigBA should use
+ * moveToSparseGraph(), which releases the compact graph frame by frame so
+ * that the peak memory stays close to that of the SparseGraph alone.
+ *
+ * Besides the format of SparseGraph::writeToBinaryFile, the graph can be
+ * stored in a columnar format (version 2) in which every kind of record is
+ * a fixed-width array. Such files are memory-mapped when read; descriptors
+ * are used in place and the other columns are copied in bulk. In both
+ * formats, frame images are referenced by path and decoded on first access
+ * through frameImage().
+ */
+class CompactSparseGraph
+{
+public:
+    typedef struct
+    {
+        unsigned int offset;
+        unsigned int count;
+    } LinkRange;
+
+    typedef struct
+    {
+        int cameraId;
+
+        PosePtr cameraPose;
+        OdometryPtr systemPose;
+        OdometryPtr odometryMeasurement;
+        PosePtr gpsInsMeasurement;
+
+        // decoded image; empty until loaded from imagePath
+        cv::Mat image;
+        std::string imagePath;
+
+        // id of the first feature of this frame
+        int featureOffset;
+
+        // per-feature data, indexed by feature id - featureOffset
+        std::vector<cv::KeyPoint> keypoints;
+        cv::Mat descriptors;
+        std::vector<unsigned int> indices;
+        std::vector<int> bestPrevMatchIds;
+        std::vector<int> bestNextMatchIds;
+        std::vector<LinkRange> prevMatches;
+        std::vector<LinkRange> nextMatches;
+        std::vector<int> scenePointIds;
+    } Frame;
+
+    typedef struct
+    {
+        Eigen::Vector3d point;
+        Eigen::Matrix3d pointCovariance;
+        int attributes;
+        double weight;
+
+        // ids of the features observing this scene point
+        LinkRange features2D;
+    } ScenePoint;
+
+    typedef struct
+    {
+        // frame ids indexed by camera id
+        std::vector<int> frameIds;
+
+        OdometryPtr systemPose;
+        OdometryPtr odometryMeasurement;
+        PosePtr gpsInsMeasurement;
+    } FrameSet;
+
+    typedef std::vector<FrameSet> FrameSetSegment;
+
+    CompactSparseGraph();
+
+    void clear(void);
+
+    std::vector<FrameSetSegment>& frameSetSegments(void);
+    const std::vector<FrameSetSegment>& frameSetSegments(void) const;
+
+    std::vector<Frame>& frames(void);
+    const std::vector<Frame>& frames(void) const;
+
+    std::vector<ScenePoint, Eigen::aligned_allocator<ScenePoint> >& scenePoints(void);
+    const std::vector<ScenePoint, Eigen::aligned_allocator<ScenePoint> >& scenePoints(void) const;
+
+    size_t featureCount(void) const;
+
+    // frame that a feature belongs to, in O(log #frames)
+    int featureFrameId(int featureId) const;
+
+    // feature ids referenced by a link range
+    const int* links(const LinkRange& range) const;
+
+    // approximate heap memory used by the graph excluding images [bytes]
+    size_t memoryUsage(void) const;
+
+    // decodes the image of a frame if it has not been loaded yet; safe to
+    // call from several threads
+    cv::Mat frameImage(int frameId);
+
+    void fromSparseGraph(const SparseGraph& graph);
+
+    // images that have not been decoded yet are only loaded if loadImages
+    // is true
+    void toSparseGraph(SparseGraph& graph, bool loadImages = true) const;
+
+    // like toSparseGraph, but releases the compact graph while converting;
+    // the compact graph is empty afterwards
+    void moveToSparseGraph(SparseGraph& graph, bool loadImages = true);
+
+    // reads either file format
+    bool readFromFile(const std::string& filename);
+
+    // hash of the complete contents of the file that the graph was last
+    // read from, or 0 if the graph was not read from a file
+    uint64_t contentHash(void) const;
+
+    // reads a graph written by SparseGraph::writeToBinaryFile without
+    // materializing the pointer-based representation
+    bool readFromBinaryFile(const std::string& filename);
+
+    bool readFromColumnarFile(const std::string& filename);
+
+    // writes the columnar format; decoded images without a path are
+    // written to a directory named after the file
+    bool writeToColumnarFile(const std::string& filename) const;
+
+    static bool isColumnarFile(const std::string& filename);
+
+private:
+    LinkRange appendLinks(const std::vector<int>& featureIds);
+
+    void createSparseGraphNodes(std::vector<FramePtr>& frames,
+                                std::vector<Point2DFeaturePtr>& features2D,
+                                std::vector<Point3DFeaturePtr>& features3D) const;
+    void convertFrame(size_t frameId, bool loadImages,
+                      const std::vector<FramePtr>& frames,
+                      const std::vector<Point2DFeaturePtr>& features2D,
+                      const std::vector<Point3DFeaturePtr>& features3D) const;
+    void convertScenePointsAndFrameSets(SparseGraph& graph,
+                                        const std::vector<FramePtr>& frames,
+                                        const std::vector<Point2DFeaturePtr>& features2D,
+                                        const std::vector<Point3DFeaturePtr>& features3D) const;
+
+    template<typename T>
+    void readData(std::ifstream& ifs, T& data) const;
+
+    std::vector<FrameSetSegment> m_frameSetSegments;
+    std::vector<Frame> m_frames;
+    std::vector<ScenePoint, Eigen::aligned_allocator<ScenePoint> > m_scenePoints;
+    std::vector<int> m_links;
+    size_t m_featureCount;
+    uint64_t m_contentHash;
+
+    // mapping of the columnar file that the descriptors refer to
+    boost::shared_ptr<void> m_mappedFile;
+
+    // guards the images of all frames
+    boost::mutex m_imageMutex;
+};
+
+}
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef GRAPHVIEW_H
+#define GRAPHVIEW_H
+
+#include <camodocal/sparse_graph/CompactSparseGraph.h>
+
+namespace camodocal
+{
+
+typedef struct
+{
+    FrameTag frameTag;
+    // index of the feature within its frame
+    int index;
+} FeatureTag;
+
+/**
+ * Read-only traversal of the frame sets, frames and features of a graph,
+ * independent of whether it is stored as a SparseGraph or as a
+ * CompactSparseGraph. Frames are addressed by FrameTag, and features by
+ * their index within the frame, i.e. the position in Frame::features2D()
+ * or in the per-feature arrays of CompactSparseGraph::Frame.
+ *
+ * The structure of the graph cannot be changed through a view. The poses
+ * that it returns are the objects of the graph, though, so an optimizer
+ * can update them in place. A view refers to its graph and must not
+ * outlive it.
+ */
+class GraphView
+{
+public:
+    virtual ~GraphView();
+
+    virtual int frameSetSegmentCount(void) const = 0;
+    virtual int frameSetCount(int segmentId) const = 0;
+
+    virtual const OdometryPtr& frameSetSystemPose(int segmentId, int frameSetId) const = 0;
+    virtual const OdometryPtr& frameSetOdometryMeasurement(int segmentId, int frameSetId) const = 0;
+
+    // number of camera slots of a frame set; hasFrame() tells which of
+    // them hold a frame
+    virtual int frameSlotCount(int segmentId, int frameSetId) const = 0;
+    virtual bool hasFrame(const FrameTag& frameTag) const = 0;
+
+    virtual int cameraId(const FrameTag& frameTag) const = 0;
+    virtual const OdometryPtr& systemPose(const FrameTag& frameTag) const = 0;
+
+    virtual int featureCount(const FrameTag& frameTag) const = 0;
+    virtual const cv::KeyPoint& keypoint(const FeatureTag& featureTag) const = 0;
+
+    // single-row descriptor that shares the data of the graph
+    virtual cv::Mat descriptor(const FeatureTag& featureTag) const = 0;
+
+    // point of the scene point that the feature observes, or 0 if the
+    // feature has no scene point
+    virtual const Eigen::Vector3d* scenePoint(const FeatureTag& featureTag) const = 0;
+};
+
+class SparseGraphView : public GraphView
+{
+public:
+    explicit SparseGraphView(const SparseGraph& graph);
+
+    int frameSetSegmentCount(void) const;
+    int frameSetCount(int segmentId) const;
+
+    const OdometryPtr& frameSetSystemPose(int segmentId, int frameSetId) const;
+    const OdometryPtr& frameSetOdometryMeasurement(int segmentId, int frameSetId) const;
+
+    int frameSlotCount(int segmentId, int frameSetId) const;
+    bool hasFrame(const FrameTag& frameTag) const;
+
+    int cameraId(const FrameTag& frameTag) const;
+    const OdometryPtr& systemPose(const FrameTag& frameTag) const;
+
+    int featureCount(const FrameTag& frameTag) const;
+    const cv::KeyPoint& keypoint(const FeatureTag& featureTag) const;
+    cv::Mat descriptor(const FeatureTag& featureTag) const;
+    const Eigen::Vector3d* scenePoint(const FeatureTag& featureTag) const;
+
+    // the features themselves, for callers that work on SparseGraph
+    const FramePtr& frame(const FrameTag& frameTag) const;
+    const Point2DFeaturePtr& feature2D(const FeatureTag& featureTag) const;
+
+private:
+    const FrameSetPtr& frameSet(int segmentId, int frameSetId) const;
+
+    const SparseGraph& m_graph;
+};
+
+class CompactSparseGraphView : public GraphView
+{
+public:
+    explicit CompactSparseGraphView(const CompactSparseGraph& graph);
+
+    int frameSetSegmentCount(void) const;
+    int frameSetCount(int segmentId) const;
+
+    const OdometryPtr& frameSetSystemPose(int segmentId, int frameSetId) const;
+    const OdometryPtr& frameSetOdometryMeasurement(int segmentId, int frameSetId) const;
+
+    int frameSlotCount(int segmentId, int frameSetId) const;
+    bool hasFrame(const FrameTag& frameTag) const;
+
+    int cameraId(const FrameTag& frameTag) const;
+    const OdometryPtr& systemPose(const FrameTag& frameTag) const;
+
+    int featureCount(const FrameTag& frameTag) const;
+    const cv::KeyPoint& keypoint(const FeatureTag& featureTag) const;
+    cv::Mat descriptor(const FeatureTag& featureTag) const;
+    const Eigen::Vector3d* scenePoint(const FeatureTag& featureTag) const;
+
+    // id of the frame in CompactSparseGraph::frames(), or -1
+    int frameId(const FrameTag& frameTag) const;
+
+private:
+    const CompactSparseGraph::FrameSet& frameSet(int segmentId, int frameSetId) const;
+    const CompactSparseGraph::Frame& frame(const FrameTag& frameTag) const;
+
+    const CompactSparseGraph& m_graph;
+};
+
+}
+
+#endif
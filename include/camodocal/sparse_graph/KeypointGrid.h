@@ -0,0 +1,66 @@
+#ifndef KEYPOINTGRID_H
+#define KEYPOINTGRID_H
+
+#include <boost/shared_ptr.hpp>
+#include <opencv2/core/core.hpp>
+#include <vector>
+
+namespace camodocal
+{
+
+/**
+ * Uniform grid over a fixed set of image points for radius queries.
+ * Point indices are stored contiguously per cell, so a query only touches
+ * the cells overlapping the search radius.
+ */
+class KeypointGrid
+{
+public:
+    explicit KeypointGrid(const std::vector<cv::Point2f>& points,
+                          float cellSize = 8.0f);
+
+    size_t size(void) const;
+
+    /**
+     * Finds all points with a distance to pt strictly less than radius.
+     * @param indices indices into the point set, in ascending order
+     */
+    void radiusSearch(const cv::Point2f& pt, float radius,
+                      std::vector<int>& indices) const;
+
+    /**
+     * Finds all points p with |p.x - pt.x| < maxDeltaX and
+     * |p.y - pt.y| < maxDeltaY.
+     * @param indices indices into the point set, in ascending order
+     */
+    void boxSearch(const cv::Point2f& pt, float maxDeltaX, float maxDeltaY,
+                   std::vector<int>& indices) const;
+
+    /**
+     * @return index of the nearest point within radius, or -1
+     */
+    int nearest(const cv::Point2f& pt, float radius) const;
+
+private:
+    void cellRange(const cv::Point2f& pt, float deltaX, float deltaY,
+                   int& c0, int& c1, int& r0, int& r1) const;
+
+    std::vector<cv::Point2f> m_points;
+
+    float m_cellSize;
+    float m_originX;
+    float m_originY;
+    int m_cols;
+    int m_rows;
+
+    // points of cell i are m_cellIndices[m_cellStart[i]..m_cellStart[i+1])
+    std::vector<int> m_cellStart;
+    std::vector<int> m_cellIndices;
+};
+
+typedef boost::shared_ptr<KeypointGrid> KeypointGridPtr;
+typedef boost::shared_ptr<const KeypointGrid> KeypointGridConstPtr;
+
+}
+
+#endif
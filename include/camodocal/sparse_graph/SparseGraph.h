@@ -6,6 +6,7 @@
 #include <opencv2/core/core.hpp>
 #include <opencv2/features2d/features2d.hpp>
 
+#include <camodocal/sparse_graph/KeypointGrid.h>
 #include <camodocal/sparse_graph/Odometry.h>
 #include <camodocal/sparse_graph/Pose.h>
 
@@ -55,6 +56,13 @@ public:
     std::vector<Point2DFeaturePtr>& features2D(void);
     const std::vector<Point2DFeaturePtr>& features2D(void) const;
 
+    // Spatial index over the keypoints of features2D(), built on first use.
+    // Indices returned by the grid refer to features2D(). Code that adds,
+    // removes, replaces or moves features of a frame must call
+    // invalidateFeatureGrid() afterwards.
+    KeypointGridConstPtr featureGrid(void) const;
+    void invalidateFeatureGrid(void);
+
     cv::Mat& image(void);
     const cv::Mat& image(void) const;
 
@@ -67,6 +75,7 @@ private:
     PosePtr m_gpsInsMeasurement;
 
     std::vector<Point2DFeaturePtr> m_features2D;
+    mutable KeypointGridConstPtr m_featureGrid;
 
     cv::Mat m_image;
 };
@@ -221,6 +230,16 @@ public:
     bool readFromBinaryFile(const std::string& filename);
     void writeToBinaryFile(const std::string& filename) const;
 
+    // Frame images are encoded in parallel while writeToBinaryFile writes
+    // the graph. The extension selects the codec (".png", ".jpg", ...), and
+    // the compression level is the PNG compression level or JPEG quality
+    // (-1 for the codec's default). If skipUnchanged is set, images whose
+    // files exist and hold the same pixels as when they were last written
+    // by this function are not encoded again.
+    void setImageWriteOptions(const std::string& extension,
+                              int compressionLevel = -1,
+                              bool skipUnchanged = true);
+
 private:
     template<typename T>
     void readData(std::ifstream& ifs, T& data) const;
@@ -229,6 +248,10 @@ private:
     void writeData(std::ofstream& ofs, T data) const;
 
     std::vector<FrameSetSegment> m_frameSetSegments;
+
+    std::string m_imageExtension;
+    int m_imageCompressionLevel;
+    bool m_skipUnchangedImages;
 };
 
 }
@@ -21,17 +21,16 @@ namespace camodocal
 
 CamOdoThread::CamOdoThread(PoseSource poseSource, int nMotions, int cameraId,
                            bool preprocess,
-                           AtomicData<cv::Mat>* image,
+                           FrameQueue* frameQueue,
                            const CameraConstPtr& camera,
-                           SensorDataBuffer<OdometryPtr>& odometryBuffer,
+                           MonotonicSensorDataBuffer<OdometryPtr>& odometryBuffer,
                            SensorDataBuffer<OdometryPtr>& interpOdometryBuffer,
                            boost::mutex& odometryBufferMutex,
-                           SensorDataBuffer<PosePtr>& gpsInsBuffer,
+                           MonotonicSensorDataBuffer<PosePtr>& gpsInsBuffer,
                            SensorDataBuffer<PosePtr>& interpGpsInsBuffer,
                            boost::mutex& gpsInsBufferMutex,
                            cv::Mat& sketch,
                            bool& completed,
-                           bool& stop,
                            double minKeyframeDistance,
                            size_t minVOSegmentSize,
                            bool verbose)
@@ -39,7 +38,7 @@ CamOdoThread::CamOdoThread(PoseSource poseSource, int nMotions, int cameraId,
  , m_cameraId(cameraId)
  , m_preprocess(preprocess)
  , m_running(false)
- , m_image(image)
+ , m_frameQueue(frameQueue)
  , m_camera(camera)
  , m_odometryBuffer(odometryBuffer)
  , m_interpOdometryBuffer(interpOdometryBuffer)
@@ -51,7 +50,6 @@ CamOdoThread::CamOdoThread(PoseSource poseSource, int nMotions, int cameraId,
  , m_camOdoTransformUseEstimate(false)
  , m_sketch(sketch)
  , m_completed(completed)
- , m_stop(stop)
  , k_minKeyframeDistance(minKeyframeDistance)
  , k_minVOSegmentSize(minVOSegmentSize)
  , k_odometryTimeout(4.0)
@@ -185,6 +183,19 @@ CamOdoThread::signalFinished(void)
     return m_signalFinished;
 }
 
+boost::signals2::signal<void ()>&
+CamOdoThread::signalCompleted(void)
+{
+    return m_signalCompleted;
+}
+
+boost::system_time
+CamOdoThread::odometryDeadline(void) const
+{
+    return boost::get_system_time() +
+           boost::posix_time::microseconds(static_cast<int64_t>(k_odometryTimeout * 1e6));
+}
+
 void
 CamOdoThread::threadFunction(void)
 {
@@ -197,6 +208,9 @@ CamOdoThread::threadFunction(void)
 
     cv::Mat image;
     cv::Mat colorImage;
+    // colorImage may share the queued image, so the conversion of a gray
+    // image needs its own buffer
+    cv::Mat convertedImage;
 
     int trackBreaks = 0;
 
@@ -212,13 +226,11 @@ CamOdoThread::threadFunction(void)
 
     while (!halt)
     {
-        boost::system_time timeout = boost::get_system_time() + boost::posix_time::milliseconds(10);
-        while (!m_image->timedWaitForData(timeout) && !m_stop)
-        {
-            timeout = boost::get_system_time() + boost::posix_time::milliseconds(10);
-        }
+        uint64_t timeStamp = 0;
 
-        if (m_stop)
+        // CamRigOdoCalibration closes the queue when it stops the threads;
+        // the frames queued until then are still processed
+        if (!m_frameQueue->pop(image, timeStamp))
         {
             std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d> > voPoses = tracker.getPoses();
 
@@ -238,30 +250,19 @@ CamOdoThread::threadFunction(void)
         }
         else
         {
-            m_image->lockData();
-            m_image->available() = false;
-
-            uint64_t timeStamp = m_image->timeStamp();
-
             if (framePrev.get() != 0 && timeStamp == framePrev->cameraPose()->timeStamp())
             {
-                m_image->unlockData();
-                m_image->notifyProcessingDone();
-
                 continue;
             }
 
-            m_image->data().copyTo(image);
-
-            m_image->unlockData();
-
             if (image.channels() == 1)
             {
-                cv::cvtColor(image, colorImage, CV_GRAY2BGR);
+                cv::cvtColor(image, convertedImage, CV_GRAY2BGR);
+                colorImage = convertedImage;
             }
             else
             {
-                image.copyTo(colorImage);
+                colorImage = image;
             }
 
             // skip if current car position is too near previous position
@@ -279,21 +280,32 @@ CamOdoThread::threadFunction(void)
             }
             else
             {
+                // wait for the raw data before taking the locks, so that a
+                // waiting thread does not hold up the other cameras
+                if (m_poseSource == ODOMETRY &&
+                    !m_odometryBuffer.timedWaitForData(timeStamp, odometryDeadline()))
+                {
+                    std::cout << "# ERROR: No odometry data for " << k_odometryTimeout << "s. Exiting..." << std::endl;
+                    exit(1);
+                }
+
+                bool useGpsIns = (m_poseSource == GPS_INS || !m_gpsInsBuffer.empty());
+                if (useGpsIns &&
+                    !m_gpsInsBuffer.timedWaitForData(timeStamp, odometryDeadline()))
+                {
+                    std::cout << "# ERROR: No GPS/INS data for " << k_odometryTimeout << "s. Exiting..." << std::endl;
+                    exit(1);
+                }
+
                 m_odometryBufferMutex.lock();
 
                 OdometryPtr interpOdo;
                 if (m_poseSource == ODOMETRY && !m_interpOdometryBuffer.find(timeStamp, interpOdo))
                 {
-                    double timeStart = timeInSeconds();
-                    while (!interpolateOdometry(m_odometryBuffer, timeStamp, interpOdo))
+                    if (!interpolateOdometry(m_odometryBuffer, timeStamp, interpOdo))
                     {
-                        if (timeInSeconds() - timeStart > k_odometryTimeout)
-                        {
-                            std::cout << "# ERROR: No odometry data for " << k_odometryTimeout << "s. Exiting..." << std::endl;
-                            exit(1);
-                        }
-
-                        usleep(1000);
+                        std::cout << "# ERROR: No odometry data before image timestamp " << timeStamp << ". Exiting..." << std::endl;
+                        exit(1);
                     }
 
                     m_interpOdometryBuffer.push(timeStamp, interpOdo);
@@ -304,18 +316,12 @@ CamOdoThread::threadFunction(void)
                 m_gpsInsBufferMutex.lock();
 
                 PosePtr interpGpsIns;
-                if ((m_poseSource == GPS_INS || !m_gpsInsBuffer.empty()) && !m_interpGpsInsBuffer.find(timeStamp, interpGpsIns))
+                if (useGpsIns && !m_interpGpsInsBuffer.find(timeStamp, interpGpsIns))
                 {
-                    double timeStart = timeInSeconds();
-                    while (!interpolatePose(m_gpsInsBuffer, timeStamp, interpGpsIns))
+                    if (!interpolatePose(m_gpsInsBuffer, timeStamp, interpGpsIns))
                     {
-                        if (timeInSeconds() - timeStart > k_odometryTimeout)
-                        {
-                            std::cout << "# ERROR: No GPS/INS data for " << k_odometryTimeout << "s. Exiting..." << std::endl;
-                            exit(1);
-                        }
-
-                        usleep(1000);
+                        std::cout << "# ERROR: No GPS/INS data before image timestamp " << timeStamp << ". Exiting..." << std::endl;
+                        exit(1);
                     }
 
                     printf("LOC: %f %f %f\n", interpGpsIns->translation()[0], interpGpsIns->translation()[1], interpGpsIns->translation()[2]);
@@ -339,7 +345,6 @@ CamOdoThread::threadFunction(void)
                 if (framePrev.get() != 0 &&
                     (pos - framePrev->systemPose()->position()).norm() < k_minKeyframeDistance)
                 {
-                    m_image->notifyProcessingDone();
                     continue;
                 }
 
@@ -354,7 +359,7 @@ CamOdoThread::threadFunction(void)
 
                 FramePtr frame = boost::make_shared<Frame>();
                 frame->cameraId() = m_cameraId;
-                image.copyTo(frame->image());
+                frame->image() = image;
 
                 bool camValid = tracker.addFrame(frame, m_camera->mask());
 
@@ -461,11 +466,12 @@ CamOdoThread::threadFunction(void)
         cv::putText(m_sketch, status, textOrg, fontFace, fontScale,
                     cv::Scalar::all(255), thickness, CV_AA);
 
-        m_image->notifyProcessingDone();
-
-        if (m_camOdoCalib.getCurrentMotionCount() + currentMotionCount >= m_camOdoCalib.getMotionCount())
+        if (!m_completed &&
+            m_camOdoCalib.getCurrentMotionCount() + currentMotionCount >= m_camOdoCalib.getMotionCount())
         {
             m_completed = true;
+
+            m_signalCompleted();
         }
     }
 
@@ -4,9 +4,10 @@
 #include <boost/thread.hpp>
 #include <boost/signals2.hpp>
 
-#include "camodocal/calib/AtomicData.h"
 #include "camodocal/calib/CamOdoCalibration.h"
+#include "camodocal/calib/FrameQueue.h"
 #include "camodocal/calib/PoseSource.h"
+#include "camodocal/calib/MonotonicSensorDataBuffer.h"
 #include "camodocal/calib/SensorDataBuffer.h"
 #include "camodocal/camera_models/Camera.h"
 #include "camodocal/sparse_graph/SparseGraph.h"
@@ -26,17 +27,16 @@ public:
 
     CamOdoThread(PoseSource poseSource, int nMotions, int cameraId,
                  bool preprocess,
-                 AtomicData<cv::Mat>* image,
+                 FrameQueue* frameQueue,
                  const CameraConstPtr& camera,
-                 SensorDataBuffer<OdometryPtr>& odometryBuffer,
+                 MonotonicSensorDataBuffer<OdometryPtr>& odometryBuffer,
                  SensorDataBuffer<OdometryPtr>& interpOdometryBuffer,
                  boost::mutex& odometryBufferMutex,
-                 SensorDataBuffer<PosePtr>& gpsInsBuffer,
+                 MonotonicSensorDataBuffer<PosePtr>& gpsInsBuffer,
                  SensorDataBuffer<PosePtr>& interpGpsInsBuffer,
                  boost::mutex& gpsInsBufferMutex,
                  cv::Mat& sketch,
                  bool& completed,
-                 bool& stop,
                  double minKeyframeDistance,
                  size_t minVOSegmentSize,
                  bool verbose = false);
@@ -54,10 +54,14 @@ public:
     void join(void);
     bool running(void) const;
     boost::signals2::signal<void ()>& signalFinished(void);
+    // emitted once the camera has collected enough motions
+    boost::signals2::signal<void ()>& signalCompleted(void);
 
 private:
     void threadFunction(void);
 
+    boost::system_time odometryDeadline(void) const;
+
     void addCamOdoCalibData(const std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d> >& camPoses,
                             const std::vector<OdometryPtr>& odoPoses,
                             std::vector<FramePtr>& frameSegment);
@@ -74,16 +78,17 @@ private:
     bool m_preprocess;
     volatile bool m_running; // poor man's synchronisation
     boost::signals2::signal<void ()> m_signalFinished;
+    boost::signals2::signal<void ()> m_signalCompleted;
 
     CamOdoCalibration m_camOdoCalib;
     std::vector<std::vector<FramePtr> > m_frameSegments;
 
-    AtomicData<cv::Mat>* m_image;
+    FrameQueue* m_frameQueue;
     const CameraConstPtr m_camera;
-    SensorDataBuffer<OdometryPtr>& m_odometryBuffer;
+    MonotonicSensorDataBuffer<OdometryPtr>& m_odometryBuffer;
     SensorDataBuffer<OdometryPtr>& m_interpOdometryBuffer;
     boost::mutex& m_odometryBufferMutex;
-    SensorDataBuffer<PosePtr>& m_gpsInsBuffer;
+    MonotonicSensorDataBuffer<PosePtr>& m_gpsInsBuffer;
     SensorDataBuffer<PosePtr>& m_interpGpsInsBuffer;
     boost::mutex& m_gpsInsBufferMutex;
     Eigen::Matrix4d m_camOdoTransform;
@@ -91,7 +96,6 @@ private:
     cv::Mat& m_sketch;
 
     bool& m_completed;
-    bool& m_stop;
 
     const double k_minKeyframeDistance;
     const size_t k_minVOSegmentSize;
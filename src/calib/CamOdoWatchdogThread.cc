@@ -49,27 +49,27 @@ CamOdoWatchdogThread::signalFinished(void)
 }
 
 void
-CamOdoWatchdogThread::threadFunction(void)
+CamOdoWatchdogThread::notify(void)
 {
-    while (!m_stop)
     {
-        bool stop = true;
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+    }
 
-        for (size_t i = 0; i < m_completed.size(); ++i)
-        {
-            if (!m_completed[i])
-            {
-                stop = false;
-                break;
-            }
-        }
+    m_cond.notify_one();
+}
+
+void
+CamOdoWatchdogThread::threadFunction(void)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
 
-        if (stop)
+        while (!m_stop && !completed())
         {
-            m_stop = stop;
+            m_cond.wait(lock);
         }
 
-        usleep(1000);
+        m_stop = true;
     }
 
     m_running = false;
@@ -77,4 +77,18 @@ CamOdoWatchdogThread::threadFunction(void)
     m_signalFinished();
 }
 
+bool
+CamOdoWatchdogThread::completed(void) const
+{
+    for (size_t i = 0; i < m_completed.size(); ++i)
+    {
+        if (!m_completed[i])
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 }
@@ -20,8 +20,12 @@ public:
     bool running(void) const;
     boost::signals2::signal<void ()>& signalFinished(void);
 
+    // wakes the watchdog after a camera has completed or stop has been set
+    void notify(void);
+
 private:
     void threadFunction(void);
+    bool completed(void) const;
 
     boost::shared_ptr<boost::thread> m_thread;
     bool m_running;
@@ -29,6 +33,9 @@ private:
 
     boost::multi_array<bool, 1>& m_completed;
     bool& m_stop;
+
+    boost::condition_variable m_cond;
+    boost::mutex m_mutex;
 };
 
 }
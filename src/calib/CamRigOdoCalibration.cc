@@ -28,7 +28,7 @@ CamRigOdoCalibration::CamRigOdoCalibration(std::vector<CameraPtr>& cameras,
                                            const Options& options)
  : m_camOdoThreads(cameras.size())
  , m_cameraSystem(cameras.size())
- , m_images(cameras.size())
+ , m_frameQueues(cameras.size())
  , m_cameras(cameras)
  , m_odometryBuffer(1000)
  , m_gpsInsBuffer(1000)
@@ -39,14 +39,31 @@ CamRigOdoCalibration::CamRigOdoCalibration(std::vector<CameraPtr>& cameras,
 {
     for (size_t i = 0; i < m_camOdoThreads.size(); ++i)
     {
-        m_images.at(i) = new AtomicData<cv::Mat>();
+        if (options.rayLookupTableStep > 0)
+        {
+            // speeds up lifting in the VO, pose graph and BA stages
+            m_cameras.at(i)->enableRayLookupTable(options.rayLookupTableStep);
+
+            if (options.verbose)
+            {
+                double maxError, avgError;
+                m_cameras.at(i)->rayLookupTableAccuracy(maxError, avgError);
+
+                std::cout << "# INFO: Ray lookup table of camera " << i
+                          << ": max error = " << maxError
+                          << " rad | avg error = " << avgError << " rad" << std::endl;
+            }
+        }
+
+        m_frameQueues.at(i) = new FrameQueue(options.frameQueueSize,
+                                             options.mode == OFFLINE ? FrameQueue::BLOCK : options.onlineOverflowPolicy);
         m_camOdoCompleted[i] = false;
 
         CamOdoThread* thread = new CamOdoThread(options.poseSource, options.nMotions, i, options.preprocessImages,
-                                                m_images.at(i), m_cameras.at(i),
+                                                m_frameQueues.at(i), m_cameras.at(i),
                                                 m_odometryBuffer, m_interpOdometryBuffer, m_odometryBufferMutex,
                                                 m_gpsInsBuffer, m_interpGpsInsBuffer, m_gpsInsBufferMutex,
-                                                m_sketches.at(i), m_camOdoCompleted[i], m_stop,
+                                                m_sketches.at(i), m_camOdoCompleted[i],
                                                 options.minKeyframeDistance, options.minVOSegmentSize,
                                                 options.verbose);
         m_camOdoThreads.at(i) = thread;
@@ -55,6 +72,11 @@ CamRigOdoCalibration::CamRigOdoCalibration(std::vector<CameraPtr>& cameras,
 
     m_camOdoWatchdogThread = new CamOdoWatchdogThread(m_camOdoCompleted, m_stop);
 
+    for (size_t i = 0; i < m_camOdoThreads.size(); ++i)
+    {
+        m_camOdoThreads.at(i)->signalCompleted().connect(boost::bind(&CamOdoWatchdogThread::notify, m_camOdoWatchdogThread));
+    }
+
     for (size_t i = 0; i < m_sketches.size(); ++i)
     {
         m_sketches.at(i) = cv::Mat(cameras.at(i)->imageHeight(), cameras.at(i)->imageWidth(), CV_8UC3);
@@ -80,20 +102,7 @@ void
 CamRigOdoCalibration::addFrame(int cameraId, const cv::Mat& image,
                                uint64_t timestamp)
 {
-    AtomicData<cv::Mat>* frame = m_images.at(cameraId);
-
-    frame->lockData();
-
-    image.copyTo(frame->data());
-
-    frame->timeStamp() = timestamp;
-
-    frame->unlockData();
-
-    if (m_options.mode == OFFLINE)
-    {
-        frame->waitForProcessingDone();
-    }
+    m_frameQueues.at(cameraId)->push(image, timestamp);
 }
 
 void
@@ -193,6 +202,20 @@ CamRigOdoCalibration::start(void)
         m_camOdoWatchdogThread->launch();
         m_camOdoWatchdogThread->join();
 
+        // stop accepting images and wake the callers of addFrame that wait
+        // for space in a queue; the camera threads process the images that
+        // are already queued before they exit
+        for (size_t i = 0; i < m_frameQueues.size(); ++i)
+        {
+            m_frameQueues.at(i)->close();
+
+            if (m_options.verbose && m_frameQueues.at(i)->droppedCount() > 0)
+            {
+                std::cout << "# INFO: Dropped " << m_frameQueues.at(i)->droppedCount()
+                          << " images from camera " << i << "." << std::endl;
+            }
+        }
+
         for (size_t i = 0; i < m_camOdoThreads.size(); ++i)
         {
             m_camOdoThreads.at(i)->join();
@@ -276,6 +299,10 @@ CamRigOdoCalibration::start(void)
     // run calibration steps
     CameraRigBA ba(m_cameraSystem, m_graph, m_options.windowDistance);
     ba.setVerbose(m_options.verbose);
+    if (m_options.rectMapTolerance > 0.0)
+    {
+        ba.setRectificationMapCache(32, m_options.rectMapTolerance);
+    }
     ba.run(m_options.beginStage, m_options.optimizeIntrinsics, m_options.saveWorkingData, m_options.dataDir);
 
     std::cout << "# INFO: Camera rig calibration took " << timeInSeconds() - tsStart << "s." << std::endl;
@@ -289,6 +316,8 @@ void
 CamRigOdoCalibration::run(void)
 {
     m_stop = true;
+
+    m_camOdoWatchdogThread->notify();
 }
 
 bool
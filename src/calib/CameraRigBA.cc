@@ -22,6 +22,7 @@
 #include "../camera_models/CostFunctionFactory.h"
 #include "../features2d/SurfGPU.h"
 #include "../gpl/EigenQuaternionParameterization.h"
+#include "../gpl/TaskScheduler.h"
 #include "camodocal/EigenUtils.h"
 #include "../npoint/five-point/five-point.hpp"
 #include "../visual_odometry/SlidingWindowBA.h"
@@ -49,6 +50,7 @@ CameraRigBA::CameraRigBA(CameraSystem& cameraSystem,
  : m_cameraSystem(cameraSystem)
  , m_graph(graph)
  , k_windowDistance(windowDistance)
+ , k_maxPendingFrameSets(4)
  , k_maxDistanceRatio(0.7f)
  , k_maxPoint3DDistance(20.0)
  , k_maxReprojErr(2.0)
@@ -342,9 +344,11 @@ CameraRigBA::run(int beginStage, bool optimizeIntrinsics,
             }
         }
 
-        std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> > correspondences2D3D;
+        std::vector<PoseGraph::Correspondence2D3D> correspondences2D3D;
         correspondences2D3D = poseGraph.getCorrespondences2D3D();
 
+        SparseGraphView graphView(m_graph);
+
         if (m_verbose)
         {
             std::cout << "# INFO: # inlier 2D-3D correspondences: " << correspondences2D3D.size() << std::endl;
@@ -353,10 +357,10 @@ CameraRigBA::run(int beginStage, bool optimizeIntrinsics,
         size_t nMerged3DScenePoints = 0;
         for (size_t i = 0; i < correspondences2D3D.size(); ++i)
         {
-            Point3DFeaturePtr f3D1 = correspondences2D3D.at(i).first->feature3D();
-            Point3DFeaturePtr f3D2 = correspondences2D3D.at(i).second;
+            Point3DFeaturePtr f3D1 = graphView.feature2D(correspondences2D3D.at(i).first)->feature3D();
+            Point3DFeaturePtr f3D2 = graphView.feature2D(correspondences2D3D.at(i).second)->feature3D();
 
-            if (!f3D1)
+            if (!f3D1 || f3D1 == f3D2)
             {
                 continue;
             }
@@ -758,6 +762,13 @@ CameraRigBA::setVerbose(bool verbose)
     m_verbose = verbose;
 }
 
+void
+CameraRigBA::setRectificationMapCache(size_t capacity, double tolerance)
+{
+    m_rectMapCache.setCapacity(capacity);
+    m_rectMapCache.setTolerance(tolerance);
+}
+
 void
 CameraRigBA::frameReprojectionError(const FramePtr& frame,
                                     const CameraConstPtr& camera,
@@ -1196,6 +1207,11 @@ CameraRigBA::findLocalInterMap2D2DCorrespondences(std::vector<Correspondence2D2D
 
     std::vector<std::list<FramePtr> > windows(m_cameraSystem.cameraCount());
 
+    // frame pairs from up to k_maxPendingFrameSets frame sets are matched
+    // concurrently on the shared scheduler; std::list keeps the result slots
+    // at stable addresses
+    std::list<FrameSetWindowMatches> pendingMatches;
+
     while (segmentId < (int)m_graph.frameSetSegments().size())
     {
         FrameSetPtr& frameSet = m_graph.frameSetSegment(segmentId).at(frameSetId);
@@ -1255,7 +1271,13 @@ CameraRigBA::findLocalInterMap2D2DCorrespondences(std::vector<Correspondence2D2D
             std::cout << "]" << std::endl;
         }
 
-        // for each camera, match current image with each image in each other camera's buffer
+        pendingMatches.push_back(FrameSetWindowMatches());
+
+        FrameSetWindowMatches& frameSetMatches = pendingMatches.back();
+        frameSetMatches.taskGroup = boost::make_shared<TaskGroup>();
+
+        // for each camera, queue matching of the current image with each image
+        // in each other camera's buffer
         for (int cameraId1 = 0; cameraId1 < m_cameraSystem.cameraCount(); ++cameraId1)
         {
             FramePtr& frame1 = frameSet->frames().at(cameraId1);
@@ -1270,9 +1292,6 @@ CameraRigBA::findLocalInterMap2D2DCorrespondences(std::vector<Correspondence2D2D
                 continue;
             }
 
-            std::vector<boost::shared_ptr<boost::thread> > threads(m_cameraSystem.cameraCount());
-            /// @todo vec<vec<>> is slow! consider alternatives like boost::static_vector multiarray, or even an eigen matrix
-            std::vector<std::vector<Correspondence2D2D> > subCorr2D2D(m_cameraSystem.cameraCount());
             for (int cameraId2 = 0; cameraId2 < m_cameraSystem.cameraCount(); ++cameraId2)
             {
                 if (cameraId1 == cameraId2)
@@ -1280,26 +1299,24 @@ CameraRigBA::findLocalInterMap2D2DCorrespondences(std::vector<Correspondence2D2D
                     continue;
                 }
 
-                std::vector<FramePtr> window;
-                window.insert(window.end(), windows[cameraId2].begin(), windows[cameraId2].end());
-                threads[cameraId2].reset(new boost::thread(boost::bind(&CameraRigBA::matchFrameToWindow, this,
-                                                                       frame1, window,
-                                                                       &subCorr2D2D[cameraId2],
-                                                                       reprojErrorThresh)));
-            }
+                frameSetMatches.matches.push_back(FrameToWindowMatch());
 
-            for (int cameraId2 = 0; cameraId2 < m_cameraSystem.cameraCount(); ++cameraId2)
-            {
-                if (threads[cameraId2].get() == 0)
-                {
-                    continue;
-                }
-                threads[cameraId2]->join();
+                FrameToWindowMatch& match = frameSetMatches.matches.back();
+                match.frame1 = frame1;
+                match.window.assign(windows[cameraId2].begin(), windows[cameraId2].end());
 
-                correspondences2D2D.insert(correspondences2D2D.end(), subCorr2D2D[cameraId2].begin(), subCorr2D2D[cameraId2].end());
+                matchFrameToWindow(match, *frameSetMatches.taskGroup, reprojErrorThresh);
             }
         }
 
+        // merge in submission order so that the result does not depend on
+        // scheduling, and free the matches of each frame set once merged
+        while (pendingMatches.size() > k_maxPendingFrameSets)
+        {
+            selectBestWindowMatches(pendingMatches.front(), correspondences2D2D);
+            pendingMatches.pop_front();
+        }
+
         ++frameSetId;
         if (frameSetId >= (int)m_graph.frameSetSegment(segmentId).size())
         {
@@ -1307,73 +1324,92 @@ CameraRigBA::findLocalInterMap2D2DCorrespondences(std::vector<Correspondence2D2D
             frameSetId = 0;
         }
     }
+
+    while (!pendingMatches.empty())
+    {
+        selectBestWindowMatches(pendingMatches.front(), correspondences2D2D);
+        pendingMatches.pop_front();
+    }
 }
 
 void
-CameraRigBA::matchFrameToWindow(FramePtr& frame1,
-                                std::vector<FramePtr>& window,
-                                std::vector<Correspondence2D2D>* correspondences2D2D,
+CameraRigBA::matchFrameToWindow(FrameToWindowMatch& match,
+                                TaskGroup& taskGroup,
                                 double reprojErrorThresh)
 {
-    if (window.empty())
+    if (match.window.empty())
     {
         return;
     }
 
-    if (frame1->image().empty())
+    if (match.frame1->image().empty())
     {
         return;
     }
 
-    std::vector<boost::shared_ptr<boost::thread> > threads(window.size());
-    /// @todo vec<vec<>> is slow! consider alternatives like boost::static_vector multiarray, or even an eigen matrix
-    std::vector<std::vector<std::pair<Point2DFeaturePtr, Point2DFeaturePtr> > > corr2D2D(window.size());
+    match.corr2D2D.resize(match.window.size());
 
-    int windowId = -1;
-    for (std::vector<FramePtr>::iterator itFrame2 = window.begin(); itFrame2 != window.end(); ++itFrame2)
+    for (size_t windowId = 0; windowId < match.window.size(); ++windowId)
     {
-        ++windowId;
-        FramePtr& frame2 = *itFrame2;
-
-        threads[windowId].reset(new boost::thread(boost::bind(&CameraRigBA::matchFrameToFrame, this,
-                                                              frame1, frame2,
-                                                              &corr2D2D[windowId],
-                                                              reprojErrorThresh)));
+        taskGroup.run(boost::bind(&CameraRigBA::matchFrameToFrame, this,
+                                  match.frame1, match.window.at(windowId),
+                                  &match.corr2D2D.at(windowId),
+                                  reprojErrorThresh));
     }
+}
 
+void
+CameraRigBA::selectBestWindowMatch(const FrameToWindowMatch& match,
+                                   std::vector<Correspondence2D2D>& correspondences2D2D) const
+{
     int windowIdBest = -1;
-    std::vector<std::pair<Point2DFeaturePtr, Point2DFeaturePtr> > corr2D2DBest;
-
-    for (windowId = 0; windowId < (int)window.size(); ++windowId)
+    for (int windowId = 0; windowId < (int)match.corr2D2D.size(); ++windowId)
     {
-        threads[windowId]->join();
-
-        if (corr2D2D[windowId].size() > corr2D2DBest.size())
+        if (windowIdBest == -1 ||
+            match.corr2D2D.at(windowId).size() > match.corr2D2D.at(windowIdBest).size())
         {
             windowIdBest = windowId;
-            corr2D2DBest = corr2D2D[windowId];
         }
     }
 
-    if (!corr2D2DBest.empty())
+    if (windowIdBest == -1 || match.corr2D2D.at(windowIdBest).empty())
     {
-        FramePtr& frame2 = window.at(windowIdBest);
+        return;
+    }
 
-        correspondences2D2D->insert(correspondences2D2D->end(),
-                                    corr2D2DBest.begin(), corr2D2DBest.end());
+    const std::vector<Correspondence2D2D>& corr2D2DBest = match.corr2D2D.at(windowIdBest);
 
-        if (m_verbose)
-        {
-            std::cout << "# INFO: Best: cam " << frame1->cameraId()
-                      << " - cam " << frame2->cameraId()
-                      << ": window " << windowIdBest
-                      << " | " << correspondences2D2D->size() << " 2D-2D" << std::endl;
-        }
+    correspondences2D2D.insert(correspondences2D2D.end(),
+                               corr2D2DBest.begin(), corr2D2DBest.end());
+
+    if (m_verbose)
+    {
+        const FramePtr& frame2 = match.window.at(windowIdBest);
+
+        std::cout << "# INFO: Best: cam " << match.frame1->cameraId()
+                  << " - cam " << frame2->cameraId()
+                  << ": window " << windowIdBest
+                  << " | " << corr2D2DBest.size() << " 2D-2D" << std::endl;
+    }
 
 #ifdef VCHARGE_VIZ
-        visualize3D3DCorrespondences("local-inter-3d-3d", corr2D2DBest);
+    visualize3D3DCorrespondences("local-inter-3d-3d", corr2D2DBest);
 #endif
+}
+
+void
+CameraRigBA::selectBestWindowMatches(FrameSetWindowMatches& frameSetMatches,
+                                     std::vector<Correspondence2D2D>& correspondences2D2D) const
+{
+    frameSetMatches.taskGroup->wait();
+
+    for (std::list<FrameToWindowMatch>::const_iterator it = frameSetMatches.matches.begin();
+            it != frameSetMatches.matches.end(); ++it)
+    {
+        selectBestWindowMatch(*it, correspondences2D2D);
     }
+
+    frameSetMatches.matches.clear();
 }
 
 void
@@ -1414,63 +1450,46 @@ CameraRigBA::matchFrameToFrame(FramePtr& frame1, FramePtr& frame2,
 
     Eigen::Matrix3d avgR = svd.matrixU() * svd.matrixV().transpose();
 
-    Eigen::Matrix3d R1 = avgR * H_cam1.block<3,3>(0,0).transpose();
-    Eigen::Matrix3d R2 = avgR * H_cam2.block<3,3>(0,0).transpose();
+    CameraConstPtr camera1 = m_cameraSystem.getCamera(cameraId1);
+    CameraConstPtr camera2 = m_cameraSystem.getCamera(cameraId2);
 
-    cv::Mat R1_cv, R2_cv;
-    cv::eigen2cv(R1, R1_cv);
-    cv::eigen2cv(R2, R2_cv);
+    float fRect1 = (camera1->modelType() == Camera::PINHOLE) ? -1.0f : k_nominalFocalLength;
+    float fRect2 = (camera2->modelType() == Camera::PINHOLE) ? -1.0f : k_nominalFocalLength;
 
-    cv::Mat mapX1, mapY1, mapX2, mapY2;
-    if (m_cameraSystem.getCamera(cameraId1)->modelType() == Camera::PINHOLE)
-    {
-        m_cameraSystem.getCamera(cameraId1)->initUndistortRectifyMap(mapX1, mapY1,
-                                                                     -1.0f, -1.0f,
-                                                                     cv::Size(0, 0),
-                                                                     -1.0f, -1.0f, R1_cv);
-    }
-    else
-    {
-        m_cameraSystem.getCamera(cameraId1)->initUndistortRectifyMap(mapX1, mapY1,
-                                                                     k_nominalFocalLength, k_nominalFocalLength,
-                                                                     cv::Size(0, 0),
-                                                                     -1.0f, -1.0f, R1_cv);
-    }
-    if (m_cameraSystem.getCamera(cameraId2)->modelType() == Camera::PINHOLE)
-    {
-        m_cameraSystem.getCamera(cameraId2)->initUndistortRectifyMap(mapX2, mapY2,
-                                                                     -1.0f, -1.0f,
-                                                                     cv::Size(0, 0),
-                                                                     -1.0f, -1.0f, R2_cv);
-    }
-    else
-    {
-        m_cameraSystem.getCamera(cameraId2)->initUndistortRectifyMap(mapX2, mapY2,
-                                                                     k_nominalFocalLength, k_nominalFocalLength,
-                                                                     cv::Size(0, 0),
-                                                                     -1.0f, -1.0f, R2_cv);
-    }
+    // the cached maps are generated for a quantized rotation which replaces
+    // R1/R2 below so that rectified points are back-projected consistently
+    RectificationMapCache::EntryConstPtr rectMap1 =
+        m_rectMapCache.get(cameraId1, camera1,
+                           avgR * H_cam1.block<3,3>(0,0).transpose(),
+                           fRect1, fRect1);
+    RectificationMapCache::EntryConstPtr rectMap2 =
+        m_rectMapCache.get(cameraId2, camera2,
+                           avgR * H_cam2.block<3,3>(0,0).transpose(),
+                           fRect2, fRect2);
+
+    Eigen::Matrix3d R1 = rectMap1->R;
+    Eigen::Matrix3d R2 = rectMap2->R;
 
     cv::Mat rimg1, rimg2;
-    cv::remap(frame1->image(), rimg1, mapX1, mapY1, cv::INTER_LINEAR);
-    cv::remap(frame2->image(), rimg2, mapX2, mapY2, cv::INTER_LINEAR);
+    cv::remap(frame1->image(), rimg1, rectMap1->map1, rectMap1->map2, cv::INTER_LINEAR);
+    cv::remap(frame2->image(), rimg2, rectMap2->map1, rectMap2->map2, cv::INTER_LINEAR);
 
     cv::Mat rmask1, rmask2;
-    if (m_cameraSystem.getCamera(cameraId1)->mask().empty())
+    if (rectMap1->mask.empty())
     {
         rmask1 = rimg1 > 0;
     }
     else
     {
-        cv::remap(m_cameraSystem.getCamera(cameraId1)->mask(), rmask1, mapX1, mapY1, cv::INTER_NEAREST);
+        rmask1 = rectMap1->mask;
     }
-    if (m_cameraSystem.getCamera(cameraId2)->mask().empty())
+    if (rectMap2->mask.empty())
     {
         rmask2 = rimg2 > 0;
     }
     else
     {
-        cv::remap(m_cameraSystem.getCamera(cameraId2)->mask(), rmask2, mapX2, mapY2, cv::INTER_NEAREST);
+        rmask2 = rectMap2->mask;
     }
 
     cv::Ptr<SurfGPU> surf = SurfGPU::instance(200.0);
@@ -1566,6 +1585,10 @@ CameraRigBA::matchFrameToFrame(FramePtr& frame1, FramePtr& frame2,
     H2.block<3,3>(0,0) = R2;
     //Eigen::Matrix4d H_rcam2 = H2 * H_cam2;
 
+    KeypointGridConstPtr featureGrid1 = frame1->featureGrid();
+    KeypointGridConstPtr featureGrid2 = frame2->featureGrid();
+    std::vector<int> candidateImagePoints;
+
     std::vector<std::pair<Point2DFeaturePtr, Point2DFeaturePtr> > candidateCorr2D2D(rmatches.size());
     for (size_t i = 0; i < rmatches.size(); ++i)
     {
@@ -1588,26 +1611,14 @@ CameraRigBA::matchFrameToFrame(FramePtr& frame1, FramePtr& frame2,
         m_cameraSystem.getCamera(cameraId1)->spaceToPlane(ray, ep);
 
         // find closest image point to computed image point
-        std::vector<Point2DFeaturePtr> candidateImagePoints1;
-        Point2DFeaturePtr p2DBest;
-        for (size_t j = 0; j < frame1->features2D().size(); ++j)
-        {
-            Point2DFeaturePtr& p2D = frame1->features2D().at(j);
+        featureGrid1->radiusSearch(cv::Point2f(ep(0), ep(1)), 1.0f, candidateImagePoints);
 
-            float kpDist = hypot(ep(0) - p2D->keypoint().pt.x,
-                                 ep(1) - p2D->keypoint().pt.y);
-            if (kpDist < 1.0f)
-            {
-                candidateImagePoints1.push_back(p2D);
-            }
-        }
-
-        if (candidateImagePoints1.size() != 1)
+        if (candidateImagePoints.size() != 1)
         {
             continue;
         }
 
-        candidateCorr2D2D.at(i).first = candidateImagePoints1.front();
+        candidateCorr2D2D.at(i).first = frame1->features2D().at(candidateImagePoints.front());
 
         rp = rpoints2.at(i);
 
@@ -1621,25 +1632,14 @@ CameraRigBA::matchFrameToFrame(FramePtr& frame1, FramePtr& frame2,
         m_cameraSystem.getCamera(cameraId2)->spaceToPlane(ray, ep);
 
         // find closest image point to computed image point
-        std::vector<Point2DFeaturePtr> candidateImagePoints2;
-        for (size_t j = 0; j < frame2->features2D().size(); ++j)
-        {
-            Point2DFeaturePtr& p2D = frame2->features2D().at(j);
-
-            float kpDist = hypot(ep(0) - p2D->keypoint().pt.x,
-                                 ep(1) - p2D->keypoint().pt.y);
-            if (kpDist < 1.0f)
-            {
-                candidateImagePoints2.push_back(p2D);
-            }
-        }
+        featureGrid2->radiusSearch(cv::Point2f(ep(0), ep(1)), 1.0f, candidateImagePoints);
 
-        if (candidateImagePoints2.size() != 1)
+        if (candidateImagePoints.size() != 1)
         {
             continue;
         }
 
-        candidateCorr2D2D.at(i).second = candidateImagePoints2.front();
+        candidateCorr2D2D.at(i).second = frame2->features2D().at(candidateImagePoints.front());
     }
 
     for (size_t i = 0; i < candidateCorr2D2D.size(); ++i)
@@ -2281,6 +2281,9 @@ CameraRigBA::optimize(int flags, bool optimizeZ, int nIterations)
         {
             m_cameraSystem.getCamera(i)->readParameters(intrinsicParams[i]);
         }
+
+        // maps for the old intrinsics are never hit again
+        m_rectMapCache.clear();
     }
 
     if ((flags & ODOMETRY_6D_POSE) && m_verbose)
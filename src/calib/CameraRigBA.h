@@ -1,19 +1,24 @@
 #ifndef CAMERARIGBA_H
 #define CAMERARIGBA_H
 
+#include <boost/shared_ptr.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/tuple/tuple.hpp>
 #include <Eigen/Dense>
+#include <list>
 
 #include <camodocal/calib/CameraCalibration.h>
 #include <camodocal/camera_systems/CameraSystem.h>
 #include <camodocal/sparse_graph/SparseGraph.h>
 
+#include "RectificationMapCache.h"
+
 namespace camodocal
 {
 
 // forward declaration
 class LocationRecognition;
+class TaskGroup;
 
 class CameraRigBA
 {
@@ -41,6 +46,11 @@ public:
 
     void setVerbose(bool verbose);
 
+    // rectification maps used for inter-camera matching are cached per
+    // camera and rectifying rotation quantized to the given tolerance [rad];
+    // caching is off unless the tolerance is positive
+    void setRectificationMapCache(size_t capacity, double tolerance);
+
     void frameReprojectionError(const FramePtr& frame,
                                 const CameraConstPtr& camera,
                                 const Pose& T_cam_odo,
@@ -74,12 +84,30 @@ private:
     typedef boost::tuple<FramePtr, FramePtr, Point2DFeaturePtr, Point3DFeaturePtr> Correspondence2D3D;
     typedef boost::tuple<FramePtr, FramePtr, Point3DFeaturePtr, Point3DFeaturePtr> Correspondence3D3D;
 
+    typedef struct
+    {
+        FramePtr frame1;
+        std::vector<FramePtr> window;
+        std::vector<std::vector<Correspondence2D2D> > corr2D2D;
+    } FrameToWindowMatch;
+
+    // the task group is destroyed first, and waits for the tasks that
+    // write to the matches
+    typedef struct
+    {
+        std::list<FrameToWindowMatch> matches;
+        boost::shared_ptr<TaskGroup> taskGroup;
+    } FrameSetWindowMatches;
+
     void findLocalInterMap2D2DCorrespondences(std::vector<Correspondence2D2D>& correspondences2D2D,
                                               double reprojErrorThresh = 2.0);
-    void matchFrameToWindow(FramePtr& frame1,
-                            std::vector<FramePtr>& window,
-                            std::vector<Correspondence2D2D>* correspondences2D2D,
+    void matchFrameToWindow(FrameToWindowMatch& match,
+                            TaskGroup& taskGroup,
                             double reprojErrorThresh = 2.0);
+    void selectBestWindowMatch(const FrameToWindowMatch& match,
+                               std::vector<Correspondence2D2D>& correspondences2D2D) const;
+    void selectBestWindowMatches(FrameSetWindowMatches& frameSetMatches,
+                                 std::vector<Correspondence2D2D>& correspondences2D2D) const;
     void matchFrameToFrame(FramePtr& frame1, FramePtr& frame2,
                            std::vector<Correspondence2D2D>* corr2D2D,
                            double reprojErrorThresh = 2.0);
@@ -139,6 +167,7 @@ private:
     SparseGraph m_graph;
 
     const size_t k_windowDistance;
+    const size_t k_maxPendingFrameSets;
     const float k_maxDistanceRatio;
     const double k_maxPoint3DDistance;
     const double k_maxReprojErr;
@@ -147,6 +176,8 @@ private:
     const int k_nearestImageMatches;
     const double k_nominalFocalLength;
 
+    RectificationMapCache m_rectMapCache;
+
     bool m_verbose;
 };
 
@@ -0,0 +1,214 @@
+#include "camodocal/calib/DatasetReader.h"
+
+#include <algorithm>
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "../gpl/TaskScheduler.h"
+
+namespace camodocal
+{
+
+DatasetReader::DatasetReader(int threadCount, size_t lookahead)
+ : k_lookahead(std::max(lookahead, static_cast<size_t>(1)))
+ , m_scheduler(boost::make_shared<TaskScheduler>(threadCount))
+ , m_sequenceBuilt(false)
+ , m_nextEvent(0)
+ , m_prefetchEnd(0)
+ , m_prefetchCount(0)
+ , m_stop(false)
+{
+    m_decodeGroup = boost::make_shared<TaskGroup>(*m_scheduler);
+}
+
+DatasetReader::~DatasetReader()
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+
+        m_stop = true;
+    }
+
+    // the pending decodes return at once, but they must finish before the
+    // images go away
+    m_decodeGroup->wait();
+}
+
+void
+DatasetReader::addImage(int cameraId, uint64_t timestamp, const std::string& filename)
+{
+    Item item;
+    item.cameraId = cameraId;
+    item.timestamp = timestamp;
+    item.filename = filename;
+    item.decoded = false;
+
+    m_images.push_back(item);
+}
+
+void
+DatasetReader::addPose(uint64_t timestamp)
+{
+    m_poses.push_back(timestamp);
+}
+
+bool
+DatasetReader::next(Event& event)
+{
+    if (!m_sequenceBuilt)
+    {
+        buildSequence();
+    }
+
+    if (m_nextEvent == m_sequence.size())
+    {
+        return false;
+    }
+
+    long int entry = m_sequence.at(m_nextEvent);
+    ++m_nextEvent;
+
+    if (entry < 0)
+    {
+        event.cameraId = -1;
+        event.timestamp = m_poses.at(-1 - entry);
+        event.image = cv::Mat();
+        event.filename.clear();
+
+        return true;
+    }
+
+    // keep the decoders busy with the images that follow this one
+    prefetch();
+
+    Item& item = m_images.at(entry);
+
+    {
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+
+        while (!item.decoded)
+        {
+            m_decodedCond.wait(lock);
+        }
+
+        event.cameraId = item.cameraId;
+        event.timestamp = item.timestamp;
+        event.image = item.image;
+        event.filename = item.filename;
+
+        item.image.release();
+        --m_prefetchCount;
+    }
+
+    prefetch();
+
+    return true;
+}
+
+size_t
+DatasetReader::eventCount(void)
+{
+    if (!m_sequenceBuilt)
+    {
+        buildSequence();
+    }
+
+    return m_sequence.size();
+}
+
+void
+DatasetReader::buildSequence(void)
+{
+    m_sequenceBuilt = true;
+
+    std::sort(m_poses.begin(), m_poses.end());
+    m_poses.erase(std::unique(m_poses.begin(), m_poses.end()), m_poses.end());
+
+    // images by timestamp, then camera
+    std::vector<std::pair<std::pair<uint64_t, int>, size_t> > imageOrder;
+    imageOrder.reserve(m_images.size());
+    for (size_t i = 0; i < m_images.size(); ++i)
+    {
+        imageOrder.push_back(std::make_pair(std::make_pair(m_images.at(i).timestamp,
+                                                           m_images.at(i).cameraId), i));
+    }
+    std::sort(imageOrder.begin(), imageOrder.end());
+
+    size_t imageId = 0;
+    for (size_t i = 0; i < m_poses.size(); ++i)
+    {
+        m_sequence.push_back(-1 - static_cast<long int>(i));
+
+        while (imageId < imageOrder.size() &&
+               imageOrder.at(imageId).first.first < m_poses.at(i))
+        {
+            // an image older than the first pose cannot be interpolated
+            if (i > 0)
+            {
+                m_sequence.push_back(imageOrder.at(imageId).second);
+            }
+            ++imageId;
+        }
+    }
+}
+
+void
+DatasetReader::prefetch(void)
+{
+    for (;;)
+    {
+        while (m_prefetchEnd < m_sequence.size() && m_sequence.at(m_prefetchEnd) < 0)
+        {
+            ++m_prefetchEnd;
+        }
+
+        if (m_prefetchEnd == m_sequence.size())
+        {
+            return;
+        }
+
+        {
+            boost::lock_guard<boost::mutex> lock(m_mutex);
+
+            if (m_prefetchCount >= k_lookahead)
+            {
+                return;
+            }
+
+            ++m_prefetchCount;
+        }
+
+        m_decodeGroup->run(boost::bind(&DatasetReader::decode, this,
+                                       static_cast<size_t>(m_sequence.at(m_prefetchEnd))));
+        ++m_prefetchEnd;
+    }
+}
+
+void
+DatasetReader::decode(size_t itemId)
+{
+    Item& item = m_images.at(itemId);
+
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+
+        if (m_stop)
+        {
+            return;
+        }
+    }
+
+    cv::Mat image = cv::imread(item.filename);
+
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+
+        item.image = image;
+        item.decoded = true;
+    }
+
+    m_decodedCond.notify_all();
+}
+
+}
@@ -0,0 +1,112 @@
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+#include <opencv2/highgui/highgui.hpp>
+#include <sstream>
+
+#include "camodocal/calib/DatasetReader.h"
+
+namespace camodocal
+{
+
+namespace
+{
+
+std::string
+writeImage(const boost::filesystem::path& dir, int cameraId, uint64_t timestamp)
+{
+    std::ostringstream oss;
+    oss << "camera_" << cameraId << "_" << timestamp << ".png";
+
+    std::string filename = (dir / oss.str()).string();
+    cv::imwrite(filename, cv::Mat(6, 8, CV_8UC3));
+
+    return filename;
+}
+
+}
+
+TEST(DatasetReader, replayOrder)
+{
+    boost::filesystem::path dir = boost::filesystem::temp_directory_path() /
+                                  boost::filesystem::unique_path("camodocal-%%%%-%%%%");
+    boost::filesystem::create_directories(dir);
+
+    // two decoding threads with a small window, so that most images are
+    // decoded ahead of the consumer
+    DatasetReader reader(2, 3);
+
+    // the images are added out of order on purpose
+    const uint64_t imageTimestamps[] = {250, 100, 50, 150, 300, 200};
+    for (int c = 0; c < 2; ++c)
+    {
+        for (size_t i = 0; i < sizeof(imageTimestamps) / sizeof(imageTimestamps[0]); ++i)
+        {
+            reader.addImage(c, imageTimestamps[i], writeImage(dir, c, imageTimestamps[i]));
+        }
+    }
+    reader.addImage(0, 120, (dir / "missing.png").string());
+
+    reader.addPose(300);
+    reader.addPose(100);
+    reader.addPose(200);
+
+    // the image at 50 is older than the first pose, and the image at 300
+    // is not older than the last pose
+    const int expectedCameras[] = {-1, -1, 0, 1, 0, 0, 1, -1, 0, 1, 0, 1};
+    const uint64_t expectedTimestamps[] = {100, 200, 100, 100, 120, 150, 150, 300, 200, 200, 250, 250};
+    const size_t expectedCount = sizeof(expectedCameras) / sizeof(expectedCameras[0]);
+
+    EXPECT_EQ(expectedCount, reader.eventCount());
+
+    DatasetReader::Event event;
+    for (size_t i = 0; i < expectedCount; ++i)
+    {
+        ASSERT_TRUE(reader.next(event));
+        EXPECT_EQ(expectedCameras[i], event.cameraId);
+        EXPECT_EQ(expectedTimestamps[i], event.timestamp);
+
+        if (event.cameraId < 0 || event.timestamp == 120)
+        {
+            EXPECT_TRUE(event.image.empty());
+        }
+        else
+        {
+            EXPECT_EQ(6, event.image.rows);
+            EXPECT_EQ(8, event.image.cols);
+        }
+    }
+    EXPECT_FALSE(reader.next(event));
+
+    boost::filesystem::remove_all(dir);
+}
+
+TEST(DatasetReader, destroyWhilePrefetching)
+{
+    boost::filesystem::path dir = boost::filesystem::temp_directory_path() /
+                                  boost::filesystem::unique_path("camodocal-%%%%-%%%%");
+    boost::filesystem::create_directories(dir);
+
+    {
+        DatasetReader reader(2, 8);
+
+        reader.addPose(0);
+        for (uint64_t t = 0; t < 50; ++t)
+        {
+            reader.addImage(0, t, writeImage(dir, 0, t));
+        }
+        reader.addPose(1000);
+
+        // both poses, then the first image
+        DatasetReader::Event event;
+        for (int i = 0; i < 3; ++i)
+        {
+            ASSERT_TRUE(reader.next(event));
+        }
+        EXPECT_EQ(0, event.cameraId);
+        EXPECT_EQ(0u, event.timestamp);
+    }
+
+    boost::filesystem::remove_all(dir);
+}
+
+}
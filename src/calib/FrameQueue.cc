@@ -0,0 +1,135 @@
+#include "camodocal/calib/FrameQueue.h"
+
+#include <algorithm>
+
+namespace camodocal
+{
+
+FrameQueue::FrameQueue(size_t capacity, OverflowPolicy policy)
+ : m_frames(std::max(capacity, static_cast<size_t>(1)))
+ , m_policy(policy)
+ , m_closed(false)
+ , m_droppedCount(0)
+{
+
+}
+
+bool
+FrameQueue::push(const cv::Mat& image, uint64_t timestamp)
+{
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    if (m_policy == BLOCK)
+    {
+        while (!m_closed && m_frames.full())
+        {
+            m_notFullCond.wait(lock);
+        }
+    }
+
+    if (m_closed)
+    {
+        return false;
+    }
+
+    if (m_frames.full())
+    {
+        ++m_droppedCount;
+
+        if (m_policy == DROP_NEWEST)
+        {
+            return false;
+        }
+
+        // the circular buffer overwrites the oldest frame
+    }
+
+    QueuedFrame frame;
+    frame.image = image;
+    frame.timestamp = timestamp;
+    m_frames.push_back(frame);
+
+    lock.unlock();
+
+    m_notEmptyCond.notify_one();
+
+    return true;
+}
+
+bool
+FrameQueue::pop(cv::Mat& image, uint64_t& timestamp)
+{
+    boost::unique_lock<boost::mutex> lock(m_mutex);
+
+    while (!m_closed && m_frames.empty())
+    {
+        m_notEmptyCond.wait(lock);
+    }
+
+    // frames queued before the queue was closed are still handed out
+    if (m_frames.empty())
+    {
+        return false;
+    }
+
+    image = m_frames.front().image;
+    timestamp = m_frames.front().timestamp;
+    m_frames.pop_front();
+
+    lock.unlock();
+
+    m_notFullCond.notify_one();
+
+    return true;
+}
+
+void
+FrameQueue::close(void)
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+
+        m_closed = true;
+    }
+
+    m_notEmptyCond.notify_all();
+    m_notFullCond.notify_all();
+}
+
+bool
+FrameQueue::closed(void) const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    return m_closed;
+}
+
+size_t
+FrameQueue::size(void) const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    return m_frames.size();
+}
+
+size_t
+FrameQueue::capacity(void) const
+{
+    return m_frames.capacity();
+}
+
+FrameQueue::OverflowPolicy
+FrameQueue::policy(void) const
+{
+    return m_policy;
+}
+
+size_t
+FrameQueue::droppedCount(void) const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    return m_droppedCount;
+}
+
+}
@@ -0,0 +1,136 @@
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <gtest/gtest.h>
+
+#include "camodocal/calib/FrameQueue.h"
+
+namespace camodocal
+{
+
+namespace
+{
+
+void
+popFrames(FrameQueue* queue, std::vector<uint64_t>* timestamps)
+{
+    cv::Mat image;
+    uint64_t timestamp;
+    while (queue->pop(image, timestamp))
+    {
+        timestamps->push_back(timestamp);
+    }
+}
+
+}
+
+TEST(FrameQueue, sharesImageData)
+{
+    FrameQueue queue(2, FrameQueue::BLOCK);
+
+    cv::Mat image(4, 4, CV_8U);
+    ASSERT_TRUE(queue.push(image, 10));
+
+    cv::Mat queued;
+    uint64_t timestamp;
+    ASSERT_TRUE(queue.pop(queued, timestamp));
+    EXPECT_EQ(10u, timestamp);
+    EXPECT_EQ(image.data, queued.data);
+}
+
+TEST(FrameQueue, dropOldest)
+{
+    FrameQueue queue(2, FrameQueue::DROP_OLDEST);
+
+    cv::Mat image(4, 4, CV_8U);
+    EXPECT_TRUE(queue.push(image, 10));
+    EXPECT_TRUE(queue.push(image, 20));
+    EXPECT_TRUE(queue.push(image, 30));
+    EXPECT_EQ(2u, queue.size());
+    EXPECT_EQ(1u, queue.droppedCount());
+
+    uint64_t timestamp;
+    ASSERT_TRUE(queue.pop(image, timestamp));
+    EXPECT_EQ(20u, timestamp);
+    ASSERT_TRUE(queue.pop(image, timestamp));
+    EXPECT_EQ(30u, timestamp);
+}
+
+TEST(FrameQueue, dropNewest)
+{
+    FrameQueue queue(2, FrameQueue::DROP_NEWEST);
+
+    cv::Mat image(4, 4, CV_8U);
+    EXPECT_TRUE(queue.push(image, 10));
+    EXPECT_TRUE(queue.push(image, 20));
+    EXPECT_FALSE(queue.push(image, 30));
+    EXPECT_EQ(1u, queue.droppedCount());
+
+    uint64_t timestamp;
+    ASSERT_TRUE(queue.pop(image, timestamp));
+    EXPECT_EQ(10u, timestamp);
+    ASSERT_TRUE(queue.pop(image, timestamp));
+    EXPECT_EQ(20u, timestamp);
+}
+
+TEST(FrameQueue, blockKeepsAllFrames)
+{
+    FrameQueue queue(2, FrameQueue::BLOCK);
+
+    std::vector<uint64_t> timestamps;
+    boost::thread consumer(boost::bind(&popFrames, &queue, &timestamps));
+
+    cv::Mat image(4, 4, CV_8U);
+    for (uint64_t i = 1; i <= 1000; ++i)
+    {
+        ASSERT_TRUE(queue.push(image, i));
+    }
+
+    // the consumer still gets the frames queued before closing
+    queue.close();
+    consumer.join();
+
+    EXPECT_EQ(0u, queue.droppedCount());
+    ASSERT_EQ(1000u, timestamps.size());
+    for (size_t i = 0; i < timestamps.size(); ++i)
+    {
+        EXPECT_EQ(i + 1, timestamps.at(i));
+    }
+}
+
+TEST(FrameQueue, closeKeepsQueuedFrames)
+{
+    FrameQueue queue(4, FrameQueue::BLOCK);
+
+    cv::Mat image(4, 4, CV_8U);
+    ASSERT_TRUE(queue.push(image, 10));
+    ASSERT_TRUE(queue.push(image, 20));
+
+    queue.close();
+    EXPECT_TRUE(queue.closed());
+    EXPECT_FALSE(queue.push(image, 30));
+
+    std::vector<uint64_t> timestamps;
+    popFrames(&queue, &timestamps);
+
+    ASSERT_EQ(2u, timestamps.size());
+    EXPECT_EQ(10u, timestamps.at(0));
+    EXPECT_EQ(20u, timestamps.at(1));
+    EXPECT_EQ(0u, queue.size());
+}
+
+TEST(FrameQueue, closeWakesWaiters)
+{
+    FrameQueue queue(1, FrameQueue::BLOCK);
+
+    std::vector<uint64_t> timestamps;
+    boost::thread consumer(boost::bind(&popFrames, &queue, &timestamps));
+
+    queue.close();
+    consumer.join();
+    EXPECT_TRUE(timestamps.empty());
+
+    cv::Mat image(4, 4, CV_8U);
+    EXPECT_FALSE(queue.push(image, 10));
+}
+
+}
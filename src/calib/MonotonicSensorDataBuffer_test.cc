@@ -0,0 +1,201 @@
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread/thread.hpp>
+#include <gtest/gtest.h>
+
+#include "camodocal/calib/MonotonicSensorDataBuffer.h"
+
+namespace camodocal
+{
+
+TEST(MonotonicSensorDataBuffer, lookup)
+{
+    MonotonicSensorDataBuffer<int> buffer(5);
+
+    int data;
+    EXPECT_TRUE(buffer.empty());
+    EXPECT_FALSE(buffer.current(data));
+
+    // timestamps 10, 20, ..., 70; the first two are evicted
+    for (int i = 1; i <= 7; ++i)
+    {
+        buffer.push(i * 10, i);
+    }
+    // not newer than the newest sample
+    buffer.push(70, 100);
+    buffer.push(65, 100);
+
+    EXPECT_EQ(5u, buffer.size());
+
+    ASSERT_TRUE(buffer.current(data));
+    EXPECT_EQ(7, data);
+
+    ASSERT_TRUE(buffer.find(40, data));
+    EXPECT_EQ(4, data);
+    EXPECT_FALSE(buffer.find(45, data));
+    EXPECT_FALSE(buffer.find(20, data));
+
+    ASSERT_TRUE(buffer.before(45, data));
+    EXPECT_EQ(4, data);
+    ASSERT_TRUE(buffer.after(45, data));
+    EXPECT_EQ(5, data);
+    // as in SensorDataBuffer, a sample at the timestamp is the one after it
+    ASSERT_TRUE(buffer.before(50, data));
+    EXPECT_EQ(4, data);
+    ASSERT_TRUE(buffer.after(50, data));
+    EXPECT_EQ(5, data);
+    ASSERT_TRUE(buffer.before(70, data));
+    EXPECT_EQ(6, data);
+    ASSERT_TRUE(buffer.after(70, data));
+    EXPECT_EQ(7, data);
+
+    // there must be data older than the timestamp and data at or after it
+    EXPECT_FALSE(buffer.before(71, data));
+    EXPECT_FALSE(buffer.after(25, data));
+    EXPECT_FALSE(buffer.after(30, data));
+
+    int dataBefore, dataAfter;
+    ASSERT_TRUE(buffer.nearest(62, dataBefore, dataAfter));
+    EXPECT_EQ(6, dataBefore);
+    EXPECT_EQ(7, dataAfter);
+    ASSERT_TRUE(buffer.nearest(70, dataBefore, dataAfter));
+    EXPECT_EQ(6, dataBefore);
+    EXPECT_EQ(7, dataAfter);
+    ASSERT_TRUE(buffer.nearest(31, dataBefore, dataAfter));
+    EXPECT_EQ(3, dataBefore);
+    EXPECT_EQ(4, dataAfter);
+    EXPECT_FALSE(buffer.nearest(30, dataBefore, dataAfter));
+
+    ASSERT_TRUE(buffer.nearest(44, data));
+    EXPECT_EQ(4, data);
+    ASSERT_TRUE(buffer.nearest(45, data));
+    EXPECT_EQ(4, data);
+    ASSERT_TRUE(buffer.nearest(46, data));
+    EXPECT_EQ(5, data);
+    ASSERT_TRUE(buffer.nearest(0, data));
+    EXPECT_EQ(3, data);
+    ASSERT_TRUE(buffer.nearest(1000, data));
+    EXPECT_EQ(7, data);
+
+    buffer.clear();
+    EXPECT_TRUE(buffer.empty());
+    EXPECT_FALSE(buffer.find(40, data));
+
+    buffer.push(80, 8);
+    ASSERT_TRUE(buffer.current(data));
+    EXPECT_EQ(8, data);
+}
+
+namespace
+{
+
+typedef boost::shared_ptr<uint64_t> SamplePtr;
+
+void
+pushSamples(MonotonicSensorDataBuffer<int>* buffer, int delayMs)
+{
+    for (int i = 1; i <= 10; ++i)
+    {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(delayMs));
+        buffer->push(i * 10, i);
+    }
+}
+
+void
+readSamples(const MonotonicSensorDataBuffer<SamplePtr>* buffer,
+            uint64_t sampleCount, int* errorCount)
+{
+    SamplePtr current;
+    while (!buffer->current(current) || *current < sampleCount)
+    {
+        if (!current)
+        {
+            continue;
+        }
+
+        // every sample carries its own timestamp, so a sample that is
+        // returned for the wrong timestamp shows up as a mismatch
+        uint64_t timestamp = *current > 50 ? *current - 50 : 1;
+
+        SamplePtr before, after;
+        if (buffer->nearest(timestamp * 2 + 1, before, after))
+        {
+            if (*before != timestamp || *after != timestamp + 1)
+            {
+                ++(*errorCount);
+            }
+        }
+
+        SamplePtr sample;
+        if (buffer->find(timestamp * 2, sample) && *sample != timestamp)
+        {
+            ++(*errorCount);
+        }
+    }
+}
+
+}
+
+TEST(MonotonicSensorDataBuffer, waitForData)
+{
+    MonotonicSensorDataBuffer<int> buffer(100);
+
+    boost::system_time timeout = boost::get_system_time() + boost::posix_time::milliseconds(20);
+    EXPECT_FALSE(buffer.timedWaitForData(10, timeout));
+
+    boost::thread writer(boost::bind(&pushSamples, &buffer, 5));
+
+    // the samples arrive well before the timeout
+    timeout = boost::get_system_time() + boost::posix_time::seconds(10);
+    ASSERT_TRUE(buffer.timedWaitForData(95, timeout));
+    EXPECT_LT(boost::get_system_time(), timeout);
+
+    int dataBefore, dataAfter;
+    ASSERT_TRUE(buffer.nearest(95, dataBefore, dataAfter));
+    EXPECT_EQ(9, dataBefore);
+    EXPECT_EQ(10, dataAfter);
+
+    // covered already
+    timeout = boost::get_system_time();
+    EXPECT_TRUE(buffer.timedWaitForData(50, timeout));
+
+    writer.join();
+
+    // the newest sample covers its own timestamp
+    EXPECT_TRUE(buffer.timedWaitForData(100, timeout));
+    ASSERT_TRUE(buffer.nearest(100, dataBefore, dataAfter));
+    EXPECT_EQ(9, dataBefore);
+    EXPECT_EQ(10, dataAfter);
+    EXPECT_FALSE(buffer.timedWaitForData(101, timeout));
+}
+
+TEST(MonotonicSensorDataBuffer, concurrentReaders)
+{
+    const uint64_t sampleCount = 200000;
+
+    MonotonicSensorDataBuffer<SamplePtr> buffer(100);
+
+    const int readerCount = 4;
+    std::vector<int> errorCounts(readerCount, 0);
+
+    boost::thread_group readers;
+    for (int i = 0; i < readerCount; ++i)
+    {
+        readers.create_thread(boost::bind(&readSamples, &buffer, sampleCount, &errorCounts.at(i)));
+    }
+
+    // sample i has timestamp 2 i
+    for (uint64_t i = 1; i <= sampleCount; ++i)
+    {
+        buffer.push(i * 2, boost::make_shared<uint64_t>(i));
+    }
+
+    readers.join_all();
+
+    for (int i = 0; i < readerCount; ++i)
+    {
+        EXPECT_EQ(0, errorCounts.at(i));
+    }
+}
+
+}
@@ -0,0 +1,253 @@
+#include "RectificationMapCache.h"
+
+#include <cmath>
+
+#include <boost/make_shared.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include <opencv2/core/eigen.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+namespace camodocal
+{
+
+bool
+RectificationMapCache::Key::operator<(const Key& other) const
+{
+    if (cameraId != other.cameraId)
+    {
+        return cameraId < other.cameraId;
+    }
+
+    if (fx != other.fx)
+    {
+        return fx < other.fx;
+    }
+
+    if (fy != other.fy)
+    {
+        return fy < other.fy;
+    }
+
+    if (intrinsics != other.intrinsics)
+    {
+        return intrinsics < other.intrinsics;
+    }
+
+    for (int i = 0; i < 3; ++i)
+    {
+        if (bucket[i] != other.bucket[i])
+        {
+            return bucket[i] < other.bucket[i];
+        }
+    }
+
+    return false;
+}
+
+RectificationMapCache::RectificationMapCache(size_t capacity, double tolerance)
+ : m_capacity(capacity)
+ , m_tolerance(tolerance)
+ , m_hitCount(0)
+ , m_missCount(0)
+{
+
+}
+
+void
+RectificationMapCache::setCapacity(size_t capacity)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    m_capacity = capacity;
+
+    evict();
+}
+
+void
+RectificationMapCache::setTolerance(double tolerance)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    if (tolerance != m_tolerance)
+    {
+        // bucket indices depend on the tolerance
+        m_lru.clear();
+        m_entries.clear();
+    }
+
+    m_tolerance = tolerance;
+}
+
+size_t
+RectificationMapCache::capacity(void) const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    return m_capacity;
+}
+
+double
+RectificationMapCache::tolerance(void) const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    return m_tolerance;
+}
+
+RectificationMapCache::EntryConstPtr
+RectificationMapCache::get(int cameraId, const CameraConstPtr& camera,
+                           const Eigen::Matrix3d& R,
+                           float fx, float fy)
+{
+    double tolerance;
+    size_t capacity;
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+
+        tolerance = m_tolerance;
+        capacity = m_capacity;
+    }
+
+    if (tolerance <= 0.0 || capacity == 0)
+    {
+        return generate(camera, R, fx, fy, false);
+    }
+
+    Eigen::AngleAxisd aa(R);
+    Eigen::Vector3d rvec = aa.angle() * aa.axis();
+
+    // the maps are only valid for the intrinsics they were generated with
+    Key key;
+    key.cameraId = cameraId;
+    key.fx = fx;
+    key.fy = fy;
+    camera->writeParameters(key.intrinsics);
+    for (int i = 0; i < 3; ++i)
+    {
+        key.bucket[i] = static_cast<int>(std::floor(rvec(i) / tolerance + 0.5));
+    }
+
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+
+        EntryMap::iterator it = m_entries.find(key);
+        if (it != m_entries.end())
+        {
+            m_lru.splice(m_lru.begin(), m_lru, it->second.second);
+            ++m_hitCount;
+
+            return it->second.first;
+        }
+
+        ++m_missCount;
+    }
+
+    // generate outside the lock so that misses on other keys are not serialized
+    Eigen::Vector3d rvecBucket(key.bucket[0], key.bucket[1], key.bucket[2]);
+    rvecBucket *= tolerance;
+
+    Eigen::Matrix3d R_bucket = Eigen::Matrix3d::Identity();
+    if (rvecBucket.norm() > 0.0)
+    {
+        R_bucket = Eigen::AngleAxisd(rvecBucket.norm(), rvecBucket.normalized()).toRotationMatrix();
+    }
+
+    EntryConstPtr entry = generate(camera, R_bucket, fx, fy, true);
+
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    if (m_tolerance != tolerance)
+    {
+        return entry;
+    }
+
+    EntryMap::iterator it = m_entries.find(key);
+    if (it != m_entries.end())
+    {
+        // another thread generated the same maps in the meantime
+        m_lru.splice(m_lru.begin(), m_lru, it->second.second);
+
+        return it->second.first;
+    }
+
+    m_lru.push_front(key);
+    m_entries[key] = std::make_pair(entry, m_lru.begin());
+
+    evict();
+
+    return entry;
+}
+
+void
+RectificationMapCache::clear(void)
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    m_lru.clear();
+    m_entries.clear();
+    m_hitCount = 0;
+    m_missCount = 0;
+}
+
+size_t
+RectificationMapCache::hitCount(void) const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    return m_hitCount;
+}
+
+size_t
+RectificationMapCache::missCount(void) const
+{
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    return m_missCount;
+}
+
+RectificationMapCache::EntryConstPtr
+RectificationMapCache::generate(const CameraConstPtr& camera,
+                                const Eigen::Matrix3d& R,
+                                float fx, float fy,
+                                bool fixedPoint) const
+{
+    boost::shared_ptr<Entry> entry = boost::make_shared<Entry>();
+    entry->R = R;
+
+    cv::Mat R_cv;
+    cv::eigen2cv(R, R_cv);
+
+    cv::Mat mapX, mapY;
+    camera->initUndistortRectifyMap(mapX, mapY, fx, fy,
+                                    cv::Size(0, 0), -1.0f, -1.0f, R_cv);
+
+    if (fixedPoint)
+    {
+        // fixed-point maps take 6 instead of 8 bytes per pixel and remap faster
+        cv::convertMaps(mapX, mapY, entry->map1, entry->map2, CV_16SC2);
+    }
+    else
+    {
+        entry->map1 = mapX;
+        entry->map2 = mapY;
+    }
+
+    if (!camera->mask().empty())
+    {
+        cv::remap(camera->mask(), entry->mask, entry->map1, entry->map2, cv::INTER_NEAREST);
+    }
+
+    return entry;
+}
+
+void
+RectificationMapCache::evict(void)
+{
+    while (m_lru.size() > m_capacity)
+    {
+        m_entries.erase(m_lru.back());
+        m_lru.pop_back();
+    }
+}
+
+}
@@ -0,0 +1,113 @@
+#ifndef RECTIFICATIONMAPCACHE_H
+#define RECTIFICATIONMAPCACHE_H
+
+#include <list>
+#include <map>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <Eigen/Dense>
+#include <opencv2/core/core.hpp>
+
+#include "camodocal/camera_models/Camera.h"
+
+namespace camodocal
+{
+
+/**
+ * LRU cache of undistort-rectify maps keyed on camera id, camera intrinsics
+ * and a quantized rectifying rotation. Rotations are bucketed by rounding
+ * their angle-axis vector to multiples of the tolerance, and the maps are
+ * generated for the bucket's representative rotation, which is returned
+ * alongside the maps so that callers back-project rectified points with the
+ * rotation actually used.
+ *
+ * Caching is disabled by default since it changes the rectified images.
+ * While disabled, get() generates floating-point maps for the exact rotation.
+ */
+class RectificationMapCache
+{
+public:
+    class Entry
+    {
+    public:
+        // maps for cv::remap; fixed-point (CV_16SC2 / CV_16UC1) when cached,
+        // floating-point (CV_32FC1) otherwise
+        cv::Mat map1;
+        cv::Mat map2;
+
+        // camera mask remapped with the maps; empty if the camera has no mask
+        cv::Mat mask;
+
+        // rectifying rotation the maps were generated with
+        Eigen::Matrix3d R;
+    };
+
+    typedef boost::shared_ptr<const Entry> EntryConstPtr;
+
+    /**
+     * @param capacity  maximum number of cached map pairs
+     * @param tolerance rotation quantization step in radians;
+     *                  a value <= 0 disables caching
+     */
+    RectificationMapCache(size_t capacity = 32, double tolerance = 0.0);
+
+    void setCapacity(size_t capacity);
+    void setTolerance(double tolerance);
+
+    size_t capacity(void) const;
+    double tolerance(void) const;
+
+    /**
+     * Returns maps for the given camera and rectifying rotation, generating
+     * them with Camera::initUndistortRectifyMap on a cache miss.
+     * fx/fy are forwarded to initUndistortRectifyMap.
+     */
+    EntryConstPtr get(int cameraId, const CameraConstPtr& camera,
+                      const Eigen::Matrix3d& R,
+                      float fx = -1.0f, float fy = -1.0f);
+
+    void clear(void);
+
+    size_t hitCount(void) const;
+    size_t missCount(void) const;
+
+private:
+    class Key
+    {
+    public:
+        bool operator<(const Key& other) const;
+
+        int cameraId;
+        float fx;
+        float fy;
+        std::vector<double> intrinsics;
+        int bucket[3];
+    };
+
+    typedef std::list<Key> LRUList;
+    typedef std::map<Key, std::pair<EntryConstPtr, LRUList::iterator> > EntryMap;
+
+    EntryConstPtr generate(const CameraConstPtr& camera,
+                           const Eigen::Matrix3d& R,
+                           float fx, float fy,
+                           bool fixedPoint) const;
+
+    void evict(void);
+
+    size_t m_capacity;
+    double m_tolerance;
+
+    LRUList m_lru;
+    EntryMap m_entries;
+
+    size_t m_hitCount;
+    size_t m_missCount;
+
+    mutable boost::mutex m_mutex;
+};
+
+}
+
+#endif
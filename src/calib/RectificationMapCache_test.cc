@@ -0,0 +1,137 @@
+#include <Eigen/Dense>
+#include <gtest/gtest.h>
+#include <opencv2/core/eigen.hpp>
+
+#include "camodocal/camera_models/PinholeCamera.h"
+#include "RectificationMapCache.h"
+
+namespace camodocal
+{
+
+namespace
+{
+
+CameraPtr
+createCamera(void)
+{
+    return CameraPtr(new PinholeCamera("camera", 64, 48,
+                                       -0.3, 0.1, 0.0, 0.0,
+                                       60.0, 60.0, 32.0, 24.0));
+}
+
+Eigen::Matrix3d
+rotationX(double angle)
+{
+    return Eigen::AngleAxisd(angle, Eigen::Vector3d::UnitX()).toRotationMatrix();
+}
+
+}
+
+TEST(RectificationMapCache, exactWhenDisabled)
+{
+    CameraPtr camera = createCamera();
+    Eigen::Matrix3d R = rotationX(0.1003);
+
+    RectificationMapCache cache;
+    EXPECT_GE(0.0, cache.tolerance());
+
+    RectificationMapCache::EntryConstPtr entry1 = cache.get(0, camera, R);
+    RectificationMapCache::EntryConstPtr entry2 = cache.get(0, camera, R);
+
+    EXPECT_NE(entry1, entry2);
+    EXPECT_EQ(0u, cache.hitCount());
+    EXPECT_EQ(0u, cache.missCount());
+
+    // the same maps as without the cache
+    cv::Mat R_cv;
+    cv::eigen2cv(R, R_cv);
+
+    cv::Mat mapX, mapY;
+    camera->initUndistortRectifyMap(mapX, mapY, -1.0f, -1.0f,
+                                    cv::Size(0, 0), -1.0f, -1.0f, R_cv);
+
+    EXPECT_TRUE(entry1->R == R);
+    ASSERT_EQ(CV_32FC1, entry1->map1.type());
+    EXPECT_EQ(0, cv::norm(entry1->map1, mapX, cv::NORM_INF));
+    EXPECT_EQ(0, cv::norm(entry1->map2, mapY, cv::NORM_INF));
+}
+
+TEST(RectificationMapCache, hitsWithinTolerance)
+{
+    CameraPtr camera = createCamera();
+
+    RectificationMapCache cache(32, 0.01);
+
+    RectificationMapCache::EntryConstPtr entry = cache.get(0, camera, rotationX(0.1003));
+    EXPECT_EQ(0u, cache.hitCount());
+    EXPECT_EQ(1u, cache.missCount());
+
+    // the maps are generated for the bucket's rotation
+    EXPECT_TRUE(entry->R.isApprox(rotationX(0.1), 1e-12));
+    EXPECT_EQ(CV_16SC2, entry->map1.type());
+
+    EXPECT_EQ(entry, cache.get(0, camera, rotationX(0.1013)));
+    EXPECT_EQ(1u, cache.hitCount());
+
+    // another bucket, another camera and another focal length
+    EXPECT_NE(entry, cache.get(0, camera, rotationX(0.1103)));
+    EXPECT_NE(entry, cache.get(1, camera, rotationX(0.1003)));
+    EXPECT_NE(entry, cache.get(0, camera, rotationX(0.1003), 30.0f, 30.0f));
+    EXPECT_EQ(1u, cache.hitCount());
+    EXPECT_EQ(4u, cache.missCount());
+}
+
+TEST(RectificationMapCache, missesAfterIntrinsicsChange)
+{
+    CameraPtr camera = createCamera();
+
+    RectificationMapCache cache(32, 0.01);
+
+    RectificationMapCache::EntryConstPtr entry = cache.get(0, camera, rotationX(0.1003));
+
+    std::vector<double> parameters;
+    camera->writeParameters(parameters);
+    parameters.at(0) = -0.2;
+    camera->readParameters(parameters);
+
+    RectificationMapCache::EntryConstPtr updated = cache.get(0, camera, rotationX(0.1003));
+    EXPECT_NE(entry, updated);
+    EXPECT_EQ(0u, cache.hitCount());
+    EXPECT_EQ(2u, cache.missCount());
+
+    EXPECT_EQ(updated, cache.get(0, camera, rotationX(0.1003)));
+    EXPECT_EQ(1u, cache.hitCount());
+}
+
+TEST(RectificationMapCache, evictsLeastRecentlyUsed)
+{
+    CameraPtr camera = createCamera();
+
+    RectificationMapCache cache(2, 0.01);
+
+    RectificationMapCache::EntryConstPtr entryA = cache.get(0, camera, rotationX(0.1003));
+    RectificationMapCache::EntryConstPtr entryB = cache.get(0, camera, rotationX(0.2003));
+
+    // A becomes the most recently used entry, so C evicts B
+    EXPECT_EQ(entryA, cache.get(0, camera, rotationX(0.1003)));
+    cache.get(0, camera, rotationX(0.3003));
+
+    EXPECT_EQ(entryA, cache.get(0, camera, rotationX(0.1003)));
+    RectificationMapCache::EntryConstPtr entryB2 = cache.get(0, camera, rotationX(0.2003));
+    EXPECT_NE(entryB, entryB2);
+    EXPECT_EQ(2u, cache.hitCount());
+    EXPECT_EQ(4u, cache.missCount());
+
+    // shrinking the cache evicts right away
+    cache.setCapacity(1);
+    EXPECT_EQ(entryB2, cache.get(0, camera, rotationX(0.2003)));
+    cache.get(0, camera, rotationX(0.1003));
+    EXPECT_EQ(3u, cache.hitCount());
+    EXPECT_EQ(5u, cache.missCount());
+
+    cache.clear();
+    EXPECT_EQ(0u, cache.hitCount());
+    EXPECT_EQ(0u, cache.missCount());
+}
+
+}
@@ -6,7 +6,7 @@ namespace camodocal
 {
 
 bool
-interpolateOdometry(SensorDataBuffer<OdometryPtr>& odometryBuffer,
+interpolateOdometry(const MonotonicSensorDataBuffer<OdometryPtr>& odometryBuffer,
                     uint64_t timestamp, OdometryPtr& interpOdo)
 {
     OdometryPtr prev, next;
@@ -50,7 +50,7 @@ interpolateOdometry(SensorDataBuffer<OdometryPtr>& odometryBuffer,
 }
 
 bool
-interpolatePose(SensorDataBuffer<PosePtr>& poseBuffer,
+interpolatePose(const MonotonicSensorDataBuffer<PosePtr>& poseBuffer,
                 uint64_t timestamp, PosePtr& interpPose)
 {
     PosePtr prev, next;
@@ -1,7 +1,7 @@
 #ifndef UTILS_H
 #define UTILS_H
 
-#include "camodocal/calib/SensorDataBuffer.h"
+#include "camodocal/calib/MonotonicSensorDataBuffer.h"
 #include "camodocal/sparse_graph/Odometry.h"
 #include "camodocal/sparse_graph/SparseGraph.h"
 
@@ -9,11 +9,11 @@ namespace camodocal
 {
 
 bool
-interpolateOdometry(SensorDataBuffer<OdometryPtr>& odometryBuffer,
+interpolateOdometry(const MonotonicSensorDataBuffer<OdometryPtr>& odometryBuffer,
                     uint64_t timestamp, OdometryPtr& interpOdo);
 
 bool
-interpolatePose(SensorDataBuffer<PosePtr>& poseBuffer,
+interpolatePose(const MonotonicSensorDataBuffer<PosePtr>& poseBuffer,
                 uint64_t timestamp, PosePtr& interpPose);
 
 }
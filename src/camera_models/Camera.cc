@@ -1,11 +1,73 @@
 #include "camodocal/camera_models/Camera.h"
 #include "camodocal/camera_models/ScaramuzzaCamera.h"
 
+#include <algorithm>
+#include <boost/make_shared.hpp>
+#include <cmath>
 #include <opencv2/calib3d/calib3d.hpp>
 
 namespace camodocal
 {
 
+class Camera::RayLookupTable
+{
+public:
+    int step;
+    int cols;
+    int rows;
+
+    // unit rays at the grid nodes, 3 floats per node in row-major order
+    std::vector<float> rays;
+
+    double maxError;
+    double avgError;
+
+    bool lift(const Eigen::Vector2d& p, Eigen::Vector3d& P) const;
+};
+
+bool
+Camera::RayLookupTable::lift(const Eigen::Vector2d& p, Eigen::Vector3d& P) const
+{
+    double u = p(0) / step;
+    double v = p(1) / step;
+
+    // also rejects NaN
+    if (!(u >= 0.0 && v >= 0.0 && u <= cols - 1 && v <= rows - 1))
+    {
+        return false;
+    }
+
+    int c = std::min(static_cast<int>(u), cols - 2);
+    int r = std::min(static_cast<int>(v), rows - 2);
+    double a = u - c;
+    double b = v - r;
+
+    const float* r00 = &rays[(r * cols + c) * 3];
+    const float* r01 = r00 + 3;
+    const float* r10 = r00 + cols * 3;
+    const float* r11 = r10 + 3;
+
+    double w00 = (1.0 - a) * (1.0 - b);
+    double w01 = a * (1.0 - b);
+    double w10 = (1.0 - a) * b;
+    double w11 = a * b;
+
+    for (int i = 0; i < 3; ++i)
+    {
+        P(i) = w00 * r00[i] + w01 * r01[i] + w10 * r10[i] + w11 * r11[i];
+    }
+
+    P.normalize();
+
+    return true;
+}
+
+Camera::Camera()
+ : m_rayTableStep(0)
+{
+
+}
+
 Camera::Parameters::Parameters(ModelType modelType)
  : m_modelType(modelType)
  , m_imageWidth(0)
@@ -140,6 +202,34 @@ Camera::estimateExtrinsics(const std::vector<cv::Point3f>& objectPoints,
     cv::solvePnP(objectPoints, Ms, cv::Mat::eye(3, 3, CV_64F), cv::noArray(), rvec, tvec);
 }
 
+void
+Camera::spaceToPlaneBatch(const Points3D& P, Points2D& p) const
+{
+    p.resize(P.rows(), 2);
+
+    for (int i = 0; i < P.rows(); ++i)
+    {
+        Eigen::Vector2d p_i;
+        spaceToPlane(P.row(i).transpose(), p_i);
+
+        p.row(i) = p_i.transpose();
+    }
+}
+
+void
+Camera::liftSphereBatch(const Points2D& p, Points3D& P) const
+{
+    P.resize(p.rows(), 3);
+
+    for (int i = 0; i < p.rows(); ++i)
+    {
+        Eigen::Vector3d P_i;
+        liftSphere(p.row(i).transpose(), P_i);
+
+        P.row(i) = P_i.transpose();
+    }
+}
+
 double
 Camera::reprojectionDist(const Eigen::Vector3d& P1, const Eigen::Vector3d& P2) const
 {
@@ -249,4 +339,119 @@ Camera::projectPoints(const std::vector<cv::Point3f>& objectPoints,
     }
 }
 
+void
+Camera::enableRayLookupTable(int step)
+{
+    m_rayTableStep = std::max(step, 1);
+
+    updateRayLookupTable();
+}
+
+void
+Camera::disableRayLookupTable(void)
+{
+    m_rayTableStep = 0;
+    m_rayTable.reset();
+}
+
+bool
+Camera::rayLookupTableEnabled(void) const
+{
+    return m_rayTable.get() != 0;
+}
+
+bool
+Camera::rayLookupTableAccuracy(double& maxError, double& avgError) const
+{
+    if (!m_rayTable)
+    {
+        return false;
+    }
+
+    maxError = m_rayTable->maxError;
+    avgError = m_rayTable->avgError;
+
+    return true;
+}
+
+bool
+Camera::liftSphereFromTable(const Eigen::Vector2d& p, Eigen::Vector3d& P) const
+{
+    if (!m_rayTable)
+    {
+        return false;
+    }
+
+    return m_rayTable->lift(p, P);
+}
+
+void
+Camera::updateRayLookupTable(void)
+{
+    // the exact model is used while the table is built
+    m_rayTable.reset();
+
+    if (m_rayTableStep <= 0 || imageWidth() <= 0 || imageHeight() <= 0)
+    {
+        return;
+    }
+
+    boost::shared_ptr<RayLookupTable> table = boost::make_shared<RayLookupTable>();
+    table->step = m_rayTableStep;
+    table->cols = std::max((imageWidth() - 1 + m_rayTableStep - 1) / m_rayTableStep + 1, 2);
+    table->rows = std::max((imageHeight() - 1 + m_rayTableStep - 1) / m_rayTableStep + 1, 2);
+    table->rays.resize(table->cols * table->rows * 3);
+
+    for (int r = 0; r < table->rows; ++r)
+    {
+        for (int c = 0; c < table->cols; ++c)
+        {
+            Eigen::Vector3d P;
+            liftSphere(Eigen::Vector2d(c * m_rayTableStep, r * m_rayTableStep), P);
+            P.normalize();
+
+            float* ray = &table->rays[(r * table->cols + c) * 3];
+            ray[0] = P(0);
+            ray[1] = P(1);
+            ray[2] = P(2);
+        }
+    }
+
+    // accuracy at the cell centres, where the interpolation error peaks
+    table->maxError = 0.0;
+    table->avgError = 0.0;
+
+    int sampleStep = std::max(1, static_cast<int>(std::sqrt((table->cols - 1) * (table->rows - 1) / 10000.0)));
+    size_t sampleCount = 0;
+    for (int r = 0; r < table->rows - 1; r += sampleStep)
+    {
+        for (int c = 0; c < table->cols - 1; c += sampleStep)
+        {
+            Eigen::Vector2d p((c + 0.5) * m_rayTableStep, (r + 0.5) * m_rayTableStep);
+
+            Eigen::Vector3d P, P_table;
+            liftSphere(p, P);
+            P.normalize();
+
+            if (!table->lift(p, P_table))
+            {
+                continue;
+            }
+
+            double error = std::atan2(P.cross(P_table).norm(), P.dot(P_table));
+
+            table->maxError = std::max(table->maxError, error);
+            table->avgError += error;
+            ++sampleCount;
+        }
+    }
+
+    if (sampleCount > 0)
+    {
+        table->avgError /= sampleCount;
+    }
+
+    m_rayTable = table;
+}
+
 }
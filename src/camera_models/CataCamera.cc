@@ -475,6 +475,11 @@ CataCamera::estimateIntrinsics(const cv::Size& boardSize,
 void
 CataCamera::liftSphere(const Eigen::Vector2d& p, Eigen::Vector3d& P) const
 {
+    if (liftSphereFromTable(p, P))
+    {
+        return;
+    }
+
     double mx_d, my_d,mx2_d, mxy_d, my2_d, mx_u, my_u;
     double rho2_d, rho4_d, radDist_d, Dx_d, Dy_d, inv_denom_d;
     double lambda;
@@ -555,6 +560,14 @@ CataCamera::liftSphere(const Eigen::Vector2d& p, Eigen::Vector3d& P) const
 void
 CataCamera::liftProjective(const Eigen::Vector2d& p, Eigen::Vector3d& P) const
 {
+    if (liftSphereFromTable(p, P))
+    {
+        // the exact ray is the point on the sphere divided by lambda, so
+        // that x and y are the undistorted normalised coordinates
+        P /= P(2) + mParameters.xi();
+        return;
+    }
+
     double mx_d, my_d,mx2_d, mxy_d, my2_d, mx_u, my_u;
     double rho2_d, rho4_d, radDist_d, Dx_d, Dy_d, inv_denom_d;
     //double lambda;
@@ -658,6 +671,81 @@ CataCamera::spaceToPlane(const Eigen::Vector3d& P, Eigen::Vector2d& p) const
          mParameters.gamma2() * p_d(1) + mParameters.v0();
 }
 
+/**
+ * \brief Projects a set of 3D points to the image plane
+ *
+ * \param P 3D point coordinates, one point per row
+ * \param p return value, image point coordinates
+ */
+void
+CataCamera::spaceToPlaneBatch(const Points3D& P, Points2D& p) const
+{
+    // Project points to the normalised plane
+    Eigen::ArrayXd z = P.col(2).array() + mParameters.xi() * P.rowwise().norm().array();
+    Eigen::ArrayXd mx_d = P.col(0).array() / z;
+    Eigen::ArrayXd my_d = P.col(1).array() / z;
+
+    if (!m_noDistortion)
+    {
+        // Apply distortion
+        Eigen::ArrayXd dx_u, dy_u;
+        distortionBatch(mx_d, my_d, dx_u, dy_u);
+        mx_d += dx_u;
+        my_d += dy_u;
+    }
+
+    // Apply generalised projection matrix
+    p.resize(P.rows(), 2);
+    p.col(0) = (mParameters.gamma1() * mx_d + mParameters.u0()).matrix();
+    p.col(1) = (mParameters.gamma2() * my_d + mParameters.v0()).matrix();
+}
+
+/**
+ * \brief Lifts a set of points from the image plane to the unit sphere
+ *
+ * \param p image coordinates, one point per row
+ * \param P return value, coordinates of the points on the sphere
+ */
+void
+CataCamera::liftSphereBatch(const Points2D& p, Points3D& P) const
+{
+    if (rayLookupTableEnabled())
+    {
+        Camera::liftSphereBatch(p, P);
+        return;
+    }
+
+    // Lift points to normalised plane
+    Eigen::ArrayXd mx_d = m_inv_K11 * p.col(0).array() + m_inv_K13;
+    Eigen::ArrayXd my_d = m_inv_K22 * p.col(1).array() + m_inv_K23;
+
+    Eigen::ArrayXd mx_u = mx_d;
+    Eigen::ArrayXd my_u = my_d;
+
+    if (!m_noDistortion)
+    {
+        // Recursive distortion model, as in liftSphere
+        Eigen::ArrayXd dx_u, dy_u;
+        for (int i = 0; i < 6; ++i)
+        {
+            distortionBatch(mx_u, my_u, dx_u, dy_u);
+            mx_u = mx_d - dx_u;
+            my_u = my_d - dy_u;
+        }
+    }
+
+    // Lift normalised points to the sphere (inv_hslash);
+    // for xi = 1 this reduces to lambda = 2 / (rho2 + 1)
+    double xi = mParameters.xi();
+    Eigen::ArrayXd rho2_u = mx_u.square() + my_u.square();
+    Eigen::ArrayXd lambda = (xi + (1.0 + (1.0 - xi * xi) * rho2_u).sqrt()) / (1.0 + rho2_u);
+
+    P.resize(p.rows(), 3);
+    P.col(0) = (lambda * mx_u).matrix();
+    P.col(1) = (lambda * my_u).matrix();
+    P.col(2) = (lambda - xi).matrix();
+}
+
 #if 0
 /** 
  * \brief Project a 3D point to the image plane and calculate Jacobian
@@ -816,6 +904,31 @@ CataCamera::distortion(const Eigen::Vector2d& p_u, Eigen::Vector2d& d_u,
          dydmx, dydmy;
 }
 
+/**
+ * \brief Apply distortion to a set of input points on the normalised plane
+ *
+ * \param mx_u, my_u undistorted coordinates of the points
+ * \param dx_u, dy_u return value, distortion offsets of the points
+ */
+void
+CataCamera::distortionBatch(const Eigen::ArrayXd& mx_u, const Eigen::ArrayXd& my_u,
+                           Eigen::ArrayXd& dx_u, Eigen::ArrayXd& dy_u) const
+{
+    double k1 = mParameters.k1();
+    double k2 = mParameters.k2();
+    double p1 = mParameters.p1();
+    double p2 = mParameters.p2();
+
+    Eigen::ArrayXd mx2_u = mx_u.square();
+    Eigen::ArrayXd my2_u = my_u.square();
+    Eigen::ArrayXd mxy_u = mx_u * my_u;
+    Eigen::ArrayXd rho2_u = mx2_u + my2_u;
+    Eigen::ArrayXd rad_dist_u = k1 * rho2_u + k2 * rho2_u.square();
+
+    dx_u = mx_u * rad_dist_u + 2.0 * p1 * mxy_u + p2 * (rho2_u + 2.0 * mx2_u);
+    dy_u = my_u * rad_dist_u + 2.0 * p2 * mxy_u + p1 * (rho2_u + 2.0 * my2_u);
+}
+
 void
 CataCamera::initUndistortMap(cv::Mat& map1, cv::Mat& map2, double fScale) const
 {
@@ -947,6 +1060,8 @@ CataCamera::setParameters(const CataCamera::Parameters& parameters)
     m_inv_K13 = -mParameters.u0() / mParameters.gamma1();
     m_inv_K22 = 1.0 / mParameters.gamma2();
     m_inv_K23 = -mParameters.v0() / mParameters.gamma2();
+
+    updateRayLookupTable();
 }
 
 void
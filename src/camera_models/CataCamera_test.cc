@@ -88,4 +88,103 @@ TEST(CataCamera, consistency)
     }
 }
 
+TEST(CataCamera, rayLookupTable)
+{
+    CataCamera camera("camera", 1280, 800,
+                      0.894975, -0.344504, 0.0984552, -0.00403995, 0.00610364,
+                      758.355, 757.615, 646.72, 395.001);
+
+    std::vector<Eigen::Vector2d> points;
+    std::vector<Eigen::Vector3d> raysExact;
+    std::vector<Eigen::Vector3d> projectiveRaysExact;
+    for (int i = 0; i < 100; ++i)
+    {
+        Eigen::Vector2d p = (Eigen::Vector2d::Random() + Eigen::Vector2d::Ones()) / 2.0;
+        p(0) *= camera.imageWidth() - 1;
+        p(1) *= camera.imageHeight() - 1;
+
+        Eigen::Vector3d P;
+        camera.liftSphere(p, P);
+
+        points.push_back(p);
+        raysExact.push_back(P.normalized());
+
+        camera.liftProjective(p, P);
+        projectiveRaysExact.push_back(P);
+    }
+
+    camera.enableRayLookupTable(2);
+    ASSERT_TRUE(camera.rayLookupTableEnabled());
+
+    double maxError, avgError;
+    ASSERT_TRUE(camera.rayLookupTableAccuracy(maxError, avgError));
+    EXPECT_LT(maxError, 1e-4);
+    EXPECT_LE(avgError, maxError);
+
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        Eigen::Vector3d P_est;
+        camera.liftSphere(points.at(i), P_est);
+
+        EXPECT_NEAR(raysExact.at(i)(0), P_est(0), 1e-4);
+        EXPECT_NEAR(raysExact.at(i)(1), P_est(1), 1e-4);
+        EXPECT_NEAR(raysExact.at(i)(2), P_est(2), 1e-4);
+
+        // same scale as the exact projective ray
+        camera.liftProjective(points.at(i), P_est);
+
+        const Eigen::Vector3d& P = projectiveRaysExact.at(i);
+        EXPECT_NEAR(P(0), P_est(0), 1e-4 * P.norm());
+        EXPECT_NEAR(P(1), P_est(1), 1e-4 * P.norm());
+        EXPECT_NEAR(P(2), P_est(2), 1e-4 * P.norm());
+    }
+
+    // changing the intrinsics rebuilds the table
+    std::vector<double> params;
+    camera.writeParameters(params);
+    camera.readParameters(params);
+    EXPECT_TRUE(camera.rayLookupTableEnabled());
+
+    camera.disableRayLookupTable();
+    EXPECT_FALSE(camera.rayLookupTableEnabled());
+}
+
+TEST(CataCamera, batch)
+{
+    CataCamera camera("camera", 1280, 800,
+                      0.894975, -0.344504, 0.0984552, -0.00403995, 0.00610364,
+                      758.355, 757.615, 646.72, 395.001);
+
+    Camera::Points3D P(100, 3);
+    for (int i = 0; i < P.rows(); ++i)
+    {
+        P.row(i) = Eigen::Vector3d::Random().transpose();
+        P(i, 2) = fabs(P(i, 2)) + 0.5;
+    }
+
+    Camera::Points2D p_est;
+    camera.spaceToPlaneBatch(P, p_est);
+    ASSERT_EQ(P.rows(), p_est.rows());
+
+    Camera::Points3D P_est;
+    camera.liftSphereBatch(p_est, P_est);
+    ASSERT_EQ(P.rows(), P_est.rows());
+
+    for (int i = 0; i < P.rows(); ++i)
+    {
+        Eigen::Vector2d p;
+        camera.spaceToPlane(P.row(i).transpose(), p);
+
+        EXPECT_NEAR(p(0), p_est(i, 0), 1e-8);
+        EXPECT_NEAR(p(1), p_est(i, 1), 1e-8);
+
+        Eigen::Vector3d P_sphere;
+        camera.liftSphere(p, P_sphere);
+
+        EXPECT_NEAR(P_sphere(0), P_est(i, 0), 1e-10);
+        EXPECT_NEAR(P_sphere(1), P_est(i, 1), 1e-10);
+        EXPECT_NEAR(P_sphere(2), P_est(i, 2), 1e-10);
+    }
+}
+
 }
@@ -428,6 +428,11 @@ EquidistantCamera::liftSphere(const Eigen::Vector2d& p, Eigen::Vector3d& P) cons
 void
 EquidistantCamera::liftProjective(const Eigen::Vector2d& p, Eigen::Vector3d& P) const
 {
+    if (liftSphereFromTable(p, P))
+    {
+        return;
+    }
+
     // Lift points to normalised plane
     Eigen::Vector2d p_u;
     p_u << m_inv_K11 * p(0) + m_inv_K13,
@@ -461,6 +466,32 @@ EquidistantCamera::spaceToPlane(const Eigen::Vector3d& P, Eigen::Vector2d& p) co
          mParameters.mv() * p_u(1) + mParameters.v0();
 }
 
+/**
+ * \brief Projects a set of 3D points to the image plane
+ *
+ * \param P 3D point coordinates, one point per row
+ * \param p return value, image point coordinates
+ */
+void
+EquidistantCamera::spaceToPlaneBatch(const Points3D& P, Points2D& p) const
+{
+    Eigen::ArrayXd rho = (P.col(0).array().square() + P.col(1).array().square()).sqrt();
+    Eigen::ArrayXd theta = (P.col(2).array() / P.rowwise().norm().array()).acos();
+
+    // r(theta) = theta + k2 theta^3 + k3 theta^5 + k4 theta^7 + k5 theta^9
+    Eigen::ArrayXd theta2 = theta.square();
+    Eigen::ArrayXd r = theta * (1.0 + theta2 * (mParameters.k2() + theta2 * (mParameters.k3() + theta2 * (mParameters.k4() + theta2 * mParameters.k5()))));
+
+    // (cos(phi), sin(phi)) = (X, Y) / rho; points on the optical axis map
+    // to the principal point
+    Eigen::ArrayXd scale = (rho > 0.0).select(r / rho, 0.0);
+
+    // Apply generalised projection matrix
+    p.resize(P.rows(), 2);
+    p.col(0) = (mParameters.mu() * scale * P.col(0).array() + mParameters.u0()).matrix();
+    p.col(1) = (mParameters.mv() * scale * P.col(1).array() + mParameters.v0()).matrix();
+}
+
 
 /** 
  * \brief Project a 3D point to the image plane and calculate Jacobian
@@ -630,6 +661,8 @@ EquidistantCamera::setParameters(const EquidistantCamera::Parameters& parameters
     m_inv_K13 = -mParameters.u0() / mParameters.mu();
     m_inv_K22 = 1.0 / mParameters.mv();
     m_inv_K23 = -mParameters.v0() / mParameters.mv();
+
+    updateRayLookupTable();
 }
 
 void
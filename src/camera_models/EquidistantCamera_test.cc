@@ -88,4 +88,95 @@ TEST(EquidistantCamera, consistency)
     }
 }
 
+TEST(EquidistantCamera, rayLookupTable)
+{
+    EquidistantCamera camera("camera", 1280, 800,
+                             -0.01648, -0.00203, 0.00069, -0.00048,
+                             419.22826, 420.42160, 655.45487, 389.66377);
+
+    std::vector<Eigen::Vector2d> points;
+    std::vector<Eigen::Vector3d> raysExact;
+    for (int i = 0; i < 100; ++i)
+    {
+        Eigen::Vector2d p = (Eigen::Vector2d::Random() + Eigen::Vector2d::Ones()) / 2.0;
+        p(0) *= camera.imageWidth() - 1;
+        p(1) *= camera.imageHeight() - 1;
+
+        Eigen::Vector3d P;
+        camera.liftSphere(p, P);
+
+        points.push_back(p);
+        raysExact.push_back(P.normalized());
+    }
+
+    camera.enableRayLookupTable(2);
+    ASSERT_TRUE(camera.rayLookupTableEnabled());
+
+    double maxError, avgError;
+    ASSERT_TRUE(camera.rayLookupTableAccuracy(maxError, avgError));
+    EXPECT_LT(maxError, 1e-4);
+    EXPECT_LE(avgError, maxError);
+
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        // the exact projective ray has unit length as well
+        Eigen::Vector3d P_est;
+        camera.liftProjective(points.at(i), P_est);
+
+        EXPECT_NEAR(raysExact.at(i)(0), P_est(0), 1e-4);
+        EXPECT_NEAR(raysExact.at(i)(1), P_est(1), 1e-4);
+        EXPECT_NEAR(raysExact.at(i)(2), P_est(2), 1e-4);
+    }
+
+    // changing the intrinsics rebuilds the table
+    std::vector<double> params;
+    camera.writeParameters(params);
+    camera.readParameters(params);
+    EXPECT_TRUE(camera.rayLookupTableEnabled());
+
+    camera.disableRayLookupTable();
+    EXPECT_FALSE(camera.rayLookupTableEnabled());
+}
+
+TEST(EquidistantCamera, batch)
+{
+    EquidistantCamera camera("camera", 1280, 800,
+                             -0.01648, -0.00203, 0.00069, -0.00048,
+                             419.22826, 420.42160, 655.45487, 389.66377);
+
+    Camera::Points3D P(100, 3);
+    for (int i = 0; i < P.rows(); ++i)
+    {
+        P.row(i) = Eigen::Vector3d::Random().transpose();
+        P(i, 2) = fabs(P(i, 2)) + 0.5;
+    }
+    // a point on the optical axis, and one behind the camera
+    P.row(0) << 0.0, 0.0, 2.0;
+    P.row(1) << 0.3, -0.2, -1.0;
+
+    Camera::Points2D p_est;
+    camera.spaceToPlaneBatch(P, p_est);
+    ASSERT_EQ(P.rows(), p_est.rows());
+
+    Camera::Points3D P_est;
+    camera.liftSphereBatch(p_est, P_est);
+    ASSERT_EQ(P.rows(), P_est.rows());
+
+    for (int i = 0; i < P.rows(); ++i)
+    {
+        Eigen::Vector2d p;
+        camera.spaceToPlane(P.row(i).transpose(), p);
+
+        EXPECT_NEAR(p(0), p_est(i, 0), 1e-8);
+        EXPECT_NEAR(p(1), p_est(i, 1), 1e-8);
+
+        Eigen::Vector3d P_sphere;
+        camera.liftSphere(p, P_sphere);
+
+        EXPECT_NEAR(P_sphere(0), P_est(i, 0), 1e-10);
+        EXPECT_NEAR(P_sphere(1), P_est(i, 1), 1e-10);
+        EXPECT_NEAR(P_sphere(2), P_est(i, 2), 1e-10);
+    }
+}
+
 }
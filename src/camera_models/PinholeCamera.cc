@@ -449,6 +449,13 @@ PinholeCamera::liftSphere(const Eigen::Vector2d& p, Eigen::Vector3d& P) const
 void
 PinholeCamera::liftProjective(const Eigen::Vector2d& p, Eigen::Vector3d& P) const
 {
+    if (liftSphereFromTable(p, P))
+    {
+        // keep the unit depth of the exact model
+        P /= P(2);
+        return;
+    }
+
     double mx_d, my_d,mx2_d, mxy_d, my2_d, mx_u, my_u;
     double rho2_d, rho4_d, radDist_d, Dx_d, Dy_d, inv_denom_d;
     //double lambda;
@@ -541,6 +548,76 @@ PinholeCamera::spaceToPlane(const Eigen::Vector3d& P, Eigen::Vector2d& p) const
          mParameters.fy() * p_d(1) + mParameters.cy();
 }
 
+/**
+ * \brief Projects a set of 3D points to the image plane
+ *
+ * \param P 3D point coordinates, one point per row
+ * \param p return value, image point coordinates
+ */
+void
+PinholeCamera::spaceToPlaneBatch(const Points3D& P, Points2D& p) const
+{
+    // Project points to the normalised plane
+    Eigen::ArrayXd mx_d = P.col(0).array() / P.col(2).array();
+    Eigen::ArrayXd my_d = P.col(1).array() / P.col(2).array();
+
+    if (!m_noDistortion)
+    {
+        // Apply distortion
+        Eigen::ArrayXd dx_u, dy_u;
+        distortionBatch(mx_d, my_d, dx_u, dy_u);
+        mx_d += dx_u;
+        my_d += dy_u;
+    }
+
+    // Apply generalised projection matrix
+    p.resize(P.rows(), 2);
+    p.col(0) = (mParameters.fx() * mx_d + mParameters.cx()).matrix();
+    p.col(1) = (mParameters.fy() * my_d + mParameters.cy()).matrix();
+}
+
+/**
+ * \brief Lifts a set of points from the image plane to the unit sphere
+ *
+ * \param p image coordinates, one point per row
+ * \param P return value, coordinates of the points on the sphere
+ */
+void
+PinholeCamera::liftSphereBatch(const Points2D& p, Points3D& P) const
+{
+    if (rayLookupTableEnabled())
+    {
+        Camera::liftSphereBatch(p, P);
+        return;
+    }
+
+    // Lift points to normalised plane
+    Eigen::ArrayXd mx_d = m_inv_K11 * p.col(0).array() + m_inv_K13;
+    Eigen::ArrayXd my_d = m_inv_K22 * p.col(1).array() + m_inv_K23;
+
+    Eigen::ArrayXd mx_u = mx_d;
+    Eigen::ArrayXd my_u = my_d;
+
+    if (!m_noDistortion)
+    {
+        // Recursive distortion model, as in liftProjective
+        Eigen::ArrayXd dx_u, dy_u;
+        for (int i = 0; i < 8; ++i)
+        {
+            distortionBatch(mx_u, my_u, dx_u, dy_u);
+            mx_u = mx_d - dx_u;
+            my_u = my_d - dy_u;
+        }
+    }
+
+    Eigen::ArrayXd invNorm = (mx_u.square() + my_u.square() + 1.0).sqrt().inverse();
+
+    P.resize(p.rows(), 3);
+    P.col(0) = (mx_u * invNorm).matrix();
+    P.col(1) = (my_u * invNorm).matrix();
+    P.col(2) = invNorm.matrix();
+}
+
 #if 0
 /**
  * \brief Project a 3D point to the image plane and calculate Jacobian
@@ -696,6 +773,31 @@ PinholeCamera::distortion(const Eigen::Vector2d& p_u, Eigen::Vector2d& d_u,
          dydmx, dydmy;
 }
 
+/**
+ * \brief Apply distortion to a set of input points on the normalised plane
+ *
+ * \param mx_u, my_u undistorted coordinates of the points
+ * \param dx_u, dy_u return value, distortion offsets of the points
+ */
+void
+PinholeCamera::distortionBatch(const Eigen::ArrayXd& mx_u, const Eigen::ArrayXd& my_u,
+                              Eigen::ArrayXd& dx_u, Eigen::ArrayXd& dy_u) const
+{
+    double k1 = mParameters.k1();
+    double k2 = mParameters.k2();
+    double p1 = mParameters.p1();
+    double p2 = mParameters.p2();
+
+    Eigen::ArrayXd mx2_u = mx_u.square();
+    Eigen::ArrayXd my2_u = my_u.square();
+    Eigen::ArrayXd mxy_u = mx_u * my_u;
+    Eigen::ArrayXd rho2_u = mx2_u + my2_u;
+    Eigen::ArrayXd rad_dist_u = k1 * rho2_u + k2 * rho2_u.square();
+
+    dx_u = mx_u * rad_dist_u + 2.0 * p1 * mxy_u + p2 * (rho2_u + 2.0 * mx2_u);
+    dy_u = my_u * rad_dist_u + 2.0 * p2 * mxy_u + p1 * (rho2_u + 2.0 * my2_u);
+}
+
 void
 PinholeCamera::initUndistortMap(cv::Mat& map1, cv::Mat& map2, double fScale) const
 {
@@ -825,6 +927,8 @@ PinholeCamera::setParameters(const PinholeCamera::Parameters& parameters)
     m_inv_K13 = -mParameters.cx() / mParameters.fx();
     m_inv_K22 = 1.0 / mParameters.fy();
     m_inv_K23 = -mParameters.cy() / mParameters.fy();
+
+    updateRayLookupTable();
 }
 
 void
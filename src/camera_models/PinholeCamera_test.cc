@@ -84,4 +84,42 @@ TEST(PinholeCamera, consistency)
     EXPECT_NEAR(P(2), P_est(2), 1e-8);
 }
 
+TEST(PinholeCamera, batch)
+{
+    PinholeCamera camera("camera", 752, 480,
+                         -0.473, 0.273, -0.001, 0.001,
+                         712.557492, 714.825860, 370.075592, 244.759309);
+
+    Camera::Points3D P(100, 3);
+    for (int i = 0; i < P.rows(); ++i)
+    {
+        P.row(i) = Eigen::Vector3d::Random().transpose();
+        P(i, 2) = fabs(P(i, 2)) + 0.5;
+    }
+
+    Camera::Points2D p_est;
+    camera.spaceToPlaneBatch(P, p_est);
+    ASSERT_EQ(P.rows(), p_est.rows());
+
+    Camera::Points3D P_est;
+    camera.liftSphereBatch(p_est, P_est);
+    ASSERT_EQ(P.rows(), P_est.rows());
+
+    for (int i = 0; i < P.rows(); ++i)
+    {
+        Eigen::Vector2d p;
+        camera.spaceToPlane(P.row(i).transpose(), p);
+
+        EXPECT_NEAR(p(0), p_est(i, 0), 1e-8);
+        EXPECT_NEAR(p(1), p_est(i, 1), 1e-8);
+
+        Eigen::Vector3d P_sphere;
+        camera.liftSphere(p, P_sphere);
+
+        EXPECT_NEAR(P_sphere(0), P_est(i, 0), 1e-10);
+        EXPECT_NEAR(P_sphere(1), P_est(i, 1), 1e-10);
+        EXPECT_NEAR(P_sphere(2), P_est(i, 2), 1e-10);
+    }
+}
+
 }
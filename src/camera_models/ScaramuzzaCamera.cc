@@ -212,6 +212,11 @@ OCAMCamera::estimateIntrinsics(const cv::Size& /*boardSize*/,
 void
 OCAMCamera::liftSphere(const Eigen::Vector2d& p, Eigen::Vector3d& P) const
 {
+    if (liftSphereFromTable(p, P))
+    {
+        return;
+    }
+
     liftProjective(p, P);
     P.normalize();
 }
@@ -225,6 +230,9 @@ OCAMCamera::liftSphere(const Eigen::Vector2d& p, Eigen::Vector3d& P) const
 void
 OCAMCamera::liftProjective(const Eigen::Vector2d& p, Eigen::Vector3d& P) const
 {
+    // no lookup table here: the exact ray is a single polynomial evaluation,
+    // and its scale depends on the distance to the image centre
+
     // Relative to Center
     Eigen::Vector2d xc(p[0] - mParameters.center_x(), p[1] - mParameters.center_y());
 
@@ -279,6 +287,83 @@ OCAMCamera::spaceToPlane(const Eigen::Vector3d& P, Eigen::Vector2d& p) const
          xn[0] * mParameters.E() + xn[1]                   + mParameters.center_y();
 }
 
+/**
+ * \brief Projects a set of 3D points to the image plane
+ *
+ * \param P 3D point coordinates, one point per row
+ * \param p return value, image point coordinates
+ */
+void
+OCAMCamera::spaceToPlaneBatch(const Points3D& P, Points2D& p) const
+{
+    Eigen::ArrayXd norm = (P.col(0).array().square() + P.col(1).array().square()).sqrt();
+
+    // Eigen has no vectorized atan2
+    Eigen::ArrayXd theta(P.rows());
+    for (int i = 0; i < P.rows(); ++i)
+    {
+        theta(i) = std::atan2(-P(i, 2), norm(i));
+    }
+
+    Eigen::ArrayXd rho = Eigen::ArrayXd::Zero(P.rows());
+    Eigen::ArrayXd theta_i = Eigen::ArrayXd::Ones(P.rows());
+
+    for (int i = 0; i < SCARAMUZZA_INV_POLY_SIZE; i++)
+    {
+        rho += theta_i * mParameters.inv_poly(i);
+        theta_i *= theta;
+    }
+
+    Eigen::ArrayXd scale = rho / norm;
+    Eigen::ArrayXd xn0 = P.col(0).array() * scale;
+    Eigen::ArrayXd xn1 = P.col(1).array() * scale;
+
+    p.resize(P.rows(), 2);
+    p.col(0) = (xn0 * mParameters.C() + xn1 * mParameters.D() + mParameters.center_x()).matrix();
+    p.col(1) = (xn0 * mParameters.E() + xn1                   + mParameters.center_y()).matrix();
+}
+
+/**
+ * \brief Lifts a set of points from the image plane to the unit sphere
+ *
+ * \param p image coordinates, one point per row
+ * \param P return value, coordinates of the points on the sphere
+ */
+void
+OCAMCamera::liftSphereBatch(const Points2D& p, Points3D& P) const
+{
+    if (rayLookupTableEnabled())
+    {
+        Camera::liftSphereBatch(p, P);
+        return;
+    }
+
+    // Relative to Center
+    Eigen::ArrayXd xc0 = p.col(0).array() - mParameters.center_x();
+    Eigen::ArrayXd xc1 = p.col(1).array() - mParameters.center_y();
+
+    // Affine Transformation
+    Eigen::ArrayXd xc_a0 = m_inv_scale * (xc0 - mParameters.D() * xc1);
+    Eigen::ArrayXd xc_a1 = m_inv_scale * (-mParameters.E() * xc0 + mParameters.C() * xc1);
+
+    Eigen::ArrayXd phi = (xc_a0.square() + xc_a1.square()).sqrt();
+    Eigen::ArrayXd phi_i = Eigen::ArrayXd::Ones(p.rows());
+    Eigen::ArrayXd z = Eigen::ArrayXd::Zero(p.rows());
+
+    for (int i = 0; i < SCARAMUZZA_POLY_SIZE; i++)
+    {
+        z += phi_i * mParameters.poly(i);
+        phi_i *= phi;
+    }
+
+    Eigen::ArrayXd invNorm = (xc0.square() + xc1.square() + z.square()).sqrt().inverse();
+
+    P.resize(p.rows(), 3);
+    P.col(0) = (xc0 * invNorm).matrix();
+    P.col(1) = (xc1 * invNorm).matrix();
+    P.col(2) = (-z * invNorm).matrix();
+}
+
 
 /** 
  * \brief Projects an undistorted 2D point p_u to the image plane
@@ -402,6 +487,8 @@ OCAMCamera::setParameters(const OCAMCamera::Parameters& parameters)
     mParameters = parameters;
 
     m_inv_scale = 1.0 / (parameters.C() - parameters.D() * parameters.E());
+
+    updateRayLookupTable();
 }
 
 void
@@ -0,0 +1,127 @@
+#include <Eigen/Dense>
+#include <gtest/gtest.h>
+#include <iostream>
+
+#include "camodocal/camera_models/ScaramuzzaCamera.h"
+
+namespace camodocal
+{
+
+namespace
+{
+
+OCAMCamera
+createCamera(void)
+{
+    OCAMCamera::Parameters params;
+    params.cameraName() = "camera";
+    params.imageWidth() = 1280;
+    params.imageHeight() = 800;
+    params.C() = 1.0003;
+    params.D() = 0.0002;
+    params.E() = -0.0004;
+    params.center_x() = 640.5;
+    params.center_y() = 400.2;
+
+    const double poly[SCARAMUZZA_POLY_SIZE] = {-260.0, 0.0, 1.5e-3, -1.2e-6, 1.8e-9};
+    for (int i = 0; i < SCARAMUZZA_POLY_SIZE; ++i)
+    {
+        params.poly(i) = poly[i];
+    }
+
+    const double invPoly[SCARAMUZZA_INV_POLY_SIZE] = {380.0, 240.0, 20.0, 30.0, 12.0, 2.0};
+    for (int i = 0; i < SCARAMUZZA_INV_POLY_SIZE; ++i)
+    {
+        params.inv_poly(i) = invPoly[i];
+    }
+
+    return OCAMCamera(params);
+}
+
+}
+
+TEST(OCAMCamera, rayLookupTable)
+{
+    OCAMCamera camera = createCamera();
+
+    std::vector<Eigen::Vector2d> points;
+    std::vector<Eigen::Vector3d> raysExact;
+    std::vector<Eigen::Vector3d> projectiveRaysExact;
+    for (int i = 0; i < 100; ++i)
+    {
+        Eigen::Vector2d p = (Eigen::Vector2d::Random() + Eigen::Vector2d::Ones()) / 2.0;
+        p(0) *= camera.imageWidth() - 1;
+        p(1) *= camera.imageHeight() - 1;
+
+        Eigen::Vector3d P;
+        camera.liftSphere(p, P);
+
+        points.push_back(p);
+        raysExact.push_back(P);
+
+        camera.liftProjective(p, P);
+        projectiveRaysExact.push_back(P);
+    }
+
+    camera.enableRayLookupTable(2);
+    ASSERT_TRUE(camera.rayLookupTableEnabled());
+
+    double maxError, avgError;
+    ASSERT_TRUE(camera.rayLookupTableAccuracy(maxError, avgError));
+    EXPECT_LT(maxError, 1e-4);
+    EXPECT_LE(avgError, maxError);
+
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        Eigen::Vector3d P_est;
+        camera.liftSphere(points.at(i), P_est);
+
+        EXPECT_NEAR(raysExact.at(i)(0), P_est(0), 1e-4);
+        EXPECT_NEAR(raysExact.at(i)(1), P_est(1), 1e-4);
+        EXPECT_NEAR(raysExact.at(i)(2), P_est(2), 1e-4);
+
+        // the projective ray is always exact
+        camera.liftProjective(points.at(i), P_est);
+
+        EXPECT_EQ(projectiveRaysExact.at(i), P_est);
+    }
+}
+
+TEST(OCAMCamera, batch)
+{
+    OCAMCamera camera = createCamera();
+
+    // points off the optical axis, in front of and behind the mirror
+    Camera::Points3D P(100, 3);
+    for (int i = 0; i < P.rows(); ++i)
+    {
+        P.row(i) = Eigen::Vector3d::Random().transpose();
+        P(i, 0) += P(i, 0) < 0.0 ? -0.1 : 0.1;
+    }
+
+    Camera::Points2D p_est;
+    camera.spaceToPlaneBatch(P, p_est);
+    ASSERT_EQ(P.rows(), p_est.rows());
+
+    Camera::Points3D P_est;
+    camera.liftSphereBatch(p_est, P_est);
+    ASSERT_EQ(P.rows(), P_est.rows());
+
+    for (int i = 0; i < P.rows(); ++i)
+    {
+        Eigen::Vector2d p;
+        camera.spaceToPlane(P.row(i).transpose(), p);
+
+        EXPECT_NEAR(p(0), p_est(i, 0), 1e-8);
+        EXPECT_NEAR(p(1), p_est(i, 1), 1e-8);
+
+        Eigen::Vector3d P_sphere;
+        camera.liftSphere(p, P_sphere);
+
+        EXPECT_NEAR(P_sphere(0), P_est(i, 0), 1e-10);
+        EXPECT_NEAR(P_sphere(1), P_est(i, 1), 1e-10);
+        EXPECT_NEAR(P_sphere(2), P_est(i, 2), 1e-10);
+    }
+}
+
+}
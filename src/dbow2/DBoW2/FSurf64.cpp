@@ -20,6 +20,11 @@
 #include <string>
 #include <sstream>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DBOW2_X86_KERNELS
+#include <immintrin.h>
+#endif
+
 #include "FClass.h"
 #include "FSurf64.h"
 
@@ -29,6 +34,194 @@ namespace DBoW2 {
 
 // --------------------------------------------------------------------------
 
+// The kernels compute (a - b)^2 and desc / s in single precision and add
+// them up in the same way as the scalar code, so the vectorized kernels
+// only differ from it in the order in which the squared differences are
+// summed. The SSE2 and AVX kernels are compiled for their instruction set
+// regardless of the build flags and selected at runtime.
+
+namespace {
+
+double distanceScalar(const float *a, const float *b)
+{
+  double sqd = 0.;
+  for(int i = 0; i < FSurf64::L; i += 4)
+  {
+    sqd += (a[i  ] - b[i  ])*(a[i  ] - b[i  ]);
+    sqd += (a[i+1] - b[i+1])*(a[i+1] - b[i+1]);
+    sqd += (a[i+2] - b[i+2])*(a[i+2] - b[i+2]);
+    sqd += (a[i+3] - b[i+3])*(a[i+3] - b[i+3]);
+  }
+  return sqd;
+}
+
+void accumulateMeanScalar(float *mean, const float *desc, float s)
+{
+  for(int i = 0; i < FSurf64::L; i += 4)
+  {
+    mean[i  ] += desc[i  ] / s;
+    mean[i+1] += desc[i+1] / s;
+    mean[i+2] += desc[i+2] / s;
+    mean[i+3] += desc[i+3] / s;
+  }
+}
+
+#ifdef DBOW2_X86_KERNELS
+
+__attribute__((target("sse2")))
+double distanceSSE2(const float *a, const float *b)
+{
+  __m128d sqd0 = _mm_setzero_pd();
+  __m128d sqd1 = _mm_setzero_pd();
+  for(int i = 0; i < FSurf64::L; i += 4)
+  {
+    __m128 d = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+    d = _mm_mul_ps(d, d);
+    sqd0 = _mm_add_pd(sqd0, _mm_cvtps_pd(d));
+    sqd1 = _mm_add_pd(sqd1, _mm_cvtps_pd(_mm_movehl_ps(d, d)));
+  }
+  sqd0 = _mm_add_pd(sqd0, sqd1);
+  sqd0 = _mm_add_sd(sqd0, _mm_unpackhi_pd(sqd0, sqd0));
+  return _mm_cvtsd_f64(sqd0);
+}
+
+__attribute__((target("sse2")))
+void accumulateMeanSSE2(float *mean, const float *desc, float s)
+{
+  const __m128 vs = _mm_set1_ps(s);
+  for(int i = 0; i < FSurf64::L; i += 4)
+  {
+    __m128 m = _mm_loadu_ps(mean + i);
+    m = _mm_add_ps(m, _mm_div_ps(_mm_loadu_ps(desc + i), vs));
+    _mm_storeu_ps(mean + i, m);
+  }
+}
+
+__attribute__((target("avx")))
+double distanceAVX(const float *a, const float *b)
+{
+  __m256d sqd0 = _mm256_setzero_pd();
+  __m256d sqd1 = _mm256_setzero_pd();
+  for(int i = 0; i < FSurf64::L; i += 8)
+  {
+    __m256 d = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+    d = _mm256_mul_ps(d, d);
+    sqd0 = _mm256_add_pd(sqd0, _mm256_cvtps_pd(_mm256_castps256_ps128(d)));
+    sqd1 = _mm256_add_pd(sqd1, _mm256_cvtps_pd(_mm256_extractf128_ps(d, 1)));
+  }
+  sqd0 = _mm256_add_pd(sqd0, sqd1);
+  __m128d sqd = _mm_add_pd(_mm256_castpd256_pd128(sqd0),
+    _mm256_extractf128_pd(sqd0, 1));
+  sqd = _mm_add_sd(sqd, _mm_unpackhi_pd(sqd, sqd));
+  return _mm_cvtsd_f64(sqd);
+}
+
+__attribute__((target("avx")))
+void accumulateMeanAVX(float *mean, const float *desc, float s)
+{
+  const __m256 vs = _mm256_set1_ps(s);
+  for(int i = 0; i < FSurf64::L; i += 8)
+  {
+    __m256 m = _mm256_loadu_ps(mean + i);
+    m = _mm256_add_ps(m, _mm256_div_ps(_mm256_loadu_ps(desc + i), vs));
+    _mm256_storeu_ps(mean + i, m);
+  }
+}
+
+#endif
+
+bool kernelSupported(FSurf64::Kernel k)
+{
+#ifdef DBOW2_X86_KERNELS
+  // the kernel is also selected from a static initializer
+  __builtin_cpu_init();
+#endif
+
+  switch(k)
+  {
+    case FSurf64::SCALAR:
+      return true;
+#ifdef DBOW2_X86_KERNELS
+    case FSurf64::SSE2:
+      return __builtin_cpu_supports("sse2");
+    case FSurf64::AVX:
+      return __builtin_cpu_supports("avx");
+#endif
+    default:
+      return false;
+  }
+}
+
+typedef double (*DistanceKernel)(const float *, const float *);
+typedef void (*AccumulateMeanKernel)(float *, const float *, float);
+
+FSurf64::Kernel g_kernel = FSurf64::SCALAR;
+DistanceKernel g_distance = distanceScalar;
+AccumulateMeanKernel g_accumulateMean = accumulateMeanScalar;
+
+// selects the best kernel when the library is loaded
+const bool g_kernelSelected = FSurf64::setKernel(FSurf64::bestKernel());
+
+} // namespace
+
+// --------------------------------------------------------------------------
+
+FSurf64::Kernel FSurf64::bestKernel()
+{
+  if(kernelSupported(AVX)) return AVX;
+  if(kernelSupported(SSE2)) return SSE2;
+  return SCALAR;
+}
+
+// --------------------------------------------------------------------------
+
+FSurf64::Kernel FSurf64::kernel()
+{
+  return g_kernel;
+}
+
+// --------------------------------------------------------------------------
+
+bool FSurf64::setKernel(FSurf64::Kernel k)
+{
+  if(!kernelSupported(k)) return false;
+
+  switch(k)
+  {
+#ifdef DBOW2_X86_KERNELS
+    case AVX:
+      g_distance = distanceAVX;
+      g_accumulateMean = accumulateMeanAVX;
+      break;
+    case SSE2:
+      g_distance = distanceSSE2;
+      g_accumulateMean = accumulateMeanSSE2;
+      break;
+#endif
+    default:
+      g_distance = distanceScalar;
+      g_accumulateMean = accumulateMeanScalar;
+      break;
+  }
+  g_kernel = k;
+
+  return true;
+}
+
+// --------------------------------------------------------------------------
+
+const char* FSurf64::kernelName(FSurf64::Kernel k)
+{
+  switch(k)
+  {
+    case SSE2: return "SSE2";
+    case AVX: return "AVX";
+    default: return "scalar";
+  }
+}
+
+// --------------------------------------------------------------------------
+
 void FSurf64::meanValue(const std::vector<FSurf64::pDescriptor> &descriptors, 
   FSurf64::TDescriptor &mean)
 {
@@ -40,14 +233,7 @@ void FSurf64::meanValue(const std::vector<FSurf64::pDescriptor> &descriptors,
   vector<FSurf64::pDescriptor>::const_iterator it;
   for(it = descriptors.begin(); it != descriptors.end(); ++it)
   {
-    const FSurf64::TDescriptor &desc = **it;
-    for(int i = 0; i < FSurf64::L; i += 4)
-    {
-      mean[i  ] += desc[i  ] / s;
-      mean[i+1] += desc[i+1] / s;
-      mean[i+2] += desc[i+2] / s;
-      mean[i+3] += desc[i+3] / s;
-    }
+    g_accumulateMean(&mean[0], &(**it)[0], s);
   }
 }
 
@@ -55,15 +241,14 @@ void FSurf64::meanValue(const std::vector<FSurf64::pDescriptor> &descriptors,
   
 double FSurf64::distance(const FSurf64::TDescriptor &a, const FSurf64::TDescriptor &b)
 {
-  double sqd = 0.;
-  for(int i = 0; i < FSurf64::L; i += 4)
-  {
-    sqd += (a[i  ] - b[i  ])*(a[i  ] - b[i  ]);
-    sqd += (a[i+1] - b[i+1])*(a[i+1] - b[i+1]);
-    sqd += (a[i+2] - b[i+2])*(a[i+2] - b[i+2]);
-    sqd += (a[i+3] - b[i+3])*(a[i+3] - b[i+3]);
-  }
-  return sqd;
+  return distance(&a[0], &b[0]);
+}
+
+// --------------------------------------------------------------------------
+
+double FSurf64::distance(const float *a, const float *b)
+{
+  return g_distance(a, b);
 }
 
 // --------------------------------------------------------------------------
@@ -39,6 +39,14 @@ public:
   /// Descriptor length
   static const int L = 64; 
 
+  /// Implementations of the distance and mean kernels
+  enum Kernel
+  {
+    SCALAR,
+    SSE2,
+    AVX
+  };
+
   /**
    * Returns the number of dimensions of the descriptor space
    * @return dimensions
@@ -63,7 +71,45 @@ public:
    * @return (squared) distance
    */
   static double distance(const TDescriptor &a, const TDescriptor &b);
+
+  /**
+   * Calculates the (squared) distance between two descriptors given as
+   * arrays of L floats, e.g. rows of a descriptor matrix
+   * @param a
+   * @param b
+   * @return (squared) distance
+   */
+  static double distance(const float *a, const float *b);
   
+  /**
+   * Returns the fastest kernel that the running CPU supports. This is
+   * the kernel used by default
+   * @return kernel
+   */
+  static Kernel bestKernel();
+
+  /**
+   * Returns the kernel used by distance and meanValue
+   * @return kernel
+   */
+  static Kernel kernel();
+
+  /**
+   * Selects the kernel used by distance and meanValue, e.g. to compare
+   * them. Must not be called while descriptors are being processed
+   * @param k kernel
+   * @return false if k is not supported by the running CPU or the build,
+   *   in which case the kernel is not changed
+   */
+  static bool setKernel(Kernel k);
+
+  /**
+   * Returns the name of a kernel
+   * @param k kernel
+   * @return name
+   */
+  static const char* kernelName(Kernel k);
+
   /**
    * Returns a string version of the descriptor
    * @param a descriptor
@@ -0,0 +1,110 @@
+#include <boost/random.hpp>
+#include <gtest/gtest.h>
+#include <iostream>
+
+#include "FSurf64.h"
+
+namespace camodocal
+{
+
+namespace
+{
+
+typedef DBoW2::FSurf64 F;
+
+void
+randomize(boost::mt19937& rng, float* data, size_t count)
+{
+    boost::uniform_real<float> value(-1.0f, 1.0f);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        data[i] = value(rng);
+    }
+}
+
+}
+
+TEST(FSurf64, kernels)
+{
+    boost::mt19937 rng(0);
+
+    // descriptor rows at every float offset within 32 bytes, so that
+    // the loads of the vectorized kernels are misaligned in all ways
+    const int alignmentCount = 8;
+    const int rowCount = 16;
+    std::vector<float> buffer(alignmentCount + rowCount * F::L);
+    randomize(rng, &buffer[0], buffer.size());
+
+    std::vector<F::TDescriptor> descriptors(rowCount, F::TDescriptor(F::L));
+    for (int i = 0; i < rowCount; ++i)
+    {
+        randomize(rng, &descriptors.at(i)[0], F::L);
+    }
+
+    std::vector<F::pDescriptor> pDescriptors;
+    for (int i = 0; i < rowCount; ++i)
+    {
+        pDescriptors.push_back(&descriptors.at(i));
+    }
+
+    F::Kernel defaultKernel = F::kernel();
+    EXPECT_EQ(F::bestKernel(), defaultKernel);
+
+    ASSERT_TRUE(F::setKernel(F::SCALAR));
+
+    std::vector<double> distances;
+    for (int offset = 0; offset < alignmentCount; ++offset)
+    {
+        for (int i = 0; i + 1 < rowCount; ++i)
+        {
+            const float* a = &buffer[offset + i * F::L];
+            const float* b = &descriptors.at(i + 1)[0];
+
+            distances.push_back(F::distance(a, b));
+        }
+    }
+
+    F::TDescriptor mean;
+    F::meanValue(pDescriptors, mean);
+
+    const F::Kernel kernels[] = {F::SSE2, F::AVX};
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k)
+    {
+        if (!F::setKernel(kernels[k]))
+        {
+            std::cout << "# INFO: Skipping the unsupported "
+                      << F::kernelName(kernels[k]) << " kernel." << std::endl;
+            continue;
+        }
+
+        SCOPED_TRACE(F::kernelName(kernels[k]));
+        EXPECT_EQ(kernels[k], F::kernel());
+
+        // the kernels only sum the squared differences in another order
+        size_t j = 0;
+        for (int offset = 0; offset < alignmentCount; ++offset)
+        {
+            for (int i = 0; i + 1 < rowCount; ++i, ++j)
+            {
+                const float* a = &buffer[offset + i * F::L];
+                const float* b = &descriptors.at(i + 1)[0];
+
+                EXPECT_NEAR(distances.at(j), F::distance(a, b), distances.at(j) * 1e-12);
+            }
+        }
+
+        F::TDescriptor kernelMean;
+        F::meanValue(pDescriptors, kernelMean);
+
+        ASSERT_EQ(mean.size(), kernelMean.size());
+        for (size_t i = 0; i < mean.size(); ++i)
+        {
+            EXPECT_EQ(mean.at(i), kernelMean.at(i));
+        }
+    }
+
+    EXPECT_TRUE(F::setKernel(defaultKernel));
+}
+
+}
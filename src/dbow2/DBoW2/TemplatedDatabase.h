@@ -25,6 +25,7 @@
 #include <string>
 #include <list>
 #include <set>
+#include <stdint.h>
 
 #include "TemplatedVocabulary.h"
 #include "QueryResults.h"
@@ -153,6 +154,16 @@ public:
   EntryId add(const BowVector &vec, 
     const FeatureVector &fec = FeatureVector() );
 
+  /**
+   * Adds several entries to the database at once, with consecutive ids
+   * @param vecs bow vectors of the new entries
+   * @param fvecs feature vectors of the new entries. Only necessary if using
+   *   the direct index, and then of the same size as vecs
+   * @return id of the first new entry
+   */
+  EntryId add(const vector<BowVector> &vecs,
+    const vector<FeatureVector> &fvecs);
+
   /**
    * Empties the database
    */
@@ -200,6 +211,25 @@ public:
   void query(const BowVector &vec, QueryResults &ret, 
     int max_results = 1, int min_id = -1, int max_id = -1) const;
 
+  /**
+   * Queries the database with a vector, returning only the best
+   * max_results entries accepted by a filter. With L1, L2 and dot product
+   * scoring, the partial scores of the postings of the query words are
+   * sorted by entry and summed, so that the cost does not depend on the
+   * size of the database, and the best entries are kept in a bounded heap
+   * instead of sorting all the matching entries; other scorings filter the
+   * results of query()
+   * @param vec bow vector already normalized
+   * @param ret results, as query() would return them after removing the
+   *   rejected entries
+   * @param max_results number of results to return. <= 0 means all
+   * @param accept functor taking an EntryId and returning whether the entry
+   *   may be returned
+   */
+  template<class TFilter>
+  void queryTopK(const BowVector &vec, QueryResults &ret, int max_results,
+    const TFilter &accept) const;
+
   /**
    * Returns the a feature vector associated with a database entry
    * @param id entry id (must be < size())
@@ -236,6 +266,22 @@ public:
   virtual void load(const cv::FileStorage &fs, 
     const std::string &name = "database");
 
+  /**
+   * Stores the inverted and direct files in binary form. The vocabulary is
+   * not stored
+   * @param os output stream opened in binary mode
+   */
+  void saveBinary(std::ostream &os) const;
+
+  /**
+   * Loads the inverted and direct files written by saveBinary. The
+   * vocabulary must already be set and be the one the database was built
+   * with. Counts that exceed the remaining length of a seekable stream
+   * are rejected before anything is allocated
+   * @param is input stream opened in binary mode
+   */
+  void loadBinary(std::istream &is);
+
 public:
 
   // #### debug only
@@ -340,9 +386,8 @@ protected:
   };
   
   /// Row of InvertedFile
-  typedef std::list<IFPair> IFRow;
-  // IFRows are sorted in ascending entry_id order
-  // ## map?
+  typedef std::vector<IFPair> IFRow;
+  // IFRows are contiguous posting arrays sorted in ascending entry_id order
   
   /// Inverted index
   typedef std::vector<IFRow> InvertedFile; 
@@ -354,6 +399,34 @@ protected:
   typedef std::vector<FeatureVector> DirectFile;
   // DirectFile[entry_id] --> [ directentry, ... ]
 
+  /// Partial score of an entry
+  typedef std::pair<EntryId, double> EntryScore;
+
+  /**
+   * Compares the entry ids of two partial scores
+   */
+  static inline bool entryIdLess(const EntryScore &a, const EntryScore &b)
+  {
+    return a.first < b.first;
+  }
+
+  /**
+   * Returns whether n items of the given size can still be read from a
+   * stream, so that counts read from a corrupt file are not allocated
+   * @param is input stream
+   * @param end position of the end of the stream, or -1 if unknown
+   * @param n number of items
+   * @param size size of an item in bytes
+   */
+  static inline bool canRead(std::istream &is, std::streamoff end,
+    uint64_t n, uint64_t size)
+  {
+    if(end < 0) return true;
+
+    std::streamoff pos = is.tellg();
+    return pos >= 0 && pos <= end && n <= (uint64_t)(end - pos) / size;
+  }
+
 protected:
 
   /// Associated vocabulary
@@ -524,6 +597,57 @@ EntryId TemplatedDatabase<TDescriptor, F>::add(const BowVector &v,
   return entry_id;
 }
 
+// ---------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+EntryId TemplatedDatabase<TDescriptor, F>::add(const vector<BowVector> &vecs,
+  const vector<FeatureVector> &fvecs)
+{
+  EntryId first_id = m_nentries;
+
+  if(m_use_di)
+  {
+    // update direct file
+    if(m_dfile.size() < first_id + fvecs.size())
+    {
+      m_dfile.resize(first_id + fvecs.size());
+    }
+    std::copy(fvecs.begin(), fvecs.end(), m_dfile.begin() + first_id);
+  }
+
+  // update inverted file; entries are appended in id order, which keeps the
+  // rows sorted. Rows grow once to their final size
+  vector<unsigned int> row_sizes(m_ifile.size(), 0);
+  for(size_t i = 0; i < vecs.size(); ++i)
+  {
+    BowVector::const_iterator vit;
+    for(vit = vecs[i].begin(); vit != vecs[i].end(); ++vit)
+    {
+      ++row_sizes[vit->first];
+    }
+  }
+  for(size_t wid = 0; wid < m_ifile.size(); ++wid)
+  {
+    if(row_sizes[wid] > 0)
+      m_ifile[wid].reserve(m_ifile[wid].size() + row_sizes[wid]);
+  }
+
+  for(size_t i = 0; i < vecs.size(); ++i)
+  {
+    EntryId entry_id = first_id + i;
+
+    BowVector::const_iterator vit;
+    for(vit = vecs[i].begin(); vit != vecs[i].end(); ++vit)
+    {
+      m_ifile[vit->first].push_back(IFPair(entry_id, vit->second));
+    }
+  }
+
+  m_nentries += vecs.size();
+
+  return first_id;
+}
+
 // --------------------------------------------------------------------------
 
 template<class TDescriptor, class F>
@@ -582,12 +706,7 @@ void TemplatedDatabase<TDescriptor, F>::allocate(int nd, int ni)
     typename std::vector<IFRow>::iterator rit;
     for(rit = m_ifile.begin(); rit != m_ifile.end(); ++rit)
     {
-      int n = (int)rit->size();
-      if(ni > n)
-      {
-        rit->resize(ni);
-        rit->resize(n);
-      }
+      rit->reserve(ni);
     }
   }
   
@@ -672,6 +791,120 @@ void TemplatedDatabase<TDescriptor, F>::query(
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F>
+template<class TFilter>
+void TemplatedDatabase<TDescriptor, F>::queryTopK(const BowVector &vec,
+  QueryResults &ret, int max_results, const TFilter &accept) const
+{
+  ret.resize(0);
+
+  const ScoringType scoring = m_voc->getScoringType();
+
+  if(scoring != L1_NORM && scoring != L2_NORM && scoring != DOT_PRODUCT)
+  {
+    QueryResults all;
+    query(vec, all, 0);
+
+    QueryResults::const_iterator qit;
+    for(qit = all.begin(); qit != all.end(); ++qit)
+    {
+      if(!accept(qit->Id)) continue;
+
+      ret.push_back(*qit);
+      if(max_results > 0 && (int)ret.size() == max_results) break;
+    }
+    return;
+  }
+
+  // accumulate the partial scores as in queryL1, queryL2 and
+  // queryDotProduct; the lower the better for all three (dot products are
+  // negated)
+  const bool binary = (m_voc->getWeightingType() == BINARY);
+
+  size_t npostings = 0;
+  BowVector::const_iterator vit;
+  for(vit = vec.begin(); vit != vec.end(); ++vit)
+  {
+    npostings += m_ifile[vit->first].size();
+  }
+
+  vector<EntryScore> postings;
+  postings.reserve(npostings);
+
+  for(vit = vec.begin(); vit != vec.end(); ++vit)
+  {
+    const WordValue qvalue = vit->second;
+    const IFRow& row = m_ifile[vit->first];
+
+    typename IFRow::const_iterator rit;
+    for(rit = row.begin(); rit != row.end(); ++rit)
+    {
+      const WordValue dvalue = rit->word_weight;
+
+      double value;
+      if(scoring == L1_NORM)
+        value = fabs(qvalue - dvalue) - fabs(qvalue) - fabs(dvalue);
+      else if(scoring == DOT_PRODUCT && binary)
+        value = -1;
+      else
+        value = -qvalue * dvalue;
+
+      postings.push_back(EntryScore(rit->entry_id, value));
+    }
+  }
+
+  // the stable sort keeps the word order of the partial scores of an
+  // entry, so that they are summed in the same order as by query()
+  stable_sort(postings.begin(), postings.end(), entryIdLess);
+
+  // keep the best entries in a max-heap whose top is the worst one kept
+  const size_t k = max_results > 0 ? (size_t)max_results : postings.size();
+
+  vector<EntryScore>::const_iterator pit = postings.begin();
+  while(pit != postings.end())
+  {
+    const EntryId entry_id = pit->first;
+
+    double score = 0.0;
+    for(; pit != postings.end() && pit->first == entry_id; ++pit)
+    {
+      score += pit->second;
+    }
+
+    if(!accept(entry_id)) continue;
+
+    Result r(entry_id, score);
+    if(ret.size() < k)
+    {
+      ret.push_back(r);
+      push_heap(ret.begin(), ret.end());
+    }
+    else if(r < ret.front())
+    {
+      pop_heap(ret.begin(), ret.end());
+      ret.back() = r;
+      push_heap(ret.begin(), ret.end());
+    }
+  }
+
+  // ascending order of the accumulated score
+  sort_heap(ret.begin(), ret.end());
+
+  // complete the scores as the query functions do
+  QueryResults::iterator qit;
+  for(qit = ret.begin(); qit != ret.end(); ++qit)
+  {
+    if(scoring == L1_NORM)
+      qit->Score = -qit->Score/2.0;
+    else if(scoring == L2_NORM)
+      qit->Score = qit->Score <= -1.0 ? 1.0 : 1.0 - sqrt(1.0 + qit->Score);
+    else
+      qit->Score = -qit->Score;
+  }
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F>
 void TemplatedDatabase<TDescriptor, F>::queryL1(const BowVector &vec, 
   QueryResults &ret, int max_results, int min_id, int max_id) const
@@ -2354,6 +2587,174 @@ void TemplatedDatabase<TDescriptor, F>::load(const cv::FileStorage &fs,
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F>
+void TemplatedDatabase<TDescriptor, F>::saveBinary(std::ostream &os) const
+{
+  // Format:
+  // nEntries, usingDI, diLevels, nWords       uint32, uint32, int32, uint32
+  // for each word:
+  //   n, entryIds [n], weights [n]           uint32, uint32, double
+  // for each entry if usingDI:
+  //   nNodes
+  //   for each node: nodeId, n, features [n] uint32
+  //
+  // Rows are written as arrays so that they are read in bulk.
+
+  uint32_t header[3] = {(uint32_t)m_nentries, m_use_di ? 1u : 0u,
+    (uint32_t)m_ifile.size()};
+  int32_t dilevels = m_dilevels;
+
+  os.write(reinterpret_cast<const char*>(&header[0]), 2 * sizeof(uint32_t));
+  os.write(reinterpret_cast<const char*>(&dilevels), sizeof(dilevels));
+  os.write(reinterpret_cast<const char*>(&header[2]), sizeof(uint32_t));
+
+  vector<uint32_t> entryIds;
+  vector<double> weights;
+
+  typename InvertedFile::const_iterator iit;
+  for(iit = m_ifile.begin(); iit != m_ifile.end(); ++iit)
+  {
+    entryIds.clear();
+    weights.clear();
+
+    typename IFRow::const_iterator irit;
+    for(irit = iit->begin(); irit != iit->end(); ++irit)
+    {
+      entryIds.push_back(irit->entry_id);
+      weights.push_back(irit->word_weight);
+    }
+
+    uint32_t n = entryIds.size();
+    os.write(reinterpret_cast<const char*>(&n), sizeof(n));
+    if(n == 0) continue;
+
+    os.write(reinterpret_cast<const char*>(&entryIds[0]),
+      n * sizeof(uint32_t));
+    os.write(reinterpret_cast<const char*>(&weights[0]), n * sizeof(double));
+  }
+
+  if(!m_use_di) return;
+
+  for(unsigned int eid = 0; eid < m_nentries; ++eid)
+  {
+    const FeatureVector &fv = m_dfile[eid];
+
+    uint32_t nNodes = fv.size();
+    os.write(reinterpret_cast<const char*>(&nNodes), sizeof(nNodes));
+
+    FeatureVector::const_iterator dit;
+    for(dit = fv.begin(); dit != fv.end(); ++dit)
+    {
+      uint32_t node[2] = {dit->first, (uint32_t)dit->second.size()};
+      os.write(reinterpret_cast<const char*>(node), sizeof(node));
+      if(node[1] == 0) continue;
+
+      os.write(reinterpret_cast<const char*>(&dit->second[0]),
+        node[1] * sizeof(unsigned int));
+    }
+  }
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedDatabase<TDescriptor, F>::loadBinary(std::istream &is)
+{
+  clear();
+
+  // the end of the stream bounds the counts read from it
+  std::streamoff end = -1;
+  std::streampos start = is.tellg();
+  if(start != std::streampos(-1) && is.seekg(0, std::ios::end))
+  {
+    end = is.tellg();
+    is.seekg(start);
+  }
+  is.clear();
+
+  uint32_t nentries, use_di, nwords;
+  int32_t dilevels;
+
+  is.read(reinterpret_cast<char*>(&nentries), sizeof(nentries));
+  is.read(reinterpret_cast<char*>(&use_di), sizeof(use_di));
+  is.read(reinterpret_cast<char*>(&dilevels), sizeof(dilevels));
+  is.read(reinterpret_cast<char*>(&nwords), sizeof(nwords));
+
+  if(!is) throw string("Truncated database");
+  if(nwords != m_ifile.size())
+    throw string("Database does not match the vocabulary");
+
+  vector<uint32_t> entryIds;
+  vector<double> weights;
+
+  for(unsigned int wid = 0; wid < nwords; ++wid)
+  {
+    uint32_t n;
+    is.read(reinterpret_cast<char*>(&n), sizeof(n));
+    if(!is) throw string("Truncated database");
+    if(n > nentries) throw string("Corrupt database");
+    if(n == 0) continue;
+    if(!canRead(is, end, n, sizeof(uint32_t) + sizeof(double)))
+      throw string("Truncated database");
+
+    entryIds.resize(n);
+    weights.resize(n);
+    is.read(reinterpret_cast<char*>(&entryIds[0]), n * sizeof(uint32_t));
+    is.read(reinterpret_cast<char*>(&weights[0]), n * sizeof(double));
+    if(!is) throw string("Truncated database");
+
+    IFRow &ifrow = m_ifile[wid];
+    ifrow.reserve(n);
+    for(uint32_t i = 0; i < n; ++i)
+    {
+      if(entryIds[i] >= nentries) throw string("Corrupt database");
+      ifrow.push_back(IFPair(entryIds[i], weights[i]));
+    }
+  }
+
+  m_use_di = (use_di != 0);
+  m_dilevels = dilevels;
+
+  if(m_use_di)
+  {
+    // each entry has at least its node count
+    if(!canRead(is, end, nentries, sizeof(uint32_t)))
+      throw string("Truncated database");
+
+    m_dfile.resize(nentries);
+
+    for(unsigned int eid = 0; eid < nentries; ++eid)
+    {
+      uint32_t nNodes;
+      is.read(reinterpret_cast<char*>(&nNodes), sizeof(nNodes));
+      if(!is) throw string("Truncated database");
+
+      FeatureVector &fv = m_dfile[eid];
+      for(uint32_t i = 0; i < nNodes; ++i)
+      {
+        uint32_t node[2];
+        is.read(reinterpret_cast<char*>(node), sizeof(node));
+        if(!is) throw string("Truncated database");
+        if(!canRead(is, end, node[1], sizeof(unsigned int)))
+          throw string("Truncated database");
+
+        // nodes were written in ascending order
+        FeatureVector::iterator dit = fv.insert(fv.end(),
+          make_pair(node[0], vector<unsigned int>(node[1])));
+        if(node[1] == 0) continue;
+
+        is.read(reinterpret_cast<char*>(&dit->second[0]),
+          node[1] * sizeof(unsigned int));
+        if(!is) throw string("Truncated database");
+      }
+    }
+  }
+
+  m_nentries = nentries;
+}
+
+// --------------------------------------------------------------------------
+
 /**
  * Writes printable information of the database
  * @param os stream to write to
@@ -0,0 +1,161 @@
+#include <boost/random.hpp>
+#include <gtest/gtest.h>
+#include <sstream>
+
+#include "DBoW2.h"
+
+namespace camodocal
+{
+
+namespace
+{
+
+typedef std::vector<std::vector<DBoW2::FSurf64::TDescriptor> > Images;
+
+Images
+createImages(boost::mt19937& rng, int imageCount, int featureCount)
+{
+    boost::uniform_real<float> value(-1.0f, 1.0f);
+
+    Images images(imageCount);
+    for (int i = 0; i < imageCount; ++i)
+    {
+        images.at(i).resize(featureCount);
+        for (int j = 0; j < featureCount; ++j)
+        {
+            DBoW2::FSurf64::TDescriptor& descriptor = images.at(i).at(j);
+
+            descriptor.resize(DBoW2::FSurf64::L);
+            for (int k = 0; k < DBoW2::FSurf64::L; ++k)
+            {
+                descriptor.at(k) = value(rng);
+            }
+        }
+    }
+
+    return images;
+}
+
+bool
+acceptOddEntries(DBoW2::EntryId id)
+{
+    return id % 2 == 1;
+}
+
+}
+
+TEST(TemplatedDatabase, queryTopK)
+{
+    boost::mt19937 rng(3);
+
+    Images trainingImages = createImages(rng, 20, 50);
+    Images images = createImages(rng, 60, 40);
+    Images queryImages = createImages(rng, 10, 40);
+
+    const DBoW2::ScoringType scorings[] = {DBoW2::L1_NORM, DBoW2::L2_NORM,
+                                           DBoW2::DOT_PRODUCT, DBoW2::CHI_SQUARE};
+    const int maxResults[] = {1, 5, 0};
+
+    for (size_t s = 0; s < sizeof(scorings) / sizeof(scorings[0]); ++s)
+    {
+        Surf64Vocabulary voc(5, 3, DBoW2::TF_IDF, scorings[s]);
+        voc.create(trainingImages);
+
+        Surf64Database db(voc, false);
+        for (size_t i = 0; i < images.size(); ++i)
+        {
+            DBoW2::BowVector bowVector;
+            voc.transform(images.at(i), bowVector);
+            db.add(bowVector);
+        }
+
+        for (size_t q = 0; q < queryImages.size(); ++q)
+        {
+            DBoW2::BowVector bowVector;
+            voc.transform(queryImages.at(q), bowVector);
+
+            DBoW2::QueryResults all;
+            db.query(bowVector, all, 0);
+
+            for (size_t m = 0; m < sizeof(maxResults) / sizeof(maxResults[0]); ++m)
+            {
+                // query() followed by filtering
+                DBoW2::QueryResults expected;
+                for (size_t i = 0; i < all.size(); ++i)
+                {
+                    if (!acceptOddEntries(all.at(i).Id))
+                    {
+                        continue;
+                    }
+
+                    expected.push_back(all.at(i));
+                    if (maxResults[m] > 0 && static_cast<int>(expected.size()) == maxResults[m])
+                    {
+                        break;
+                    }
+                }
+                ASSERT_FALSE(expected.empty());
+
+                DBoW2::QueryResults ret;
+                db.queryTopK(bowVector, ret, maxResults[m], acceptOddEntries);
+
+                ASSERT_EQ(expected.size(), ret.size());
+                for (size_t i = 0; i < ret.size(); ++i)
+                {
+                    EXPECT_EQ(expected.at(i).Id, ret.at(i).Id);
+                    EXPECT_NEAR(expected.at(i).Score, ret.at(i).Score, 1e-12);
+                }
+            }
+        }
+    }
+}
+
+TEST(TemplatedDatabase, loadBinary)
+{
+    boost::mt19937 rng(5);
+
+    Images trainingImages = createImages(rng, 20, 50);
+    Images images = createImages(rng, 30, 40);
+
+    Surf64Vocabulary voc(5, 3, DBoW2::TF_IDF, DBoW2::L1_NORM);
+    voc.create(trainingImages);
+
+    Surf64Database db(voc, true, 1);
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        DBoW2::BowVector bowVector;
+        DBoW2::FeatureVector featureVector;
+        voc.transform(images.at(i), bowVector, featureVector, 1);
+        db.add(bowVector, featureVector);
+    }
+
+    std::stringstream ss;
+    db.saveBinary(ss);
+    const std::string data = ss.str();
+
+    Surf64Database loaded(voc, false);
+    std::istringstream is(data);
+    loaded.loadBinary(is);
+
+    ASSERT_EQ(db.size(), loaded.size());
+    ASSERT_TRUE(loaded.usingDirectIndex());
+    for (unsigned int i = 0; i < db.size(); ++i)
+    {
+        EXPECT_EQ(db.retrieveFeatures(i), loaded.retrieveFeatures(i));
+    }
+
+    // a truncated file is rejected
+    std::istringstream truncated(data.substr(0, data.size() / 2));
+    EXPECT_THROW(loaded.loadBinary(truncated), std::string);
+
+    // an entry count larger than the file is rejected before the
+    // direct index is allocated
+    std::string corrupt = data;
+    const uint32_t nentries = 0xffffffff;
+    corrupt.replace(0, sizeof(nentries),
+                    reinterpret_cast<const char*>(&nentries), sizeof(nentries));
+    std::istringstream corrupted(corrupt);
+    EXPECT_THROW(loaded.loadBinary(corrupted), std::string);
+}
+
+}
@@ -20,6 +20,8 @@
 #define __D_T_TEMPLATED_VOCABULARY__
 
 #include <cassert>
+#include <cstring>
+#include <stdint.h>
 
 #include <vector>
 #include <numeric>
@@ -28,6 +30,15 @@
 #include <algorithm>
 #include <opencv/cv.h>
 
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+
+#include "../../gpl/TaskScheduler.h"
 #include "FeatureVector.h"
 #include "BowVector.h"
 #include "ScoringObject.h"
@@ -152,6 +163,30 @@ public:
    * @return word id
    */
   virtual WordId transform(const TDescriptor& feature) const;
+
+  /**
+   * Transforms a set of descriptors given as pointers to arrays of F::L
+   * scalars (e.g. rows of descriptor matrices) into a bow vector, without
+   * copying them into TDescriptor objects
+   * @param features
+   * @param v (out) bow vector of weighted words
+   * @note F must provide distance(const TScalar*, const TScalar*)
+   */
+  template<class TScalar>
+  void transform(const std::vector<const TScalar*>& features,
+    BowVector &v) const;
+
+  /**
+   * Transforms a set of descriptors given as pointers to arrays of F::L
+   * scalars into a bow vector and a feature vector
+   * @param features
+   * @param v (out) bow vector
+   * @param fv (out) feature vector of nodes and feature indexes
+   * @param levelsup levels to go up the vocabulary tree to get the node index
+   */
+  template<class TScalar>
+  void transform(const std::vector<const TScalar*>& features,
+    BowVector &v, FeatureVector &fv, int levelsup) const;
   
   /**
    * Returns the score of two vectors
@@ -210,6 +245,15 @@ public:
    * @return weight
    */
   virtual inline WordValue getWordWeight(WordId wid) const;
+
+  /**
+   * Returns a hash of the tree structure, the node descriptors and the
+   * word weights, which identifies the vocabulary that data such as a
+   * database was created with
+   * @return 64-bit FNV-1a hash over 8-byte blocks
+   * @note only for descriptors stored as vectors of scalars
+   */
+  uint64_t contentHash() const;
   
   /** 
    * Returns the weighting method
@@ -235,6 +279,36 @@ public:
    */
   void setScoringType(ScoringType type);
   
+  /**
+   * Sets the seed of the random choices made when creating the vocabulary.
+   * Each node is clustered with its own generator, seeded from this seed
+   * and the node id, so that the tree does not depend on the order in
+   * which the threads cluster the nodes
+   * @param seed
+   */
+  inline void setRandomSeed(unsigned int seed) { m_seed = seed; }
+
+  /**
+   * Counts the words of a document given as pointers to arrays of F::L
+   * scalars, once per word
+   * @param features
+   * @param Ni (in/out) Ni[wid] is incremented if the document contains
+   *   word wid; must have one entry per word
+   */
+  template<class TScalar>
+  void countDocumentWords(const std::vector<const TScalar*>& features,
+    std::vector<unsigned int> &Ni) const;
+
+  /**
+   * Sets the idf weights of the words from the number of documents that
+   * contain each of them, e.g. when the tree was created from a sample of
+   * the documents. Has no effect unless the weighting is IDF or TF_IDF
+   * @param Ni Ni[wid] = number of documents that contain word wid
+   * @param NDocs number of documents
+   */
+  void setDocumentFrequencies(const std::vector<unsigned int> &Ni,
+    unsigned int NDocs);
+
   /**
    * Saves the vocabulary into a file
    * @param filename
@@ -262,7 +336,31 @@ public:
    */  
   virtual void load(const cv::FileStorage &fs, 
     const std::string &name = "vocabulary");
-  
+
+  /**
+   * Saves the vocabulary into a binary file in which the nodes are stored
+   * as contiguous arrays (parents, children, weights, descriptors)
+   * @param filename
+   * @note only for descriptors stored as vectors of F::L scalars
+   */
+  void saveBinary(const std::string &filename) const;
+
+  /**
+   * Loads the vocabulary from a file written by saveBinary. The file is
+   * memory-mapped while it is read, which avoids parsing text, but the
+   * children and descriptor of each node are still copied into the node,
+   * so the vocabulary does not refer to the file afterwards
+   * @param filename
+   */
+  void loadBinary(const std::string &filename);
+
+  /**
+   * Returns whether a file was written by saveBinary
+   * @param filename
+   * @return true iff the file starts with the binary vocabulary signature
+   */
+  static bool isBinaryFile(const std::string &filename);
+
   /** 
    * Stops those words whose weight is below minWeight.
    * Words are stopped by setting their weight to 0. There are not returned
@@ -282,6 +380,27 @@ protected:
   /// Pointer to descriptor
   typedef const TDescriptor *pDescriptor;
 
+  /// Header of the binary vocabulary file
+  struct BinaryHeader
+  {
+    char magic[8];
+    uint32_t version;
+    int32_t k;
+    int32_t L;
+    int32_t scoring;
+    int32_t weighting;
+    uint32_t nodeCount;
+    uint32_t wordCount;
+    uint32_t descriptorLength;
+    uint32_t scalarSize;
+  };
+
+  /// Signature of the binary vocabulary file
+  static const char* binaryMagic() { return "DBOW2VOC"; }
+
+  /// Version of the binary vocabulary file
+  static const uint32_t BINARY_VERSION = 1;
+
   /// Tree node
   struct Node 
   {
@@ -324,6 +443,35 @@ protected:
    */
   void createScoringObject();
 
+  /**
+   * Adds a block of data to a 64-bit FNV-1a hash, 8 bytes at a time
+   * @param hash (in/out) hash
+   * @param data
+   * @param size size of the data in bytes
+   */
+  static void hashBlock(uint64_t &hash, const void *data, size_t size);
+
+  /**
+   * Writes an array to a binary vocabulary file, padded to 8 bytes
+   * @param ofs output stream
+   * @param data array
+   */
+  template<class T>
+  static void writeBinaryArray(std::ofstream &ofs, const vector<T> &data);
+
+  /**
+   * Returns a pointer to an array in a mapped binary vocabulary file and
+   * advances the offset past the array and its padding
+   * @param data start of the file
+   * @param size size of the file
+   * @param offset (in/out) offset of the array
+   * @param count number of elements of the array
+   * @return pointer to the array, or NULL if it exceeds the file
+   */
+  template<class T>
+  static const T* mappedBinaryArray(const char *data, size_t size,
+    size_t &offset, size_t count);
+
   /** 
    * Returns a set of pointers to descriptores
    * @param training_features all the features
@@ -350,10 +498,26 @@ protected:
    * @param id (out) word id
    */
   virtual void transform(const TDescriptor &feature, WordId &id) const;
+
+  /**
+   * Returns the word id associated to a feature given as an array of F::L
+   * scalars
+   * @param feature
+   * @param id (out) word id
+   * @param weight (out) word weight
+   * @param nid (out) if given, id of the node "levelsup" levels up
+   * @param levelsup
+   */
+  template<class TScalar>
+  void transform(const TScalar *feature, WordId &id, WordValue &weight,
+    NodeId* nid = NULL, int levelsup = 0) const;
       
   /**
    * Creates a level in the tree, under the parent, by running kmeans with
-   * a descriptor set, and recursively creates the subsequent levels too
+   * a descriptor set, and creates the subsequent levels too. The tree is
+   * built level by level; the kmeans of the nodes of a level run
+   * concurrently, and the association step of a node runs in parallel
+   * when it is alone in its level
    * @param parent_id id of parent node
    * @param descriptors descriptors to run the kmeans on
    * @param current_level current level in the tree
@@ -361,22 +525,73 @@ protected:
   void HKmeansStep(NodeId parent_id, const vector<pDescriptor> &descriptors, 
     int current_level);
 
+  /**
+   * Runs kmeans on a descriptor set
+   * @param descriptors descriptors to run the kmeans on
+   * @param clusters (out) cluster centres
+   * @param groups (out) groups[i] = [j1, j2, ...], indices of the
+   *   descriptors associated to cluster i
+   * @param parent_id id of the node being split, which seeds its generator
+   * @param parallel if true, the association step runs in several threads
+   */
+  void HKmeansCluster(const vector<pDescriptor> &descriptors,
+    vector<TDescriptor> &clusters, vector<vector<unsigned int> > &groups,
+    NodeId parent_id, bool parallel) const;
+
+  /**
+   * Associates the descriptors [begin, end) with their closest cluster
+   * @param descriptors
+   * @param clusters cluster centres
+   * @param association (out) association[i] = cluster of descriptor i
+   * @param begin
+   * @param end
+   */
+  void associateClusters(const vector<pDescriptor> &descriptors,
+    const vector<TDescriptor> &clusters, vector<int> &association,
+    size_t begin, size_t end) const;
+
+  /**
+   * Runs HKmeansCluster, without parallel association, on the i-th of a
+   * set of descriptor sets, split from the i-th of the parent nodes
+   */
+  void HKmeansClusterNode(const vector<vector<pDescriptor> > &descriptors,
+    const vector<NodeId> &parent_ids, vector<vector<TDescriptor> > &clusters,
+    vector<vector<vector<unsigned int> > > &groups, size_t i) const;
+
+  /**
+   * Associates the i-th block of block_size descriptors with their closest
+   * cluster
+   */
+  void associateBlock(const vector<pDescriptor> &descriptors,
+    const vector<TDescriptor> &clusters, vector<int> &association,
+    size_t block_size, size_t i) const;
+
+  /**
+   * Calls f(0), ..., f(n - 1) as tasks of the process-wide TaskScheduler
+   * and waits for them
+   * @param n
+   * @param f
+   */
+  static void parallelFor(size_t n, const boost::function<void (size_t)> &f);
+
   /**
    * Creates k clusters from the given descriptors with some seeding algorithm.
    * @note In this class, kmeans++ is used, but this function should be
-   *   overriden by inherited classes.
+   *   overriden by inherited classes. It may be called from several
+   *   threads, each with its own generator.
    */
   virtual void initiateClusters(const vector<pDescriptor> &descriptors,
-    vector<TDescriptor> &clusters) const;
+    vector<TDescriptor> &clusters, boost::random::mt19937 &rng) const;
   
   /**
    * Creates k clusters from the given descriptor sets by running the
    * initial step of kmeans++
    * @param descriptors 
    * @param clusters resulting clusters
+   * @param rng random generator
    */
   void initiateClustersKMpp(const vector<pDescriptor> &descriptors, 
-    vector<TDescriptor> &clusters) const;
+    vector<TDescriptor> &clusters, boost::random::mt19937 &rng) const;
   
   /**
    * Create the words of the vocabulary once the tree has been built
@@ -404,6 +619,9 @@ protected:
   
   /// Scoring method
   ScoringType m_scoring;
+
+  /// Seed of the random choices of create
+  unsigned int m_seed;
   
   /// Object for computing scores
   GeneralScoring* m_scoring_object;
@@ -423,7 +641,7 @@ template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
   (int k, int L, WeightingType weighting, ScoringType scoring)
   : m_k(k), m_L(L), m_weighting(weighting), m_scoring(scoring),
-  m_scoring_object(NULL)
+  m_seed(0), m_scoring_object(NULL)
 {
   createScoringObject();
 }
@@ -432,7 +650,7 @@ TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
 
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
-  (const std::string &filename): m_scoring_object(NULL)
+  (const std::string &filename): m_seed(0), m_scoring_object(NULL)
 {
   load(filename);
 }
@@ -441,7 +659,7 @@ TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
 
 template<class TDescriptor, class F>
 TemplatedVocabulary<TDescriptor,F>::TemplatedVocabulary
-  (const char *filename): m_scoring_object(NULL)
+  (const char *filename): m_seed(0), m_scoring_object(NULL)
 {
   load(filename);
 }
@@ -529,6 +747,7 @@ TemplatedVocabulary<TDescriptor,F>::operator=
   this->m_L = voc.m_L;
   this->m_scoring = voc.m_scoring;
   this->m_weighting = voc.m_weighting;
+  this->m_seed = voc.m_seed;
 
   this->createScoringObject();
   
@@ -632,20 +851,82 @@ void TemplatedVocabulary<TDescriptor,F>::HKmeansStep(NodeId parent_id,
   const vector<pDescriptor> &descriptors, int current_level)
 {
   if(descriptors.empty()) return;
-        
-  // features associated to each cluster
-  vector<TDescriptor> clusters;
-	vector<vector<unsigned int> > groups; // groups[i] = [j1, j2, ...]
-	// j1, j2, ... indices of descriptors associated to cluster i
+
+  // nodes of the current level still to be split, and their descriptors
+  vector<NodeId> parents(1, parent_id);
+  vector<vector<pDescriptor> > parent_descriptors(1, descriptors);
+
+  for(int level = current_level; !parents.empty(); ++level)
+  {
+    const size_t n = parents.size();
+
+    vector<vector<TDescriptor> > clusters(n);
+    vector<vector<vector<unsigned int> > > groups(n);
+
+    if(n == 1)
+    {
+      HKmeansCluster(parent_descriptors[0], clusters[0], groups[0],
+        parents[0], true);
+    }
+    else
+    {
+      // the nodes of a level are independent
+      parallelFor(n, boost::bind(&TemplatedVocabulary<TDescriptor,F>::HKmeansClusterNode,
+        this, boost::cref(parent_descriptors), boost::cref(parents),
+        boost::ref(clusters), boost::ref(groups), _1));
+    }
+
+    // create nodes; ids are assigned in the order of the parents
+    vector<NodeId> next_parents;
+    vector<vector<pDescriptor> > next_descriptors;
+
+    for(size_t p = 0; p < n; ++p)
+    {
+      for(unsigned int i = 0; i < clusters[p].size(); ++i)
+      {
+        NodeId id = m_nodes.size();
+        m_nodes.push_back(Node(id));
+        m_nodes.back().descriptor = clusters[p][i];
+        m_nodes.back().parent = parents[p];
+        m_nodes[parents[p]].children.push_back(id);
+
+        // go on with the next level
+        if(level < m_L && groups[p][i].size() > 1)
+        {
+          next_parents.push_back(id);
+          next_descriptors.push_back(vector<pDescriptor>());
+
+          vector<pDescriptor> &child_features = next_descriptors.back();
+          child_features.reserve(groups[p][i].size());
+
+          vector<unsigned int>::const_iterator vit;
+          for(vit = groups[p][i].begin(); vit != groups[p][i].end(); ++vit)
+          {
+            child_features.push_back(parent_descriptors[p][*vit]);
+          }
+        }
+      }
+    }
+
+    parents.swap(next_parents);
+    parent_descriptors.swap(next_descriptors);
+  }
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor,F>::HKmeansCluster(
+  const vector<pDescriptor> &descriptors, vector<TDescriptor> &clusters,
+  vector<vector<unsigned int> > &groups, NodeId parent_id,
+  bool parallel) const
+{
+  clusters.clear();
+  groups.clear();
 
   clusters.reserve(m_k);
-	groups.reserve(m_k);
-  
-  //const int msizes[] = { m_k, descriptors.size() };
-  //cv::SparseMat assoc(2, msizes, CV_8U);
-  //cv::SparseMat last_assoc(2, msizes, CV_8U);  
-  //// assoc.row(cluster_idx).col(descriptor_idx) = 1 iif associated
-  
+  groups.reserve(m_k);
+
   if((int)descriptors.size() <= m_k)
   {
     // trivial case: one cluster per feature
@@ -656,171 +937,178 @@ void TemplatedVocabulary<TDescriptor,F>::HKmeansStep(NodeId parent_id,
       groups[i].push_back(i);
       clusters.push_back(*descriptors[i]);
     }
+    return;
   }
-  else
-  {
-    // select clusters and groups with kmeans
-    
-    bool first_time = true;
-    bool goon = true;
-    
-    // to check if clusters move after iterations
-    vector<int> last_association, current_association;
 
-    while(goon)
-    {
-      // 1. Calculate clusters
+  // select clusters and groups with kmeans
 
-			if(first_time)
-			{
-        // random sample 
-        initiateClusters(descriptors, clusters);
-      }
-      else
-      {
-        // calculate cluster centres
+  // descriptors associated by one task of the parallel association step
+  const size_t block_size = 4096;
+  const size_t nblocks = (descriptors.size() + block_size - 1) / block_size;
 
-        for(unsigned int c = 0; c < clusters.size(); ++c)
-        {
-          vector<pDescriptor> cluster_descriptors;
-          cluster_descriptors.reserve(groups[c].size());
-          
-          /*
-          for(unsigned int d = 0; d < descriptors.size(); ++d)
-          {
-            if( assoc.find<unsigned char>(c, d) )
-            {
-              cluster_descriptors.push_back(descriptors[d]);
-            }
-          }
-          */
-          
-          vector<unsigned int>::const_iterator vit;
-          for(vit = groups[c].begin(); vit != groups[c].end(); ++vit)
-          {
-            cluster_descriptors.push_back(descriptors[*vit]);
-          }
-          
-          
-          F::meanValue(cluster_descriptors, clusters[c]);
-        }
-        
-      } // if(!first_time)
+  bool first_time = true;
+  bool goon = true;
 
-      // 2. Associate features with clusters
+  // to check if clusters move after iterations
+  vector<int> last_association, current_association;
 
-      // calculate distances to cluster centers
-      groups.clear();
-      groups.resize(clusters.size(), vector<unsigned int>());
-      current_association.resize(descriptors.size());
+  // a generator per node, so that the nodes of a level can be clustered in
+  // any order
+  boost::random::mt19937 rng(m_seed + 2654435761u * parent_id);
 
-      //assoc.clear();
+  while(goon)
+  {
+    // 1. Calculate clusters
 
-      typename vector<pDescriptor>::const_iterator fit;
-      //unsigned int d = 0;
-      for(fit = descriptors.begin(); fit != descriptors.end(); ++fit)//, ++d)
+    if(first_time)
+    {
+      // random sample
+      initiateClusters(descriptors, clusters, rng);
+    }
+    else
+    {
+      // calculate cluster centres
+      for(unsigned int c = 0; c < clusters.size(); ++c)
       {
-        double best_dist = F::distance(*(*fit), clusters[0]);
-        unsigned int icluster = 0;
-        
-        for(unsigned int c = 1; c < clusters.size(); ++c)
+        vector<pDescriptor> cluster_descriptors;
+        cluster_descriptors.reserve(groups[c].size());
+
+        vector<unsigned int>::const_iterator vit;
+        for(vit = groups[c].begin(); vit != groups[c].end(); ++vit)
         {
-          double dist = F::distance(*(*fit), clusters[c]);
-          if(dist < best_dist)
-          {
-            best_dist = dist;
-            icluster = c;
-          }
+          cluster_descriptors.push_back(descriptors[*vit]);
         }
 
-        //assoc.ref<unsigned char>(icluster, d) = 1;
-
-        groups[icluster].push_back(fit - descriptors.begin());
-        current_association[ fit - descriptors.begin() ] = icluster;
+        F::meanValue(cluster_descriptors, clusters[c]);
       }
-      
-      // kmeans++ ensures all the clusters has any feature associated with them
+    }
 
-      // 3. check convergence
-      if(first_time)
-      {
-        first_time = false;
-      }
-      else
-      {
-        //goon = !eqUChar(last_assoc, assoc);
-        
-        goon = false;
-        for(unsigned int i = 0; i < current_association.size(); i++)
-        {
-          if(current_association[i] != last_association[i]){
-            goon = true;
-            break;
-          }
-        }
-      }
+    // 2. Associate features with clusters
+    current_association.resize(descriptors.size());
 
-			if(goon)
-			{
-				// copy last feature-cluster association
-				last_association = current_association;
-				//last_assoc = assoc.clone();
-			}
-			
-		} // while(goon)
-    
-  } // if must run kmeans
-  
-  // create nodes
-  for(unsigned int i = 0; i < clusters.size(); ++i)
-  {
-    NodeId id = m_nodes.size();
-    m_nodes.push_back(Node(id));
-    m_nodes.back().descriptor = clusters[i];
-    m_nodes.back().parent = parent_id;
-    m_nodes[parent_id].children.push_back(id);
-  }
-  
-  // go on with the next level
-  if(current_level < m_L)
-  {
-    // iterate again with the resulting clusters
-    const vector<NodeId> &children_ids = m_nodes[parent_id].children;
-    for(unsigned int i = 0; i < clusters.size(); ++i)
+    if(parallel && nblocks > 1)
     {
-      NodeId id = children_ids[i];
+      parallelFor(nblocks, boost::bind(&TemplatedVocabulary<TDescriptor,F>::associateBlock,
+        this, boost::cref(descriptors), boost::cref(clusters),
+        boost::ref(current_association), block_size, _1));
+    }
+    else
+    {
+      associateClusters(descriptors, clusters, current_association,
+        0, descriptors.size());
+    }
 
-      vector<pDescriptor> child_features;
-      child_features.reserve(groups[i].size());
+    groups.clear();
+    groups.resize(clusters.size(), vector<unsigned int>());
+    for(unsigned int i = 0; i < current_association.size(); ++i)
+    {
+      groups[current_association[i]].push_back(i);
+    }
 
-      vector<unsigned int>::const_iterator vit;
-      for(vit = groups[i].begin(); vit != groups[i].end(); ++vit)
-      {
-        child_features.push_back(descriptors[*vit]);
-      }
+    // kmeans++ ensures all the clusters has any feature associated with them
 
-      if(child_features.size() > 1)
+    // 3. check convergence
+    if(first_time)
+    {
+      first_time = false;
+    }
+    else
+    {
+      goon = (current_association != last_association);
+    }
+
+    if(goon)
+    {
+      // copy last feature-cluster association
+      last_association = current_association;
+    }
+  } // while(goon)
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor,F>::associateClusters(
+  const vector<pDescriptor> &descriptors, const vector<TDescriptor> &clusters,
+  vector<int> &association, size_t begin, size_t end) const
+{
+  for(size_t d = begin; d < end; ++d)
+  {
+    double best_dist = F::distance(*descriptors[d], clusters[0]);
+    int icluster = 0;
+
+    for(unsigned int c = 1; c < clusters.size(); ++c)
+    {
+      double dist = F::distance(*descriptors[d], clusters[c]);
+      if(dist < best_dist)
       {
-        HKmeansStep(id, child_features, current_level + 1);
+        best_dist = dist;
+        icluster = c;
       }
     }
+
+    association[d] = icluster;
   }
 }
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor,F>::HKmeansClusterNode(
+  const vector<vector<pDescriptor> > &descriptors,
+  const vector<NodeId> &parent_ids, vector<vector<TDescriptor> > &clusters,
+  vector<vector<vector<unsigned int> > > &groups, size_t i) const
+{
+  HKmeansCluster(descriptors[i], clusters[i], groups[i], parent_ids[i], false);
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor,F>::associateBlock(
+  const vector<pDescriptor> &descriptors, const vector<TDescriptor> &clusters,
+  vector<int> &association, size_t block_size, size_t i) const
+{
+  associateClusters(descriptors, clusters, association, i * block_size,
+    std::min((i + 1) * block_size, descriptors.size()));
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor,F>::parallelFor(size_t n,
+  const boost::function<void (size_t)> &f)
+{
+  if(n <= 1 || camodocal::TaskScheduler::instance().threadCount() <= 1)
+  {
+    for(size_t i = 0; i < n; ++i) f(i);
+    return;
+  }
+
+  camodocal::TaskGroup tasks;
+  for(size_t i = 0; i < n; ++i)
+  {
+    tasks.run(boost::bind(f, i));
+  }
+  tasks.wait();
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F>
 void TemplatedVocabulary<TDescriptor, F>::initiateClusters
-  (const vector<pDescriptor> &descriptors, vector<TDescriptor> &clusters) const
+  (const vector<pDescriptor> &descriptors, vector<TDescriptor> &clusters,
+  boost::random::mt19937 &rng) const
 {
-  initiateClustersKMpp(descriptors, clusters);  
+  initiateClustersKMpp(descriptors, clusters, rng);  
 }
 
 // --------------------------------------------------------------------------
 
 template<class TDescriptor, class F>
 void TemplatedVocabulary<TDescriptor,F>::initiateClustersKMpp(
-  const vector<pDescriptor> &pfeatures, vector<TDescriptor> &clusters) const
+  const vector<pDescriptor> &pfeatures, vector<TDescriptor> &clusters,
+  boost::random::mt19937 &rng) const
 {
   // Implements kmeans++ seeding algorithm
   // Algorithm:
@@ -833,15 +1121,14 @@ void TemplatedVocabulary<TDescriptor,F>::initiateClustersKMpp(
   // 5. Now that the initial centers have been chosen, proceed using standard k-means 
   //    clustering.
 
-  DUtils::Random::SeedRandOnce();
-
   clusters.resize(0);
   clusters.reserve(m_k);
   vector<double> min_dists(pfeatures.size(), std::numeric_limits<double>::max());
   
   // 1.
   
-  int ifeature = DUtils::Random::RandomInt(0, pfeatures.size()-1);
+  int ifeature = boost::random::uniform_int_distribution<int>(
+    0, pfeatures.size()-1)(rng);
   
   // create first cluster
   clusters.push_back(*pfeatures[ifeature]);
@@ -876,7 +1163,8 @@ void TemplatedVocabulary<TDescriptor,F>::initiateClustersKMpp(
       double cut_d;
       do
       {
-        cut_d = DUtils::Random::RandomValue<double>(0, dist_sum);
+        cut_d = boost::random::uniform_real_distribution<double>(
+          0, dist_sum)(rng);
       } while(cut_d == 0.0);
 
       double d_up_now = 0;
@@ -971,17 +1259,57 @@ void TemplatedVocabulary<TDescriptor,F>::setNodeWeights
       }
     }
 
-    // set ln(N/Ni)
-    for(unsigned int i = 0; i < NWords; i++)
-    {
-      if(Ni[i] > 0)
-      {
-        m_words[i]->weight = log((double)NDocs / (double)Ni[i]);
-      }// else // This cannot occur if using kmeans++
-    }
-  
+    setDocumentFrequencies(Ni, NDocs);
+  }
+
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+template<class TScalar>
+void TemplatedVocabulary<TDescriptor,F>::countDocumentWords(
+  const std::vector<const TScalar*>& features,
+  std::vector<unsigned int> &Ni) const
+{
+  vector<WordId> words;
+  words.reserve(features.size());
+
+  typename vector<const TScalar*>::const_iterator fit;
+  for(fit = features.begin(); fit != features.end(); ++fit)
+  {
+    WordId id;
+    WordValue w;
+    transform(*fit, id, w);
+    words.push_back(id);
   }
 
+  std::sort(words.begin(), words.end());
+  words.erase(std::unique(words.begin(), words.end()), words.end());
+
+  vector<WordId>::const_iterator wit;
+  for(wit = words.begin(); wit != words.end(); ++wit)
+  {
+    Ni[*wit]++;
+  }
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor,F>::setDocumentFrequencies(
+  const std::vector<unsigned int> &Ni, unsigned int NDocs)
+{
+  if(m_weighting != IDF && m_weighting != TF_IDF) return;
+
+  // set ln(N/Ni)
+  for(unsigned int i = 0; i < m_words.size() && i < Ni.size(); i++)
+  {
+    if(Ni[i] > 0)
+    {
+      m_words[i]->weight = log((double)NDocs / (double)Ni[i]);
+    }// else // This cannot occur if using kmeans++
+  }
 }
 
 // --------------------------------------------------------------------------
@@ -1035,6 +1363,57 @@ WordValue TemplatedVocabulary<TDescriptor, F>::getWordWeight(WordId wid) const
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F>
+uint64_t TemplatedVocabulary<TDescriptor, F>::contentHash() const
+{
+  uint64_t hash = 14695981039346656037ULL;
+
+  for(size_t i = 0; i < m_nodes.size(); ++i)
+  {
+    const Node& node = m_nodes[i];
+
+    uint32_t structure[2] = {node.parent, (uint32_t)node.children.size()};
+    hashBlock(hash, structure, sizeof(structure));
+    hashBlock(hash, &node.weight, sizeof(node.weight));
+
+    // the root descriptor is not used, and it is only stored by saveBinary
+    if(i > 0 && !node.descriptor.empty())
+    {
+      hashBlock(hash, &node.descriptor[0],
+        node.descriptor.size() * sizeof(node.descriptor[0]));
+    }
+  }
+
+  return hash;
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor, F>::hashBlock
+  (uint64_t &hash, const void *data, size_t size)
+{
+  const char *bytes = static_cast<const char*>(data);
+
+  size_t i = 0;
+  for(; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+  {
+    uint64_t block;
+    memcpy(&block, bytes + i, sizeof(block));
+
+    hash ^= block;
+    hash *= 1099511628211ULL;
+  }
+
+  for(; i < size; ++i)
+  {
+    hash ^= (unsigned char)bytes[i];
+    hash *= 1099511628211ULL;
+  }
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F>
 WordId TemplatedVocabulary<TDescriptor, F>::transform
   (const TDescriptor& feature) const
@@ -1249,6 +1628,161 @@ void TemplatedVocabulary<TDescriptor,F>::transform(const TDescriptor &feature,
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F>
+template<class TScalar>
+void TemplatedVocabulary<TDescriptor,F>::transform(
+  const std::vector<const TScalar*>& features, BowVector &v) const
+{
+  v.clear();
+
+  if(empty())
+  {
+    return;
+  }
+
+  // normalize
+  LNorm norm;
+  bool must = m_scoring_object->mustNormalize(norm);
+
+  typename vector<const TScalar*>::const_iterator fit;
+
+  if(m_weighting == TF || m_weighting == TF_IDF)
+  {
+    for(fit = features.begin(); fit < features.end(); ++fit)
+    {
+      WordId id;
+      WordValue w;
+      // w is the idf value if TF_IDF, 1 if TF
+
+      transform(*fit, id, w);
+
+      // not stopped
+      if(w > 0) v.addWeight(id, w);
+    }
+
+    if(!v.empty() && !must)
+    {
+      // unnecessary when normalizing
+      const double nd = v.size();
+      for(BowVector::iterator vit = v.begin(); vit != v.end(); vit++)
+        vit->second /= nd;
+    }
+  }
+  else // IDF || BINARY
+  {
+    for(fit = features.begin(); fit < features.end(); ++fit)
+    {
+      WordId id;
+      WordValue w;
+      // w is idf if IDF, or 1 if BINARY
+
+      transform(*fit, id, w);
+
+      // not stopped
+      if(w > 0) v.addIfNotExist(id, w);
+    }
+  } // if m_weighting == ...
+
+  if(must) v.normalize(norm);
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+template<class TScalar>
+void TemplatedVocabulary<TDescriptor,F>::transform(
+  const std::vector<const TScalar*>& features,
+  BowVector &v, FeatureVector &fv, int levelsup) const
+{
+  v.clear();
+  fv.clear();
+
+  if(empty())
+  {
+    return;
+  }
+
+  // normalize
+  LNorm norm;
+  bool must = m_scoring_object->mustNormalize(norm);
+
+  for(unsigned int i_feature = 0; i_feature < features.size(); ++i_feature)
+  {
+    WordId id;
+    NodeId nid;
+    WordValue w;
+    // w is the idf value if TF_IDF, 1 if TF, idf if IDF, or 1 if BINARY
+
+    transform(features[i_feature], id, w, &nid, levelsup);
+
+    if(w > 0) // not stopped
+    {
+      if(m_weighting == TF || m_weighting == TF_IDF)
+        v.addWeight(id, w);
+      else
+        v.addIfNotExist(id, w);
+
+      fv.addFeature(nid, i_feature);
+    }
+  }
+
+  if((m_weighting == TF || m_weighting == TF_IDF) && !v.empty() && !must)
+  {
+    // unnecessary when normalizing
+    const double nd = v.size();
+    for(BowVector::iterator vit = v.begin(); vit != v.end(); vit++)
+      vit->second /= nd;
+  }
+
+  if(must) v.normalize(norm);
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+template<class TScalar>
+void TemplatedVocabulary<TDescriptor,F>::transform(const TScalar *feature,
+  WordId &word_id, WordValue &weight, NodeId *nid, int levelsup) const
+{
+  // same descent as for TDescriptor features, comparing against the node
+  // descriptors in place
+  const int nid_level = m_L - levelsup;
+  if(nid_level <= 0 && nid != NULL) *nid = 0; // root
+
+  NodeId final_id = 0; // root
+  int current_level = 0;
+
+  do
+  {
+    ++current_level;
+    const vector<NodeId> &nodes = m_nodes[final_id].children;
+    final_id = nodes[0];
+
+    double best_d = F::distance(feature, &m_nodes[final_id].descriptor[0]);
+
+    for(size_t i = 1; i < nodes.size(); ++i)
+    {
+      NodeId id = nodes[i];
+      double d = F::distance(feature, &m_nodes[id].descriptor[0]);
+      if(d < best_d)
+      {
+        best_d = d;
+        final_id = id;
+      }
+    }
+
+    if(nid != NULL && current_level == nid_level)
+      *nid = final_id;
+
+  } while( !m_nodes[final_id].isLeaf() );
+
+  // turn node id into word id
+  word_id = m_nodes[final_id].word_id;
+  weight = m_nodes[final_id].weight;
+}
+
+// --------------------------------------------------------------------------
+
 template<class TDescriptor, class F>
 NodeId TemplatedVocabulary<TDescriptor,F>::getParentNode
   (WordId wid, int levelsup) const
@@ -1496,6 +2030,242 @@ void TemplatedVocabulary<TDescriptor,F>::load(const cv::FileStorage &fs,
 
 // --------------------------------------------------------------------------
 
+template<class TDescriptor, class F>
+template<class T>
+void TemplatedVocabulary<TDescriptor,F>::writeBinaryArray
+  (std::ofstream &ofs, const vector<T> &data)
+{
+  size_t bytes = data.size() * sizeof(T);
+  if(bytes > 0) ofs.write(reinterpret_cast<const char*>(&data[0]), bytes);
+
+  static const char padding[8] = {0};
+  if(bytes % 8 != 0) ofs.write(padding, 8 - bytes % 8);
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+template<class T>
+const T* TemplatedVocabulary<TDescriptor,F>::mappedBinaryArray
+  (const char *data, size_t size, size_t &offset, size_t count)
+{
+  size_t bytes = count * sizeof(T);
+  if(offset > size || bytes > size - offset) return NULL;
+
+  const T* array = reinterpret_cast<const T*>(data + offset);
+  offset += (bytes + 7) / 8 * 8;
+  return array;
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor,F>::saveBinary
+  (const std::string &filename) const
+{
+  // Format:
+  // header
+  // parents      [N]     uint32  parent node id (0 for the root)
+  // childOffsets [N + 1] uint32  children of node i are stored in
+  // children     [C]     uint32    [childOffsets[i], childOffsets[i + 1])
+  // wordNodes    [W]     uint32  node id of each word
+  // weights      [N]     double
+  // descriptors  [N * D] scalar  the root descriptor is all zeros
+  //
+  // Arrays are indexed by node id and start at multiples of 8 bytes, so
+  // that they can be read straight from the mapped file. The children of
+  // a node have larger ids than the node.
+  //
+
+  typedef typename TDescriptor::value_type Scalar;
+
+  const size_t N = m_nodes.size();
+  const size_t D = F::L;
+
+  vector<uint32_t> parents(N), childOffsets(N + 1, 0), children;
+  vector<uint32_t> wordNodes(m_words.size());
+  vector<double> weights(N);
+  vector<Scalar> descriptors(N * D, Scalar(0));
+
+  children.reserve(N);
+  for(size_t i = 0; i < N; ++i)
+  {
+    const Node& node = m_nodes[i];
+
+    parents[i] = node.parent;
+    weights[i] = node.weight;
+
+    children.insert(children.end(), node.children.begin(),
+      node.children.end());
+    childOffsets[i + 1] = children.size();
+
+    if(i == 0) continue; // root
+
+    if(node.descriptor.size() != D)
+      throw string("Unexpected descriptor length in vocabulary node");
+
+    std::copy(node.descriptor.begin(), node.descriptor.end(),
+      descriptors.begin() + i * D);
+  }
+
+  for(size_t i = 0; i < m_words.size(); ++i)
+  {
+    wordNodes[i] = m_words[i]->id;
+  }
+
+  std::ofstream ofs(filename.c_str(), std::ios::out | std::ios::binary);
+  if(!ofs.is_open()) throw string("Could not open file ") + filename;
+
+  BinaryHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, binaryMagic(), sizeof(header.magic));
+  header.version = BINARY_VERSION;
+  header.k = m_k;
+  header.L = m_L;
+  header.scoring = m_scoring;
+  header.weighting = m_weighting;
+  header.nodeCount = N;
+  header.wordCount = m_words.size();
+  header.descriptorLength = D;
+  header.scalarSize = sizeof(Scalar);
+
+  ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  static const char padding[8] = {0};
+  if(sizeof(header) % 8 != 0) ofs.write(padding, 8 - sizeof(header) % 8);
+
+  writeBinaryArray(ofs, parents);
+  writeBinaryArray(ofs, childOffsets);
+  writeBinaryArray(ofs, children);
+  writeBinaryArray(ofs, wordNodes);
+  writeBinaryArray(ofs, weights);
+  writeBinaryArray(ofs, descriptors);
+
+  if(!ofs.good()) throw string("Could not write file ") + filename;
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+void TemplatedVocabulary<TDescriptor,F>::loadBinary
+  (const std::string &filename)
+{
+  typedef typename TDescriptor::value_type Scalar;
+
+  using namespace boost::interprocess;
+
+  m_words.clear();
+  m_nodes.clear();
+
+  try
+  {
+    file_mapping file(filename.c_str(), read_only);
+    mapped_region region(file, read_only);
+
+    const char *data = static_cast<const char*>(region.get_address());
+    const size_t size = region.get_size();
+
+    size_t offset = 0;
+    const BinaryHeader *header =
+      mappedBinaryArray<BinaryHeader>(data, size, offset, 1);
+
+    if(header == NULL ||
+      memcmp(header->magic, binaryMagic(), sizeof(header->magic)) != 0 ||
+      header->version != BINARY_VERSION)
+      throw string("Not a binary vocabulary file: ") + filename;
+
+    if(header->descriptorLength != (uint32_t)F::L ||
+      header->scalarSize != sizeof(Scalar))
+      throw string("Incompatible descriptor type in file ") + filename;
+
+    const size_t N = header->nodeCount;
+    const size_t W = header->wordCount;
+    const size_t D = header->descriptorLength;
+
+    if(N == 0) throw string("Corrupt vocabulary file ") + filename;
+
+    const uint32_t *parents =
+      mappedBinaryArray<uint32_t>(data, size, offset, N);
+    const uint32_t *childOffsets =
+      mappedBinaryArray<uint32_t>(data, size, offset, N + 1);
+    const size_t C = childOffsets != NULL ? childOffsets[N] : 0;
+    const uint32_t *children =
+      mappedBinaryArray<uint32_t>(data, size, offset, C);
+    const uint32_t *wordNodes =
+      mappedBinaryArray<uint32_t>(data, size, offset, W);
+    const double *weights =
+      mappedBinaryArray<double>(data, size, offset, N);
+    const Scalar *descriptors =
+      mappedBinaryArray<Scalar>(data, size, offset, N * D);
+
+    if(parents == NULL || childOffsets == NULL || children == NULL ||
+      wordNodes == NULL || weights == NULL || descriptors == NULL)
+      throw string("Truncated vocabulary file ") + filename;
+
+    m_k = header->k;
+    m_L = header->L;
+    m_scoring = (ScoringType)header->scoring;
+    m_weighting = (WeightingType)header->weighting;
+
+    createScoringObject();
+
+    m_nodes.resize(N);
+    for(size_t i = 0; i < N; ++i)
+    {
+      Node& node = m_nodes[i];
+
+      if(parents[i] >= N || childOffsets[i] > childOffsets[i + 1] ||
+        childOffsets[i + 1] > C)
+        throw string("Corrupt vocabulary file ") + filename;
+
+      // descending into larger ids ensures that transform terminates
+      for(size_t j = childOffsets[i]; j < childOffsets[i + 1]; ++j)
+      {
+        if(children[j] <= i || children[j] >= N)
+          throw string("Corrupt vocabulary file ") + filename;
+      }
+
+      node.id = i;
+      node.parent = parents[i];
+      node.weight = weights[i];
+      node.children.assign(children + childOffsets[i],
+        children + childOffsets[i + 1]);
+
+      if(i > 0) // root
+        node.descriptor.assign(descriptors + i * D, descriptors + (i + 1) * D);
+    }
+
+    m_words.resize(W);
+    for(size_t i = 0; i < W; ++i)
+    {
+      if(wordNodes[i] >= N) throw string("Corrupt vocabulary file ") + filename;
+
+      m_nodes[wordNodes[i]].word_id = i;
+      m_words[i] = &m_nodes[wordNodes[i]];
+    }
+  }
+  catch(const interprocess_exception &)
+  {
+    throw string("Could not open file ") + filename;
+  }
+}
+
+// --------------------------------------------------------------------------
+
+template<class TDescriptor, class F>
+bool TemplatedVocabulary<TDescriptor,F>::isBinaryFile
+  (const std::string &filename)
+{
+  std::ifstream ifs(filename.c_str(), std::ios::in | std::ios::binary);
+
+  char magic[8];
+  if(!ifs.read(magic, sizeof(magic))) return false;
+
+  return memcmp(magic, binaryMagic(), sizeof(magic)) == 0;
+}
+
+// --------------------------------------------------------------------------
+
 /**
  * Writes printable information of the vocabulary
  * @param os stream to write to
@@ -0,0 +1,160 @@
+#include <boost/filesystem.hpp>
+#include <boost/random.hpp>
+#include <cstring>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <iterator>
+
+#include "DBoW2.h"
+
+namespace camodocal
+{
+
+namespace
+{
+
+typedef std::vector<std::vector<DBoW2::FSurf64::TDescriptor> > Images;
+
+Images
+createImages(boost::mt19937& rng, int imageCount, int featureCount)
+{
+    boost::uniform_real<float> value(-1.0f, 1.0f);
+
+    Images images(imageCount);
+    for (int i = 0; i < imageCount; ++i)
+    {
+        images.at(i).resize(featureCount);
+        for (int j = 0; j < featureCount; ++j)
+        {
+            DBoW2::FSurf64::TDescriptor& descriptor = images.at(i).at(j);
+
+            descriptor.resize(DBoW2::FSurf64::L);
+            for (int k = 0; k < DBoW2::FSurf64::L; ++k)
+            {
+                descriptor.at(k) = value(rng);
+            }
+        }
+    }
+
+    return images;
+}
+
+std::string
+readFile(const std::string& filename)
+{
+    std::ifstream ifs(filename.c_str(), std::ios::in | std::ios::binary);
+
+    return std::string(std::istreambuf_iterator<char>(ifs),
+                       std::istreambuf_iterator<char>());
+}
+
+void
+writeFile(const std::string& filename, const std::string& data)
+{
+    std::ofstream ofs(filename.c_str(), std::ios::out | std::ios::binary);
+    ofs.write(data.data(), data.size());
+}
+
+template<typename T>
+void
+replaceValue(std::string& data, size_t offset, T value)
+{
+    data.replace(offset, sizeof(value), reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+}
+
+TEST(TemplatedVocabulary, binaryFile)
+{
+    boost::mt19937 rng(3);
+
+    Images trainingImages = createImages(rng, 20, 50);
+    Images images = createImages(rng, 5, 40);
+
+    Surf64Vocabulary voc(5, 3, DBoW2::TF_IDF, DBoW2::L1_NORM);
+    voc.create(trainingImages);
+
+    boost::filesystem::path dir = boost::filesystem::temp_directory_path() /
+                                  boost::filesystem::unique_path();
+    boost::filesystem::create_directories(dir);
+
+    std::string filename = (dir / "voc.bin").string();
+    voc.saveBinary(filename);
+    EXPECT_TRUE(Surf64Vocabulary::isBinaryFile(filename));
+
+    Surf64Vocabulary loaded;
+    loaded.loadBinary(filename);
+
+    EXPECT_EQ(voc.size(), loaded.size());
+    EXPECT_EQ(voc.contentHash(), loaded.contentHash());
+
+    for (size_t i = 0; i < images.size(); ++i)
+    {
+        DBoW2::BowVector bowVector, loadedBowVector;
+        DBoW2::FeatureVector featureVector, loadedFeatureVector;
+        voc.transform(images.at(i), bowVector, featureVector, 1);
+        loaded.transform(images.at(i), loadedBowVector, loadedFeatureVector, 1);
+
+        EXPECT_EQ(bowVector, loadedBowVector);
+        EXPECT_EQ(featureVector, loadedFeatureVector);
+
+        std::vector<const float*> features;
+        for (size_t j = 0; j < images.at(i).size(); ++j)
+        {
+            features.push_back(&images.at(i).at(j)[0]);
+        }
+
+        loaded.transform(features, loadedBowVector, loadedFeatureVector, 1);
+
+        EXPECT_EQ(bowVector, loadedBowVector);
+        EXPECT_EQ(featureVector, loadedFeatureVector);
+    }
+
+    // layout of the header and the first arrays written by saveBinary
+    const std::string data = readFile(filename);
+    const size_t nodeCountOffset = 28;
+    const size_t headerSize = 40;
+
+    uint32_t nodeCount;
+    memcpy(&nodeCount, data.data() + nodeCountOffset, sizeof(nodeCount));
+
+    const size_t childrenOffset = headerSize + (nodeCount * 4 + 7) / 8 * 8
+                                  + ((nodeCount + 1) * 4 + 7) / 8 * 8;
+
+    std::string corruptFilename = (dir / "corrupt.bin").string();
+
+    // truncated files are rejected
+    writeFile(corruptFilename, data.substr(0, data.size() - 1));
+    EXPECT_THROW(loaded.loadBinary(corruptFilename), std::string);
+
+    writeFile(corruptFilename, data.substr(0, headerSize / 2));
+    EXPECT_THROW(loaded.loadBinary(corruptFilename), std::string);
+
+    // node counts that the file cannot hold are rejected
+    std::string corrupt = data;
+    replaceValue<uint32_t>(corrupt, nodeCountOffset, 0xffffffff);
+    writeFile(corruptFilename, corrupt);
+    EXPECT_THROW(loaded.loadBinary(corruptFilename), std::string);
+
+    corrupt = data;
+    replaceValue<uint32_t>(corrupt, nodeCountOffset, 0);
+    writeFile(corruptFilename, corrupt);
+    EXPECT_THROW(loaded.loadBinary(corruptFilename), std::string);
+
+    // child ids beyond the node array or cycles in the tree are rejected
+    corrupt = data;
+    replaceValue<uint32_t>(corrupt, childrenOffset, nodeCount);
+    writeFile(corruptFilename, corrupt);
+    EXPECT_THROW(loaded.loadBinary(corruptFilename), std::string);
+
+    corrupt = data;
+    replaceValue<uint32_t>(corrupt, childrenOffset, 0);
+    writeFile(corruptFilename, corrupt);
+    EXPECT_THROW(loaded.loadBinary(corruptFilename), std::string);
+
+    EXPECT_THROW(loaded.loadBinary((dir / "missing.bin").string()), std::string);
+
+    boost::filesystem::remove_all(dir);
+}
+
+}
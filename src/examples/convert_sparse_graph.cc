@@ -0,0 +1,104 @@
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <iostream>
+
+#include "camodocal/sparse_graph/CompactSparseGraph.h"
+
+int main(int argc, char** argv)
+{
+    std::string inputFilename;
+    std::string outputFilename;
+    std::string format;
+
+    //========= Handling Program options =========
+    boost::program_options::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "produce help message")
+        ("input,i", boost::program_options::value<std::string>(&inputFilename), "Input graph file in either format")
+        ("output,o", boost::program_options::value<std::string>(&outputFilename), "Output graph file")
+        ("format,f", boost::program_options::value<std::string>(&format)->default_value(""), "Output format: binary | columnar (default: the format that the input is not in)")
+        ;
+
+    boost::program_options::positional_options_description pdesc;
+    pdesc.add("input", 1);
+    pdesc.add("output", 1);
+
+    boost::program_options::variables_map vm;
+    boost::program_options::store(boost::program_options::command_line_parser(argc, argv).options(desc).positional(pdesc).run(), vm);
+    boost::program_options::notify(vm);
+
+    if (vm.count("help") || inputFilename.empty() || outputFilename.empty())
+    {
+        std::cout << desc << std::endl;
+        return 1;
+    }
+
+    if (!boost::filesystem::exists(inputFilename))
+    {
+        std::cerr << "# ERROR: Cannot find input file " << inputFilename << "." << std::endl;
+        return 1;
+    }
+
+    // a columnar input is mapped while the output is written
+    if (boost::filesystem::exists(outputFilename) &&
+        boost::filesystem::equivalent(inputFilename, outputFilename))
+    {
+        std::cerr << "# ERROR: Input and output files must differ." << std::endl;
+        return 1;
+    }
+
+    bool inputColumnar = camodocal::CompactSparseGraph::isColumnarFile(inputFilename);
+
+    bool outputColumnar;
+    if (format.empty())
+    {
+        outputColumnar = !inputColumnar;
+    }
+    else if (boost::iequals(format, "columnar"))
+    {
+        outputColumnar = true;
+    }
+    else if (boost::iequals(format, "binary"))
+    {
+        outputColumnar = false;
+    }
+    else
+    {
+        std::cerr << "# ERROR: Unknown output format: " << format << std::endl;
+        return 1;
+    }
+
+    camodocal::CompactSparseGraph graph;
+    if (!graph.readFromFile(inputFilename))
+    {
+        std::cerr << "# ERROR: Cannot read graph file " << inputFilename << "." << std::endl;
+        return 1;
+    }
+
+    std::cout << "# INFO: Read " << graph.frames().size() << " frames, "
+              << graph.featureCount() << " features and "
+              << graph.scenePoints().size() << " scene points." << std::endl;
+
+    if (outputColumnar)
+    {
+        // images stay where they are and are referenced by path
+        if (!graph.writeToColumnarFile(outputFilename))
+        {
+            std::cerr << "# ERROR: Cannot write graph file " << outputFilename << "." << std::endl;
+            return 1;
+        }
+    }
+    else
+    {
+        camodocal::SparseGraph sparseGraph;
+        graph.toSparseGraph(sparseGraph);
+
+        sparseGraph.writeToBinaryFile(outputFilename);
+    }
+
+    std::cout << "# INFO: Wrote " << (outputColumnar ? "columnar" : "binary")
+              << " graph file " << outputFilename << "." << std::endl;
+
+    return 0;
+}
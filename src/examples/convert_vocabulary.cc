@@ -0,0 +1,65 @@
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <iostream>
+
+#include "../dbow2/DBoW2/DBoW2.h"
+
+int main(int argc, char** argv)
+{
+    std::string inputFilename;
+    std::string outputFilename;
+
+    //========= Handling Program options =========
+    boost::program_options::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "produce help message")
+        ("input,i", boost::program_options::value<std::string>(&inputFilename)->default_value("surf64.yml.gz"), "Input SURF64 vocabulary in OpenCV file storage format")
+        ("output,o", boost::program_options::value<std::string>(&outputFilename)->default_value("surf64.voc"), "Output binary vocabulary file")
+        ;
+
+    boost::program_options::positional_options_description pdesc;
+    pdesc.add("input", 1);
+    pdesc.add("output", 1);
+
+    boost::program_options::variables_map vm;
+    boost::program_options::store(boost::program_options::command_line_parser(argc, argv).options(desc).positional(pdesc).run(), vm);
+    boost::program_options::notify(vm);
+
+    if (vm.count("help"))
+    {
+        std::cout << desc << std::endl;
+        return 1;
+    }
+
+    if (!boost::filesystem::exists(inputFilename))
+    {
+        std::cerr << "# ERROR: Cannot find input file " << inputFilename << "." << std::endl;
+        return 1;
+    }
+
+    Surf64Vocabulary voc;
+    try
+    {
+        if (Surf64Vocabulary::isBinaryFile(inputFilename))
+        {
+            voc.loadBinary(inputFilename);
+        }
+        else
+        {
+            voc.load(inputFilename);
+        }
+
+        std::cout << "# INFO: Read " << voc << "." << std::endl;
+
+        voc.saveBinary(outputFilename);
+    }
+    catch (const std::string& error)
+    {
+        std::cerr << "# ERROR: " << error << std::endl;
+        return 1;
+    }
+
+    std::cout << "# INFO: Wrote binary vocabulary file " << outputFilename << "." << std::endl;
+
+    return 0;
+}
@@ -27,6 +27,7 @@ namespace cv {
 #endif // HAVE_CUDA
 
 #include "camodocal/calib/CamRigOdoCalibration.h"
+#include "camodocal/calib/DatasetReader.h"
 #include "camodocal/camera_models/CameraFactory.h"
 
 int
@@ -52,6 +53,10 @@ main(int argc, char** argv)
     float refCameraGroundHeight;
     float keyframeDistance;
     std::string eventFile;
+    int decodeThreads;
+    int prefetchCount;
+    double rectMapTolerance;
+    int rayTableStep;
 
     //================= Handling Program options ==================
     boost::program_options::options_description desc("Allowed options");
@@ -72,6 +77,10 @@ main(int argc, char** argv)
         ("ref-height", boost::program_options::value<float>(&refCameraGroundHeight)->default_value(0), "Height of the reference camera (cam=0) above the ground (cameras extrinsics will be relative to the reference camera)")
         ("keydist", boost::program_options::value<float>(&keyframeDistance)->default_value(0.4), "Distance of rig to be traveled before taking a keyframe (distance is measured by means of odometry poses)")
         ("verbose,v", boost::program_options::bool_switch(&verbose)->default_value(false), "Verbose output")
+        ("decode-threads", boost::program_options::value<int>(&decodeThreads)->default_value(0), "Number of threads that decode input images (0 for one per hardware thread).")
+        ("prefetch", boost::program_options::value<int>(&prefetchCount)->default_value(16), "Number of input images decoded ahead of the calibration.")
+        ("ray-table-step", boost::program_options::value<int>(&rayTableStep)->default_value(0), "Lift image points with a ray lookup table sampled every this many pixels (0 to use the exact camera model).")
+        ("rect-map-tolerance", boost::program_options::value<double>(&rectMapTolerance)->default_value(0.0), "Reuse rectification maps in local matching for rotations within this tolerance in radians (0 to disable).")
         ;
     boost::program_options::variables_map vm;
     boost::program_options::store(boost::program_options::parse_command_line(argc, argv, desc), vm);
@@ -335,6 +344,8 @@ main(int argc, char** argv)
     options.beginStage = beginStage;
     options.dataDir = dataDir;
     options.verbose = verbose;
+    options.rectMapTolerance = rectMapTolerance;
+    options.rayLookupTableStep = rayTableStep;
 
     CamRigOdoCalibration camRigOdoCalib(cameras, options);
 
@@ -342,15 +353,10 @@ main(int argc, char** argv)
 
     std::cout << "# INFO: Initialization finished!" << std::endl;
 
-    std::thread inputThread([&inputImages, &inputOdometry, &camRigOdoCalib, cameraCount, bUseGPS]()
+    std::thread inputThread([&inputImages, &inputOdometry, &camRigOdoCalib, cameraCount, bUseGPS, decodeThreads, prefetchCount]()
     {
         //uint64_t lastTimestamp = std::numeric_limits<uint64_t>::max();
 
-        std::vector<ImageMap::iterator> camIterator(cameraCount);
-        IsometryMap::iterator locIterator = inputOdometry.begin();
-        for (int c=0; c < cameraCount; c++)
-            camIterator[c] = inputImages[c].begin();
-
         auto addLocation = [&camRigOdoCalib, bUseGPS](uint64_t timestamp, const Eigen::Isometry3f& T)
         {
             if (bUseGPS)
@@ -371,42 +377,29 @@ main(int argc, char** argv)
             }
         };
 
-        // ensure that we have
-        // location data available, before adding images
-        for (int i=0; i < 3 && locIterator != inputOdometry.end(); i++, locIterator++)
+        // the reader replays the location data and the images such that
+        // location data is always fresher than camera data, and decodes
+        // the next images while the calibration processes the current ones
+        DatasetReader reader(decodeThreads, prefetchCount);
+        for (int c=0; c < cameraCount; c++)
         {
-            addLocation(locIterator->first, locIterator->second);
+            for (const auto& pair : inputImages[c])
+                reader.addImage(c, pair.first, pair.second);
         }
+        for (const auto& pair : inputOdometry)
+            reader.addPose(pair.first);
 
-        while(locIterator != inputOdometry.end())
+        DatasetReader::Event event;
+        while (!camRigOdoCalib.isRunning() && reader.next(event))
         {
-            if (camRigOdoCalib.isRunning()) break;
-
-            int64_t locTime = locIterator->first;
-            addLocation(locTime, locIterator->second);
-
-            // now add image and location data, but such that
-            // location data is always fresher than camera data
-            bool hasData = true;
-            while(hasData)
+            if (event.cameraId < 0)
             {
-                hasData = false;
-                for (int c=0; c < cameraCount; c++)
-                {
-                    if(camIterator[c] == inputImages[c].end()) continue;
-                    if(camIterator[c]->first < locTime)
-                    {
-                        uint64_t camTime = camIterator[c]->first;
-                        std::cout << "IMG: " << camTime << " -> " << camIterator[c]->second << std::endl;
-                        std::cout << "Pose : " << locIterator->first << std::endl << locIterator->second.linear() << std::endl;
-                        camRigOdoCalib.addFrame(c, cv::imread(camIterator[c]->second), camTime);
-                        camIterator[c]++;
-                        hasData = true;
-                    }
-                }
+                addLocation(event.timestamp, inputOdometry.find(event.timestamp)->second);
+                continue;
             }
 
-            locIterator++;
+            std::cout << "IMG: " << event.timestamp << " -> " << event.filename << std::endl;
+            camRigOdoCalib.addFrame(event.cameraId, event.image, event.timestamp);
         }
 
 #if 0
@@ -483,14 +476,18 @@ main(int argc, char** argv)
     // camRigOdoCalib.addGpsIns(lat, lon, alt, roll, pitch, yaw, timestamp);
     // camRigOdoCalib.addFrame(cameraId, image, timestamp);
     //
+    // The image passed to addFrame is queued without a copy,
+    // so do not write to it after the call.
     // If options.mode == CamRigOdoCalibration::ONLINE,
-    // the addFrame call returns immediately.
+    // the addFrame call returns immediately, and drops an image
+    // if options.frameQueueSize images are already queued.
     // If options.mode == CamRigOdoCalibration::OFFLINE,
-    // the addFrame call returns after the image has been processed.
+    // the addFrame call waits while the queue is full.
     //
     // After you are done, if the minimum number of motions has not been
     // reached, but you want to run the calibration anyway, call:
     // camRigOdoCalib.run();
+    // Images that are still queued at that point are processed first.
     //
     //****************
 
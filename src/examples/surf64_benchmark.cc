@@ -0,0 +1,260 @@
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+#include "../dbow2/DBoW2/DBoW2.h"
+#include "../dbow2/DUtils/DUtils.h"
+
+namespace
+{
+
+// accumulated so that the compiler cannot drop the distance calls
+volatile double g_sink = 0.0;
+
+double
+benchmarkDistance(const std::vector<DBoW2::FSurf64::TDescriptor>& descriptors,
+                  const std::vector<DBoW2::FSurf64::TDescriptor>& centers,
+                  int repeat, std::vector<double>& distances)
+{
+    distances.resize(descriptors.size() * centers.size());
+
+    DUtils::Timestamp start;
+    start.setToCurrentTime();
+
+    for (int r = 0; r < repeat; ++r)
+    {
+        // same access pattern as a vocabulary tree descending one level
+        for (size_t i = 0; i < descriptors.size(); ++i)
+        {
+            for (size_t j = 0; j < centers.size(); ++j)
+            {
+                distances.at(i * centers.size() + j) =
+                    DBoW2::FSurf64::distance(&descriptors.at(i)[0], &centers.at(j)[0]);
+            }
+        }
+        g_sink += distances.back();
+    }
+
+    DUtils::Timestamp end;
+    end.setToCurrentTime();
+
+    return end - start;
+}
+
+double
+benchmarkMean(const std::vector<DBoW2::FSurf64::TDescriptor>& descriptors,
+              int repeat, DBoW2::FSurf64::TDescriptor& mean)
+{
+    std::vector<DBoW2::FSurf64::pDescriptor> pointers;
+    pointers.reserve(descriptors.size());
+    for (size_t i = 0; i < descriptors.size(); ++i)
+    {
+        pointers.push_back(&descriptors.at(i));
+    }
+
+    DUtils::Timestamp start;
+    start.setToCurrentTime();
+
+    for (int r = 0; r < repeat; ++r)
+    {
+        DBoW2::FSurf64::meanValue(pointers, mean);
+        g_sink += mean.front();
+    }
+
+    DUtils::Timestamp end;
+    end.setToCurrentTime();
+
+    return end - start;
+}
+
+double
+benchmarkTransform(const Surf64Vocabulary& voc,
+                   const std::vector<DBoW2::FSurf64::TDescriptor>& descriptors,
+                   int repeat, DBoW2::BowVector& bowVector)
+{
+    DUtils::Timestamp start;
+    start.setToCurrentTime();
+
+    for (int r = 0; r < repeat; ++r)
+    {
+        voc.transform(descriptors, bowVector);
+        g_sink += bowVector.size();
+    }
+
+    DUtils::Timestamp end;
+    end.setToCurrentTime();
+
+    return end - start;
+}
+
+}
+
+int
+main(int argc, char** argv)
+{
+    size_t descriptorCount;
+    size_t centerCount;
+    int repeat;
+    std::string vocabularyFilename;
+
+    //========= Handling Program options =========
+    boost::program_options::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "produce help message")
+        ("descriptors,n", boost::program_options::value<size_t>(&descriptorCount)->default_value(20000), "Number of random descriptors")
+        ("centers,k", boost::program_options::value<size_t>(&centerCount)->default_value(10), "Number of cluster centers that each descriptor is compared with")
+        ("repeat,r", boost::program_options::value<int>(&repeat)->default_value(20), "Number of repetitions")
+        ("vocabulary,v", boost::program_options::value<std::string>(&vocabularyFilename)->default_value(""), "Optional vocabulary to also time transform() with")
+        ;
+
+    boost::program_options::variables_map vm;
+    boost::program_options::store(boost::program_options::parse_command_line(argc, argv, desc), vm);
+    boost::program_options::notify(vm);
+
+    if (vm.count("help") || descriptorCount == 0 || centerCount == 0 || repeat <= 0)
+    {
+        std::cout << desc << std::endl;
+        return 1;
+    }
+
+    Surf64Vocabulary voc;
+    if (!vocabularyFilename.empty())
+    {
+        if (!boost::filesystem::exists(vocabularyFilename))
+        {
+            std::cerr << "# ERROR: Cannot find vocabulary " << vocabularyFilename << "." << std::endl;
+            return 1;
+        }
+
+        try
+        {
+            if (Surf64Vocabulary::isBinaryFile(vocabularyFilename))
+            {
+                voc.loadBinary(vocabularyFilename);
+            }
+            else
+            {
+                voc.load(vocabularyFilename);
+            }
+        }
+        catch (const std::string& error)
+        {
+            std::cerr << "# ERROR: " << error << std::endl;
+            return 1;
+        }
+    }
+
+    boost::random::mt19937 rng(0);
+    boost::random::uniform_real_distribution<float> dist(-0.25f, 0.25f);
+
+    std::vector<DBoW2::FSurf64::TDescriptor> descriptors(descriptorCount);
+    std::vector<DBoW2::FSurf64::TDescriptor> centers(centerCount);
+    for (size_t i = 0; i < descriptors.size(); ++i)
+    {
+        descriptors.at(i).resize(DBoW2::FSurf64::L);
+        for (int j = 0; j < DBoW2::FSurf64::L; ++j)
+        {
+            descriptors.at(i).at(j) = dist(rng);
+        }
+    }
+    for (size_t i = 0; i < centers.size(); ++i)
+    {
+        centers.at(i) = descriptors.at(i % descriptors.size());
+        for (int j = 0; j < DBoW2::FSurf64::L; ++j)
+        {
+            centers.at(i).at(j) += dist(rng);
+        }
+    }
+
+    const DBoW2::FSurf64::Kernel kernels[] = {DBoW2::FSurf64::SCALAR,
+                                              DBoW2::FSurf64::SSE2,
+                                              DBoW2::FSurf64::AVX};
+    const DBoW2::FSurf64::Kernel defaultKernel = DBoW2::FSurf64::kernel();
+
+    std::cout << "# INFO: Default kernel: "
+              << DBoW2::FSurf64::kernelName(defaultKernel) << std::endl;
+
+    // results of the scalar kernel that the others are checked against
+    std::vector<double> refDistances;
+    DBoW2::FSurf64::TDescriptor refMean;
+    DBoW2::BowVector refBowVector;
+    double refDistanceTime = 0.0;
+    double refMeanTime = 0.0;
+    double refTransformTime = 0.0;
+
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); ++k)
+    {
+        const char* name = DBoW2::FSurf64::kernelName(kernels[k]);
+        if (!DBoW2::FSurf64::setKernel(kernels[k]))
+        {
+            std::cout << "# INFO: " << name << " kernel is not supported." << std::endl;
+            continue;
+        }
+
+        std::vector<double> distances;
+        double distanceTime = benchmarkDistance(descriptors, centers, repeat, distances);
+
+        DBoW2::FSurf64::TDescriptor mean;
+        double meanTime = benchmarkMean(descriptors, repeat, mean);
+
+        DBoW2::BowVector bowVector;
+        double transformTime = 0.0;
+        if (!voc.empty())
+        {
+            transformTime = benchmarkTransform(voc, descriptors, repeat, bowVector);
+        }
+
+        if (kernels[k] == DBoW2::FSurf64::SCALAR)
+        {
+            refDistances = distances;
+            refMean = mean;
+            refBowVector = bowVector;
+            refDistanceTime = distanceTime;
+            refMeanTime = meanTime;
+            refTransformTime = transformTime;
+        }
+
+        double maxDistanceError = 0.0;
+        for (size_t i = 0; i < distances.size(); ++i)
+        {
+            maxDistanceError = std::max(maxDistanceError,
+                                        std::fabs(distances.at(i) - refDistances.at(i)) / refDistances.at(i));
+        }
+
+        const double distanceCount = static_cast<double>(repeat) * distances.size();
+
+        std::cout << std::fixed << std::setprecision(2)
+                  << "# INFO: " << name << ": distance "
+                  << distanceTime / distanceCount * 1e9 << " ns ("
+                  << refDistanceTime / distanceTime << "x), mean "
+                  << meanTime / (static_cast<double>(repeat) * descriptors.size()) * 1e9
+                  << " ns per descriptor (" << refMeanTime / meanTime << "x)";
+        if (!voc.empty())
+        {
+            std::cout << ", transform "
+                      << transformTime / (static_cast<double>(repeat) * descriptors.size()) * 1e6
+                      << " us per descriptor (" << refTransformTime / transformTime << "x)";
+        }
+        std::cout << std::endl;
+
+        std::cout << std::scientific << std::setprecision(2)
+                  << "# INFO: " << name << ": max. relative distance error "
+                  << maxDistanceError << ", mean "
+                  << (mean == refMean ? "identical" : "differs")
+                  << " to scalar";
+        if (!voc.empty())
+        {
+            std::cout << ", BoW vector "
+                      << (bowVector == refBowVector ? "identical" : "differs");
+        }
+        std::cout << "." << std::endl;
+    }
+
+    DBoW2::FSurf64::setKernel(defaultKernel);
+
+    return 0;
+}
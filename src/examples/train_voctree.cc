@@ -1,22 +1,250 @@
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <iostream>
+
+#include "camodocal/sparse_graph/CompactSparseGraph.h"
 #include "../dbow2/DBoW2/DBoW2.h"
 #include "../dbow2/DUtils/DUtils.h"
 #include "../dbow2/DUtilsCV/DUtilsCV.h"
 #include "../dbow2/DVision/DVision.h"
 
+namespace
+{
+
+// Uniform sample of a stream of descriptors (reservoir sampling). Each
+// sampled descriptor remembers the frame it came from, since the frames
+// are the documents that the tree is created from.
+class DescriptorReservoir
+{
+public:
+    DescriptorReservoir(size_t capacity, unsigned int seed)
+     : m_capacity(capacity)
+     , m_seen(0)
+     , m_rng(seed)
+    {
+        m_descriptors.reserve(capacity);
+        m_documentIds.reserve(capacity);
+    }
+
+    void add(const float* descriptor, int documentId)
+    {
+        ++m_seen;
+
+        size_t slot;
+        if (m_descriptors.size() < m_capacity)
+        {
+            slot = m_descriptors.size();
+            m_descriptors.push_back(std::vector<float>());
+            m_documentIds.push_back(documentId);
+        }
+        else
+        {
+            boost::random::uniform_int_distribution<uint64_t> dist(0, m_seen - 1);
+            slot = dist(m_rng);
+            if (slot >= m_capacity)
+            {
+                return;
+            }
+            m_documentIds.at(slot) = documentId;
+        }
+
+        m_descriptors.at(slot).assign(descriptor, descriptor + DBoW2::FSurf64::L);
+    }
+
+    uint64_t seen(void) const
+    {
+        return m_seen;
+    }
+
+    // groups the sampled descriptors by document; documents without any
+    // sampled descriptor are dropped
+    void documents(std::vector<std::vector<std::vector<float> > >& documents) const
+    {
+        std::map<int, size_t> documentIndices;
+        for (size_t i = 0; i < m_descriptors.size(); ++i)
+        {
+            std::map<int, size_t>::iterator it = documentIndices.find(m_documentIds.at(i));
+            if (it == documentIndices.end())
+            {
+                it = documentIndices.insert(std::make_pair(m_documentIds.at(i), documents.size())).first;
+                documents.push_back(std::vector<std::vector<float> >());
+            }
+
+            documents.at(it->second).push_back(m_descriptors.at(i));
+        }
+    }
+
+private:
+    size_t m_capacity;
+    uint64_t m_seen;
+    boost::random::mt19937 m_rng;
+
+    std::vector<std::vector<float> > m_descriptors;
+    std::vector<int> m_documentIds;
+};
+
+bool
+readGraph(const std::string& filename, camodocal::CompactSparseGraph& graph)
+{
+    if (!graph.readFromFile(filename))
+    {
+        std::cerr << "# ERROR: Cannot read graph file " << filename << "." << std::endl;
+        return false;
+    }
+
+    for (size_t j = 0; j < graph.frames().size(); ++j)
+    {
+        const cv::Mat& descriptors = graph.frames().at(j).descriptors;
+        if (!descriptors.empty() &&
+            (descriptors.type() != CV_32F || descriptors.cols != DBoW2::FSurf64::L))
+        {
+            std::cerr << "# ERROR: " << filename
+                      << " does not contain SURF64 descriptors." << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+}
+
 int
 main(int argc, char** argv)
 {
+    std::vector<std::string> inputFilenames;
+    std::string outputFilename;
+    int k;
+    int L;
+    size_t maxDescriptors;
+    unsigned int seed;
+
+    //========= Handling Program options =========
+    boost::program_options::options_description desc("Allowed options");
+    desc.add_options()
+        ("help", "produce help message")
+        ("input,i", boost::program_options::value<std::vector<std::string> >(&inputFilenames), "Graph files to read SURF descriptors from")
+        ("output,o", boost::program_options::value<std::string>(&outputFilename)->default_value("surf64.voc"), "Output vocabulary; written in the binary format if the extension is .voc, else with cv::FileStorage")
+        ("k", boost::program_options::value<int>(&k)->default_value(10), "Branching factor")
+        ("L", boost::program_options::value<int>(&L)->default_value(5), "Depth levels")
+        ("max-descriptors", boost::program_options::value<size_t>(&maxDescriptors)->default_value(2000000), "Number of descriptors sampled for training")
+        ("seed", boost::program_options::value<unsigned int>(&seed)->default_value(0), "Seed of the descriptor sampling and of the clustering")
+        ;
+
+    boost::program_options::positional_options_description pdesc;
+    pdesc.add("input", -1);
+
+    boost::program_options::variables_map vm;
+    boost::program_options::store(boost::program_options::command_line_parser(argc, argv).options(desc).positional(pdesc).run(), vm);
+    boost::program_options::notify(vm);
+
+    if (vm.count("help") || inputFilenames.empty())
+    {
+        std::cout << desc << std::endl;
+        return 1;
+    }
+
+    // the graphs are read one at a time so that only the sample is kept
+    // in memory
+    DescriptorReservoir reservoir(maxDescriptors, seed);
+    int documentId = 0;
+
+    for (size_t i = 0; i < inputFilenames.size(); ++i)
+    {
+        camodocal::CompactSparseGraph graph;
+        if (!readGraph(inputFilenames.at(i), graph))
+        {
+            return 1;
+        }
+
+        for (size_t j = 0; j < graph.frames().size(); ++j, ++documentId)
+        {
+            const cv::Mat& descriptors = graph.frames().at(j).descriptors;
+            for (int r = 0; r < descriptors.rows; ++r)
+            {
+                reservoir.add(descriptors.ptr<float>(r), documentId);
+            }
+        }
+
+        std::cout << "# INFO: Read " << inputFilenames.at(i) << "; "
+                  << reservoir.seen() << " descriptors so far." << std::endl;
+    }
+
     std::vector<std::vector<std::vector<float> > > features;
+    reservoir.documents(features);
+
+    std::cout << "# INFO: Training vocabulary with k = " << k << ", L = " << L
+              << " on " << std::min<uint64_t>(reservoir.seen(), maxDescriptors)
+              << " descriptors from " << features.size() << " frames..." << std::endl;
 
-    const int k = 10;
-    const int L = 5;
     const DBoW2::WeightingType weight = DBoW2::TF_IDF;
     const DBoW2::ScoringType score = DBoW2::L2_NORM;
 
     Surf64Vocabulary voc(k, L, weight, score);
+    voc.setRandomSeed(seed);
     voc.create(features);
+    features.clear();
+
+    // create() weights the words by the sampled frames only; the idf is
+    // counted again over all the frames
+    std::vector<unsigned int> documentFrequencies(voc.size(), 0);
+    unsigned int documentCount = 0;
+
+    for (size_t i = 0; i < inputFilenames.size(); ++i)
+    {
+        camodocal::CompactSparseGraph graph;
+        if (!readGraph(inputFilenames.at(i), graph))
+        {
+            return 1;
+        }
+
+        for (size_t j = 0; j < graph.frames().size(); ++j)
+        {
+            const cv::Mat& descriptors = graph.frames().at(j).descriptors;
+            if (descriptors.empty())
+            {
+                continue;
+            }
+
+            std::vector<const float*> document(descriptors.rows);
+            for (int r = 0; r < descriptors.rows; ++r)
+            {
+                document.at(r) = descriptors.ptr<float>(r);
+            }
+
+            voc.countDocumentWords(document, documentFrequencies);
+            ++documentCount;
+        }
+    }
+
+    voc.setDocumentFrequencies(documentFrequencies, documentCount);
+
+    std::cout << "# INFO: Computed word weights over " << documentCount
+              << " frames." << std::endl;
+
+    std::cout << "# INFO: " << voc << std::endl;
+
+    try
+    {
+        if (boost::iends_with(outputFilename, ".voc"))
+        {
+            voc.saveBinary(outputFilename);
+        }
+        else
+        {
+            voc.save(outputFilename);
+        }
+    }
+    catch (const std::string& error)
+    {
+        std::cerr << "# ERROR: " << error << std::endl;
+        return 1;
+    }
 
-    voc.save("vocabulary.voc");
+    std::cout << "# INFO: Wrote vocabulary " << outputFilename << "." << std::endl;
 
     return 0;
 }
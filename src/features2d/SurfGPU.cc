@@ -1,12 +1,30 @@
 #include "SurfGPU.h"
 
+#include <boost/thread/tss.hpp>
+#include <boost/tuple/tuple.hpp>
+#include <boost/tuple/tuple_comparison.hpp>
 #include <iostream>
+#include <map>
 
 namespace camodocal
 {
 
-cv::Ptr<SurfGPU> SurfGPU::m_instance;
-boost::mutex SurfGPU::m_instanceMutex;
+namespace
+{
+
+// hessianThreshold, nOctaves, nOctaveLayers, extended, keypointsRatio
+typedef boost::tuple<double, int, int, bool, float> SurfParameters;
+typedef std::map<SurfParameters, cv::Ptr<SurfGPU> > SurfInstanceMap;
+
+#ifdef HAVE_CUDA
+// the GPU is shared by all threads
+boost::mutex s_instanceMutex;
+SurfInstanceMap s_instances;
+#else
+boost::thread_specific_ptr<SurfInstanceMap> s_threadInstances;
+#endif
+
+}
 
 SurfGPU::SurfGPU(double hessianThreshold, int nOctaves,
                  int nOctaveLayers, bool extended,
@@ -55,21 +73,36 @@ SurfGPU::instance(double hessianThreshold, int nOctaves,
                   int nOctaveLayers, bool extended,
                   float keypointsRatio)
 {
-    boost::lock_guard<boost::mutex> lock(m_instanceMutex);
+    SurfParameters parameters(hessianThreshold, nOctaves, nOctaveLayers,
+                              extended, keypointsRatio);
+
+#ifdef HAVE_CUDA
+    boost::lock_guard<boost::mutex> lock(s_instanceMutex);
+
+    SurfInstanceMap& instances = s_instances;
+#else
+    if (s_threadInstances.get() == 0)
+    {
+        s_threadInstances.reset(new SurfInstanceMap);
+    }
+
+    SurfInstanceMap& instances = *s_threadInstances;
+#endif
 
-    if (m_instance.empty())
+    cv::Ptr<SurfGPU>& instance = instances[parameters];
+    if (instance.empty())
     {
-        m_instance = cv::Ptr<SurfGPU>(new SurfGPU(hessianThreshold, nOctaves, nOctaveLayers, extended, keypointsRatio));
+        instance = cv::Ptr<SurfGPU>(new SurfGPU(hessianThreshold, nOctaves, nOctaveLayers, extended, keypointsRatio));
     }
 
-    return m_instance;
+    return instance;
 }
 
 void
 SurfGPU::detect(const cv::Mat& image, std::vector<cv::KeyPoint>& keypoints,
                 const cv::Mat& mask)
 {
-    boost::lock_guard<boost::mutex> lock(m_instanceMutex);
+    boost::lock_guard<boost::mutex> lock(m_mutex);
 #ifdef HAVE_CUDA
     // CUDA, Both OpenCV2 and OpenCV3?
     MatType imageGPU(image);
@@ -106,7 +139,7 @@ SurfGPU::compute(const cv::Mat& image,
                  std::vector<cv::KeyPoint>& keypoints,
                  cv::Mat& descriptors)
 {
-    boost::lock_guard<boost::mutex> lock(m_instanceMutex);
+    boost::lock_guard<boost::mutex> lock(m_mutex);
 
 #ifdef HAVE_CUDA
 
@@ -151,7 +184,7 @@ SurfGPU::knnMatch(const cv::Mat& queryDescriptors,
                   const cv::Mat& mask,
                   bool compactResult)
 {
-    boost::lock_guard<boost::mutex> lock(m_instanceMutex);
+    boost::lock_guard<boost::mutex> lock(m_mutex);
 
     if (queryDescriptors.empty() || trainDescriptors.empty())
     {
@@ -184,7 +217,7 @@ SurfGPU::radiusMatch(const cv::Mat& queryDescriptors,
                      const cv::Mat& mask,
                      bool compactResult)
 {
-    boost::lock_guard<boost::mutex> lock(m_instanceMutex);
+    boost::lock_guard<boost::mutex> lock(m_mutex);
 
     if (queryDescriptors.empty() || trainDescriptors.empty())
     {
@@ -218,7 +251,7 @@ SurfGPU::match(const cv::Mat& image1, std::vector<cv::KeyPoint>& keypoints1,
                bool useProvidedKeypoints,
                float maxDistanceRatio)
 {
-    boost::lock_guard<boost::mutex> lock(m_instanceMutex);
+    boost::lock_guard<boost::mutex> lock(m_mutex);
 
     MatType imageGPU[2];
     MatType maskGPU[2];
@@ -107,6 +107,11 @@ public:
 
     ~SurfGPU();
 
+    // Returns a shared engine for the given parameters. Without CUDA, each
+    // thread gets its own engines so that threads extract and match
+    // features concurrently; with CUDA, all threads share one engine per
+    // parameter set. Engines are safe to use from several threads, but
+    // calls on the same engine are serialized.
     static cv::Ptr<SurfGPU> instance(double hessianThreshold, int nOctaves=4,
                                      int nOctaveLayers=2, bool extended=false,
                                      float keypointsRatio=0.01f);
@@ -133,8 +138,7 @@ public:
                float maxDistanceRatio = 0.7f);
 
 private:
-    static cv::Ptr<SurfGPU> m_instance;
-    static boost::mutex m_instanceMutex;
+    boost::mutex m_mutex;
 
     cv::Ptr<SURFType>    m_surfGPU;
     cv::Ptr<MatcherType> m_matcher;
@@ -0,0 +1,282 @@
+#include "TaskScheduler.h"
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+
+namespace camodocal
+{
+
+TaskScheduler::TaskScheduler(int threadCount)
+ : m_queuedTaskCount(0)
+ , m_nextWorker(0)
+ , m_stop(false)
+{
+    if (threadCount <= 0)
+    {
+        threadCount = std::max(1u, boost::thread::hardware_concurrency());
+    }
+
+    for (int i = 0; i < threadCount; ++i)
+    {
+        m_workers.push_back(boost::make_shared<Worker>());
+    }
+
+    for (int i = 0; i < threadCount; ++i)
+    {
+        m_threads.create_thread(boost::bind(&TaskScheduler::workerFunction, this, i));
+    }
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+
+        m_stop = true;
+    }
+
+    m_taskCond.notify_all();
+    m_threads.join_all();
+}
+
+TaskScheduler&
+TaskScheduler::instance(void)
+{
+    static TaskScheduler scheduler;
+
+    return scheduler;
+}
+
+int
+TaskScheduler::threadCount(void) const
+{
+    return m_workers.size();
+}
+
+void
+TaskScheduler::submit(const Task& task)
+{
+    size_t workerId;
+    if (m_workerId.get() != 0)
+    {
+        workerId = *m_workerId;
+    }
+    else
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+
+        workerId = m_nextWorker;
+        m_nextWorker = (m_nextWorker + 1) % m_workers.size();
+    }
+
+    // count the task before publishing it, since a worker may steal and
+    // uncount it as soon as it is in the deque
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+
+        ++m_queuedTaskCount;
+    }
+
+    {
+        Worker& worker = *m_workers.at(workerId);
+
+        boost::lock_guard<boost::mutex> lock(worker.mutex);
+
+        worker.tasks.push_back(task);
+    }
+
+    m_taskCond.notify_one();
+}
+
+bool
+TaskScheduler::runPendingTask(void)
+{
+    Task task;
+    if (!popTask(m_workerId.get() != 0 ? *m_workerId : 0, task))
+    {
+        return false;
+    }
+
+    task();
+
+    return true;
+}
+
+void
+TaskScheduler::workerFunction(int workerId)
+{
+    m_workerId.reset(new int(workerId));
+
+    while (true)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(m_mutex);
+
+            while (!m_stop && m_queuedTaskCount == 0)
+            {
+                m_taskCond.wait(lock);
+            }
+
+            if (m_stop)
+            {
+                break;
+            }
+        }
+
+        Task task;
+        if (popTask(workerId, task))
+        {
+            task();
+        }
+    }
+}
+
+bool
+TaskScheduler::popTask(int workerId, Task& task)
+{
+    bool found = false;
+
+    // own deque first, newest task
+    {
+        Worker& worker = *m_workers.at(workerId);
+
+        boost::lock_guard<boost::mutex> lock(worker.mutex);
+
+        if (!worker.tasks.empty())
+        {
+            task = worker.tasks.back();
+            worker.tasks.pop_back();
+            found = true;
+        }
+    }
+
+    // steal oldest task from the other workers
+    for (size_t i = 1; !found && i < m_workers.size(); ++i)
+    {
+        Worker& victim = *m_workers.at((workerId + i) % m_workers.size());
+
+        boost::lock_guard<boost::mutex> lock(victim.mutex);
+
+        if (!victim.tasks.empty())
+        {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            found = true;
+        }
+    }
+
+    if (found)
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+
+        --m_queuedTaskCount;
+    }
+
+    return found;
+}
+
+TaskGroup::TaskGroup(TaskScheduler& scheduler)
+ : m_scheduler(scheduler)
+ , m_pendingTaskCount(0)
+{
+
+}
+
+TaskGroup::~TaskGroup()
+{
+    // a destructor must not throw, so an exception that nobody waited for
+    // is dropped
+    waitForTasks();
+}
+
+void
+TaskGroup::run(const TaskScheduler::Task& task)
+{
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+
+        ++m_pendingTaskCount;
+    }
+
+    m_scheduler.submit(boost::bind(&TaskGroup::execute, this, task));
+}
+
+void
+TaskGroup::wait(void)
+{
+    waitForTasks();
+
+    boost::exception_ptr exception;
+    {
+        boost::lock_guard<boost::mutex> lock(m_mutex);
+
+        exception = m_exception;
+        m_exception = boost::exception_ptr();
+    }
+
+    if (exception)
+    {
+        boost::rethrow_exception(exception);
+    }
+}
+
+void
+TaskGroup::waitForTasks(void)
+{
+    while (true)
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(m_mutex);
+
+            if (m_pendingTaskCount == 0)
+            {
+                return;
+            }
+        }
+
+        // help out instead of blocking a thread that may be a worker itself
+        if (m_scheduler.runPendingTask())
+        {
+            continue;
+        }
+
+        boost::unique_lock<boost::mutex> lock(m_mutex);
+
+        if (m_pendingTaskCount != 0)
+        {
+            m_doneCond.timed_wait(lock, boost::posix_time::milliseconds(1));
+        }
+    }
+}
+
+void
+TaskGroup::execute(const TaskScheduler::Task& task)
+{
+    boost::exception_ptr exception;
+    try
+    {
+        task();
+    }
+    catch (...)
+    {
+        // the task may run on any thread, so hand the exception to wait()
+        // instead of letting it end the worker
+        exception = boost::current_exception();
+    }
+
+    // notify under the lock since the group may be destroyed as soon as
+    // a waiter observes that no tasks are pending
+    boost::lock_guard<boost::mutex> lock(m_mutex);
+
+    if (exception && !m_exception)
+    {
+        m_exception = exception;
+    }
+
+    --m_pendingTaskCount;
+    m_doneCond.notify_all();
+}
+
+}
@@ -0,0 +1,111 @@
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+#include <deque>
+#include <vector>
+
+#include <boost/exception_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/tss.hpp>
+
+namespace camodocal
+{
+
+class TaskGroup;
+
+/**
+ * A fixed-size pool of worker threads with one task deque per worker.
+ * A worker pops its own tasks in LIFO order and steals the oldest task
+ * from another worker when its own deque is empty. Tasks submitted from
+ * a worker thread go to that worker's deque, which keeps nested work
+ * local; tasks submitted from other threads are distributed round-robin.
+ */
+class TaskScheduler : private boost::noncopyable
+{
+public:
+    typedef boost::function<void()> Task;
+
+    /**
+     * @param threadCount number of worker threads; 0 means one per hardware thread
+     */
+    explicit TaskScheduler(int threadCount = 0);
+    ~TaskScheduler();
+
+    /**
+     * Process-wide scheduler sized to the hardware concurrency.
+     */
+    static TaskScheduler& instance(void);
+
+    int threadCount(void) const;
+
+    void submit(const Task& task);
+
+    /**
+     * Runs one queued task on the calling thread.
+     * @return false if no task was queued
+     */
+    bool runPendingTask(void);
+
+private:
+    struct Worker
+    {
+        boost::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void workerFunction(int workerId);
+    bool popTask(int workerId, Task& task);
+
+    std::vector<boost::shared_ptr<Worker> > m_workers;
+    boost::thread_group m_threads;
+
+    boost::mutex m_mutex;
+    boost::condition_variable m_taskCond;
+    size_t m_queuedTaskCount;
+    size_t m_nextWorker;
+    bool m_stop;
+
+    boost::thread_specific_ptr<int> m_workerId;
+};
+
+/**
+ * Tracks a set of tasks submitted to a TaskScheduler so that the caller
+ * can wait for all of them. While waiting, the calling thread executes
+ * queued tasks itself, so groups may be nested inside scheduler tasks
+ * without starving the pool. The first exception thrown by a task is
+ * rethrown from wait().
+ */
+class TaskGroup : private boost::noncopyable
+{
+public:
+    explicit TaskGroup(TaskScheduler& scheduler = TaskScheduler::instance());
+    ~TaskGroup();
+
+    void run(const TaskScheduler::Task& task);
+
+    /**
+     * Waits until all tasks have finished, then rethrows the first
+     * exception that a task threw, if any.
+     */
+    void wait(void);
+
+private:
+    void waitForTasks(void);
+    void execute(const TaskScheduler::Task& task);
+
+    TaskScheduler& m_scheduler;
+
+    boost::mutex m_mutex;
+    boost::condition_variable m_doneCond;
+    size_t m_pendingTaskCount;
+    boost::exception_ptr m_exception;
+};
+
+}
+
+#endif
@@ -0,0 +1,141 @@
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <gtest/gtest.h>
+#include <stdexcept>
+
+#include "TaskScheduler.h"
+
+namespace camodocal
+{
+
+namespace
+{
+
+void
+increment(boost::atomic<int>* count)
+{
+    count->fetch_add(1);
+}
+
+void
+throwError(void)
+{
+    throw std::runtime_error("task failed");
+}
+
+void
+runNested(TaskScheduler* scheduler, int depth, boost::atomic<int>* count)
+{
+    count->fetch_add(1);
+
+    if (depth == 0)
+    {
+        return;
+    }
+
+    // waits inside a scheduler task, so the pool only makes progress if
+    // the waiting worker runs queued tasks itself
+    TaskGroup group(*scheduler);
+    for (int i = 0; i < 2; ++i)
+    {
+        group.run(boost::bind(&runNested, scheduler, depth - 1, count));
+    }
+    group.wait();
+}
+
+}
+
+TEST(TaskScheduler, runAndWait)
+{
+    TaskScheduler scheduler(4);
+    EXPECT_EQ(4, scheduler.threadCount());
+
+    boost::atomic<int> count(0);
+
+    TaskGroup group(scheduler);
+    for (int i = 0; i < 1000; ++i)
+    {
+        group.run(boost::bind(&increment, &count));
+    }
+    group.wait();
+
+    EXPECT_EQ(1000, count.load());
+
+    // a group can be reused after waiting
+    group.run(boost::bind(&increment, &count));
+    group.wait();
+
+    EXPECT_EQ(1001, count.load());
+}
+
+TEST(TaskScheduler, destructorWaits)
+{
+    TaskScheduler scheduler(2);
+
+    boost::atomic<int> count(0);
+    {
+        TaskGroup group(scheduler);
+        for (int i = 0; i < 100; ++i)
+        {
+            group.run(boost::bind(&increment, &count));
+        }
+    }
+
+    EXPECT_EQ(100, count.load());
+}
+
+TEST(TaskScheduler, exceptionPropagation)
+{
+    TaskScheduler scheduler(2);
+
+    boost::atomic<int> count(0);
+
+    TaskGroup group(scheduler);
+    for (int i = 0; i < 50; ++i)
+    {
+        group.run(boost::bind(&increment, &count));
+    }
+    group.run(&throwError);
+    for (int i = 0; i < 50; ++i)
+    {
+        group.run(boost::bind(&increment, &count));
+    }
+
+    EXPECT_THROW(group.wait(), std::runtime_error);
+
+    // the other tasks still ran, and the workers survived the exception
+    EXPECT_EQ(100, count.load());
+
+    group.run(boost::bind(&increment, &count));
+    EXPECT_NO_THROW(group.wait());
+    EXPECT_EQ(101, count.load());
+
+    // an exception that is never waited for does not escape the destructor
+    {
+        TaskGroup unwaited(scheduler);
+        unwaited.run(&throwError);
+    }
+}
+
+TEST(TaskScheduler, nestedGroups)
+{
+    // 2^0 + 2^1 + ... + 2^8 tasks
+    const int depth = 8;
+    const int expectedCount = (1 << (depth + 1)) - 1;
+
+    // a single worker deadlocks unless waiting threads help out
+    for (int threadCount = 1; threadCount <= 4; threadCount *= 2)
+    {
+        TaskScheduler scheduler(threadCount);
+
+        boost::atomic<int> count(0);
+
+        TaskGroup group(scheduler);
+        group.run(boost::bind(&runNested, &scheduler, depth, &count));
+        group.wait();
+
+        EXPECT_EQ(expectedCount, count.load());
+    }
+}
+
+}
@@ -2,6 +2,7 @@
 
 #include <boost/filesystem.hpp>
 #include <boost/make_shared.hpp>
+#include <fstream>
 #include <iostream>
 #include <opencv2/core/eigen.hpp>
 
@@ -13,8 +14,10 @@
 #ifndef HAVE_OPENCV3
 #include "../gpl/OpenCVUtils.h"
 #endif // HAVE_OPENCV3
+#include "../location_recognition/DescriptorIndex.h"
 #include "../location_recognition/LocationRecognition.h"
-#include "../pose_estimation/P3P.h"
+#include "../pose_estimation/P3PRansac.h"
+#include "camodocal/sparse_graph/CompactSparseGraph.h"
 #include "camodocal/sparse_graph/SparseGraphUtils.h"
 #include "ceres/ceres.h"
 
@@ -29,9 +32,11 @@ namespace camodocal
 InfrastructureCalibration::InfrastructureCalibration(std::vector<CameraPtr>& cameras,
                                                      bool verbose)
  : m_cameras(cameras)
+ , m_refIndexCacheSize(256)
  , m_x_last(0.0)
  , m_y_last(0.0)
  , m_distance(0.0)
+ , m_descriptorSearchChecks(64)
  , m_verbose(verbose)
 #ifdef VCHARGE_VIZ
  , m_overlay("cameras", VCharge::COORDINATE_FRAME_GLOBAL)
@@ -57,12 +62,26 @@ InfrastructureCalibration::loadMap(const std::string& mapDirectory)
     boost::filesystem::path graphPath(mapDirectory);
     graphPath /= "frames_5.sg";
 
-    if (!m_refGraph.readFromBinaryFile(graphPath.string()))
+    // the map may be in either graph file format; its images are not
+    // needed for calibration and are not loaded
+    CompactSparseGraph graph;
+    if (!graph.readFromFile(graphPath.string()))
     {
         std::cout << std::endl << "# ERROR: Cannot read graph file " << graphPath.string() << "." << std::endl;
         return false;
     }
 
+    // identifies the map for the location recognition database below
+    uint64_t graphHash = graph.contentHash();
+
+    graph.moveToSparseGraph(m_refGraph, false);
+
+    {
+        boost::lock_guard<boost::mutex> lock(m_refIndexMutex);
+        m_refIndexLRU.clear();
+        m_refIndices.clear();
+    }
+
     if (m_verbose)
     {
         std::cout << "Finished." << std::endl;
@@ -79,8 +98,22 @@ InfrastructureCalibration::loadMap(const std::string& mapDirectory)
         std::cout << "# INFO: Setting up location recognition... " << std::flush;
     }
 
+    // the database built from the map is stored next to the graph file and
+    // reused as long as the content of the graph file does not change
+    boost::filesystem::path databasePath = graphPath;
+    databasePath.replace_extension(".bow");
+
     m_locrec = boost::make_shared<LocationRecognition>();
-    m_locrec->setup(m_refGraph);
+    if (!m_locrec->readFromBinaryFile(databasePath.string(), m_refGraph, graphHash))
+    {
+        m_locrec->setup(m_refGraph);
+
+        if (!m_locrec->writeToBinaryFile(databasePath.string(), graphHash))
+        {
+            std::cout << std::endl << "# WARNING: Cannot write location recognition database "
+                      << databasePath.string() << "." << std::endl;
+        }
+    }
 
     if (m_verbose)
     {
@@ -660,11 +693,15 @@ InfrastructureCalibration::estimateCameraPose(const cv::Mat& image,
 
         frame->features2D().push_back(feature2D);
     }
+    frame->invalidateFeatureGrid();
 
     // find k closest matches in vocabulary tree
     std::vector<FrameTag> candidates;
     m_locrec->knnMatch(frame, k_nearestImageMatches, candidates);
 
+    // indexed once and matched against every candidate
+    DescriptorIndex queryIndex(frame->features2D(), false);
+
     // find match with highest number of inlier 2D-2D correspondences
     int bestInlierCount = 0;
     std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> > bestCorr2D3D;
@@ -677,7 +714,7 @@ InfrastructureCalibration::estimateCameraPose(const cv::Mat& image,
         FramePtr& trainFrame = m_refGraph.frameSetSegment(tag.frameSetSegmentId).at(tag.frameSetId)->frames().at(tag.frameId);
 
         // find 2D-3D correspondences
-        std::vector<cv::DMatch> matches = matchFeatures(frame->features2D(), trainFrame->features2D());
+        std::vector<cv::DMatch> matches = matchFeatures(queryIndex, *referenceIndex(trainFrame));
 
         if ((int)matches.size() < k_minCorrespondences2D3D)
         {
@@ -769,6 +806,7 @@ InfrastructureCalibration::estimateCameraPose(const cv::Mat& image,
             ++it;
         }
     }
+    frame->invalidateFeatureGrid();
 
     if (m_verbose)
     {
@@ -793,6 +831,22 @@ InfrastructureCalibration::cameraSystem(void) const
     return m_cameraSystem;
 }
 
+void
+InfrastructureCalibration::setDescriptorSearchChecks(int checks)
+{
+    m_descriptorSearchChecks = checks;
+}
+
+void
+InfrastructureCalibration::setReferenceIndexCacheSize(size_t size)
+{
+    boost::lock_guard<boost::mutex> lock(m_refIndexMutex);
+
+    m_refIndexCacheSize = size;
+
+    evictReferenceIndices();
+}
+
 void
 InfrastructureCalibration::optimize(bool optimizeScenePoints)
 {
@@ -911,58 +965,77 @@ InfrastructureCalibration::optimize(bool optimizeScenePoints)
     }
 }
 
-cv::Mat
-InfrastructureCalibration::buildDescriptorMat(const std::vector<Point2DFeaturePtr>& features,
-                                              std::vector<size_t>& indices,
-                                              bool hasScenePoint) const
+boost::shared_ptr<const DescriptorIndex>
+InfrastructureCalibration::referenceIndex(const FramePtr& frame)
 {
-    for (size_t i = 0; i < features.size(); ++i)
     {
-        if (hasScenePoint && !features.at(i)->feature3D())
+        boost::lock_guard<boost::mutex> lock(m_refIndexMutex);
+
+        RefIndexMap::iterator it = m_refIndices.find(frame.get());
+        if (it != m_refIndices.end())
         {
-            continue;
-        }
+            m_refIndexLRU.splice(m_refIndexLRU.begin(), m_refIndexLRU, it->second.second);
 
-        indices.push_back(i);
+            return it->second.first;
+        }
     }
 
-    cv::Mat dtor(indices.size(), features.at(0)->descriptor().cols, features.at(0)->descriptor().type());
+    // built outside the lock; if two cameras need the same frame at once,
+    // the index that is inserted first is kept
+    boost::shared_ptr<const DescriptorIndex> index = boost::make_shared<DescriptorIndex>(frame->features2D(), true);
 
-    for (size_t i = 0; i < indices.size(); ++i)
+    boost::lock_guard<boost::mutex> lock(m_refIndexMutex);
+
+    RefIndexMap::iterator it = m_refIndices.find(frame.get());
+    if (it != m_refIndices.end())
     {
-         features.at(indices.at(i))->descriptor().copyTo(dtor.row(i));
+        m_refIndexLRU.splice(m_refIndexLRU.begin(), m_refIndexLRU, it->second.second);
+
+        return it->second.first;
     }
 
-    return dtor;
+    m_refIndexLRU.push_front(frame.get());
+    m_refIndices[frame.get()] = std::make_pair(index, m_refIndexLRU.begin());
+
+    // the caller holds its own reference to an evicted index
+    evictReferenceIndices();
+
+    return index;
+}
+
+void
+InfrastructureCalibration::evictReferenceIndices(void)
+{
+    while (m_refIndexLRU.size() > m_refIndexCacheSize)
+    {
+        m_refIndices.erase(m_refIndexLRU.back());
+        m_refIndexLRU.pop_back();
+    }
 }
 
 std::vector<cv::DMatch>
-InfrastructureCalibration::matchFeatures(const std::vector<Point2DFeaturePtr>& queryFeatures,
-                                         const std::vector<Point2DFeaturePtr>& trainFeatures) const
+InfrastructureCalibration::matchFeatures(const DescriptorIndex& queryIndex,
+                                         const DescriptorIndex& trainIndex) const
 {
-    std::vector<size_t> queryIndices, trainIndices;
-    cv::Mat queryDtor = buildDescriptorMat(queryFeatures, queryIndices, false);
-    cv::Mat trainDtor = buildDescriptorMat(trainFeatures, trainIndices, true);
+    const std::vector<size_t>& queryIndices = queryIndex.featureIndices();
+    const std::vector<size_t>& trainIndices = trainIndex.featureIndices();
 
-    if (queryDtor.cols != trainDtor.cols)
+    if (queryIndex.size() == 0 || trainIndex.size() == 0)
     {
-        std::cout << "# WARNING: Descriptor lengths do not match." << std::endl;
         return std::vector<cv::DMatch>();
     }
 
-    if (queryDtor.type() != trainDtor.type())
+    if (queryIndex.descriptors().cols != trainIndex.descriptors().cols)
     {
-        std::cout << "# WARNING: Descriptor types do not match." << std::endl;
+        std::cout << "# WARNING: Descriptor lengths do not match." << std::endl;
         return std::vector<cv::DMatch>();
     }
 
-    cv::Ptr<SurfGPU> surf = SurfGPU::instance(300.0);
-
     std::vector<std::vector<cv::DMatch> > candidateFwdMatches;
-    surf->knnMatch(queryDtor, trainDtor, candidateFwdMatches, 2);
+    trainIndex.knnSearch(queryIndex.descriptors(), candidateFwdMatches, 2, m_descriptorSearchChecks);
 
     std::vector<std::vector<cv::DMatch> > candidateRevMatches;
-    surf->knnMatch(trainDtor, queryDtor, candidateRevMatches, 2);
+    queryIndex.knnSearch(trainIndex.descriptors(), candidateRevMatches, 2, m_descriptorSearchChecks);
 
     std::vector<std::vector<cv::DMatch> > fwdMatches(candidateFwdMatches.size());
     for (size_t i = 0; i < candidateFwdMatches.size(); ++i)
@@ -1041,93 +1114,33 @@ InfrastructureCalibration::solveP3PRansac(const FrameConstPtr& frame1,
 {
     inliers.clear();
 
-    double p = 0.99; // probability that at least one set of random samples does not contain an outlier
-    double v = 0.6; // probability of observing an outlier
-
-    double u = 1.0 - v;
-    int N = static_cast<int>(log(1.0 - p) / log(1.0 - u * u * u) + 0.5);
-
-    std::vector<size_t> indices;
-    for (size_t i = 0; i < matches.size(); ++i)
-    {
-        indices.push_back(i);
-    }
-
     const std::vector<Point2DFeaturePtr>& features1 = frame1->features2D();
     const std::vector<Point2DFeaturePtr>& features2 = frame2->features2D();
 
     const CameraConstPtr& camera1 = m_cameraSystem.getCamera(frame1->cameraId());
 
-    // run RANSAC to find best H
-    Eigen::Matrix4d H_best;
-    std::vector<size_t> inlierIds_best;
-    for (int i = 0; i < N; ++i)
+    // scene points and their observations, laid out for batch projection
+    Camera::Points3D scenePoints(matches.size(), 3);
+    Camera::Points2D imagePoints(matches.size(), 2);
+    for (size_t i = 0; i < matches.size(); ++i)
     {
-        std::random_shuffle(indices.begin(), indices.end());
+        const cv::DMatch& match = matches.at(i);
 
-        std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > rays(3);
-        std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > worldPoints(3);
-        for (int j = 0; j < 3; ++j)
-        {
-            const cv::DMatch& match = matches.at(indices.at(j));
-
-            worldPoints.at(j) = features2.at(match.trainIdx)->feature3D()->point();
-
-            const cv::KeyPoint& kpt1 = features1.at(match.queryIdx)->keypoint();
+        scenePoints.row(i) = features2.at(match.trainIdx)->feature3D()->point().transpose();
 
-            Eigen::Vector3d ray;
-            camera1->liftProjective(Eigen::Vector2d(kpt1.pt.x, kpt1.pt.y), ray);
-
-            rays.at(j) = ray.normalized();
-        }
-
-        std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d> > solutions;
-        if (!solveP3P(rays, worldPoints, solutions))
-        {
-            continue;
-        }
-
-        for (size_t j = 0; j < solutions.size(); ++j)
-        {
-            Eigen::Matrix4d H_inv = solutions.at(j).inverse();
-
-            std::vector<size_t> inliersIds;
-            for (size_t k = 0; k < matches.size(); ++k)
-            {
-                const cv::DMatch& match = matches.at(k);
-
-                Eigen::Vector3d P2 = features2.at(match.trainIdx)->feature3D()->point();
-
-                Eigen::Vector3d P1 = transformPoint(H_inv, P2);
-                Eigen::Vector2d p1_pred;
-                camera1->spaceToPlane(P1, p1_pred);
-
-                const Point2DFeatureConstPtr& f1 = features1.at(match.queryIdx);
-
-                double err = hypot(f1->keypoint().pt.x - p1_pred(0),
-                                   f1->keypoint().pt.y - p1_pred(1));
-                if (err > k_reprojErrorThresh)
-                {
-                    continue;
-                }
+        const cv::KeyPoint& kpt1 = features1.at(match.queryIdx)->keypoint();
+        imagePoints.row(i) << kpt1.pt.x, kpt1.pt.y;
+    }
 
-                inliersIds.push_back(k);
-            }
+    std::vector<size_t> inlierIds;
 
-            if (inliersIds.size() > inlierIds_best.size())
-            {
-                H_best = H_inv;
-                inlierIds_best = inliersIds;
-            }
-        }
-    }
+    P3PRansac ransac(camera1, k_reprojErrorThresh);
+    ransac.estimate(scenePoints, imagePoints, H, inlierIds);
 
-    for (size_t i = 0; i < inlierIds_best.size(); ++i)
+    for (size_t i = 0; i < inlierIds.size(); ++i)
     {
-        inliers.push_back(matches.at(inlierIds_best.at(i)));
+        inliers.push_back(matches.at(inlierIds.at(i)));
     }
-
-    H = H_best;
 }
 
 double
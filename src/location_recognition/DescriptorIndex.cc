@@ -0,0 +1,481 @@
+#include "DescriptorIndex.h"
+
+#include <algorithm>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <cmath>
+#include <functional>
+#include <limits>
+
+#include "../dbow2/DBoW2/FSurf64.h"
+
+namespace camodocal
+{
+
+/**
+ * State of the search for the neighbours of one query: the k best rows
+ * found so far, the rows already compared, and the unexplored branches
+ * ordered by their distance bound.
+ */
+class DescriptorIndex::Search
+{
+public:
+    typedef struct
+    {
+        double minDistance;
+        int tree;
+        int node;
+    } Branch;
+
+    Search(int rowCount, int k)
+     : m_k(k)
+     , m_visited(rowCount, 0)
+     , m_stamp(0)
+     , m_checkCount(0)
+    {
+
+    }
+
+    void reset(void)
+    {
+        ++m_stamp;
+        m_checkCount = 0;
+        m_results.clear();
+        m_branches.clear();
+    }
+
+    // false if the row has already been compared with the query
+    bool visit(int row)
+    {
+        if (m_visited.at(row) == m_stamp)
+        {
+            return false;
+        }
+        m_visited.at(row) = m_stamp;
+        ++m_checkCount;
+
+        return true;
+    }
+
+    void addResult(int row, double distance)
+    {
+        if ((int)m_results.size() == m_k && distance >= m_results.back().first)
+        {
+            return;
+        }
+
+        std::vector<std::pair<double, int> >::iterator it =
+            std::upper_bound(m_results.begin(), m_results.end(),
+                             std::make_pair(distance, row));
+        m_results.insert(it, std::make_pair(distance, row));
+
+        if ((int)m_results.size() > m_k)
+        {
+            m_results.pop_back();
+        }
+    }
+
+    double worstDistance(void) const
+    {
+        if ((int)m_results.size() < m_k)
+        {
+            return std::numeric_limits<double>::max();
+        }
+        return m_results.back().first;
+    }
+
+    bool complete(void) const
+    {
+        return (int)m_results.size() == m_k;
+    }
+
+    int checkCount(void) const
+    {
+        return m_checkCount;
+    }
+
+    void pushBranch(double minDistance, int tree, int node)
+    {
+        Branch branch;
+        branch.minDistance = minDistance;
+        branch.tree = tree;
+        branch.node = node;
+
+        m_branches.push_back(branch);
+        std::push_heap(m_branches.begin(), m_branches.end(), compareBranches);
+    }
+
+    bool popBranch(Branch& branch)
+    {
+        if (m_branches.empty())
+        {
+            return false;
+        }
+
+        std::pop_heap(m_branches.begin(), m_branches.end(), compareBranches);
+        branch = m_branches.back();
+        m_branches.pop_back();
+
+        return true;
+    }
+
+    const std::vector<std::pair<double, int> >& results(void) const
+    {
+        return m_results;
+    }
+
+private:
+    // orders the heap with the nearest branch on top
+    static bool compareBranches(const Branch& a, const Branch& b)
+    {
+        return a.minDistance > b.minDistance;
+    }
+
+    int m_k;
+
+    // a row has been compared with the current query if its entry equals
+    // m_stamp, which saves clearing the flags for each query
+    std::vector<unsigned int> m_visited;
+    unsigned int m_stamp;
+    int m_checkCount;
+
+    std::vector<std::pair<double, int> > m_results;
+    std::vector<Branch> m_branches;
+};
+
+DescriptorIndex::DescriptorIndex(const cv::Mat& descriptors, int treeCount)
+{
+    descriptors.convertTo(m_descriptors, CV_32F);
+
+    m_featureIndices.resize(m_descriptors.rows);
+    for (int i = 0; i < m_descriptors.rows; ++i)
+    {
+        m_featureIndices.at(i) = i;
+    }
+
+    build(treeCount);
+}
+
+DescriptorIndex::DescriptorIndex(const std::vector<Point2DFeaturePtr>& features,
+                                 bool scenePointsOnly, int treeCount)
+{
+    for (size_t i = 0; i < features.size(); ++i)
+    {
+        if (scenePointsOnly && !features.at(i)->feature3D())
+        {
+            continue;
+        }
+
+        m_featureIndices.push_back(i);
+    }
+
+    if (!m_featureIndices.empty())
+    {
+        m_descriptors.create(m_featureIndices.size(),
+                             features.at(m_featureIndices.front())->descriptor().cols,
+                             CV_32F);
+
+        for (size_t i = 0; i < m_featureIndices.size(); ++i)
+        {
+            features.at(m_featureIndices.at(i))->descriptor().convertTo(m_descriptors.row(i), CV_32F);
+        }
+    }
+
+    build(treeCount);
+}
+
+int
+DescriptorIndex::size(void) const
+{
+    return m_descriptors.rows;
+}
+
+const cv::Mat&
+DescriptorIndex::descriptors(void) const
+{
+    return m_descriptors;
+}
+
+const std::vector<size_t>&
+DescriptorIndex::featureIndices(void) const
+{
+    return m_featureIndices;
+}
+
+void
+DescriptorIndex::knnSearch(const cv::Mat& queries,
+                           std::vector<std::vector<cv::DMatch> >& matches,
+                           int k, int checks) const
+{
+    matches.clear();
+    matches.resize(queries.rows);
+
+    if (queries.empty() || m_descriptors.empty() || k <= 0 ||
+        queries.cols != m_descriptors.cols)
+    {
+        return;
+    }
+
+    cv::Mat queryDescriptors;
+    queries.convertTo(queryDescriptors, CV_32F);
+
+    // comparing all descriptors is cheaper than walking the trees once the
+    // check budget covers most of the index
+    bool exact = m_trees.empty() || checks <= 0 || checks >= m_descriptors.rows;
+
+    Search search(m_descriptors.rows, k);
+    for (int i = 0; i < queryDescriptors.rows; ++i)
+    {
+        const float* query = queryDescriptors.ptr<float>(i);
+
+        search.reset();
+        if (exact)
+        {
+            exactSearch(query, search);
+        }
+        else
+        {
+            forestSearch(query, checks, search);
+        }
+
+        const std::vector<std::pair<double, int> >& results = search.results();
+
+        matches.at(i).reserve(results.size());
+        for (size_t j = 0; j < results.size(); ++j)
+        {
+            matches.at(i).push_back(cv::DMatch(i, results.at(j).second,
+                                               std::sqrt(results.at(j).first)));
+        }
+    }
+}
+
+void
+DescriptorIndex::build(int treeCount)
+{
+    m_rng.seed(0);
+
+    if (m_descriptors.rows <= k_leafSize)
+    {
+        // too small for the trees to pay off; always searched exhaustively
+        return;
+    }
+
+    m_trees.resize(std::max(treeCount, 1));
+    for (size_t i = 0; i < m_trees.size(); ++i)
+    {
+        Tree& tree = m_trees.at(i);
+
+        tree.rows.resize(m_descriptors.rows);
+        for (int j = 0; j < m_descriptors.rows; ++j)
+        {
+            tree.rows.at(j) = j;
+        }
+
+        // the split statistics are taken from the first rows of a range,
+        // which are then a random sample
+        for (int j = m_descriptors.rows - 1; j > 0; --j)
+        {
+            boost::random::uniform_int_distribution<int> dist(0, j);
+            std::swap(tree.rows.at(j), tree.rows.at(dist(m_rng)));
+        }
+
+        tree.root = buildNode(tree, 0, m_descriptors.rows);
+    }
+}
+
+int
+DescriptorIndex::buildNode(Tree& tree, int begin, int end)
+{
+    int nodeId = m_nodes.size();
+    m_nodes.push_back(Node());
+
+    if (end - begin <= k_leafSize)
+    {
+        Node& node = m_nodes.at(nodeId);
+        node.dim = -1;
+        node.value = 0.0f;
+        node.first = begin;
+        node.second = end;
+
+        return nodeId;
+    }
+
+    int dim;
+    float value;
+    selectSplit(tree.rows, begin, end, dim, value);
+
+    std::vector<int>::iterator itBegin = tree.rows.begin() + begin;
+    std::vector<int>::iterator itEnd = tree.rows.begin() + end;
+    std::vector<int>::iterator itMid = itBegin;
+    for (std::vector<int>::iterator it = itBegin; it != itEnd; ++it)
+    {
+        if (m_descriptors.at<float>(*it, dim) < value)
+        {
+            std::iter_swap(it, itMid);
+            ++itMid;
+        }
+    }
+
+    // all rows on one side, e.g. duplicate descriptors; split at the median
+    // instead so that the recursion terminates
+    if (itMid == itBegin || itMid == itEnd)
+    {
+        itMid = itBegin + (end - begin) / 2;
+
+        std::vector<std::pair<float, int> > values;
+        values.reserve(end - begin);
+        for (std::vector<int>::iterator it = itBegin; it != itEnd; ++it)
+        {
+            values.push_back(std::make_pair(m_descriptors.at<float>(*it, dim), *it));
+        }
+        std::nth_element(values.begin(), values.begin() + (end - begin) / 2, values.end());
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            *(itBegin + i) = values.at(i).second;
+        }
+
+        value = values.at((end - begin) / 2).first;
+    }
+
+    int mid = itMid - tree.rows.begin();
+
+    int first = buildNode(tree, begin, mid);
+    int second = buildNode(tree, mid, end);
+
+    Node& node = m_nodes.at(nodeId);
+    node.dim = dim;
+    node.value = value;
+    node.first = first;
+    node.second = second;
+
+    return nodeId;
+}
+
+void
+DescriptorIndex::selectSplit(const std::vector<int>& rows, int begin, int end,
+                             int& dim, float& value)
+{
+    const int cols = m_descriptors.cols;
+    const int sampleCount = std::min(end - begin, k_splitSampleCount);
+
+    std::vector<double> mean(cols, 0.0);
+    std::vector<double> var(cols, 0.0);
+    for (int i = 0; i < sampleCount; ++i)
+    {
+        const float* d = m_descriptors.ptr<float>(rows.at(begin + i));
+        for (int j = 0; j < cols; ++j)
+        {
+            mean.at(j) += d[j];
+        }
+    }
+    for (int j = 0; j < cols; ++j)
+    {
+        mean.at(j) /= sampleCount;
+    }
+    for (int i = 0; i < sampleCount; ++i)
+    {
+        const float* d = m_descriptors.ptr<float>(rows.at(begin + i));
+        for (int j = 0; j < cols; ++j)
+        {
+            var.at(j) += (d[j] - mean.at(j)) * (d[j] - mean.at(j));
+        }
+    }
+
+    // split on one of the dimensions with the highest variance, chosen at
+    // random so that the trees differ
+    std::vector<std::pair<double, int> > dims(cols);
+    for (int j = 0; j < cols; ++j)
+    {
+        dims.at(j) = std::make_pair(var.at(j), j);
+    }
+
+    int candidateCount = std::min(cols, k_splitDimCandidates);
+    std::partial_sort(dims.begin(), dims.begin() + candidateCount, dims.end(),
+                      std::greater<std::pair<double, int> >());
+
+    boost::random::uniform_int_distribution<int> dist(0, candidateCount - 1);
+    dim = dims.at(dist(m_rng)).second;
+    value = mean.at(dim);
+}
+
+double
+DescriptorIndex::distance(const float* a, const float* b) const
+{
+    if (m_descriptors.cols == DBoW2::FSurf64::L)
+    {
+        return DBoW2::FSurf64::distance(a, b);
+    }
+
+    double sqd = 0.0;
+    for (int i = 0; i < m_descriptors.cols; ++i)
+    {
+        sqd += (a[i] - b[i]) * (a[i] - b[i]);
+    }
+    return sqd;
+}
+
+void
+DescriptorIndex::exactSearch(const float* query, Search& search) const
+{
+    for (int i = 0; i < m_descriptors.rows; ++i)
+    {
+        search.addResult(i, distance(query, m_descriptors.ptr<float>(i)));
+    }
+}
+
+void
+DescriptorIndex::forestSearch(const float* query, int checks, Search& search) const
+{
+    for (size_t i = 0; i < m_trees.size(); ++i)
+    {
+        descend(query, i, m_trees.at(i).root, 0.0, search);
+    }
+
+    Search::Branch branch;
+    while ((search.checkCount() < checks || !search.complete()) &&
+           search.popBranch(branch))
+    {
+        if (branch.minDistance >= search.worstDistance())
+        {
+            break;
+        }
+
+        descend(query, branch.tree, branch.node, branch.minDistance, search);
+    }
+}
+
+void
+DescriptorIndex::descend(const float* query, int treeId, int nodeId,
+                         double minDistance, Search& search) const
+{
+    const Tree& tree = m_trees.at(treeId);
+
+    const Node* node = &m_nodes.at(nodeId);
+    while (node->dim >= 0)
+    {
+        double diff = query[node->dim] - node->value;
+
+        int nearId = diff < 0.0 ? node->first : node->second;
+        int farId = diff < 0.0 ? node->second : node->first;
+
+        // the bound adds up the distances to the splitting planes on the
+        // way down, as in FLANN
+        double farDistance = minDistance + diff * diff;
+        if (farDistance < search.worstDistance())
+        {
+            search.pushBranch(farDistance, treeId, farId);
+        }
+
+        node = &m_nodes.at(nearId);
+    }
+
+    for (int i = node->first; i < node->second; ++i)
+    {
+        int row = tree.rows.at(i);
+        if (search.visit(row))
+        {
+            search.addResult(row, distance(query, m_descriptors.ptr<float>(row)));
+        }
+    }
+}
+
+}
@@ -0,0 +1,105 @@
+#ifndef DESCRIPTORINDEX_H
+#define DESCRIPTORINDEX_H
+
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/shared_ptr.hpp>
+#include <opencv2/core/core.hpp>
+#include <vector>
+
+#include "camodocal/sparse_graph/SparseGraph.h"
+
+namespace camodocal
+{
+
+/**
+ * Approximate nearest neighbour index over a set of descriptors with the
+ * L2 norm, e.g. the SURF descriptors of the features of one frame. The
+ * index is a forest of randomized k-d trees that are searched together
+ * with one priority queue. The number of descriptors that are compared
+ * per query trades recall for speed; with 0 checks, every descriptor is
+ * compared and the search is exact.
+ *
+ * The index is immutable once built, so it can be queried from several
+ * threads at once.
+ */
+class DescriptorIndex
+{
+public:
+    /**
+     * @param descriptors one descriptor per row
+     * @param treeCount number of randomized k-d trees
+     */
+    explicit DescriptorIndex(const cv::Mat& descriptors, int treeCount = 4);
+
+    /**
+     * Indexes the descriptors of features. featureIndices() maps the rows of
+     * the index back to positions in features.
+     * @param scenePointsOnly index only features with a scene point
+     */
+    DescriptorIndex(const std::vector<Point2DFeaturePtr>& features,
+                    bool scenePointsOnly, int treeCount = 4);
+
+    int size(void) const;
+
+    const cv::Mat& descriptors(void) const;
+    const std::vector<size_t>& featureIndices(void) const;
+
+    /**
+     * Finds the k nearest neighbours of each row of queries, nearest first.
+     * queryIdx is the row in queries, trainIdx the row in this index.
+     * @param checks number of indexed descriptors that are compared with
+     *        each query; 0 compares all of them.
+     */
+    void knnSearch(const cv::Mat& queries,
+                   std::vector<std::vector<cv::DMatch> >& matches,
+                   int k, int checks) const;
+
+private:
+    typedef struct
+    {
+        // split dimension, or -1 for a leaf
+        int dim;
+        float value;
+        // children of a split node, range in Tree::rows of a leaf
+        int first;
+        int second;
+    } Node;
+
+    typedef struct
+    {
+        int root;
+        std::vector<int> rows;
+    } Tree;
+
+    class Search;
+
+    void build(int treeCount);
+    int buildNode(Tree& tree, int begin, int end);
+    void selectSplit(const std::vector<int>& rows, int begin, int end,
+                     int& dim, float& value);
+
+    double distance(const float* a, const float* b) const;
+
+    void exactSearch(const float* query, Search& search) const;
+    void forestSearch(const float* query, int checks, Search& search) const;
+    void descend(const float* query, int tree, int node,
+                 double minDistance, Search& search) const;
+
+    cv::Mat m_descriptors;
+    std::vector<size_t> m_featureIndices;
+
+    std::vector<Tree> m_trees;
+    std::vector<Node> m_nodes;
+    boost::random::mt19937 m_rng;
+
+    static const int k_leafSize = 8;
+    static const int k_splitSampleCount = 100;
+    static const int k_splitDimCandidates = 5;
+};
+
+typedef boost::shared_ptr<DescriptorIndex> DescriptorIndexPtr;
+typedef boost::shared_ptr<const DescriptorIndex> DescriptorIndexConstPtr;
+
+}
+
+#endif
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <cmath>
+#include <gtest/gtest.h>
+
+#include "DescriptorIndex.h"
+
+namespace camodocal
+{
+
+namespace
+{
+
+cv::Mat
+randomDescriptors(int rows, int cols)
+{
+    cv::Mat descriptors(rows, cols, CV_32F);
+    for (int i = 0; i < rows; ++i)
+    {
+        for (int j = 0; j < cols; ++j)
+        {
+            descriptors.at<float>(i, j) = static_cast<float>(rand()) / RAND_MAX - 0.5f;
+        }
+    }
+    return descriptors;
+}
+
+// copies of random rows of descriptors with a little noise
+cv::Mat
+perturbedDescriptors(const cv::Mat& descriptors, int rows, std::vector<int>& sourceRows)
+{
+    cv::Mat queries(rows, descriptors.cols, CV_32F);
+    sourceRows.resize(rows);
+    for (int i = 0; i < rows; ++i)
+    {
+        sourceRows.at(i) = rand() % descriptors.rows;
+        for (int j = 0; j < descriptors.cols; ++j)
+        {
+            queries.at<float>(i, j) = descriptors.at<float>(sourceRows.at(i), j) +
+                                      0.02f * (static_cast<float>(rand()) / RAND_MAX - 0.5f);
+        }
+    }
+    return queries;
+}
+
+}
+
+TEST(DescriptorIndex, exactSearch)
+{
+    srand(0);
+
+    cv::Mat descriptors = randomDescriptors(500, 64);
+    cv::Mat queries = randomDescriptors(50, 64);
+
+    DescriptorIndex index(descriptors);
+
+    std::vector<std::vector<cv::DMatch> > matches;
+    index.knnSearch(queries, matches, 2, 0);
+
+    ASSERT_EQ(queries.rows, static_cast<int>(matches.size()));
+    for (int i = 0; i < queries.rows; ++i)
+    {
+        std::vector<std::pair<double, int> > distances;
+        for (int j = 0; j < descriptors.rows; ++j)
+        {
+            double sqd = 0.0;
+            for (int k = 0; k < descriptors.cols; ++k)
+            {
+                double d = queries.at<float>(i, k) - descriptors.at<float>(j, k);
+                sqd += d * d;
+            }
+            distances.push_back(std::make_pair(sqd, j));
+        }
+        std::sort(distances.begin(), distances.end());
+
+        ASSERT_EQ(2u, matches.at(i).size());
+        for (int k = 0; k < 2; ++k)
+        {
+            EXPECT_EQ(i, matches.at(i).at(k).queryIdx);
+            EXPECT_EQ(distances.at(k).second, matches.at(i).at(k).trainIdx);
+            EXPECT_NEAR(std::sqrt(distances.at(k).first), matches.at(i).at(k).distance, 1e-5);
+        }
+    }
+}
+
+TEST(DescriptorIndex, approximateSearch)
+{
+    srand(0);
+
+    cv::Mat descriptors = randomDescriptors(2000, 64);
+
+    std::vector<int> sourceRows;
+    cv::Mat queries = perturbedDescriptors(descriptors, 200, sourceRows);
+
+    DescriptorIndex index(descriptors);
+
+    std::vector<std::vector<cv::DMatch> > matches;
+    index.knnSearch(queries, matches, 2, 64);
+
+    // a near-duplicate is found although a fraction of the descriptors is
+    // compared
+    int found = 0;
+    for (int i = 0; i < queries.rows; ++i)
+    {
+        ASSERT_EQ(2u, matches.at(i).size());
+        EXPECT_LE(matches.at(i).at(0).distance, matches.at(i).at(1).distance);
+
+        if (matches.at(i).at(0).trainIdx == sourceRows.at(i))
+        {
+            ++found;
+        }
+    }
+    EXPECT_GE(found, queries.rows * 95 / 100);
+}
+
+TEST(DescriptorIndex, smallIndex)
+{
+    srand(0);
+
+    cv::Mat descriptors = randomDescriptors(3, 64);
+
+    DescriptorIndex index(descriptors);
+
+    std::vector<std::vector<cv::DMatch> > matches;
+    index.knnSearch(descriptors, matches, 5, 64);
+
+    ASSERT_EQ(3u, matches.size());
+    for (int i = 0; i < descriptors.rows; ++i)
+    {
+        ASSERT_EQ(3u, matches.at(i).size());
+        EXPECT_EQ(i, matches.at(i).at(0).trainIdx);
+        EXPECT_FLOAT_EQ(0.0f, matches.at(i).at(0).distance);
+    }
+}
+
+}
@@ -1,9 +1,88 @@
 #include "LocationRecognition.h"
 
+#include <boost/bind.hpp>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "../gpl/TaskScheduler.h"
+
 namespace camodocal
 {
 
+// written by convert_vocabulary from k_vocabularyFilename; preferred since
+// it is mapped instead of parsed
+static const char* const k_binaryVocabularyFilename = "surf64.voc";
+static const char* const k_vocabularyFilename = "surf64.yml.gz";
+
+// number of frames transformed by one task in setup()
+static const size_t k_transformBlockSize = 64;
+
+static const char k_databaseMagic[8] = {'L','O','C','R','E','C','D','B'};
+static const uint32_t k_databaseVersion = 2;
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t wordCount;
+    uint64_t graphHash;
+    uint64_t vocabularyHash;
+    int32_t k;
+    int32_t L;
+    int32_t weighting;
+    int32_t scoring;
+    uint32_t frameCount;
+    uint32_t reserved;
+} DatabaseHeader;
+
+// accepts the database entries of frames that are not within
+// minFrameSetDistance frame sets of the query frame in the same segment
+class DistantFrameFilter
+{
+public:
+    DistantFrameFilter(const std::vector<FrameTag>& frameTags,
+                       const FrameTag& tagQuery, int minFrameSetDistance)
+     : m_frameTags(frameTags)
+     , m_tagQuery(tagQuery)
+     , m_minFrameSetDistance(minFrameSetDistance)
+    {
+
+    }
+
+    bool operator()(DBoW2::EntryId id) const
+    {
+        const FrameTag& tag = m_frameTags.at(id);
+
+        return m_tagQuery.frameSetSegmentId != tag.frameSetSegmentId ||
+               std::abs(m_tagQuery.frameSetId - tag.frameSetId) >= m_minFrameSetDistance;
+    }
+
+private:
+    const std::vector<FrameTag>& m_frameTags;
+    FrameTag m_tagQuery;
+    int m_minFrameSetDistance;
+};
+
+static void
+fillDatabaseHeader(const Surf64Vocabulary& voc, uint64_t vocabularyHash,
+                   uint64_t graphHash, size_t frameCount, DatabaseHeader& header)
+{
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, k_databaseMagic, sizeof(header.magic));
+    header.version = k_databaseVersion;
+    header.wordCount = voc.size();
+    header.graphHash = graphHash;
+    header.vocabularyHash = vocabularyHash;
+    header.k = voc.getBranchingFactor();
+    header.L = voc.getDepthLevels();
+    header.weighting = voc.getWeightingType();
+    header.scoring = voc.getScoringType();
+    header.frameCount = frameCount;
+}
+
 LocationRecognition::LocationRecognition()
+ : m_vocabularyHash(0)
 {
 
 }
@@ -11,55 +90,141 @@ LocationRecognition::LocationRecognition()
 void
 LocationRecognition::setup(const SparseGraph& graph)
 {
-    m_frameTags.clear();
-    m_frames.clear();
-    m_frameMap.clear();
+    setup(SparseGraphView(graph));
+    mapFrames(graph);
+}
 
-    Surf64Vocabulary voc;
-    voc.load("surf64.yml.gz");
+void
+LocationRecognition::setup(const GraphView& graph)
+{
+    // the vocabulary may have been loaded by readFromBinaryFile()
+    if (m_db.getVocabulary() == 0)
+    {
+        loadVocabulary();
+    }
+    else
+    {
+        m_db.clear();
+    }
+    collectFrames(graph);
 
-    m_db.setVocabulary(voc);
+    // the vocabulary transform dominates; run it on blocks of frames in
+    // parallel and insert the results in frame order afterwards
+    std::vector<DBoW2::BowVector> bowVectors(m_frameTags.size());
+    std::vector<DBoW2::FeatureVector> featureVectors(m_frameTags.size());
+
+    TaskGroup transformTasks;
+    for (size_t begin = 0; begin < m_frameTags.size(); begin += k_transformBlockSize)
+    {
+        size_t end = std::min(begin + k_transformBlockSize, m_frameTags.size());
+
+        transformTasks.run(boost::bind(&LocationRecognition::transformFrames, this,
+                                       boost::cref(graph), begin, end,
+                                       boost::ref(bowVectors),
+                                       boost::ref(featureVectors)));
+    }
+    transformTasks.wait();
+
+    m_db.add(bowVectors, featureVectors);
+}
+
+bool
+LocationRecognition::readFromBinaryFile(const std::string& filename,
+                                        const SparseGraph& graph,
+                                        uint64_t graphHash)
+{
+    std::ifstream ifs(filename.c_str(), std::ios::in | std::ios::binary);
+    if (!ifs.is_open())
+    {
+        return false;
+    }
+
+    loadVocabulary();
+    collectFrames(SparseGraphView(graph));
+    mapFrames(graph);
+
+    DatabaseHeader expected;
+    fillDatabaseHeader(*m_db.getVocabulary(), m_vocabularyHash, graphHash,
+                       m_frameTags.size(), expected);
 
-    // build vocabulary tree
-    std::vector<std::vector<std::vector<float> > > features;
+    DatabaseHeader header;
+    if (!ifs.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        memcmp(&header, &expected, sizeof(header)) != 0)
+    {
+        // written for another graph or vocabulary
+        return false;
+    }
 
-    for (size_t segmentId = 0; segmentId < graph.frameSetSegments().size(); ++segmentId)
+    std::vector<int32_t> tags(m_frameTags.size() * 3);
+    if (!tags.empty() &&
+        !ifs.read(reinterpret_cast<char*>(&tags[0]), tags.size() * sizeof(int32_t)))
     {
-        const FrameSetSegment& segment = graph.frameSetSegment(segmentId);
+        return false;
+    }
 
-        for (size_t frameSetId = 0; frameSetId < segment.size(); ++frameSetId)
+    for (size_t i = 0; i < m_frameTags.size(); ++i)
+    {
+        const FrameTag& tag = m_frameTags.at(i);
+        if (tags.at(i * 3) != tag.frameSetSegmentId ||
+            tags.at(i * 3 + 1) != tag.frameSetId ||
+            tags.at(i * 3 + 2) != tag.frameId)
         {
-            const FrameSetPtr& frameSet = segment.at(frameSetId);
+            return false;
+        }
+    }
 
-            for (size_t frameId = 0; frameId < frameSet->frames().size(); ++frameId)
-            {
-                const FramePtr& frame = frameSet->frames().at(frameId);
+    try
+    {
+        m_db.loadBinary(ifs);
+    }
+    catch (const std::string& error)
+    {
+        std::cerr << "# WARNING: Cannot read location recognition database "
+                  << filename << ": " << error << std::endl;
 
-                if (frame.get() == 0)
-                {
-                    continue;
-                }
+        m_db.clear();
+        return false;
+    }
 
-                FrameTag tag;
-                tag.frameSetSegmentId = segmentId;
-                tag.frameSetId = frameSetId;
-                tag.frameId = frameId;
+    return true;
+}
 
-                m_frameTags.push_back(tag);
+bool
+LocationRecognition::writeToBinaryFile(const std::string& filename,
+                                       uint64_t graphHash) const
+{
+    std::ofstream ofs(filename.c_str(), std::ios::out | std::ios::binary);
+    if (!ofs.is_open())
+    {
+        return false;
+    }
 
-                m_frames.push_back(frame);
+    DatabaseHeader header;
+    fillDatabaseHeader(*m_db.getVocabulary(), m_vocabularyHash, graphHash,
+                       m_frameTags.size(), header);
 
-                m_frameMap.insert(std::make_pair(frame.get(), tag));
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
 
-                features.push_back(frameToBOW(frame));
-            }
-        }
+    std::vector<int32_t> tags;
+    tags.reserve(m_frameTags.size() * 3);
+    for (size_t i = 0; i < m_frameTags.size(); ++i)
+    {
+        const FrameTag& tag = m_frameTags.at(i);
+        tags.push_back(tag.frameSetSegmentId);
+        tags.push_back(tag.frameSetId);
+        tags.push_back(tag.frameId);
     }
 
-    for (size_t i = 0; i < features.size(); ++i)
+    if (!tags.empty())
     {
-        m_db.add(features.at(i));
+        ofs.write(reinterpret_cast<const char*>(&tags[0]), tags.size() * sizeof(int32_t));
     }
+
+    m_db.saveBinary(ofs);
+
+    ofs.close();
+
+    return !ofs.fail();
 }
 
 void
@@ -74,26 +239,16 @@ LocationRecognition::knnMatch(const FrameConstPtr& frame, int k,
 
     FrameTag tagQuery = it->second;
 
+    std::vector<const float*> descriptors;
+    frameDescriptors(frame, descriptors);
+
     DBoW2::QueryResults ret;
-    m_db.query(frameToBOW(frame), ret, 0);
+    query(descriptors, tagQuery, k, 30, ret);
 
     matches.clear();
     for (size_t i = 0; i < ret.size(); ++i)
     {
-        FrameTag tag = m_frameTags.at(ret.at(i).Id);
-
-        if (tagQuery.frameSetSegmentId == tag.frameSetSegmentId &&
-            std::abs(tagQuery.frameSetId - tag.frameSetId) < 30)
-        {
-            continue;
-        }
-
-        matches.push_back(tag);
-
-        if ((int)matches.size() == k)
-        {
-            return;
-        }
+        matches.push_back(m_frameTags.at(ret.at(i).Id));
     }
 }
 
@@ -109,53 +264,156 @@ LocationRecognition::knnMatch(const FrameConstPtr& frame, int k,
 
     FrameTag tagQuery = it->second;
 
+    std::vector<const float*> descriptors;
+    frameDescriptors(frame, descriptors);
+
     DBoW2::QueryResults ret;
-    m_db.query(frameToBOW(frame), ret, 0);
+    query(descriptors, tagQuery, k, 20, ret);
 
     matches.clear();
     for (size_t i = 0; i < ret.size(); ++i)
     {
-        FrameTag tag = m_frameTags.at(ret.at(i).Id);
+        matches.push_back(m_frames.at(ret.at(i).Id));
+    }
+}
 
-        if (tagQuery.frameSetSegmentId == tag.frameSetSegmentId &&
-            std::abs(tagQuery.frameSetId - tag.frameSetId) < 20)
-        {
-            continue;
-        }
+void
+LocationRecognition::knnMatch(const GraphView& graph, const FrameTag& frameTag,
+                              int k, std::vector<FrameTag>& matches) const
+{
+    std::vector<const float*> descriptors;
+    frameDescriptors(graph, frameTag, descriptors);
+
+    DBoW2::QueryResults ret;
+    query(descriptors, frameTag, k, 30, ret);
+
+    matches.clear();
+    for (size_t i = 0; i < ret.size(); ++i)
+    {
+        matches.push_back(m_frameTags.at(ret.at(i).Id));
+    }
+}
+
+void
+LocationRecognition::loadVocabulary(void)
+{
+    Surf64Vocabulary voc;
+    if (Surf64Vocabulary::isBinaryFile(k_binaryVocabularyFilename))
+    {
+        voc.loadBinary(k_binaryVocabularyFilename);
+    }
+    else
+    {
+        voc.load(k_vocabularyFilename);
+    }
 
-        const FramePtr& frame = m_frames.at(ret.at(i).Id);
+    m_db.setVocabulary(voc);
+    m_vocabularyHash = voc.contentHash();
+}
 
-        matches.push_back(frame);
+void
+LocationRecognition::collectFrames(const GraphView& graph)
+{
+    m_frameTags.clear();
+    m_frames.clear();
+    m_frameMap.clear();
 
-        if ((int)matches.size() == k)
+    for (int segmentId = 0; segmentId < graph.frameSetSegmentCount(); ++segmentId)
+    {
+        for (int frameSetId = 0; frameSetId < graph.frameSetCount(segmentId); ++frameSetId)
         {
-            return;
+            for (int frameId = 0; frameId < graph.frameSlotCount(segmentId, frameSetId); ++frameId)
+            {
+                FrameTag tag;
+                tag.frameSetSegmentId = segmentId;
+                tag.frameSetId = frameSetId;
+                tag.frameId = frameId;
+
+                if (graph.hasFrame(tag))
+                {
+                    m_frameTags.push_back(tag);
+                }
+            }
         }
     }
 }
 
-std::vector<std::vector<float> >
-LocationRecognition::frameToBOW(const FrameConstPtr& frame) const
+void
+LocationRecognition::mapFrames(const SparseGraph& graph)
 {
-    std::vector<std::vector<float> > bow;
+    SparseGraphView view(graph);
+
+    m_frames.clear();
+    m_frameMap.clear();
+
+    for (size_t i = 0; i < m_frameTags.size(); ++i)
+    {
+        const FrameTag& tag = m_frameTags.at(i);
+        const FramePtr& frame = view.frame(tag);
 
+        m_frames.push_back(frame);
+
+        m_frameMap.insert(std::make_pair(frame.get(), tag));
+    }
+}
+
+void
+LocationRecognition::frameDescriptors(const FrameConstPtr& frame,
+                                      std::vector<const float*>& descriptors) const
+{
     const std::vector<Point2DFeaturePtr>& features2D = frame->features2D();
-    for (std::vector<Point2DFeaturePtr>::const_iterator it = features2D.begin();
-            it != features2D.end(); ++it)
+
+    descriptors.resize(features2D.size());
+    for (size_t i = 0; i < features2D.size(); ++i)
     {
-        const Point2DFeatureConstPtr& feature2D = (*it);
-        const cv::Mat& dtor = feature2D->descriptor();
+        descriptors.at(i) = features2D.at(i)->descriptor().ptr<float>(0);
+    }
+}
 
-        std::vector<float> w(dtor.cols);
-        for (int j = 0; j < dtor.cols; ++j)
-        {
-            w.at(j) = dtor.at<float>(0,j);
-        }
+void
+LocationRecognition::frameDescriptors(const GraphView& graph, const FrameTag& frameTag,
+                                      std::vector<const float*>& descriptors) const
+{
+    FeatureTag featureTag;
+    featureTag.frameTag = frameTag;
 
-        bow.push_back(w);
+    descriptors.resize(graph.featureCount(frameTag));
+    for (size_t i = 0; i < descriptors.size(); ++i)
+    {
+        featureTag.index = i;
+
+        // the row shares the data of the graph, which outlives the pointer
+        descriptors.at(i) = graph.descriptor(featureTag).ptr<float>(0);
     }
+}
+
+void
+LocationRecognition::query(const std::vector<const float*>& descriptors,
+                           const FrameTag& tagQuery, int k, int minFrameSetDistance,
+                           DBoW2::QueryResults& results) const
+{
+    DBoW2::BowVector bowVector;
+    m_db.getVocabulary()->transform(descriptors, bowVector);
+
+    m_db.queryTopK(bowVector, results, k,
+                   DistantFrameFilter(m_frameTags, tagQuery, minFrameSetDistance));
+}
 
-    return bow;
+void
+LocationRecognition::transformFrames(const GraphView& graph, size_t begin, size_t end,
+                                     std::vector<DBoW2::BowVector>& bowVectors,
+                                     std::vector<DBoW2::FeatureVector>& featureVectors) const
+{
+    const Surf64Vocabulary* voc = m_db.getVocabulary();
+
+    std::vector<const float*> descriptors;
+    for (size_t i = begin; i < end; ++i)
+    {
+        frameDescriptors(graph, m_frameTags.at(i), descriptors);
+
+        voc->transform(descriptors, bowVectors.at(i), featureVectors.at(i),
+                       m_db.getDirectIndexLevels());
+    }
 }
 
 }
@@ -1,7 +1,9 @@
 #ifndef LOCATIONRECOGNITION_H
 #define LOCATIONRECOGNITION_H
 
-#include "camodocal/sparse_graph/SparseGraph.h"
+#include <stdint.h>
+
+#include "camodocal/sparse_graph/GraphView.h"
 #include "../dbow2/DBoW2/DBoW2.h"
 #include "../dbow2/DUtils/DUtils.h"
 #include "../dbow2/DUtilsCV/DUtilsCV.h"
@@ -17,13 +19,50 @@ public:
 
     void setup(const SparseGraph& graph);
 
+    // Builds the database from the frames of a view. Only the overload of
+    // knnMatch() that takes a view can be used afterwards.
+    void setup(const GraphView& graph);
+
+    // Restores the database written by writeToBinaryFile() instead of
+    // building it with setup(). graphHash identifies the content of the
+    // graph; the file is rejected if it was written for another graph or
+    // for a vocabulary with other contents. If it is rejected, setup()
+    // reuses the vocabulary loaded here.
+    bool readFromBinaryFile(const std::string& filename,
+                            const SparseGraph& graph, uint64_t graphHash);
+    bool writeToBinaryFile(const std::string& filename, uint64_t graphHash) const;
+
     void knnMatch(const FrameConstPtr& frame, int k, std::vector<FrameTag>& matches) const;
     void knnMatch(const FrameConstPtr& frame, int k, std::vector<FramePtr>& matches) const;
 
+    // frameTag refers to a frame of the graph that the database was built
+    // from, and graph is a view of that graph
+    void knnMatch(const GraphView& graph, const FrameTag& frameTag, int k,
+                  std::vector<FrameTag>& matches) const;
+
 private:
-    std::vector<std::vector<float> > frameToBOW(const FrameConstPtr& frame) const;
+    void loadVocabulary(void);
+    void collectFrames(const GraphView& graph);
+    // the frame pointers of the collected frames
+    void mapFrames(const SparseGraph& graph);
+
+    // views of the descriptor rows of the features of a frame
+    void frameDescriptors(const FrameConstPtr& frame,
+                          std::vector<const float*>& descriptors) const;
+    void frameDescriptors(const GraphView& graph, const FrameTag& frameTag,
+                          std::vector<const float*>& descriptors) const;
+
+    // frames close in time to the query are not reported
+    void query(const std::vector<const float*>& descriptors,
+               const FrameTag& tagQuery, int k, int minFrameSetDistance,
+               DBoW2::QueryResults& results) const;
+
+    void transformFrames(const GraphView& graph, size_t begin, size_t end,
+                         std::vector<DBoW2::BowVector>& bowVectors,
+                         std::vector<DBoW2::FeatureVector>& featureVectors) const;
 
     Surf64Database m_db;
+    uint64_t m_vocabularyHash;
 
     std::vector<FrameTag> m_frameTags;
     std::vector<FramePtr> m_frames;
@@ -0,0 +1,420 @@
+#include "P3PRansac.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+#include "P3P.h"
+
+namespace camodocal
+{
+
+namespace
+{
+
+// number of correspondences projected at a time during verification
+const int k_verificationBatchSize = 16;
+
+// cost of generating the hypotheses of one sample, in units of
+// verifying one correspondence, and the average number of hypotheses
+// per sample; these drive the SPRT decision threshold
+const double k_sprtSampleCost = 200.0;
+const double k_sprtHypothesesPerSample = 2.0;
+
+const double k_sprtInitialDelta = 0.05;
+
+const int k_localOptimizationSteps = 3;
+const int k_refinementIterations = 10;
+
+}
+
+P3PRansac::P3PRansac(const CameraConstPtr& camera, double reprojErrorThresh)
+ : k_camera(camera)
+ , k_reprojErrorThresh(reprojErrorThresh)
+ , m_confidence(0.99)
+ , m_useSPRT(true)
+ , m_useLocalOptimization(true)
+ , m_epsilon(0.0)
+ , m_delta(k_sprtInitialDelta)
+ , m_sprtThreshold(0.0)
+ , m_rejectedCount(0)
+ , m_iterationCount(0)
+{
+    // the fixed iteration count previously used for an assumed outlier
+    // ratio of 60%, so that hopeless estimates cost no more than before
+    double u = 1.0 - 0.6;
+    m_maxIterations = static_cast<int>(log(1.0 - m_confidence) / log(1.0 - u * u * u) + 0.5);
+}
+
+void
+P3PRansac::setConfidence(double confidence)
+{
+    m_confidence = confidence;
+}
+
+void
+P3PRansac::setMaxIterations(int maxIterations)
+{
+    m_maxIterations = maxIterations;
+}
+
+void
+P3PRansac::setSPRT(bool enable)
+{
+    m_useSPRT = enable;
+}
+
+void
+P3PRansac::setLocalOptimization(bool enable)
+{
+    m_useLocalOptimization = enable;
+}
+
+bool
+P3PRansac::estimate(const Camera::Points3D& scenePoints,
+                    const Camera::Points2D& imagePoints,
+                    Eigen::Matrix4d& H, std::vector<size_t>& inliers)
+{
+    inliers.clear();
+    H.setIdentity();
+    m_iterationCount = 0;
+
+    int n = scenePoints.rows();
+    if (n < 3)
+    {
+        return false;
+    }
+
+    // SPRT assumes that correspondences are verified in random order
+    std::vector<int> order(n);
+    for (int i = 0; i < n; ++i)
+    {
+        order.at(i) = i;
+    }
+    std::random_shuffle(order.begin(), order.end());
+
+    m_scenePoints.resize(n, 3);
+    m_imagePoints.resize(n, 2);
+    for (int i = 0; i < n; ++i)
+    {
+        m_scenePoints.row(i) = scenePoints.row(order.at(i));
+        m_imagePoints.row(i) = imagePoints.row(order.at(i));
+    }
+
+    k_camera->liftSphereBatch(m_imagePoints, m_rays);
+
+    // epsilon is the inlier ratio of the best hypothesis so far; SPRT is
+    // off until there is one, as an epsilon above the true inlier ratio
+    // rejects most of the correct hypotheses
+    m_epsilon = 0.0;
+    m_delta = k_sprtInitialDelta;
+    m_sprtThreshold = 0.0;
+    m_rejectedCount = 0;
+
+    Eigen::Matrix4d H_best = Eigen::Matrix4d::Identity();
+    std::vector<int> inliers_best;
+
+    int maxIterations = m_maxIterations;
+    for (; m_iterationCount < maxIterations; ++m_iterationCount)
+    {
+        int sample[3];
+        for (int j = 0; j < 3; ++j)
+        {
+            bool duplicate;
+            do
+            {
+                sample[j] = rand() % n;
+
+                duplicate = false;
+                for (int k = 0; k < j; ++k)
+                {
+                    duplicate |= (sample[k] == sample[j]);
+                }
+            }
+            while (duplicate);
+        }
+
+        std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > rays(3);
+        std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > worldPoints(3);
+        for (int j = 0; j < 3; ++j)
+        {
+            rays.at(j) = m_rays.row(sample[j]).transpose();
+            worldPoints.at(j) = m_scenePoints.row(sample[j]).transpose();
+        }
+
+        std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d> > solutions;
+        if (!solveP3P(rays, worldPoints, solutions))
+        {
+            continue;
+        }
+
+        for (size_t j = 0; j < solutions.size(); ++j)
+        {
+            // P3P solutions transform from the camera to the scene frame
+            Eigen::Matrix4d H_inv = solutions.at(j).inverse();
+
+            std::vector<int> inlierIds;
+            if (!verify(H_inv, m_useSPRT && !inliers_best.empty(), inlierIds))
+            {
+                continue;
+            }
+
+            if (inlierIds.size() <= inliers_best.size())
+            {
+                continue;
+            }
+
+            if (m_useLocalOptimization)
+            {
+                optimizeLocally(H_inv, inlierIds);
+            }
+
+            H_best = H_inv;
+            inliers_best.swap(inlierIds);
+
+            double inlierRatio = static_cast<double>(inliers_best.size()) / n;
+            m_epsilon = inlierRatio;
+            updateSPRTThreshold();
+
+            maxIterations = std::min(maxIterations, requiredIterations(inlierRatio));
+        }
+    }
+
+    if (inliers_best.empty())
+    {
+        return false;
+    }
+
+    H = H_best;
+
+    inliers.reserve(inliers_best.size());
+    for (size_t i = 0; i < inliers_best.size(); ++i)
+    {
+        inliers.push_back(order.at(inliers_best.at(i)));
+    }
+    std::sort(inliers.begin(), inliers.end());
+
+    return true;
+}
+
+int
+P3PRansac::iterationCount(void) const
+{
+    return m_iterationCount;
+}
+
+bool
+P3PRansac::verify(const Eigen::Matrix4d& H, bool useSPRT,
+                  std::vector<int>& inliers)
+{
+    inliers.clear();
+
+    // the test is only meaningful if good hypotheses are more likely
+    // to agree with a correspondence than bad ones
+    useSPRT = useSPRT && m_delta < m_epsilon;
+
+    double inlierRatioStep = m_delta / m_epsilon;
+    double outlierRatioStep = (1.0 - m_delta) / (1.0 - m_epsilon);
+    double likelihoodRatio = 1.0;
+
+    double reprojErrorThresh2 = k_reprojErrorThresh * k_reprojErrorThresh;
+
+    Eigen::Matrix3d R = H.block<3,3>(0,0);
+    Eigen::Vector3d t = H.block<3,1>(0,3);
+
+    int n = m_scenePoints.rows();
+    for (int start = 0; start < n; start += k_verificationBatchSize)
+    {
+        int count = std::min(k_verificationBatchSize, n - start);
+
+        Camera::Points3D P = (m_scenePoints.middleRows(start, count) * R.transpose()).rowwise()
+                             + t.transpose();
+        Camera::Points2D p_pred;
+        k_camera->spaceToPlaneBatch(P, p_pred);
+
+        Eigen::VectorXd err2 = (p_pred - m_imagePoints.middleRows(start, count)).rowwise().squaredNorm();
+
+        for (int k = 0; k < count; ++k)
+        {
+            if (err2(k) <= reprojErrorThresh2)
+            {
+                inliers.push_back(start + k);
+                likelihoodRatio *= inlierRatioStep;
+            }
+            else
+            {
+                likelihoodRatio *= outlierRatioStep;
+            }
+
+            if (useSPRT && likelihoodRatio > m_sprtThreshold)
+            {
+                // the fraction of correspondences consistent with rejected
+                // hypotheses estimates delta
+                double delta = static_cast<double>(inliers.size()) / (start + k + 1);
+
+                m_delta = (m_delta * m_rejectedCount + delta) / (m_rejectedCount + 1);
+                m_delta = std::max(m_delta, 0.01);
+                ++m_rejectedCount;
+
+                updateSPRTThreshold();
+
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+void
+P3PRansac::optimizeLocally(Eigen::Matrix4d& H, std::vector<int>& inliers)
+{
+    for (int i = 0; i < k_localOptimizationSteps; ++i)
+    {
+        Eigen::Matrix4d H_refined = H;
+        if (!refinePose(inliers, H_refined))
+        {
+            return;
+        }
+
+        std::vector<int> inliersRefined;
+        verify(H_refined, false, inliersRefined);
+
+        if (inliersRefined.size() < inliers.size())
+        {
+            return;
+        }
+
+        bool grown = inliersRefined.size() > inliers.size();
+
+        H = H_refined;
+        inliers.swap(inliersRefined);
+
+        if (!grown)
+        {
+            return;
+        }
+    }
+}
+
+bool
+P3PRansac::refinePose(const std::vector<int>& inliers, Eigen::Matrix4d& H) const
+{
+    if (inliers.size() < 3)
+    {
+        return false;
+    }
+
+    Eigen::Matrix3d R = H.block<3,3>(0,0);
+    Eigen::Vector3d t = H.block<3,1>(0,3);
+
+    // Gauss-Newton on the difference between the observed rays and the
+    // directions of the transformed scene points, which is independent
+    // of the camera model; the rotation is updated on the left
+    for (int i = 0; i < k_refinementIterations; ++i)
+    {
+        Eigen::Matrix<double,6,6> JtJ = Eigen::Matrix<double,6,6>::Zero();
+        Eigen::Matrix<double,6,1> Jtr = Eigen::Matrix<double,6,1>::Zero();
+
+        for (size_t j = 0; j < inliers.size(); ++j)
+        {
+            Eigen::Vector3d RX = R * m_scenePoints.row(inliers.at(j)).transpose();
+            Eigen::Vector3d Y = RX + t;
+
+            double norm = Y.norm();
+            Eigen::Vector3d f = Y / norm;
+            Eigen::Vector3d r = f - m_rays.row(inliers.at(j)).transpose();
+
+            Eigen::Matrix3d J_f = (Eigen::Matrix3d::Identity() - f * f.transpose()) / norm;
+
+            Eigen::Matrix3d RX_skew;
+            RX_skew << 0.0, -RX(2), RX(1),
+                       RX(2), 0.0, -RX(0),
+                       -RX(1), RX(0), 0.0;
+
+            Eigen::Matrix<double,3,6> J;
+            J.block<3,3>(0,0) = -J_f * RX_skew;
+            J.block<3,3>(0,3) = J_f;
+
+            JtJ += J.transpose() * J;
+            Jtr += J.transpose() * r;
+        }
+
+        Eigen::Matrix<double,6,1> dx = -JtJ.ldlt().solve(Jtr);
+        if (!dx.allFinite())
+        {
+            return false;
+        }
+
+        Eigen::Vector3d omega = dx.head<3>();
+        if (omega.norm() > 0.0)
+        {
+            R = Eigen::AngleAxisd(omega.norm(), omega.normalized()).toRotationMatrix() * R;
+        }
+        t += dx.tail<3>();
+
+        if (dx.norm() < 1e-10)
+        {
+            break;
+        }
+    }
+
+    H.block<3,3>(0,0) = R;
+    H.block<3,1>(0,3) = t;
+
+    return true;
+}
+
+int
+P3PRansac::requiredIterations(double inlierRatio) const
+{
+    // probability that a sample is outlier-free and its hypothesis is not
+    // rejected by SPRT
+    double p = inlierRatio * inlierRatio * inlierRatio;
+    if (m_useSPRT && m_sprtThreshold > 1.0)
+    {
+        p *= 1.0 - 1.0 / m_sprtThreshold;
+    }
+
+    if (p >= 1.0)
+    {
+        return 1;
+    }
+    if (p <= 0.0)
+    {
+        return m_maxIterations;
+    }
+
+    double N = std::ceil(log(1.0 - m_confidence) / log(1.0 - p));
+
+    return static_cast<int>(std::min(N, static_cast<double>(m_maxIterations)));
+}
+
+void
+P3PRansac::updateSPRTThreshold(void)
+{
+    m_epsilon = std::min(m_epsilon, 0.99);
+
+    if (m_delta >= m_epsilon)
+    {
+        return;
+    }
+
+    // Kullback-Leibler divergence between the bad and good hypothesis
+    // distributions per verified correspondence
+    double C = (1.0 - m_delta) * log((1.0 - m_delta) / (1.0 - m_epsilon))
+               + m_delta * log(m_delta / m_epsilon);
+
+    // optimal threshold A solves A = K + log(A)
+    double K = k_sprtSampleCost * C / k_sprtHypothesesPerSample + 1.0;
+
+    double A = K;
+    for (int i = 0; i < 10; ++i)
+    {
+        A = K + log(A);
+    }
+
+    m_sprtThreshold = A;
+}
+
+}
@@ -0,0 +1,85 @@
+#ifndef P3PRANSAC_H
+#define P3PRANSAC_H
+
+#include <Eigen/Dense>
+#include <vector>
+
+#include "camodocal/camera_models/Camera.h"
+
+namespace camodocal
+{
+
+/**
+ * RANSAC estimation of an absolute camera pose from 3D-2D correspondences
+ * using minimal P3P samples.
+ *
+ * The number of iterations adapts to the inlier ratio of the best
+ * hypothesis found so far. With SPRT enabled, hypotheses are verified
+ * against the correspondences in random order and abandoned as soon as the
+ * sequential probability ratio test decides that they are bad (Matas and
+ * Chum, Randomized RANSAC with Sequential Probability Ratio Test, ICCV 2005).
+ * With local optimisation enabled, each new best hypothesis is refined on
+ * its inliers by minimising the ray alignment error and rescored
+ * (Chum et al., Locally Optimized RANSAC, DAGM 2003).
+ */
+class P3PRansac
+{
+public:
+    P3PRansac(const CameraConstPtr& camera, double reprojErrorThresh);
+
+    // probability that at least one outlier-free sample is drawn
+    void setConfidence(double confidence);
+
+    void setMaxIterations(int maxIterations);
+    void setSPRT(bool enable);
+    void setLocalOptimization(bool enable);
+
+    /**
+     * @param scenePoints 3D points, one per row
+     * @param imagePoints observations of the scene points, one per row
+     * @param H transform from the scene frame to the camera frame
+     * @param inliers indices of the inlier correspondences, in ascending order
+     * @return false if no pose with at least one inlier was found
+     */
+    bool estimate(const Camera::Points3D& scenePoints,
+                  const Camera::Points2D& imagePoints,
+                  Eigen::Matrix4d& H, std::vector<size_t>& inliers);
+
+    // number of samples drawn by the last call to estimate
+    int iterationCount(void) const;
+
+private:
+    bool verify(const Eigen::Matrix4d& H, bool useSPRT,
+                std::vector<int>& inliers);
+    void optimizeLocally(Eigen::Matrix4d& H, std::vector<int>& inliers);
+    bool refinePose(const std::vector<int>& inliers, Eigen::Matrix4d& H) const;
+
+    int requiredIterations(double inlierRatio) const;
+    void updateSPRTThreshold(void);
+
+    const CameraConstPtr k_camera;
+    const double k_reprojErrorThresh;
+
+    double m_confidence;
+    int m_maxIterations;
+    bool m_useSPRT;
+    bool m_useLocalOptimization;
+
+    // correspondences of the current estimate, in verification order
+    Camera::Points3D m_scenePoints;
+    Camera::Points2D m_imagePoints;
+    Camera::Points3D m_rays;
+
+    // SPRT state: probability of a correspondence being consistent with
+    // a good (epsilon) and a bad (delta) hypothesis, and the decision threshold
+    double m_epsilon;
+    double m_delta;
+    double m_sprtThreshold;
+    int m_rejectedCount;
+
+    int m_iterationCount;
+};
+
+}
+
+#endif
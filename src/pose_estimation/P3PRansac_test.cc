@@ -0,0 +1,118 @@
+#include <Eigen/Dense>
+#include <gtest/gtest.h>
+
+#include "camodocal/camera_models/PinholeCamera.h"
+#include "P3PRansac.h"
+
+namespace camodocal
+{
+
+namespace
+{
+
+// correspondence i is an inlier iff i % inlierStride == 0; the outliers
+// are displaced by at least 10 pixels in both coordinates
+void
+generateCorrespondences(const CameraConstPtr& camera, const Eigen::Matrix4d& H,
+                        int n, int inlierStride,
+                        Camera::Points3D& scenePoints, Camera::Points2D& imagePoints)
+{
+    Eigen::Matrix4d H_inv = H.inverse();
+
+    scenePoints.resize(n, 3);
+    imagePoints.resize(n, 2);
+    for (int i = 0; i < n; ++i)
+    {
+        Eigen::Vector3d P_cam = Eigen::Vector3d::Random();
+        P_cam(2) = 3.0 + 2.0 * fabs(P_cam(2));
+
+        Eigen::Vector2d p;
+        camera->spaceToPlane(P_cam, p);
+
+        if (i % inlierStride != 0)
+        {
+            p += Eigen::Vector2d::Random() * 50.0 + Eigen::Vector2d(60.0, -60.0);
+        }
+
+        scenePoints.row(i) = (H_inv.block<3,3>(0,0) * P_cam + H_inv.block<3,1>(0,3)).transpose();
+        imagePoints.row(i) = p.transpose();
+    }
+}
+
+}
+
+TEST(P3PRansac, outliers)
+{
+    CameraPtr camera(new PinholeCamera("camera", 640, 480,
+                                       0.0, 0.0, 0.0, 0.0,
+                                       500.0, 500.0, 320.0, 240.0));
+
+    Eigen::Matrix4d H_true = Eigen::Matrix4d::Identity();
+    H_true.block<3,3>(0,0) = Eigen::AngleAxisd(0.2, Eigen::Vector3d(0.3, -1.0, 0.5).normalized()).toRotationMatrix();
+    H_true.block<3,1>(0,3) << 0.4, -0.2, 1.0;
+
+    srand(0);
+
+    // every other correspondence is an outlier
+    const int n = 200;
+    Camera::Points3D scenePoints;
+    Camera::Points2D imagePoints;
+    generateCorrespondences(camera, H_true, n, 2, scenePoints, imagePoints);
+
+    P3PRansac ransac(camera, 1.0);
+    ransac.setMaxIterations(500);
+
+    Eigen::Matrix4d H;
+    std::vector<size_t> inliers;
+    ASSERT_TRUE(ransac.estimate(scenePoints, imagePoints, H, inliers));
+
+    EXPECT_EQ(n / 2, static_cast<int>(inliers.size()));
+    for (size_t i = 0; i < inliers.size(); ++i)
+    {
+        EXPECT_EQ(0, static_cast<int>(inliers.at(i) % 2));
+    }
+
+    EXPECT_LT((H - H_true).norm(), 1e-6);
+
+    // the adaptive stopping criterion needs far fewer samples than the cap
+    EXPECT_LT(ransac.iterationCount(), 100);
+}
+
+TEST(P3PRansac, lowInlierRatio)
+{
+    CameraPtr camera(new PinholeCamera("camera", 640, 480,
+                                       0.0, 0.0, 0.0, 0.0,
+                                       500.0, 500.0, 320.0, 240.0));
+
+    Eigen::Matrix4d H_true = Eigen::Matrix4d::Identity();
+    H_true.block<3,3>(0,0) = Eigen::AngleAxisd(-0.3, Eigen::Vector3d(1.0, 0.2, -0.4).normalized()).toRotationMatrix();
+    H_true.block<3,1>(0,3) << -0.3, 0.1, 0.5;
+
+    srand(1);
+
+    // inlier ratios of 25%, 20% and 16.7%; SPRT must not reject the
+    // correct hypotheses before it knows how many inliers to expect
+    const int n = 240;
+    for (int inlierStride = 4; inlierStride <= 6; ++inlierStride)
+    {
+        for (int trial = 0; trial < 10; ++trial)
+        {
+            Camera::Points3D scenePoints;
+            Camera::Points2D imagePoints;
+            generateCorrespondences(camera, H_true, n, inlierStride, scenePoints, imagePoints);
+
+            // three times the samples needed at 16.7% without SPRT
+            P3PRansac ransac(camera, 1.0);
+            ransac.setMaxIterations(3000);
+
+            Eigen::Matrix4d H;
+            std::vector<size_t> inliers;
+            ASSERT_TRUE(ransac.estimate(scenePoints, imagePoints, H, inliers));
+
+            EXPECT_EQ(n / inlierStride, static_cast<int>(inliers.size()));
+            EXPECT_LT((H - H_true).norm(), 1e-6);
+        }
+    }
+}
+
+}
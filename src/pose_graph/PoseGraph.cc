@@ -1,5 +1,6 @@
 #include <camodocal/pose_graph/PoseGraph.h>
 
+#include <algorithm>
 #include <boost/thread.hpp>
 #include <camodocal/sparse_graph/SparseGraphUtils.h>
 #include <ceres/ceres.h>
@@ -7,8 +8,10 @@
 #include <opencv2/core/eigen.hpp>
 
 #include "../gpl/EigenQuaternionParameterization.h"
+#include "../gpl/TaskScheduler.h"
+#include "../location_recognition/DescriptorIndex.h"
 #include "../location_recognition/LocationRecognition.h"
-#include "../pose_estimation/P3P.h"
+#include "../pose_estimation/P3PRansac.h"
 #include "PoseGraphError.h"
 
 #ifdef VCHARGE_VIZ
@@ -24,11 +27,31 @@ PoseGraph::PoseGraph(CameraSystem& cameraSystem,
                      int minLoopCorrespondences2D3D,
                      int nImageMatches)
  : m_cameraSystem(cameraSystem)
- , m_graph(graph)
+ , m_graph(new SparseGraphView(graph))
  , k_lossWidth(0.01)
  , k_minLoopCorrespondences2D3D(minLoopCorrespondences2D3D)
  , k_maxDistanceRatio(maxDistanceRatio)
  , k_nImageMatches(nImageMatches)
+ , m_analyticJacobians(true)
+ , m_descriptorSearchChecks(64)
+ , m_verbose(false)
+{
+
+}
+
+PoseGraph::PoseGraph(CameraSystem& cameraSystem,
+                     CompactSparseGraph& graph,
+                     float maxDistanceRatio,
+                     int minLoopCorrespondences2D3D,
+                     int nImageMatches)
+ : m_cameraSystem(cameraSystem)
+ , m_graph(new CompactSparseGraphView(graph))
+ , k_lossWidth(0.01)
+ , k_minLoopCorrespondences2D3D(minLoopCorrespondences2D3D)
+ , k_maxDistanceRatio(maxDistanceRatio)
+ , k_nImageMatches(nImageMatches)
+ , m_analyticJacobians(true)
+ , m_descriptorSearchChecks(64)
  , m_verbose(false)
 {
 
@@ -40,6 +63,18 @@ PoseGraph::setVerbose(bool onoff)
     m_verbose = onoff;
 }
 
+void
+PoseGraph::setAnalyticJacobians(bool onoff)
+{
+    m_analyticJacobians = onoff;
+}
+
+void
+PoseGraph::setDescriptorSearchChecks(int checks)
+{
+    m_descriptorSearchChecks = checks;
+}
+
 void
 PoseGraph::buildEdges(void)
 {
@@ -70,6 +105,161 @@ PoseGraph::buildEdges(void)
     m_loopClosureEdgeSwitches.assign(m_loopClosureEdges.size(), ON);
 }
 
+/**
+ * Optimization problem that persists across the EM iterations of one call
+ * to optimize(). The problem does not own the cost and loss functions, so
+ * residual blocks of loop closure edges can be removed and added again as
+ * the edge switches change state without rebuilding the problem.
+ */
+class PoseGraph::EMProblem
+{
+public:
+    EMProblem(std::vector<Edge, Eigen::aligned_allocator<Edge> >& odometryEdges,
+              std::vector<Edge, Eigen::aligned_allocator<Edge> >& loopClosureEdges,
+              bool useRobustOptimization, bool analyticJacobians,
+              double lossWidth);
+
+    // adds the residual blocks of switched-on loop closure edges to the
+    // problem and removes those of the other edges
+    void updateLoopClosureEdges(const std::vector<EdgeSwitchState>& switches);
+
+    ceres::Problem* problem(void);
+    bool robust(void) const;
+
+private:
+    static ceres::Problem::Options problemOptions(void);
+
+    static ceres::CostFunction* createCostFunction(const Edge& edge, bool analyticJacobians);
+
+    ceres::ResidualBlockId addResidualBlock(Edge& edge,
+                                            ceres::CostFunction* costFunction,
+                                            ceres::LossFunction* lossFunction);
+
+    std::vector<Edge, Eigen::aligned_allocator<Edge> >& m_loopClosureEdges;
+    bool m_robust;
+
+    std::vector<boost::shared_ptr<ceres::CostFunction> > m_odometryCostFunctions;
+    std::vector<boost::shared_ptr<ceres::CostFunction> > m_loopClosureCostFunctions;
+    boost::shared_ptr<ceres::LossFunction> m_lossFunction;
+
+    // null for loop closure edges that are not part of the problem
+    std::vector<ceres::ResidualBlockId> m_loopClosureResidualBlocks;
+
+    // declared last so that it is destroyed before the cost functions
+    ceres::Problem m_problem;
+};
+
+PoseGraph::EMProblem::EMProblem(std::vector<Edge, Eigen::aligned_allocator<Edge> >& odometryEdges,
+                                std::vector<Edge, Eigen::aligned_allocator<Edge> >& loopClosureEdges,
+                                bool useRobustOptimization, bool analyticJacobians,
+                                double lossWidth)
+ : m_loopClosureEdges(loopClosureEdges)
+ , m_robust(useRobustOptimization)
+ , m_loopClosureResidualBlocks(loopClosureEdges.size(), static_cast<ceres::ResidualBlockId>(0))
+ , m_problem(problemOptions())
+{
+    // odometry edges
+    for (size_t i = 0; i < odometryEdges.size(); ++i)
+    {
+        Edge& edge = odometryEdges.at(i);
+
+        m_odometryCostFunctions.push_back(boost::shared_ptr<ceres::CostFunction>(createCostFunction(edge, analyticJacobians)));
+
+        addResidualBlock(edge, m_odometryCostFunctions.back().get(), 0);
+
+        if (i == 0)
+        {
+            OdometryPtr pose1 = edge.inVertex().lock();
+
+            m_problem.SetParameterBlockConstant(pose1->positionData());
+            m_problem.SetParameterBlockConstant(pose1->attitudeData());
+        }
+    }
+
+    // loop closure edges are added by updateLoopClosureEdges
+    for (size_t i = 0; i < loopClosureEdges.size(); ++i)
+    {
+        m_loopClosureCostFunctions.push_back(boost::shared_ptr<ceres::CostFunction>(createCostFunction(loopClosureEdges.at(i), analyticJacobians)));
+    }
+
+    if (useRobustOptimization)
+    {
+        // loss functions are stateless and can be shared by all edges
+        m_lossFunction.reset(new ceres::CauchyLoss(lossWidth));
+    }
+}
+
+void
+PoseGraph::EMProblem::updateLoopClosureEdges(const std::vector<EdgeSwitchState>& switches)
+{
+    for (size_t i = 0; i < m_loopClosureEdges.size(); ++i)
+    {
+        ceres::ResidualBlockId& residualBlock = m_loopClosureResidualBlocks.at(i);
+
+        if (switches.at(i) == ON && residualBlock == 0)
+        {
+            residualBlock = addResidualBlock(m_loopClosureEdges.at(i),
+                                             m_loopClosureCostFunctions.at(i).get(),
+                                             m_lossFunction.get());
+        }
+        else if (switches.at(i) != ON && residualBlock != 0)
+        {
+            m_problem.RemoveResidualBlock(residualBlock);
+            residualBlock = 0;
+        }
+    }
+}
+
+ceres::Problem*
+PoseGraph::EMProblem::problem(void)
+{
+    return &m_problem;
+}
+
+bool
+PoseGraph::EMProblem::robust(void) const
+{
+    return m_robust;
+}
+
+ceres::Problem::Options
+PoseGraph::EMProblem::problemOptions(void)
+{
+    ceres::Problem::Options options;
+    options.cost_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+    options.loss_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+    // loop closure edges are removed and re-added on every EM iteration
+    options.enable_fast_parameter_block_removal = true;
+
+    return options;
+}
+
+ceres::CostFunction*
+PoseGraph::EMProblem::createCostFunction(const Edge& edge, bool analyticJacobians)
+{
+    if (analyticJacobians)
+    {
+        return new AnalyticPoseGraphError(edge.property(), edge.weight());
+    }
+
+    return new ceres::AutoDiffCostFunction<PoseGraphError, 6, 3, 3, 3, 3>(
+        new PoseGraphError(edge.property(), edge.weight()));
+}
+
+ceres::ResidualBlockId
+PoseGraph::EMProblem::addResidualBlock(Edge& edge,
+                                       ceres::CostFunction* costFunction,
+                                       ceres::LossFunction* lossFunction)
+{
+    OdometryPtr pose1, pose2;
+    pose1 = edge.inVertex().lock();
+    pose2 = edge.outVertex().lock();
+
+    return m_problem.AddResidualBlock(costFunction, lossFunction,
+                                      pose1->positionData(), pose1->attitudeData(),
+                                      pose2->positionData(), pose2->attitudeData());
+}
+
 void
 PoseGraph::optimize(bool useRobustOptimization)
 {
@@ -77,11 +267,17 @@ PoseGraph::optimize(bool useRobustOptimization)
     // G.H. Lee, F. Fraundorfer, and M. Pollefeys,
     // Robust Pose-Graph Loop-Closures with Expectation-Maximization,
     // In International Conference on Intelligent Robots and Systems, 2013.
+
+    // The problem is built once; each EM iteration only toggles the
+    // loop closure edges and starts from the previous iteration's poses.
+    EMProblem problem(m_odometryEdges, m_loopClosureEdges,
+                      useRobustOptimization, m_analyticJacobians, k_lossWidth);
+
     if (useRobustOptimization)
     {
         for (int i = 0; i < 20; ++i)
         {
-            if (!iterateEM(true))
+            if (!iterateEM(problem))
             {
 #ifdef VCHARGE_VIZ
                 visualizeLoopClosureEdges();
@@ -92,15 +288,15 @@ PoseGraph::optimize(bool useRobustOptimization)
     }
     else
     {
-        iterateEM(false);
+        iterateEM(problem);
     }
 }
 
-std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> >
+std::vector<PoseGraph::Correspondence2D3D>
 PoseGraph::getCorrespondences2D3D(void) const
 {
     // return 2D-3D correspondences from switched-on loop closure edges
-    std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> > correspondences2D3D;
+    std::vector<Correspondence2D3D> correspondences2D3D;
 
     for (size_t i = 0; i < m_correspondences2D3D.size(); ++i)
     {
@@ -122,24 +318,19 @@ PoseGraph::findOdometryEdges(void) const
 {
     std::vector<PoseGraph::Edge, Eigen::aligned_allocator<PoseGraph::Edge> > edges;
 
-    for (size_t i = 0; i < m_graph.frameSetSegments().size(); ++i)
+    for (int i = 0; i < m_graph->frameSetSegmentCount(); ++i)
     {
-        const FrameSetSegment& segment = m_graph.frameSetSegment(i);
+        int frameSetCount = m_graph->frameSetCount(i);
 
-        if (segment.size() <= 1)
+        for (int j = 0; j < frameSetCount - 1; ++j)
         {
-            continue;
-        }
-
-        for (size_t j = 0; j < segment.size() - 1; ++j)
-        {
-            edges.push_back(Edge(segment.at(j)->systemPose(),
-                                 segment.at(j + 1)->systemPose()));
+            edges.push_back(Edge(m_graph->frameSetSystemPose(i, j),
+                                 m_graph->frameSetSystemPose(i, j + 1)));
 
             edges.back().type() = EDGE_ODOMETRY;
 
-            Eigen::Matrix4d H_01 = segment.at(j + 1)->odometryMeasurement()->toMatrix().inverse() *
-                                   segment.at(j)->odometryMeasurement()->toMatrix();
+            Eigen::Matrix4d H_01 = m_graph->frameSetOdometryMeasurement(i, j + 1)->toMatrix().inverse() *
+                                   m_graph->frameSetOdometryMeasurement(i, j)->toMatrix();
 
             edges.back().property().rotation() = Eigen::Quaterniond(H_01.block<3,3>(0,0));
             edges.back().property().translation() = H_01.block<3,1>(0,3);
@@ -150,97 +341,166 @@ PoseGraph::findOdometryEdges(void) const
     return edges;
 }
 
-void
-PoseGraph::findLoopClosures(std::vector<PoseGraph::Edge, Eigen::aligned_allocator<PoseGraph::Edge> >& loopClosureEdges,
-                            std::vector<std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> > >& correspondences2D3D,
-                            double reprojErrorThresh) const
+namespace
 {
-    boost::shared_ptr<LocationRecognition> locRec(new LocationRecognition);
-    locRec->setup(m_graph);
 
-    for (int i = 0; i < (int)m_graph.frameSetSegments().size(); ++i)
+/**
+ * Counts the loop closure queries that have finished and reports the
+ * progress in steps of 10%.
+ */
+class LoopClosureProgress
+{
+public:
+    LoopClosureProgress(size_t queryCount, bool verbose)
+     : m_queryCount(queryCount)
+     , m_finishedCount(0)
+     , m_loopClosureCount(0)
+     , m_reportedPercent(0)
+     , m_verbose(verbose)
+    {
+
+    }
+
+    void finished(bool foundLoopClosure)
     {
-        const FrameSetSegment& segment = m_graph.frameSetSegment(i);
+        boost::lock_guard<boost::mutex> lock(m_mutex);
 
-        for (int j = 0; j < (int)segment.size(); ++j)
+        ++m_finishedCount;
+        if (foundLoopClosure)
         {
-            const FrameSetPtr& frameSet = segment.at(j);
+            ++m_loopClosureCount;
+        }
 
-            std::vector<boost::shared_ptr<boost::thread> > threads(frameSet->frames().size());
-            std::vector<PoseGraph::Edge> edges(frameSet->frames().size());
-            /// @todo std::vector<std::vector<>> will be quite slow! consider boost::static_vector<boost::static_vector<>> or a single 2d data type allocation
-            std::vector<std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> > > corr2D3D(frameSet->frames().size());
+        int percent = m_finishedCount * 100 / m_queryCount;
+        if (!m_verbose || percent < m_reportedPercent + 10)
+        {
+            return;
+        }
+        m_reportedPercent = percent - percent % 10;
 
-            for (size_t k = 0; k < frameSet->frames().size(); ++k)
-            {
-                const FramePtr& frame = frameSet->frames().at(k);
+        std::cout << "# INFO: Loop closure search: " << m_reportedPercent
+                  << "% (" << m_finishedCount << "/" << m_queryCount
+                  << " frames), " << m_loopClosureCount
+                  << " loop closures so far." << std::endl;
+    }
 
-                if (frame.get() == 0)
-                {
-                    continue;
-                }
+private:
+    boost::mutex m_mutex;
+    size_t m_queryCount;
+    size_t m_finishedCount;
+    size_t m_loopClosureCount;
+    int m_reportedPercent;
+    bool m_verbose;
+};
 
+void
+runLoopClosureQuery(const TaskScheduler::Task& query,
+                    const std::vector<PoseGraph::Correspondence2D3D>* correspondences2D3D,
+                    LoopClosureProgress& progress)
+{
+    query();
+
+    progress.finished(!correspondences2D3D->empty());
+}
+
+}
+
+void
+PoseGraph::findLoopClosures(std::vector<PoseGraph::Edge, Eigen::aligned_allocator<PoseGraph::Edge> >& loopClosureEdges,
+                            std::vector<std::vector<Correspondence2D3D> >& correspondences2D3D,
+                            double reprojErrorThresh) const
+{
+    boost::shared_ptr<LocationRecognition> locRec(new LocationRecognition);
+    locRec->setup(*m_graph);
+
+    // the frames of all frame sets are queried at once
+    std::vector<FrameTag> queries;
+    for (int i = 0; i < m_graph->frameSetSegmentCount(); ++i)
+    {
+        for (int j = 0; j < m_graph->frameSetCount(i); ++j)
+        {
+            for (int k = 0; k < m_graph->frameSlotCount(i, j); ++k)
+            {
                 FrameTag frameTag;
                 frameTag.frameSetSegmentId = i;
                 frameTag.frameSetId = j;
                 frameTag.frameId = k;
 
-                threads[k].reset(new boost::thread(boost::bind(&PoseGraph::findLoopClosuresHelper, this,
-                                                               frameTag, locRec,
-                                                               &edges[k], &corr2D3D[k],
-                                                               reprojErrorThresh)));
-            }
-
-            for (int k = 0; k < (int)frameSet->frames().size(); ++k)
-            {
-                if (threads[k].get() == 0)
-                {
-                    continue;
-                }
-                threads[k]->join();
-
-                if (!corr2D3D[k].empty())
+                if (m_graph->hasFrame(frameTag))
                 {
-                    loopClosureEdges.push_back(edges[k]);
-                    correspondences2D3D.push_back(corr2D3D[k]);
+                    queries.push_back(frameTag);
                 }
             }
         }
     }
+
+    if (queries.empty())
+    {
+        return;
+    }
+
+    // one result slot per query, so that the edges come out in frame order
+    // regardless of the order in which the queries finish
+    std::vector<PoseGraph::Edge, Eigen::aligned_allocator<PoseGraph::Edge> > edges(queries.size());
+    std::vector<std::vector<Correspondence2D3D> > corr2D3D(queries.size());
+
+    LoopClosureProgress progress(queries.size(), m_verbose);
+
+    TaskGroup queryTasks;
+    for (size_t i = 0; i < queries.size(); ++i)
+    {
+        TaskScheduler::Task query = boost::bind(&PoseGraph::findLoopClosuresHelper, this,
+                                                queries.at(i), locRec,
+                                                &edges.at(i), &corr2D3D.at(i),
+                                                reprojErrorThresh);
+
+        queryTasks.run(boost::bind(&runLoopClosureQuery, query,
+                                   &corr2D3D.at(i), boost::ref(progress)));
+    }
+    queryTasks.wait();
+
+    for (size_t i = 0; i < queries.size(); ++i)
+    {
+        if (!corr2D3D.at(i).empty())
+        {
+            loopClosureEdges.push_back(edges.at(i));
+            correspondences2D3D.push_back(corr2D3D.at(i));
+        }
+    }
 }
 
 void
 PoseGraph::findLoopClosuresHelper(FrameTag frameTagQuery,
                                   boost::shared_ptr<LocationRecognition> locRec,
                                   PoseGraph::Edge* edge,
-                                  std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> >* correspondences2D3D,
+                                  std::vector<Correspondence2D3D>* correspondences2D3D,
                                   double reprojErrorThresh) const
 {
-    FramePtr& frameQuery = m_graph.frameSetSegment(frameTagQuery.frameSetSegmentId).at(frameTagQuery.frameSetId)->frames().at(frameTagQuery.frameId);
-
-    if (frameQuery.get() == 0)
+    if (!m_graph->hasFrame(frameTagQuery))
     {
         return;
     }
 
-    Pose T_cam_odo(m_cameraSystem.getGlobalCameraPose(frameQuery->cameraId()));
+    Pose T_cam_odo(m_cameraSystem.getGlobalCameraPose(m_graph->cameraId(frameTagQuery)));
 
     // find closest matching images
     std::vector<FrameTag> frameTags;
-    locRec->knnMatch(frameQuery, k_nImageMatches, frameTags);
+    locRec->knnMatch(*m_graph, frameTagQuery, k_nImageMatches, frameTags);
+
+    // the features of each candidate are matched against this frame; all
+    // features are indexed, so the rows of the index are feature indices
+    std::vector<size_t> queryIndices;
+    DescriptorIndex queryIndex(buildDescriptorMat(frameTagQuery, queryIndices, false));
 
-    std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> > corr2D3DBest;
+    std::vector<Correspondence2D3D> corr2D3DBest;
     Transform transformBest;
-    FramePtr frameBest;
     FrameTag frameTagBest;
     for (size_t i = 0; i < frameTags.size(); ++i)
     {
         FrameTag frameTag = frameTags.at(i);
 
-        const FramePtr& frame = m_graph.frameSetSegment(frameTag.frameSetSegmentId).at(frameTag.frameSetId)->frames().at(frameTag.frameId);
-
         // find 2D-3D correspondences between frame pair
-        std::vector<cv::DMatch> matches = matchFeatures(frame->features2D(), frameQuery->features2D(), k_maxDistanceRatio);
+        std::vector<cv::DMatch> matches = matchFeatures(frameTag, queryIndex, k_maxDistanceRatio);
 
         if ((int)matches.size() < k_minLoopCorrespondences2D3D)
         {
@@ -250,16 +510,16 @@ PoseGraph::findLoopClosuresHelper(FrameTag frameTagQuery,
         // find camera pose from P3P RANSAC
         Eigen::Matrix4d H;
         std::vector<cv::DMatch> inliers;
-        solveP3PRansac(frame, frameQuery, matches,
+        solveP3PRansac(frameTag, frameTagQuery, matches,
                        H, inliers, reprojErrorThresh);
 
-        std::vector<std::pair<Point2DFeaturePtr, Point3DFeaturePtr> > corr2D3D;
+        std::vector<Correspondence2D3D> corr2D3D;
         for (size_t j = 0; j < inliers.size(); ++j)
         {
             const cv::DMatch& match = inliers.at(j);
 
-            Point3DFeaturePtr& p3D = frame->features2D().at(match.queryIdx)->feature3D();
-            Point2DFeaturePtr& p2D = frameQuery->features2D().at(match.trainIdx);
+            FeatureTag p2D = {frameTagQuery, match.trainIdx};
+            FeatureTag p3D = {frameTag, match.queryIdx};
 
             corr2D3D.push_back(std::make_pair(p2D, p3D));
         }
@@ -273,11 +533,10 @@ PoseGraph::findLoopClosuresHelper(FrameTag frameTagQuery,
 
         if (nInliers > (int)corr2D3DBest.size())
         {
-            frameBest = frame;
             frameTagBest = frameTag;
 
             // compute loop closure constraint
-            Eigen::Matrix4d H_01 = frame->systemPose()->toMatrix().inverse() * H;
+            Eigen::Matrix4d H_01 = m_graph->systemPose(frameTag)->toMatrix().inverse() * H;
 
             transformBest.rotation() = Eigen::Quaterniond(H_01.block<3,3>(0,0));
             transformBest.translation() = H_01.block<3,1>(0,3);
@@ -288,8 +547,8 @@ PoseGraph::findLoopClosuresHelper(FrameTag frameTagQuery,
 
     if (!corr2D3DBest.empty())
     {
-        edge->inVertex() = frameQuery->systemPose();
-        edge->outVertex() = frameBest->systemPose();
+        edge->inVertex() = m_graph->systemPose(frameTagQuery);
+        edge->outVertex() = m_graph->systemPose(frameTagBest);
         edge->type() = EDGE_LOOP_CLOSURE;
         edge->property() = transformBest;
 
@@ -312,66 +571,15 @@ PoseGraph::findLoopClosuresHelper(FrameTag frameTagQuery,
 }
 
 bool
-PoseGraph::iterateEM(bool useRobustOptimization)
+PoseGraph::iterateEM(EMProblem& problem)
 {
-    ceres::Problem problem;
-
-    // odometry edges
-    for (size_t i = 0; i < m_odometryEdges.size(); ++i)
-    {
-        Edge& edge = m_odometryEdges.at(i);
-
-        ceres::CostFunction* costFunction =
-            new ceres::AutoDiffCostFunction<PoseGraphError, 6, 3, 3, 3, 3>(
-                new PoseGraphError(edge.property(), edge.weight()));
-
-        OdometryPtr pose1, pose2;
-        pose1 = edge.inVertex().lock();
-        pose2 = edge.outVertex().lock();
-
-        problem.AddResidualBlock(costFunction, NULL,
-                                 pose1->positionData(), pose1->attitudeData(),
-                                 pose2->positionData(), pose2->attitudeData());
-
-        if (i == 0)
-        {
-            problem.SetParameterBlockConstant(pose1->positionData());
-            problem.SetParameterBlockConstant(pose1->attitudeData());
-        }
-    }
-
-    // loop closure edges
-    for (size_t i = 0; i < m_loopClosureEdges.size(); ++i)
-    {
-        if (m_loopClosureEdgeSwitches.at(i) != ON)
-        {
-            continue;
-        }
-
-        Edge& edge = m_loopClosureEdges.at(i);
-
-        ceres::CostFunction* costFunction =
-            new ceres::AutoDiffCostFunction<PoseGraphError, 6, 3, 3, 3, 3>(
-                new PoseGraphError(edge.property(), edge.weight()));
-
-        OdometryPtr pose1, pose2;
-        pose1 = edge.inVertex().lock();
-        pose2 = edge.outVertex().lock();
-
-        ceres::LossFunction* lossFunction = 0;
-        if (useRobustOptimization)
-        {
-            lossFunction = new ceres::CauchyLoss(k_lossWidth);
-        }
-
-        problem.AddResidualBlock(costFunction, lossFunction,
-                                 pose1->positionData(), pose1->attitudeData(),
-                                 pose2->positionData(), pose2->attitudeData());
-    }
+    problem.updateLoopClosureEdges(m_loopClosureEdgeSwitches);
 
     ceres::Solver::Options options;
+    options.num_threads = std::max(1u, boost::thread::hardware_concurrency());
+
     ceres::Solver::Summary summary;
-    ceres::Solve(options, &problem, &summary);
+    ceres::Solve(options, problem.problem(), &summary);
 
     if (m_verbose)
     {
@@ -380,7 +588,7 @@ PoseGraph::iterateEM(bool useRobustOptimization)
 
     int nIterations = summary.num_successful_steps + summary.num_unsuccessful_steps;
 
-    if (nIterations != 0 && useRobustOptimization)
+    if (nIterations != 0 && problem.robust())
     {
         classifySwitches();
     }
@@ -469,8 +677,8 @@ PoseGraph::classifySwitches(void)
 }
 
 void
-PoseGraph::solveP3PRansac(const FrameConstPtr& frame1,
-                          const FrameConstPtr& frame2,
+PoseGraph::solveP3PRansac(const FrameTag& frame1,
+                          const FrameTag& frame2,
                           const std::vector<cv::DMatch>& matches,
                           Eigen::Matrix4d& H,
                           std::vector<cv::DMatch>& inliers,
@@ -478,103 +686,50 @@ PoseGraph::solveP3PRansac(const FrameConstPtr& frame1,
 {
     inliers.clear();
 
-    double p = 0.99; // probability that at least one set of random samples does not contain an outlier
-    double v = 0.6; // probability of observing an outlier
-
-    double u = 1.0 - v;
-    int N = static_cast<int>(log(1.0 - p) / log(1.0 - u * u * u) + 0.5);
+    int cameraId2 = m_graph->cameraId(frame2);
+    const CameraConstPtr& camera2 = m_cameraSystem.getCamera(cameraId2);
 
-    std::vector<size_t> indices;
+    // scene points and their observations, laid out for batch projection
+    Camera::Points3D scenePoints(matches.size(), 3);
+    Camera::Points2D imagePoints(matches.size(), 2);
     for (size_t i = 0; i < matches.size(); ++i)
     {
-        indices.push_back(i);
-    }
-
-    const std::vector<Point2DFeaturePtr>& features1 = frame1->features2D();
-    const std::vector<Point2DFeaturePtr>& features2 = frame2->features2D();
-
-    const CameraConstPtr& camera2 = m_cameraSystem.getCamera(frame2->cameraId());
-
-    // run RANSAC to find best H
-    Eigen::Matrix4d H_best;
-    std::vector<size_t> inlierIds_best;
-    for (int i = 0; i < N; ++i)
-    {
-        std::random_shuffle(indices.begin(), indices.end());
-
-        std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > rays(3);
-        std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > worldPoints(3);
-        for (int j = 0; j < 3; ++j)
-        {
-            const cv::DMatch& match = matches.at(indices.at(j));
-
-            worldPoints.at(j) = features1.at(match.queryIdx)->feature3D()->point();
+        const cv::DMatch& match = matches.at(i);
 
-            const cv::KeyPoint& kpt2 = features2.at(match.trainIdx)->keypoint();
+        FeatureTag feature1 = {frame1, match.queryIdx};
+        FeatureTag feature2 = {frame2, match.trainIdx};
 
-            Eigen::Vector3d ray;
-            camera2->liftSphere(Eigen::Vector2d(kpt2.pt.x, kpt2.pt.y), ray);
+        scenePoints.row(i) = m_graph->scenePoint(feature1)->transpose();
 
-            rays.at(j) = ray;
-        }
-
-        std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d> > solutions;
-        if (!solveP3P(rays, worldPoints, solutions))
-        {
-            continue;
-        }
-
-        for (size_t j = 0; j < solutions.size(); ++j)
-        {
-            Eigen::Matrix4d H_inv = solutions.at(j).inverse();
-
-            std::vector<size_t> inliersIds;
-            for (size_t k = 0; k < matches.size(); ++k)
-            {
-                const cv::DMatch& match = matches.at(k);
-
-                Eigen::Vector3d P1 = features1.at(match.queryIdx)->feature3D()->point();
-
-                Eigen::Vector3d P2 = transformPoint(H_inv, P1);
-                Eigen::Vector2d p2_pred;
-                camera2->spaceToPlane(P2, p2_pred);
-
-                const Point2DFeatureConstPtr& f2 = features2.at(match.trainIdx);
-
-                double err = hypot(f2->keypoint().pt.x - p2_pred(0),
-                                   f2->keypoint().pt.y - p2_pred(1));
-                if (err > reprojErrorThresh)
-                {
-                    continue;
-                }
+        const cv::KeyPoint& kpt2 = m_graph->keypoint(feature2);
+        imagePoints.row(i) << kpt2.pt.x, kpt2.pt.y;
+    }
 
-                inliersIds.push_back(k);
-            }
+    // transform from the scene frame to the camera frame
+    Eigen::Matrix4d H_cam;
+    std::vector<size_t> inlierIds;
 
-            if (inliersIds.size() > inlierIds_best.size())
-            {
-                H_best = solutions.at(j);
-                inlierIds_best = inliersIds;
-            }
-        }
-    }
+    P3PRansac ransac(camera2, reprojErrorThresh);
+    ransac.estimate(scenePoints, imagePoints, H_cam, inlierIds);
 
-    for (size_t i = 0; i < inlierIds_best.size(); ++i)
+    for (size_t i = 0; i < inlierIds.size(); ++i)
     {
-        inliers.push_back(matches.at(inlierIds_best.at(i)));
+        inliers.push_back(matches.at(inlierIds.at(i)));
     }
 
-    H = H_best * m_cameraSystem.getGlobalCameraPose(frame2->cameraId()).inverse();
+    H = H_cam.inverse() * m_cameraSystem.getGlobalCameraPose(cameraId2).inverse();
 }
 
 cv::Mat
-PoseGraph::buildDescriptorMat(const std::vector<Point2DFeaturePtr>& features,
+PoseGraph::buildDescriptorMat(const FrameTag& frame,
                               std::vector<size_t>& indices,
                               bool hasScenePoint) const
 {
-    for (size_t i = 0; i < features.size(); ++i)
+    int featureCount = m_graph->featureCount(frame);
+    for (int i = 0; i < featureCount; ++i)
     {
-        if (hasScenePoint && !features.at(i)->feature3D())
+        FeatureTag feature = {frame, i};
+        if (hasScenePoint && !m_graph->scenePoint(feature))
         {
             continue;
         }
@@ -582,29 +737,37 @@ PoseGraph::buildDescriptorMat(const std::vector<Point2DFeaturePtr>& features,
         indices.push_back(i);
     }
 
-    cv::Mat dtor(indices.size(), features.at(0)->descriptor().cols, features.at(0)->descriptor().type());
+    if (indices.empty())
+    {
+        return cv::Mat();
+    }
+
+    FeatureTag feature = {frame, static_cast<int>(indices.front())};
+    cv::Mat descriptor = m_graph->descriptor(feature);
+
+    cv::Mat dtor(indices.size(), descriptor.cols, descriptor.type());
 
     for (size_t i = 0; i < indices.size(); ++i)
     {
-        features.at(indices.at(i))->descriptor().copyTo(dtor.row(i));
+        feature.index = indices.at(i);
+        m_graph->descriptor(feature).copyTo(dtor.row(i));
     }
 
     return dtor;
 }
 
 std::vector<cv::DMatch>
-PoseGraph::matchFeatures(const std::vector<Point2DFeaturePtr>& features1,
-                         const std::vector<Point2DFeaturePtr>& features2,
+PoseGraph::matchFeatures(const FrameTag& frame1,
+                         const DescriptorIndex& index2,
                          float maxDistanceRatio) const
 {
-    cv::BFMatcher descriptorMatcher(cv::NORM_L2, false);
+    std::vector<size_t> indices1;
+    cv::Mat dtor1 = buildDescriptorMat(frame1, indices1, true);
 
-    std::vector<size_t> indices1, indices2;
-    cv::Mat dtor1 = buildDescriptorMat(features1, indices1, true);
-    cv::Mat dtor2 = buildDescriptorMat(features2, indices2, false);
+    const std::vector<size_t>& indices2 = index2.featureIndices();
 
     std::vector<std::vector<cv::DMatch> > candidateMatches;
-    descriptorMatcher.knnMatch(dtor1, dtor2, candidateMatches, 2);
+    index2.knnSearch(dtor1, candidateMatches, 2, m_descriptorSearchChecks);
 
     std::vector<cv::DMatch> matches;
     for (size_t i = 0; i < candidateMatches.size(); ++i)
@@ -0,0 +1,176 @@
+#include "PoseGraphError.h"
+
+namespace camodocal
+{
+
+namespace
+{
+
+// rotation RPY2mat(r[2], r[1], r[0]) and its derivatives with respect to
+// r[0] (yaw), r[1] (pitch) and r[2] (roll)
+void
+rotationAndDerivatives(const double* const r,
+                       Eigen::Matrix3d& R, Eigen::Matrix3d dR[3])
+{
+    double cy = cos(r[0]);
+    double sy = sin(r[0]);
+    double cp = cos(r[1]);
+    double sp = sin(r[1]);
+    double cr = cos(r[2]);
+    double sr = sin(r[2]);
+
+    Eigen::Matrix3d Rz, Ry, Rx, dRz, dRy, dRx;
+    Rz << cy, -sy, 0.0,
+          sy, cy, 0.0,
+          0.0, 0.0, 1.0;
+    dRz << -sy, -cy, 0.0,
+           cy, -sy, 0.0,
+           0.0, 0.0, 0.0;
+
+    Ry << cp, 0.0, sp,
+          0.0, 1.0, 0.0,
+          -sp, 0.0, cp;
+    dRy << -sp, 0.0, cp,
+           0.0, 0.0, 0.0,
+           -cp, 0.0, -sp;
+
+    Rx << 1.0, 0.0, 0.0,
+          0.0, cr, -sr,
+          0.0, sr, cr;
+    dRx << 0.0, 0.0, 0.0,
+           0.0, -sr, -cr,
+           0.0, cr, -sr;
+
+    R = Rz * Ry * Rx;
+    dR[0] = dRz * Ry * Rx;
+    dR[1] = Rz * dRy * Rx;
+    dR[2] = Rz * Ry * dRx;
+}
+
+// derivative of (roll, pitch, yaw) = mat2RPY(m) along dm
+Eigen::Vector3d
+rpyDerivative(const Eigen::Matrix3d& m, const Eigen::Matrix3d& dm)
+{
+    double n2 = m(2,1) * m(2,1) + m(2,2) * m(2,2);
+    double n = sqrt(n2);
+    double dn = (m(2,1) * dm(2,1) + m(2,2) * dm(2,2)) / n;
+
+    Eigen::Vector3d d;
+    d(0) = (m(2,2) * dm(2,1) - m(2,1) * dm(2,2)) / n2;
+    d(1) = (-n * dm(2,0) + m(2,0) * dn) / (n2 + m(2,0) * m(2,0));
+    d(2) = (m(0,0) * dm(1,0) - m(1,0) * dm(0,0)) / (m(0,0) * m(0,0) + m(1,0) * m(1,0));
+
+    return d;
+}
+
+}
+
+AnalyticPoseGraphError::AnalyticPoseGraphError(const Transform& meas_T_01)
+ : m_meas_R_01(meas_T_01.rotation().toRotationMatrix())
+ , m_meas_t_01(meas_T_01.translation())
+{
+    for (size_t i = 0; i < 6; ++i)
+    {
+        m_weight[i] = 1.0;
+    }
+}
+
+AnalyticPoseGraphError::AnalyticPoseGraphError(const Transform& meas_T_01,
+                                               const std::vector<double>& weight)
+ : m_meas_R_01(meas_T_01.rotation().toRotationMatrix())
+ , m_meas_t_01(meas_T_01.translation())
+{
+    for (size_t i = 0; i < 6; ++i)
+    {
+        m_weight[i] = weight.at(i);
+    }
+}
+
+bool
+AnalyticPoseGraphError::Evaluate(double const* const* parameters,
+                                 double* residuals,
+                                 double** jacobians) const
+{
+    const double* const t0 = parameters[0];
+    const double* const r0 = parameters[1];
+    const double* const t1 = parameters[2];
+    const double* const r1 = parameters[3];
+
+    Eigen::Matrix3d R0, R1;
+    Eigen::Matrix3d dR0[3], dR1[3];
+    rotationAndDerivatives(r0, R0, dR0);
+    rotationAndDerivatives(r1, R1, dR1);
+
+    // err_H = meas_H_01 * H0^-1 * H1
+    Eigen::Vector3d d(t1[0] - t0[0], t1[1] - t0[1], t1[2] - t0[2]);
+    Eigen::Matrix3d A = m_meas_R_01 * R0.transpose();
+
+    Eigen::Vector3d err_t = A * d + m_meas_t_01;
+    Eigen::Matrix3d err_R = A * R1;
+
+    double roll, pitch, yaw;
+    mat2RPY(err_R, roll, pitch, yaw);
+
+    residuals[0] = err_t(0) * m_weight[0];
+    residuals[1] = err_t(1) * m_weight[1];
+    residuals[2] = err_t(2) * m_weight[2];
+
+    residuals[3] = roll * m_weight[3];
+    residuals[4] = pitch * m_weight[4];
+    residuals[5] = yaw * m_weight[5];
+
+    if (jacobians == 0)
+    {
+        return true;
+    }
+
+    Eigen::Matrix<double,6,1> w;
+    w << m_weight[0], m_weight[1], m_weight[2],
+         m_weight[3], m_weight[4], m_weight[5];
+
+    typedef Eigen::Map<Eigen::Matrix<double,6,3,Eigen::RowMajor> > JacobianMap;
+
+    if (jacobians[0] != 0)
+    {
+        JacobianMap J(jacobians[0]);
+        J.topRows(3) = -A;
+        J.bottomRows(3).setZero();
+        J = w.asDiagonal() * J;
+    }
+
+    if (jacobians[1] != 0)
+    {
+        JacobianMap J(jacobians[1]);
+        for (int k = 0; k < 3; ++k)
+        {
+            Eigen::Matrix3d dA = m_meas_R_01 * dR0[k].transpose();
+
+            J.block<3,1>(0,k) = dA * d;
+            J.block<3,1>(3,k) = rpyDerivative(err_R, dA * R1);
+        }
+        J = w.asDiagonal() * J;
+    }
+
+    if (jacobians[2] != 0)
+    {
+        JacobianMap J(jacobians[2]);
+        J.topRows(3) = A;
+        J.bottomRows(3).setZero();
+        J = w.asDiagonal() * J;
+    }
+
+    if (jacobians[3] != 0)
+    {
+        JacobianMap J(jacobians[3]);
+        J.topRows(3).setZero();
+        for (int k = 0; k < 3; ++k)
+        {
+            J.block<3,1>(3,k) = rpyDerivative(err_R, A * dR1[k]);
+        }
+        J = w.asDiagonal() * J;
+    }
+
+    return true;
+}
+
+}
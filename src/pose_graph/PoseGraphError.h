@@ -2,6 +2,7 @@
 #define POSEGRAPHERROR_H
 
 #include <camodocal/sparse_graph/Transform.h>
+#include <ceres/sized_cost_function.h>
 
 #include "camodocal/EigenUtils.h"
 
@@ -11,7 +12,7 @@ namespace camodocal
 class PoseGraphError
 {
 public:
-    PoseGraphError(Transform& meas_T_01)
+    PoseGraphError(const Transform& meas_T_01)
      : m_meas_T_01(meas_T_01)
     {
         for (size_t i = 0; i < 6; ++i)
@@ -20,7 +21,7 @@ public:
         }
     }
 
-    PoseGraphError(Transform& meas_T_01, const std::vector<double>& weight)
+    PoseGraphError(const Transform& meas_T_01, const std::vector<double>& weight)
      : m_meas_T_01(meas_T_01)
     {
         for (size_t i = 0; i < 6; ++i)
@@ -72,6 +73,27 @@ private:
     double m_weight[6];
 };
 
+/**
+ * PoseGraphError with hand-derived Jacobians. The residuals are identical,
+ * but an evaluation avoids the dual-number arithmetic of automatic
+ * differentiation.
+ */
+class AnalyticPoseGraphError : public ceres::SizedCostFunction<6, 3, 3, 3, 3>
+{
+public:
+    AnalyticPoseGraphError(const Transform& meas_T_01);
+    AnalyticPoseGraphError(const Transform& meas_T_01, const std::vector<double>& weight);
+
+    virtual bool Evaluate(double const* const* parameters,
+                          double* residuals,
+                          double** jacobians) const;
+
+private:
+    Eigen::Matrix3d m_meas_R_01;
+    Eigen::Vector3d m_meas_t_01;
+    double m_weight[6];
+};
+
 }
 
 #endif
@@ -0,0 +1,131 @@
+#include <ceres/ceres.h>
+#include <Eigen/Dense>
+#include <gtest/gtest.h>
+
+#include "PoseGraphError.h"
+
+namespace camodocal
+{
+
+namespace
+{
+
+std::vector<double>
+createWeight(void)
+{
+    std::vector<double> weight(6);
+    for (int i = 0; i < 6; ++i)
+    {
+        weight.at(i) = 0.5 + i * 0.25;
+    }
+
+    return weight;
+}
+
+Transform
+createRandomTransform(void)
+{
+    Eigen::Matrix4d H = Eigen::Matrix4d::Identity();
+    H.block<3,3>(0,0) = Eigen::AngleAxisd(M_PI * Eigen::Vector2d::Random()(0),
+                                          Eigen::Vector3d::Random().normalized()).toRotationMatrix();
+    H.block<3,1>(0,3) = Eigen::Vector3d::Random();
+
+    return Transform(H);
+}
+
+// the Jacobians of roll and yaw grow as 1 / cos(pitch), so the tolerance
+// is relative to their magnitude
+void
+compareWithAutoDiff(const Transform& meas_T_01, const std::vector<double>& weight,
+                    const Eigen::Vector3d& t0, const Eigen::Vector3d& r0,
+                    const Eigen::Vector3d& t1, const Eigen::Vector3d& r1)
+{
+    ceres::AutoDiffCostFunction<PoseGraphError, 6, 3, 3, 3, 3> autoDiffError(
+        new PoseGraphError(meas_T_01, weight));
+    AnalyticPoseGraphError analyticError(meas_T_01, weight);
+
+    const double* parameters[4] = {t0.data(), r0.data(), t1.data(), r1.data()};
+
+    double residualsAutoDiff[6], residualsAnalytic[6];
+    double jacobiansAutoDiff[4][18], jacobiansAnalytic[4][18];
+    double* jacobianPtrsAutoDiff[4] = {jacobiansAutoDiff[0], jacobiansAutoDiff[1],
+                                       jacobiansAutoDiff[2], jacobiansAutoDiff[3]};
+    double* jacobianPtrsAnalytic[4] = {jacobiansAnalytic[0], jacobiansAnalytic[1],
+                                       jacobiansAnalytic[2], jacobiansAnalytic[3]};
+
+    ASSERT_TRUE(autoDiffError.Evaluate(parameters, residualsAutoDiff, jacobianPtrsAutoDiff));
+    ASSERT_TRUE(analyticError.Evaluate(parameters, residualsAnalytic, jacobianPtrsAnalytic));
+
+    for (int j = 0; j < 6; ++j)
+    {
+        EXPECT_NEAR(residualsAutoDiff[j], residualsAnalytic[j], 1e-10);
+    }
+
+    for (int j = 0; j < 4; ++j)
+    {
+        for (int k = 0; k < 18; ++k)
+        {
+            EXPECT_NEAR(jacobiansAutoDiff[j][k], jacobiansAnalytic[j][k],
+                        1e-8 * std::max(1.0, fabs(jacobiansAutoDiff[j][k])));
+        }
+    }
+}
+
+}
+
+TEST(PoseGraphError, analyticJacobians)
+{
+    srand(0);
+
+    std::vector<double> weight = createWeight();
+
+    for (int i = 0; i < 100; ++i)
+    {
+        Transform meas_T_01 = createRandomTransform();
+
+        // the pitch of both poses lies within [-1, 1] rad
+        Eigen::Vector3d t0 = Eigen::Vector3d::Random();
+        Eigen::Vector3d r0 = Eigen::Vector3d::Random();
+        Eigen::Vector3d t1 = Eigen::Vector3d::Random();
+        Eigen::Vector3d r1 = Eigen::Vector3d::Random();
+
+        compareWithAutoDiff(meas_T_01, weight, t0, r0, t1, r1);
+    }
+}
+
+TEST(PoseGraphError, analyticJacobiansNearGimbalLock)
+{
+    srand(0);
+
+    std::vector<double> weight = createWeight();
+
+    // distance of the pitch of the error rotation from +/- pi/2
+    const double eps[] = {1e-2, 1e-3, 1e-4};
+
+    for (size_t i = 0; i < sizeof(eps) / sizeof(eps[0]); ++i)
+    {
+        for (int j = 0; j < 10; ++j)
+        {
+            Transform meas_T_01 = createRandomTransform();
+
+            Eigen::Vector3d t0 = Eigen::Vector3d::Random();
+            Eigen::Vector3d r0 = Eigen::Vector3d::Random();
+            Eigen::Vector3d t1 = Eigen::Vector3d::Random();
+
+            // choose the second pose so that err_R = meas_R_01 * R0^T * R1
+            Eigen::Vector2d rollYaw = Eigen::Vector2d::Random();
+            double pitch = (j % 2 == 0 ? 1.0 : -1.0) * (M_PI / 2.0 - eps[i]);
+
+            Eigen::Matrix3d err_R = RPY2mat(rollYaw(0), pitch, rollYaw(1));
+            Eigen::Matrix3d R0 = RPY2mat(r0(2), r0(1), r0(0));
+            Eigen::Matrix3d R1 = R0 * meas_T_01.rotation().toRotationMatrix().transpose() * err_R;
+
+            Eigen::Vector3d r1;
+            mat2RPY(R1, r1(2), r1(1), r1(0));
+
+            compareWithAutoDiff(meas_T_01, weight, t0, r0, t1, r1);
+        }
+    }
+}
+
+}
@@ -0,0 +1,1903 @@
+#include <camodocal/sparse_graph/CompactSparseGraph.h>
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/thread/lock_guard.hpp>
+#include <boost/unordered_map.hpp>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <opencv2/highgui/highgui.hpp>
+#include <stdexcept>
+#include <stdint.h>
+
+namespace camodocal
+{
+
+namespace
+{
+
+// Layout of the columnar file format. A header is followed by one array
+// of fixed-width records per column, each starting at an 8-byte aligned
+// offset. Ids of -1 denote missing references, and all values are stored
+// in native byte order as in the binary format of SparseGraph.
+const char k_columnarMagic[8] = {'C', 'S', 'G', 'R', 'A', 'P', 'H', '\0'};
+const uint32_t k_columnarVersion = 2;
+
+enum
+{
+    // number of frame sets of each segment
+    COLUMN_SEGMENTS,
+    COLUMN_FRAME_SETS,
+    // frame ids of all frame sets, indexed by camera id
+    COLUMN_FRAME_SET_FRAMES,
+    COLUMN_FRAMES,
+    COLUMN_POSES,
+    COLUMN_ODOMETRY,
+    COLUMN_KEYPOINTS,
+    COLUMN_FEATURES,
+    // packed descriptors of all frames [bytes]
+    COLUMN_DESCRIPTORS,
+    COLUMN_LINKS,
+    COLUMN_SCENE_POINTS,
+    // image paths [bytes]
+    COLUMN_STRINGS,
+    COLUMN_COUNT
+};
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t columnCount;
+    uint64_t offsets[COLUMN_COUNT];
+    uint64_t counts[COLUMN_COUNT];
+} ColumnarHeader;
+
+typedef struct
+{
+    uint32_t frameOffset;
+    uint32_t frameCount;
+    int32_t systemPoseId;
+    int32_t odometryMeasurementId;
+    int32_t gpsInsMeasurementId;
+    int32_t reserved;
+} FrameSetRecord;
+
+typedef struct
+{
+    int32_t cameraId;
+    int32_t cameraPoseId;
+    int32_t systemPoseId;
+    int32_t odometryMeasurementId;
+    int32_t gpsInsMeasurementId;
+    int32_t descriptorType;
+    int32_t descriptorCols;
+    uint32_t featureCount;
+    uint64_t featureOffset;
+    uint64_t descriptorOffset;
+    uint64_t imagePathOffset;
+    uint64_t imagePathLength;
+} FrameRecord;
+
+typedef struct
+{
+    uint64_t timeStamp;
+    double rotation[4];
+    double translation[3];
+    double covariance[49];
+} PoseRecord;
+
+typedef struct
+{
+    uint64_t timeStamp;
+    double position[3];
+    double attitude[3];
+} OdometryRecord;
+
+typedef struct
+{
+    float x;
+    float y;
+    float size;
+    float angle;
+    float response;
+    int32_t octave;
+    int32_t classId;
+} KeypointRecord;
+
+typedef struct
+{
+    uint32_t index;
+    int32_t bestPrevMatchId;
+    int32_t bestNextMatchId;
+    int32_t scenePointId;
+    uint32_t prevMatchOffset;
+    uint32_t prevMatchCount;
+    uint32_t nextMatchOffset;
+    uint32_t nextMatchCount;
+} FeatureRecord;
+
+typedef struct
+{
+    double point[3];
+    double pointCovariance[9];
+    double weight;
+    int32_t attributes;
+    uint32_t featureCount;
+    uint64_t featureOffset;
+} ScenePointRecord;
+
+const size_t k_columnRecordSizes[COLUMN_COUNT] =
+{
+    sizeof(uint64_t),
+    sizeof(FrameSetRecord),
+    sizeof(int32_t),
+    sizeof(FrameRecord),
+    sizeof(PoseRecord),
+    sizeof(OdometryRecord),
+    sizeof(KeypointRecord),
+    sizeof(FeatureRecord),
+    1,
+    sizeof(int32_t),
+    sizeof(ScenePointRecord),
+    1
+};
+
+// id of the record of a pose, which is appended on first use
+int32_t
+poseRecordId(const PosePtr& pose,
+             boost::unordered_map<const Pose*,int32_t>& poseMap,
+             std::vector<PoseRecord>& poseRecords)
+{
+    if (pose.get() == 0)
+    {
+        return -1;
+    }
+
+    boost::unordered_map<const Pose*,int32_t>::iterator it = poseMap.find(pose.get());
+    if (it != poseMap.end())
+    {
+        return it->second;
+    }
+
+    PoseRecord record;
+    record.timeStamp = pose->timeStamp();
+    memcpy(record.rotation, pose->rotationData(), sizeof(record.rotation));
+    memcpy(record.translation, pose->translationData(), sizeof(record.translation));
+    memcpy(record.covariance, pose->covarianceData(), sizeof(record.covariance));
+
+    int32_t poseId = poseRecords.size();
+    poseRecords.push_back(record);
+    poseMap.insert(std::make_pair(pose.get(), poseId));
+
+    return poseId;
+}
+
+int32_t
+odometryRecordId(const OdometryPtr& odometry,
+                 boost::unordered_map<const Odometry*,int32_t>& odometryMap,
+                 std::vector<OdometryRecord>& odometryRecords)
+{
+    if (odometry.get() == 0)
+    {
+        return -1;
+    }
+
+    boost::unordered_map<const Odometry*,int32_t>::iterator it = odometryMap.find(odometry.get());
+    if (it != odometryMap.end())
+    {
+        return it->second;
+    }
+
+    OdometryRecord record;
+    record.timeStamp = odometry->timeStamp();
+    memcpy(record.position, odometry->positionData(), sizeof(record.position));
+    memcpy(record.attitude, odometry->attitudeData(), sizeof(record.attitude));
+
+    int32_t odometryId = odometryRecords.size();
+    odometryRecords.push_back(record);
+    odometryMap.insert(std::make_pair(odometry.get(), odometryId));
+
+    return odometryId;
+}
+
+template<typename T>
+void
+writeRecords(std::ofstream& ofs, const T* records, size_t count)
+{
+    ofs.write(reinterpret_cast<const char*>(records), sizeof(T) * count);
+}
+
+// pads the file to the next 8-byte boundary
+void
+alignColumn(std::ofstream& ofs, uint64_t& offset)
+{
+    const char padding[8] = {0};
+
+    size_t nBytes = (8 - offset % 8) % 8;
+    ofs.write(padding, nBytes);
+    offset += nBytes;
+}
+
+template<typename T>
+const T*
+columnData(const char* base, const ColumnarHeader& header, int column)
+{
+    return reinterpret_cast<const T*>(base + header.offsets[column]);
+}
+
+// whether the records [offset, offset + count) lie within a column of
+// size records
+bool
+rangeInColumn(uint64_t offset, uint64_t count, uint64_t size)
+{
+    return offset <= size && count <= size - offset;
+}
+
+// whether an id is either -1 or a valid index into a table of size entries
+bool
+validId(int32_t id, uint64_t size)
+{
+    return id == -1 || (id >= 0 && static_cast<uint64_t>(id) < size);
+}
+
+// 64-bit FNV-1a over 8-byte words followed by the remaining bytes. Each
+// step folds the high half of the state back so that every input bit
+// affects the whole hash.
+uint64_t
+hashBytes(const char* data, size_t nBytes)
+{
+    const uint64_t prime = 1099511628211ULL;
+
+    uint64_t hash = 14695981039346656037ULL;
+
+    size_t nWords = nBytes / sizeof(uint64_t);
+    for (size_t i = 0; i < nWords; ++i)
+    {
+        uint64_t word;
+        memcpy(&word, data + i * sizeof(uint64_t), sizeof(word));
+
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 32;
+    }
+
+    for (size_t i = nWords * sizeof(uint64_t); i < nBytes; ++i)
+    {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * prime;
+    }
+
+    return (hash ^ nBytes) * prime;
+}
+
+bool
+frameFeatureOffsetLess(int featureId, const CompactSparseGraph::Frame& frame)
+{
+    return featureId < frame.featureOffset;
+}
+
+void
+resizeFeatures(CompactSparseGraph::Frame& frame, size_t nFeatures)
+{
+    frame.keypoints.resize(nFeatures);
+    frame.indices.resize(nFeatures, 0);
+    frame.bestPrevMatchIds.resize(nFeatures, -1);
+    frame.bestNextMatchIds.resize(nFeatures, -1);
+
+    CompactSparseGraph::LinkRange empty = {0, 0};
+    frame.prevMatches.resize(nFeatures, empty);
+    frame.nextMatches.resize(nFeatures, empty);
+    frame.scenePointIds.resize(nFeatures, -1);
+}
+
+// copies a single-row descriptor into row i of the frame's descriptor
+// matrix, which is allocated from the first descriptor seen
+bool
+packDescriptor(CompactSparseGraph::Frame& frame, size_t nFeatures, int i,
+               const cv::Mat& dtor)
+{
+    if (dtor.empty())
+    {
+        return true;
+    }
+
+    if (frame.descriptors.empty())
+    {
+        frame.descriptors = cv::Mat::zeros(nFeatures, dtor.cols, dtor.type());
+    }
+
+    if (dtor.rows != 1 || dtor.cols != frame.descriptors.cols ||
+        dtor.type() != frame.descriptors.type())
+    {
+        return false;
+    }
+
+    dtor.copyTo(frame.descriptors.row(i));
+
+    return true;
+}
+
+}
+
+CompactSparseGraph::CompactSparseGraph()
+ : m_featureCount(0)
+ , m_contentHash(0)
+{
+
+}
+
+void
+CompactSparseGraph::clear(void)
+{
+    m_frameSetSegments.clear();
+    m_frames.clear();
+    m_scenePoints.clear();
+    m_links.clear();
+    m_featureCount = 0;
+    m_contentHash = 0;
+    m_mappedFile.reset();
+}
+
+std::vector<CompactSparseGraph::FrameSetSegment>&
+CompactSparseGraph::frameSetSegments(void)
+{
+    return m_frameSetSegments;
+}
+
+const std::vector<CompactSparseGraph::FrameSetSegment>&
+CompactSparseGraph::frameSetSegments(void) const
+{
+    return m_frameSetSegments;
+}
+
+std::vector<CompactSparseGraph::Frame>&
+CompactSparseGraph::frames(void)
+{
+    return m_frames;
+}
+
+const std::vector<CompactSparseGraph::Frame>&
+CompactSparseGraph::frames(void) const
+{
+    return m_frames;
+}
+
+std::vector<CompactSparseGraph::ScenePoint, Eigen::aligned_allocator<CompactSparseGraph::ScenePoint> >&
+CompactSparseGraph::scenePoints(void)
+{
+    return m_scenePoints;
+}
+
+const std::vector<CompactSparseGraph::ScenePoint, Eigen::aligned_allocator<CompactSparseGraph::ScenePoint> >&
+CompactSparseGraph::scenePoints(void) const
+{
+    return m_scenePoints;
+}
+
+size_t
+CompactSparseGraph::featureCount(void) const
+{
+    return m_featureCount;
+}
+
+int
+CompactSparseGraph::featureFrameId(int featureId) const
+{
+    if (featureId < 0 || featureId >= static_cast<int>(m_featureCount))
+    {
+        return -1;
+    }
+
+    // empty frames share their offset with the next frame, so the last
+    // frame whose offset does not exceed the id is the one holding it
+    std::vector<Frame>::const_iterator it =
+        std::upper_bound(m_frames.begin(), m_frames.end(), featureId,
+                         frameFeatureOffsetLess);
+
+    return static_cast<int>(it - m_frames.begin()) - 1;
+}
+
+const int*
+CompactSparseGraph::links(const LinkRange& range) const
+{
+    if (range.count == 0)
+    {
+        return 0;
+    }
+
+    return &m_links.at(range.offset);
+}
+
+size_t
+CompactSparseGraph::memoryUsage(void) const
+{
+    size_t bytes = m_frames.capacity() * sizeof(Frame) +
+                   m_scenePoints.capacity() * sizeof(ScenePoint) +
+                   m_links.capacity() * sizeof(int);
+
+    for (size_t i = 0; i < m_frameSetSegments.size(); ++i)
+    {
+        const FrameSetSegment& segment = m_frameSetSegments.at(i);
+
+        bytes += segment.capacity() * sizeof(FrameSet);
+        for (size_t j = 0; j < segment.size(); ++j)
+        {
+            bytes += segment.at(j).frameIds.capacity() * sizeof(int);
+        }
+    }
+
+    for (size_t i = 0; i < m_frames.size(); ++i)
+    {
+        const Frame& frame = m_frames.at(i);
+
+        if (m_mappedFile.get() == 0)
+        {
+            bytes += frame.descriptors.total() * frame.descriptors.elemSize();
+        }
+
+        bytes += frame.keypoints.capacity() * sizeof(cv::KeyPoint) +
+                 frame.indices.capacity() * sizeof(unsigned int) +
+                 frame.bestPrevMatchIds.capacity() * sizeof(int) +
+                 frame.bestNextMatchIds.capacity() * sizeof(int) +
+                 frame.prevMatches.capacity() * sizeof(LinkRange) +
+                 frame.nextMatches.capacity() * sizeof(LinkRange) +
+                 frame.scenePointIds.capacity() * sizeof(int);
+    }
+
+    return bytes;
+}
+
+cv::Mat
+CompactSparseGraph::frameImage(int frameId)
+{
+    std::string imagePath;
+    {
+        boost::lock_guard<boost::mutex> lock(m_imageMutex);
+
+        const Frame& frame = m_frames.at(frameId);
+        if (!frame.image.empty() || frame.imagePath.empty())
+        {
+            return frame.image;
+        }
+
+        imagePath = frame.imagePath;
+    }
+
+    // threads asking for different frames decode in parallel; if two ask
+    // for the same frame, the first decoded image is kept
+    cv::Mat image = cv::imread(imagePath.c_str(), -1);
+    if (image.empty())
+    {
+        std::cout << "# WARNING: Unable to read " << imagePath << std::endl;
+        return image;
+    }
+
+    boost::lock_guard<boost::mutex> lock(m_imageMutex);
+
+    Frame& frame = m_frames.at(frameId);
+    if (frame.image.empty())
+    {
+        frame.image = image;
+    }
+
+    return frame.image;
+}
+
+void
+CompactSparseGraph::fromSparseGraph(const SparseGraph& graph)
+{
+    clear();
+
+    boost::unordered_map<const camodocal::Frame*,int> frameMap;
+    boost::unordered_map<const Point2DFeature*,int> feature2DMap;
+    boost::unordered_map<const Point3DFeature*,int> feature3DMap;
+
+    std::vector<FramePtr> frames;
+    std::vector<Point3DFeaturePtr> features3D;
+
+    int featureId = 0;
+
+    // assign ids to frames, features and scene points
+    m_frameSetSegments.resize(graph.frameSetSegments().size());
+    for (size_t segmentId = 0; segmentId < graph.frameSetSegments().size(); ++segmentId)
+    {
+        const camodocal::FrameSetSegment& segment = graph.frameSetSegment(segmentId);
+        FrameSetSegment& compactSegment = m_frameSetSegments.at(segmentId);
+
+        compactSegment.resize(segment.size());
+        for (size_t frameSetId = 0; frameSetId < segment.size(); ++frameSetId)
+        {
+            const FrameSetPtr& frameSet = segment.at(frameSetId);
+            FrameSet& compactFrameSet = compactSegment.at(frameSetId);
+
+            compactFrameSet.systemPose = frameSet->systemPose();
+            compactFrameSet.odometryMeasurement = frameSet->odometryMeasurement();
+            compactFrameSet.gpsInsMeasurement = frameSet->gpsInsMeasurement();
+
+            compactFrameSet.frameIds.assign(frameSet->frames().size(), -1);
+            for (size_t i = 0; i < frameSet->frames().size(); ++i)
+            {
+                const FramePtr& frame = frameSet->frames().at(i);
+                if (frame.get() == 0)
+                {
+                    continue;
+                }
+
+                boost::unordered_map<const camodocal::Frame*,int>::iterator it = frameMap.find(frame.get());
+                if (it != frameMap.end())
+                {
+                    compactFrameSet.frameIds.at(i) = it->second;
+                    continue;
+                }
+
+                int frameId = frames.size();
+                frameMap.insert(std::make_pair(frame.get(), frameId));
+                frames.push_back(frame);
+                compactFrameSet.frameIds.at(i) = frameId;
+
+                const std::vector<Point2DFeaturePtr>& features2D = frame->features2D();
+                for (size_t j = 0; j < features2D.size(); ++j)
+                {
+                    const Point2DFeaturePtr& feature2D = features2D.at(j);
+                    if (feature2D.get() == 0)
+                    {
+                        continue;
+                    }
+
+                    // ids follow the order in which the features are
+                    // packed below
+                    feature2DMap.insert(std::make_pair(feature2D.get(), featureId));
+                    ++featureId;
+
+                    const Point3DFeaturePtr& feature3D = feature2D->feature3D();
+                    if (feature3D.get() != 0 &&
+                        feature3DMap.find(feature3D.get()) == feature3DMap.end())
+                    {
+                        feature3DMap.insert(std::make_pair(feature3D.get(), features3D.size()));
+                        features3D.push_back(feature3D);
+                    }
+                }
+            }
+        }
+    }
+
+    std::vector<int> linkIds;
+
+    m_frames.resize(frames.size());
+    for (size_t frameId = 0; frameId < frames.size(); ++frameId)
+    {
+        const FramePtr& frame = frames.at(frameId);
+        Frame& compactFrame = m_frames.at(frameId);
+
+        compactFrame.cameraId = frame->cameraId();
+        compactFrame.cameraPose = frame->cameraPose();
+        compactFrame.systemPose = frame->systemPose();
+        compactFrame.odometryMeasurement = frame->odometryMeasurement();
+        compactFrame.gpsInsMeasurement = frame->gpsInsMeasurement();
+        compactFrame.image = frame->image();
+        compactFrame.featureOffset = m_featureCount;
+
+        const std::vector<Point2DFeaturePtr>& features2D = frame->features2D();
+
+        size_t nFeatures = 0;
+        for (size_t i = 0; i < features2D.size(); ++i)
+        {
+            if (features2D.at(i).get() != 0)
+            {
+                ++nFeatures;
+            }
+        }
+
+        resizeFeatures(compactFrame, nFeatures);
+
+        int k = 0;
+        for (size_t i = 0; i < features2D.size(); ++i)
+        {
+            const Point2DFeaturePtr& feature2D = features2D.at(i);
+            if (feature2D.get() == 0)
+            {
+                continue;
+            }
+
+            compactFrame.keypoints.at(k) = feature2D->keypoint();
+            compactFrame.indices.at(k) = feature2D->index();
+            compactFrame.bestPrevMatchIds.at(k) = feature2D->bestPrevMatchId();
+            compactFrame.bestNextMatchIds.at(k) = feature2D->bestNextMatchId();
+
+            if (!packDescriptor(compactFrame, nFeatures, k, feature2D->descriptor()))
+            {
+                std::cout << "# WARNING: CompactSparseGraph: Descriptor of feature "
+                          << feature2D.get() << " does not match the frame's descriptor layout." << std::endl;
+            }
+
+            // keep the positions of expired matches, as the best match ids
+            // index into the match lists
+            linkIds.clear();
+            for (size_t j = 0; j < feature2D->prevMatches().size(); ++j)
+            {
+                int featureId = -1;
+                if (Point2DFeaturePtr prevMatch = feature2D->prevMatches().at(j).lock())
+                {
+                    boost::unordered_map<const Point2DFeature*,int>::iterator it = feature2DMap.find(prevMatch.get());
+                    if (it != feature2DMap.end())
+                    {
+                        featureId = it->second;
+                    }
+                }
+                linkIds.push_back(featureId);
+            }
+            compactFrame.prevMatches.at(k) = appendLinks(linkIds);
+
+            linkIds.clear();
+            for (size_t j = 0; j < feature2D->nextMatches().size(); ++j)
+            {
+                int featureId = -1;
+                if (Point2DFeaturePtr nextMatch = feature2D->nextMatches().at(j).lock())
+                {
+                    boost::unordered_map<const Point2DFeature*,int>::iterator it = feature2DMap.find(nextMatch.get());
+                    if (it != feature2DMap.end())
+                    {
+                        featureId = it->second;
+                    }
+                }
+                linkIds.push_back(featureId);
+            }
+            compactFrame.nextMatches.at(k) = appendLinks(linkIds);
+
+            if (feature2D->feature3D().get() != 0)
+            {
+                compactFrame.scenePointIds.at(k) = feature3DMap[feature2D->feature3D().get()];
+            }
+
+            ++k;
+        }
+
+        m_featureCount += nFeatures;
+    }
+
+    m_scenePoints.resize(features3D.size());
+    for (size_t i = 0; i < features3D.size(); ++i)
+    {
+        const Point3DFeaturePtr& feature3D = features3D.at(i);
+        ScenePoint& scenePoint = m_scenePoints.at(i);
+
+        scenePoint.point = feature3D->point();
+        scenePoint.pointCovariance = feature3D->pointCovariance();
+        scenePoint.attributes = feature3D->attributes();
+        scenePoint.weight = feature3D->weight();
+
+        linkIds.clear();
+        for (size_t j = 0; j < feature3D->features2D().size(); ++j)
+        {
+            int featureId = -1;
+            if (Point2DFeaturePtr feature2D = feature3D->features2D().at(j).lock())
+            {
+                boost::unordered_map<const Point2DFeature*,int>::iterator it = feature2DMap.find(feature2D.get());
+                if (it != feature2DMap.end())
+                {
+                    featureId = it->second;
+                }
+            }
+            linkIds.push_back(featureId);
+        }
+        scenePoint.features2D = appendLinks(linkIds);
+    }
+}
+
+void
+CompactSparseGraph::toSparseGraph(SparseGraph& graph, bool loadImages) const
+{
+    std::vector<FramePtr> frames;
+    std::vector<Point2DFeaturePtr> features2D;
+    std::vector<Point3DFeaturePtr> features3D;
+    createSparseGraphNodes(frames, features2D, features3D);
+
+    // poses and images are shared between both representations
+    for (size_t frameId = 0; frameId < m_frames.size(); ++frameId)
+    {
+        convertFrame(frameId, loadImages, frames, features2D, features3D);
+    }
+
+    convertScenePointsAndFrameSets(graph, frames, features2D, features3D);
+}
+
+void
+CompactSparseGraph::moveToSparseGraph(SparseGraph& graph, bool loadImages)
+{
+    std::vector<FramePtr> frames;
+    std::vector<Point2DFeaturePtr> features2D;
+    std::vector<Point3DFeaturePtr> features3D;
+    createSparseGraphNodes(frames, features2D, features3D);
+
+    for (size_t frameId = 0; frameId < m_frames.size(); ++frameId)
+    {
+        convertFrame(frameId, loadImages, frames, features2D, features3D);
+
+        // the converted frame holds the only references to the descriptors
+        // and the image from now on
+        Frame& compactFrame = m_frames.at(frameId);
+        compactFrame.image.release();
+        compactFrame.descriptors.release();
+        std::vector<cv::KeyPoint>().swap(compactFrame.keypoints);
+        std::vector<unsigned int>().swap(compactFrame.indices);
+        std::vector<int>().swap(compactFrame.bestPrevMatchIds);
+        std::vector<int>().swap(compactFrame.bestNextMatchIds);
+        std::vector<LinkRange>().swap(compactFrame.prevMatches);
+        std::vector<LinkRange>().swap(compactFrame.nextMatches);
+        std::vector<int>().swap(compactFrame.scenePointIds);
+    }
+
+    convertScenePointsAndFrameSets(graph, frames, features2D, features3D);
+
+    // the scene points need the link array until here
+    clear();
+}
+
+void
+CompactSparseGraph::createSparseGraphNodes(std::vector<FramePtr>& frames,
+                                           std::vector<Point2DFeaturePtr>& features2D,
+                                           std::vector<Point3DFeaturePtr>& features3D) const
+{
+    frames.resize(m_frames.size());
+    for (size_t i = 0; i < frames.size(); ++i)
+    {
+        frames.at(i) = boost::make_shared<camodocal::Frame>();
+    }
+
+    features2D.resize(m_featureCount);
+    for (size_t i = 0; i < features2D.size(); ++i)
+    {
+        features2D.at(i) = boost::make_shared<Point2DFeature>();
+    }
+
+    features3D.resize(m_scenePoints.size());
+    for (size_t i = 0; i < features3D.size(); ++i)
+    {
+        features3D.at(i) = boost::make_shared<Point3DFeature>();
+    }
+}
+
+void
+CompactSparseGraph::convertFrame(size_t frameId, bool loadImages,
+                                 const std::vector<FramePtr>& frames,
+                                 const std::vector<Point2DFeaturePtr>& features2D,
+                                 const std::vector<Point3DFeaturePtr>& features3D) const
+{
+    const Frame& compactFrame = m_frames.at(frameId);
+    const FramePtr& frame = frames.at(frameId);
+
+    frame->cameraId() = compactFrame.cameraId;
+    frame->cameraPose() = compactFrame.cameraPose;
+    frame->systemPose() = compactFrame.systemPose;
+    frame->odometryMeasurement() = compactFrame.odometryMeasurement;
+    frame->gpsInsMeasurement() = compactFrame.gpsInsMeasurement;
+
+    frame->image() = compactFrame.image;
+    if (frame->image().empty() && loadImages && !compactFrame.imagePath.empty())
+    {
+        frame->image() = cv::imread(compactFrame.imagePath.c_str(), -1);
+        if (frame->image().empty())
+        {
+            std::cout << "# WARNING: Unable to read " << compactFrame.imagePath << std::endl;
+        }
+    }
+
+    // descriptors in a mapped file must not outlive the mapping
+    cv::Mat descriptors = compactFrame.descriptors;
+    if (m_mappedFile.get() != 0)
+    {
+        descriptors = descriptors.clone();
+    }
+
+    size_t nFeatures = compactFrame.keypoints.size();
+    frame->features2D().resize(nFeatures);
+
+    for (size_t i = 0; i < nFeatures; ++i)
+    {
+        const Point2DFeaturePtr& feature2D = features2D.at(compactFrame.featureOffset + i);
+        frame->features2D().at(i) = feature2D;
+
+        // the descriptor refers to the packed matrix without copying
+        if (!descriptors.empty())
+        {
+            feature2D->descriptor() = descriptors.row(i);
+        }
+        feature2D->keypoint() = compactFrame.keypoints.at(i);
+        feature2D->index() = compactFrame.indices.at(i);
+        feature2D->bestPrevMatchId() = compactFrame.bestPrevMatchIds.at(i);
+        feature2D->bestNextMatchId() = compactFrame.bestNextMatchIds.at(i);
+
+        const LinkRange& prevMatches = compactFrame.prevMatches.at(i);
+        feature2D->prevMatches().resize(prevMatches.count);
+        for (unsigned int j = 0; j < prevMatches.count; ++j)
+        {
+            int featureId = m_links.at(prevMatches.offset + j);
+            if (featureId != -1)
+            {
+                feature2D->prevMatches().at(j) = features2D.at(featureId);
+            }
+        }
+
+        const LinkRange& nextMatches = compactFrame.nextMatches.at(i);
+        feature2D->nextMatches().resize(nextMatches.count);
+        for (unsigned int j = 0; j < nextMatches.count; ++j)
+        {
+            int featureId = m_links.at(nextMatches.offset + j);
+            if (featureId != -1)
+            {
+                feature2D->nextMatches().at(j) = features2D.at(featureId);
+            }
+        }
+
+        int scenePointId = compactFrame.scenePointIds.at(i);
+        if (scenePointId != -1)
+        {
+            feature2D->feature3D() = features3D.at(scenePointId);
+        }
+
+        feature2D->frame() = frame;
+    }
+}
+
+void
+CompactSparseGraph::convertScenePointsAndFrameSets(SparseGraph& graph,
+                                                   const std::vector<FramePtr>& frames,
+                                                   const std::vector<Point2DFeaturePtr>& features2D,
+                                                   const std::vector<Point3DFeaturePtr>& features3D) const
+{
+    for (size_t i = 0; i < m_scenePoints.size(); ++i)
+    {
+        const ScenePoint& scenePoint = m_scenePoints.at(i);
+        const Point3DFeaturePtr& feature3D = features3D.at(i);
+
+        feature3D->point() = scenePoint.point;
+        feature3D->pointCovariance() = scenePoint.pointCovariance;
+        feature3D->attributes() = scenePoint.attributes;
+        feature3D->weight() = scenePoint.weight;
+
+        feature3D->features2D().resize(scenePoint.features2D.count);
+        for (unsigned int j = 0; j < scenePoint.features2D.count; ++j)
+        {
+            int featureId = m_links.at(scenePoint.features2D.offset + j);
+            if (featureId != -1)
+            {
+                feature3D->features2D().at(j) = features2D.at(featureId);
+            }
+        }
+    }
+
+    graph.frameSetSegments().clear();
+    graph.frameSetSegments().resize(m_frameSetSegments.size());
+    for (size_t segmentId = 0; segmentId < m_frameSetSegments.size(); ++segmentId)
+    {
+        const FrameSetSegment& compactSegment = m_frameSetSegments.at(segmentId);
+        camodocal::FrameSetSegment& segment = graph.frameSetSegment(segmentId);
+
+        segment.resize(compactSegment.size());
+        for (size_t frameSetId = 0; frameSetId < compactSegment.size(); ++frameSetId)
+        {
+            const FrameSet& compactFrameSet = compactSegment.at(frameSetId);
+
+            FrameSetPtr frameSet = boost::make_shared<camodocal::FrameSet>();
+            frameSet->systemPose() = compactFrameSet.systemPose;
+            frameSet->odometryMeasurement() = compactFrameSet.odometryMeasurement;
+            frameSet->gpsInsMeasurement() = compactFrameSet.gpsInsMeasurement;
+
+            frameSet->frames().resize(compactFrameSet.frameIds.size());
+            for (size_t i = 0; i < compactFrameSet.frameIds.size(); ++i)
+            {
+                int frameId = compactFrameSet.frameIds.at(i);
+                if (frameId != -1)
+                {
+                    frameSet->frames().at(i) = frames.at(frameId);
+                }
+            }
+
+            segment.at(frameSetId) = frameSet;
+        }
+    }
+}
+
+bool
+CompactSparseGraph::readFromFile(const std::string& filename)
+{
+    if (isColumnarFile(filename))
+    {
+        return readFromColumnarFile(filename);
+    }
+
+    return readFromBinaryFile(filename);
+}
+
+uint64_t
+CompactSparseGraph::contentHash(void) const
+{
+    return m_contentHash;
+}
+
+bool
+CompactSparseGraph::readFromBinaryFile(const std::string& filename)
+{
+    boost::filesystem::path filePath(filename);
+
+    boost::filesystem::path rootDir;
+    if (filePath.has_parent_path())
+    {
+        rootDir = filePath.parent_path();
+    }
+    else
+    {
+        rootDir = boost::filesystem::path(".");
+    }
+
+    clear();
+
+    std::ifstream ifs(filename.c_str(), std::ios::in | std::ios::binary);
+    if (!ifs.is_open())
+    {
+        return false;
+    }
+
+    size_t nFrames;
+    readData(ifs, nFrames);
+
+    size_t nPoses;
+    readData(ifs, nPoses);
+
+    size_t nOdometry;
+    readData(ifs, nOdometry);
+
+    size_t nFeatures2D;
+    readData(ifs, nFeatures2D);
+
+    size_t nFeatures3D;
+    readData(ifs, nFeatures3D);
+
+    std::vector<PosePtr> poseMap(nPoses);
+    for (size_t i = 0; i < nPoses; ++i)
+    {
+        poseMap.at(i) = boost::make_shared<Pose>();
+    }
+
+    std::vector<OdometryPtr> odometryMap(nOdometry);
+    for (size_t i = 0; i < nOdometry; ++i)
+    {
+        odometryMap.at(i) = boost::make_shared<Odometry>();
+    }
+
+    // the file ids of frames and features are arbitrary; frames keep
+    // their file ids, and features are renumbered so that the features
+    // of a frame are consecutive
+    std::vector<std::vector<size_t> > frameFeatureIds(nFrames);
+    m_frames.resize(nFrames);
+
+    for (size_t i = 0; i < nFrames; ++i)
+    {
+        size_t frameId;
+        readData(ifs, frameId);
+
+        Frame& frame = m_frames.at(frameId);
+
+        size_t imageFilenameLen;
+        readData(ifs, imageFilenameLen);
+
+        if (imageFilenameLen > 1)
+        {
+            std::vector<char> imageFilename(imageFilenameLen);
+            ifs.read(&imageFilename[0], imageFilenameLen);
+
+            boost::filesystem::path imagePath = boost::filesystem::absolute(rootDir);
+            imagePath /= &imageFilename[0];
+
+            frame.imagePath = imagePath.string();
+        }
+
+        readData(ifs, frame.cameraId);
+
+        size_t poseId;
+        readData(ifs, poseId);
+        if (poseId != static_cast<size_t>(-1))
+        {
+            frame.cameraPose = poseMap.at(poseId);
+        }
+
+        size_t odometryId;
+        readData(ifs, odometryId);
+        if (odometryId != static_cast<size_t>(-1))
+        {
+            frame.systemPose = odometryMap.at(odometryId);
+        }
+
+        readData(ifs, odometryId);
+        if (odometryId != static_cast<size_t>(-1))
+        {
+            frame.odometryMeasurement = odometryMap.at(odometryId);
+        }
+
+        readData(ifs, poseId);
+        if (poseId != static_cast<size_t>(-1))
+        {
+            frame.gpsInsMeasurement = poseMap.at(poseId);
+        }
+
+        size_t nFrameFeatures;
+        readData(ifs, nFrameFeatures);
+
+        std::vector<size_t>& featureIds = frameFeatureIds.at(frameId);
+        featureIds.reserve(nFrameFeatures);
+        for (size_t j = 0; j < nFrameFeatures; ++j)
+        {
+            size_t feature2DId;
+            readData(ifs, feature2DId);
+
+            if (feature2DId != static_cast<size_t>(-1))
+            {
+                featureIds.push_back(feature2DId);
+            }
+        }
+    }
+
+    // (frame id, index within frame) of each feature by file id
+    std::vector<std::pair<int,int> > feature2DMap(nFeatures2D, std::make_pair(-1, -1));
+    for (size_t frameId = 0; frameId < nFrames; ++frameId)
+    {
+        Frame& frame = m_frames.at(frameId);
+        const std::vector<size_t>& featureIds = frameFeatureIds.at(frameId);
+
+        frame.featureOffset = m_featureCount;
+        resizeFeatures(frame, featureIds.size());
+
+        for (size_t j = 0; j < featureIds.size(); ++j)
+        {
+            feature2DMap.at(featureIds.at(j)) = std::make_pair(frameId, j);
+        }
+
+        m_featureCount += featureIds.size();
+    }
+    frameFeatureIds.clear();
+
+    for (size_t i = 0; i < nPoses; ++i)
+    {
+        size_t poseId;
+        readData(ifs, poseId);
+
+        PosePtr& pose = poseMap.at(poseId);
+
+        readData(ifs, pose->timeStamp());
+
+        double q[4];
+        readData(ifs, q[0]);
+        readData(ifs, q[1]);
+        readData(ifs, q[2]);
+        readData(ifs, q[3]);
+
+        memcpy(pose->rotationData(), q, sizeof(double) * 4);
+
+        double t[3];
+        readData(ifs, t[0]);
+        readData(ifs, t[1]);
+        readData(ifs, t[2]);
+
+        memcpy(pose->translationData(), t, sizeof(double) * 3);
+
+        double cov[49];
+        for (int j = 0; j < 49; ++j)
+        {
+            readData(ifs, cov[j]);
+        }
+
+        memcpy(pose->covarianceData(), cov, sizeof(double) * 49);
+    }
+
+    for (size_t i = 0; i < nOdometry; ++i)
+    {
+        size_t odometryId;
+        readData(ifs, odometryId);
+
+        OdometryPtr& odometry = odometryMap.at(odometryId);
+
+        readData(ifs, odometry->timeStamp());
+        readData(ifs, odometry->x());
+        readData(ifs, odometry->y());
+        readData(ifs, odometry->z());
+        readData(ifs, odometry->yaw());
+        readData(ifs, odometry->pitch());
+        readData(ifs, odometry->roll());
+    }
+
+    std::vector<int> linkIds;
+    for (size_t i = 0; i < nFeatures2D; ++i)
+    {
+        size_t featureId;
+        readData(ifs, featureId);
+
+        const std::pair<int,int>& location = feature2DMap.at(featureId);
+
+        int type, rows, cols;
+        readData(ifs, type);
+        readData(ifs, rows);
+        readData(ifs, cols);
+
+        // descriptors are stored element by element in native byte order
+        cv::Mat dtor(rows, cols, type);
+        if (!dtor.empty())
+        {
+            ifs.read(reinterpret_cast<char*>(dtor.data), dtor.total() * dtor.elemSize());
+        }
+
+        cv::KeyPoint keypoint;
+        unsigned int index;
+        int bestPrevMatchId, bestNextMatchId;
+        readData(ifs, keypoint.angle);
+        readData(ifs, keypoint.class_id);
+        readData(ifs, keypoint.octave);
+        readData(ifs, keypoint.pt.x);
+        readData(ifs, keypoint.pt.y);
+        readData(ifs, keypoint.response);
+        readData(ifs, keypoint.size);
+        readData(ifs, index);
+        readData(ifs, bestPrevMatchId);
+        readData(ifs, bestNextMatchId);
+
+        // previous matches followed by next matches
+        LinkRange matches[2];
+        for (int k = 0; k < 2; ++k)
+        {
+            size_t nMatches;
+            readData(ifs, nMatches);
+
+            linkIds.resize(nMatches);
+            for (size_t j = 0; j < nMatches; ++j)
+            {
+                size_t matchId;
+                readData(ifs, matchId);
+
+                linkIds.at(j) = -1;
+                if (matchId != static_cast<size_t>(-1))
+                {
+                    const std::pair<int,int>& matchLocation = feature2DMap.at(matchId);
+                    if (matchLocation.first != -1)
+                    {
+                        linkIds.at(j) = m_frames.at(matchLocation.first).featureOffset + matchLocation.second;
+                    }
+                }
+            }
+
+            matches[k] = appendLinks(linkIds);
+        }
+
+        size_t feature3DId;
+        readData(ifs, feature3DId);
+
+        // the frame reference is implied by the frame's feature list
+        size_t frameId;
+        readData(ifs, frameId);
+
+        if (location.first == -1)
+        {
+            // not referenced by any frame
+            continue;
+        }
+
+        Frame& frame = m_frames.at(location.first);
+        int k = location.second;
+
+        frame.keypoints.at(k) = keypoint;
+        frame.indices.at(k) = index;
+        frame.bestPrevMatchIds.at(k) = bestPrevMatchId;
+        frame.bestNextMatchIds.at(k) = bestNextMatchId;
+        frame.prevMatches.at(k) = matches[0];
+        frame.nextMatches.at(k) = matches[1];
+
+        if (feature3DId != static_cast<size_t>(-1))
+        {
+            frame.scenePointIds.at(k) = feature3DId;
+        }
+
+        if (!packDescriptor(frame, frame.keypoints.size(), k, dtor))
+        {
+            std::cout << "# WARNING: CompactSparseGraph: Descriptor of feature "
+                      << featureId << " does not match the frame's descriptor layout." << std::endl;
+        }
+    }
+
+    m_scenePoints.resize(nFeatures3D);
+    for (size_t i = 0; i < nFeatures3D; ++i)
+    {
+        size_t scenePointId;
+        readData(ifs, scenePointId);
+
+        ScenePoint& scenePoint = m_scenePoints.at(scenePointId);
+
+        Eigen::Vector3d& P = scenePoint.point;
+        readData(ifs, P(0));
+        readData(ifs, P(1));
+        readData(ifs, P(2));
+
+        double cov[9];
+        for (int j = 0; j < 9; ++j)
+        {
+            readData(ifs, cov[j]);
+        }
+
+        memcpy(scenePoint.pointCovariance.data(), cov, sizeof(double) * 9);
+
+        readData(ifs, scenePoint.attributes);
+        readData(ifs, scenePoint.weight);
+
+        size_t nObservations;
+        readData(ifs, nObservations);
+
+        linkIds.resize(nObservations);
+        for (size_t j = 0; j < nObservations; ++j)
+        {
+            size_t featureId;
+            readData(ifs, featureId);
+
+            linkIds.at(j) = -1;
+            if (featureId != static_cast<size_t>(-1))
+            {
+                const std::pair<int,int>& location = feature2DMap.at(featureId);
+                if (location.first != -1)
+                {
+                    linkIds.at(j) = m_frames.at(location.first).featureOffset + location.second;
+                }
+            }
+        }
+
+        scenePoint.features2D = appendLinks(linkIds);
+    }
+
+    size_t nSegments;
+    readData(ifs, nSegments);
+
+    m_frameSetSegments.resize(nSegments);
+
+    for (size_t segmentId = 0; segmentId < m_frameSetSegments.size(); ++segmentId)
+    {
+        size_t nFrameSets;
+        readData(ifs, nFrameSets);
+
+        FrameSetSegment& segment = m_frameSetSegments.at(segmentId);
+        segment.resize(nFrameSets);
+
+        for (size_t frameSetId = 0; frameSetId < segment.size(); ++frameSetId)
+        {
+            FrameSet& frameSet = segment.at(frameSetId);
+
+            size_t frameSetSize;
+            readData(ifs, frameSetSize);
+
+            frameSet.frameIds.assign(frameSetSize, -1);
+            for (size_t i = 0; i < frameSetSize; ++i)
+            {
+                size_t frameId;
+                readData(ifs, frameId);
+
+                if (frameId != static_cast<size_t>(-1))
+                {
+                    frameSet.frameIds.at(i) = frameId;
+                }
+            }
+
+            size_t odometryId;
+            readData(ifs, odometryId);
+            if (odometryId != static_cast<size_t>(-1))
+            {
+                frameSet.systemPose = odometryMap.at(odometryId);
+            }
+
+            readData(ifs, odometryId);
+            if (odometryId != static_cast<size_t>(-1))
+            {
+                frameSet.odometryMeasurement = odometryMap.at(odometryId);
+            }
+
+            size_t poseId;
+            readData(ifs, poseId);
+            if (poseId != static_cast<size_t>(-1))
+            {
+                frameSet.gpsInsMeasurement = poseMap.at(poseId);
+            }
+        }
+    }
+
+    ifs.close();
+
+    try
+    {
+        boost::interprocess::file_mapping file(filename.c_str(), boost::interprocess::read_only);
+        boost::interprocess::mapped_region region(file, boost::interprocess::read_only);
+
+        m_contentHash = hashBytes(static_cast<const char*>(region.get_address()),
+                                  region.get_size());
+    }
+    catch (boost::interprocess::interprocess_exception& e)
+    {
+        std::cout << "# ERROR: Cannot map " << filename << ": " << e.what() << std::endl;
+        clear();
+        return false;
+    }
+
+    return true;
+}
+
+bool
+CompactSparseGraph::readFromColumnarFile(const std::string& filename)
+{
+    clear();
+
+    boost::filesystem::path filePath(filename);
+    boost::filesystem::path rootDir = boost::filesystem::absolute(filePath).parent_path();
+
+    // descriptors are used in place, so the mapping is private to allow
+    // them to be modified without touching the file
+    boost::shared_ptr<boost::interprocess::mapped_region> region;
+    try
+    {
+        boost::interprocess::file_mapping file(filename.c_str(), boost::interprocess::read_only);
+        region = boost::make_shared<boost::interprocess::mapped_region>(file, boost::interprocess::copy_on_write);
+    }
+    catch (boost::interprocess::interprocess_exception& e)
+    {
+        std::cout << "# ERROR: Cannot map " << filename << ": " << e.what() << std::endl;
+        return false;
+    }
+
+    const char* base = static_cast<const char*>(region->get_address());
+    size_t fileSize = region->get_size();
+
+    if (fileSize < sizeof(ColumnarHeader))
+    {
+        return false;
+    }
+
+    const ColumnarHeader& header = *reinterpret_cast<const ColumnarHeader*>(base);
+    if (memcmp(header.magic, k_columnarMagic, sizeof(k_columnarMagic)) != 0 ||
+        header.version != k_columnarVersion ||
+        header.columnCount != COLUMN_COUNT)
+    {
+        std::cout << "# ERROR: " << filename << " is not a version "
+                  << k_columnarVersion << " graph file." << std::endl;
+        return false;
+    }
+
+    for (int i = 0; i < COLUMN_COUNT; ++i)
+    {
+        if (header.offsets[i] % 8 != 0 || header.offsets[i] > fileSize ||
+            header.counts[i] > (fileSize - header.offsets[i]) / k_columnRecordSizes[i])
+        {
+            std::cout << "# ERROR: " << filename << " is truncated or corrupt." << std::endl;
+            return false;
+        }
+    }
+
+    const uint64_t* segmentSizes = columnData<uint64_t>(base, header, COLUMN_SEGMENTS);
+    const FrameSetRecord* frameSetRecords = columnData<FrameSetRecord>(base, header, COLUMN_FRAME_SETS);
+    const int32_t* frameSetFrameIds = columnData<int32_t>(base, header, COLUMN_FRAME_SET_FRAMES);
+    const FrameRecord* frameRecords = columnData<FrameRecord>(base, header, COLUMN_FRAMES);
+    const PoseRecord* poseRecords = columnData<PoseRecord>(base, header, COLUMN_POSES);
+    const OdometryRecord* odometryRecords = columnData<OdometryRecord>(base, header, COLUMN_ODOMETRY);
+    const KeypointRecord* keypointRecords = columnData<KeypointRecord>(base, header, COLUMN_KEYPOINTS);
+    const FeatureRecord* featureRecords = columnData<FeatureRecord>(base, header, COLUMN_FEATURES);
+    const char* descriptorData = columnData<char>(base, header, COLUMN_DESCRIPTORS);
+    const int32_t* links = columnData<int32_t>(base, header, COLUMN_LINKS);
+    const ScenePointRecord* scenePointRecords = columnData<ScenePointRecord>(base, header, COLUMN_SCENE_POINTS);
+    const char* strings = columnData<char>(base, header, COLUMN_STRINGS);
+
+    if (header.counts[COLUMN_KEYPOINTS] != header.counts[COLUMN_FEATURES])
+    {
+        std::cout << "# ERROR: " << filename << " is truncated or corrupt." << std::endl;
+        return false;
+    }
+
+    std::vector<PosePtr> poses(header.counts[COLUMN_POSES]);
+    for (size_t i = 0; i < poses.size(); ++i)
+    {
+        const PoseRecord& record = poseRecords[i];
+
+        poses.at(i) = boost::make_shared<Pose>();
+        poses.at(i)->timeStamp() = record.timeStamp;
+        memcpy(poses.at(i)->rotationData(), record.rotation, sizeof(record.rotation));
+        memcpy(poses.at(i)->translationData(), record.translation, sizeof(record.translation));
+        memcpy(poses.at(i)->covarianceData(), record.covariance, sizeof(record.covariance));
+    }
+
+    std::vector<OdometryPtr> odometry(header.counts[COLUMN_ODOMETRY]);
+    for (size_t i = 0; i < odometry.size(); ++i)
+    {
+        const OdometryRecord& record = odometryRecords[i];
+
+        odometry.at(i) = boost::make_shared<Odometry>();
+        odometry.at(i)->timeStamp() = record.timeStamp;
+        memcpy(odometry.at(i)->positionData(), record.position, sizeof(record.position));
+        memcpy(odometry.at(i)->attitudeData(), record.attitude, sizeof(record.attitude));
+    }
+
+    try
+    {
+        m_frames.resize(header.counts[COLUMN_FRAMES]);
+        for (size_t frameId = 0; frameId < m_frames.size(); ++frameId)
+        {
+            const FrameRecord& record = frameRecords[frameId];
+            Frame& frame = m_frames.at(frameId);
+
+            frame.cameraId = record.cameraId;
+            if (record.cameraPoseId != -1)
+            {
+                frame.cameraPose = poses.at(record.cameraPoseId);
+            }
+            if (record.systemPoseId != -1)
+            {
+                frame.systemPose = odometry.at(record.systemPoseId);
+            }
+            if (record.odometryMeasurementId != -1)
+            {
+                frame.odometryMeasurement = odometry.at(record.odometryMeasurementId);
+            }
+            if (record.gpsInsMeasurementId != -1)
+            {
+                frame.gpsInsMeasurement = poses.at(record.gpsInsMeasurementId);
+            }
+
+            if (record.imagePathLength > 0)
+            {
+                if (!rangeInColumn(record.imagePathOffset, record.imagePathLength,
+                                   header.counts[COLUMN_STRINGS]))
+                {
+                    throw std::out_of_range("image path");
+                }
+
+                boost::filesystem::path imagePath(std::string(strings + record.imagePathOffset,
+                                                              record.imagePathLength));
+                if (imagePath.is_relative())
+                {
+                    imagePath = rootDir / imagePath;
+                }
+                frame.imagePath = imagePath.string();
+            }
+
+            size_t nFeatures = record.featureCount;
+            if (record.featureOffset != m_featureCount ||
+                !rangeInColumn(m_featureCount, nFeatures, header.counts[COLUMN_FEATURES]))
+            {
+                throw std::out_of_range("features");
+            }
+
+            frame.featureOffset = m_featureCount;
+            resizeFeatures(frame, nFeatures);
+
+            const KeypointRecord* keypoints = keypointRecords + m_featureCount;
+            const FeatureRecord* features = featureRecords + m_featureCount;
+            for (size_t i = 0; i < nFeatures; ++i)
+            {
+                // the links themselves are checked once all frames are read
+                const FeatureRecord& feature = features[i];
+                if (!rangeInColumn(feature.prevMatchOffset, feature.prevMatchCount,
+                                   header.counts[COLUMN_LINKS]) ||
+                    !rangeInColumn(feature.nextMatchOffset, feature.nextMatchCount,
+                                   header.counts[COLUMN_LINKS]) ||
+                    !validId(feature.bestPrevMatchId, feature.prevMatchCount) ||
+                    !validId(feature.bestNextMatchId, feature.nextMatchCount) ||
+                    !validId(feature.scenePointId, header.counts[COLUMN_SCENE_POINTS]))
+                {
+                    throw std::out_of_range("feature links");
+                }
+
+                cv::KeyPoint& keypoint = frame.keypoints.at(i);
+                keypoint.pt.x = keypoints[i].x;
+                keypoint.pt.y = keypoints[i].y;
+                keypoint.size = keypoints[i].size;
+                keypoint.angle = keypoints[i].angle;
+                keypoint.response = keypoints[i].response;
+                keypoint.octave = keypoints[i].octave;
+                keypoint.class_id = keypoints[i].classId;
+
+                frame.indices.at(i) = feature.index;
+                frame.bestPrevMatchIds.at(i) = feature.bestPrevMatchId;
+                frame.bestNextMatchIds.at(i) = feature.bestNextMatchId;
+                frame.scenePointIds.at(i) = feature.scenePointId;
+                frame.prevMatches.at(i).offset = feature.prevMatchOffset;
+                frame.prevMatches.at(i).count = feature.prevMatchCount;
+                frame.nextMatches.at(i).offset = feature.nextMatchOffset;
+                frame.nextMatches.at(i).count = feature.nextMatchCount;
+            }
+
+            if (nFeatures > 0 && record.descriptorCols > 0)
+            {
+                // descriptors are used in place, so they have to be aligned
+                // like the rest of the file
+                if (record.descriptorType != CV_MAT_TYPE(record.descriptorType) ||
+                    CV_MAT_DEPTH(record.descriptorType) > CV_64F ||
+                    record.descriptorOffset % 8 != 0)
+                {
+                    throw std::out_of_range("descriptors");
+                }
+
+                uint64_t rowBytes = static_cast<uint64_t>(record.descriptorCols) *
+                                    CV_ELEM_SIZE(record.descriptorType);
+                if (record.descriptorOffset > header.counts[COLUMN_DESCRIPTORS] ||
+                    nFeatures > (header.counts[COLUMN_DESCRIPTORS] - record.descriptorOffset) / rowBytes)
+                {
+                    throw std::out_of_range("descriptors");
+                }
+
+                frame.descriptors = cv::Mat(nFeatures, record.descriptorCols, record.descriptorType,
+                                            const_cast<char*>(descriptorData + record.descriptorOffset));
+            }
+
+            m_featureCount += nFeatures;
+        }
+
+        m_links.assign(links, links + header.counts[COLUMN_LINKS]);
+        for (size_t i = 0; i < m_links.size(); ++i)
+        {
+            if (!validId(m_links.at(i), m_featureCount))
+            {
+                throw std::out_of_range("links");
+            }
+        }
+
+        m_scenePoints.resize(header.counts[COLUMN_SCENE_POINTS]);
+        for (size_t i = 0; i < m_scenePoints.size(); ++i)
+        {
+            const ScenePointRecord& record = scenePointRecords[i];
+            ScenePoint& scenePoint = m_scenePoints.at(i);
+
+            memcpy(scenePoint.point.data(), record.point, sizeof(record.point));
+            memcpy(scenePoint.pointCovariance.data(), record.pointCovariance, sizeof(record.pointCovariance));
+            scenePoint.attributes = record.attributes;
+            scenePoint.weight = record.weight;
+            if (!rangeInColumn(record.featureOffset, record.featureCount, m_links.size()))
+            {
+                throw std::out_of_range("scene point links");
+            }
+            scenePoint.features2D.offset = record.featureOffset;
+            scenePoint.features2D.count = record.featureCount;
+        }
+
+        m_frameSetSegments.resize(header.counts[COLUMN_SEGMENTS]);
+
+        size_t frameSetId = 0;
+        for (size_t segmentId = 0; segmentId < m_frameSetSegments.size(); ++segmentId)
+        {
+            FrameSetSegment& segment = m_frameSetSegments.at(segmentId);
+
+            if (!rangeInColumn(frameSetId, segmentSizes[segmentId], header.counts[COLUMN_FRAME_SETS]))
+            {
+                throw std::out_of_range("frame sets");
+            }
+
+            segment.resize(segmentSizes[segmentId]);
+            for (size_t i = 0; i < segment.size(); ++i, ++frameSetId)
+            {
+                const FrameSetRecord& record = frameSetRecords[frameSetId];
+                FrameSet& frameSet = segment.at(i);
+
+                if (!rangeInColumn(record.frameOffset, record.frameCount,
+                                   header.counts[COLUMN_FRAME_SET_FRAMES]))
+                {
+                    throw std::out_of_range("frame set frames");
+                }
+
+                frameSet.frameIds.assign(frameSetFrameIds + record.frameOffset,
+                                         frameSetFrameIds + record.frameOffset + record.frameCount);
+                for (size_t j = 0; j < frameSet.frameIds.size(); ++j)
+                {
+                    if (!validId(frameSet.frameIds.at(j), m_frames.size()))
+                    {
+                        throw std::out_of_range("frame set frames");
+                    }
+                }
+
+                if (record.systemPoseId != -1)
+                {
+                    frameSet.systemPose = odometry.at(record.systemPoseId);
+                }
+                if (record.odometryMeasurementId != -1)
+                {
+                    frameSet.odometryMeasurement = odometry.at(record.odometryMeasurementId);
+                }
+                if (record.gpsInsMeasurementId != -1)
+                {
+                    frameSet.gpsInsMeasurement = poses.at(record.gpsInsMeasurementId);
+                }
+            }
+        }
+    }
+    catch (std::out_of_range&)
+    {
+        std::cout << "# ERROR: " << filename << " is truncated or corrupt." << std::endl;
+        clear();
+        return false;
+    }
+
+    m_contentHash = hashBytes(base, fileSize);
+    m_mappedFile = region;
+
+    return true;
+}
+
+bool
+CompactSparseGraph::writeToColumnarFile(const std::string& filename) const
+{
+    boost::filesystem::path filePath(filename);
+    boost::filesystem::path rootDir = boost::filesystem::absolute(filePath).parent_path();
+    boost::filesystem::path imageDir = rootDir / filePath.stem();
+
+    std::ofstream ofs(filename.c_str(), std::ios::out | std::ios::binary);
+    if (!ofs.is_open())
+    {
+        return false;
+    }
+
+    boost::unordered_map<const Pose*,int32_t> poseMap;
+    boost::unordered_map<const Odometry*,int32_t> odometryMap;
+    std::vector<PoseRecord> poseRecords;
+    std::vector<OdometryRecord> odometryRecords;
+
+    std::vector<uint64_t> segmentSizes;
+    std::vector<FrameSetRecord> frameSetRecords;
+    std::vector<int32_t> frameSetFrameIds;
+    for (size_t segmentId = 0; segmentId < m_frameSetSegments.size(); ++segmentId)
+    {
+        const FrameSetSegment& segment = m_frameSetSegments.at(segmentId);
+
+        segmentSizes.push_back(segment.size());
+        for (size_t i = 0; i < segment.size(); ++i)
+        {
+            const FrameSet& frameSet = segment.at(i);
+
+            FrameSetRecord record;
+            record.frameOffset = frameSetFrameIds.size();
+            record.frameCount = frameSet.frameIds.size();
+            record.systemPoseId = odometryRecordId(frameSet.systemPose, odometryMap, odometryRecords);
+            record.odometryMeasurementId = odometryRecordId(frameSet.odometryMeasurement, odometryMap, odometryRecords);
+            record.gpsInsMeasurementId = poseRecordId(frameSet.gpsInsMeasurement, poseMap, poseRecords);
+            record.reserved = 0;
+
+            frameSetRecords.push_back(record);
+            frameSetFrameIds.insert(frameSetFrameIds.end(),
+                                    frameSet.frameIds.begin(), frameSet.frameIds.end());
+        }
+    }
+
+    std::vector<FrameRecord> frameRecords(m_frames.size());
+    std::string strings;
+    uint64_t descriptorBytes = 0;
+    for (size_t frameId = 0; frameId < m_frames.size(); ++frameId)
+    {
+        const Frame& frame = m_frames.at(frameId);
+        FrameRecord& record = frameRecords.at(frameId);
+
+        record.cameraId = frame.cameraId;
+        record.cameraPoseId = poseRecordId(frame.cameraPose, poseMap, poseRecords);
+        record.systemPoseId = odometryRecordId(frame.systemPose, odometryMap, odometryRecords);
+        record.odometryMeasurementId = odometryRecordId(frame.odometryMeasurement, odometryMap, odometryRecords);
+        record.gpsInsMeasurementId = poseRecordId(frame.gpsInsMeasurement, poseMap, poseRecords);
+        record.descriptorType = frame.descriptors.type();
+        record.descriptorCols = frame.descriptors.cols;
+        record.featureCount = frame.keypoints.size();
+        record.featureOffset = frame.featureOffset;
+        record.descriptorOffset = descriptorBytes;
+
+        descriptorBytes += frame.descriptors.total() * frame.descriptors.elemSize();
+        descriptorBytes += (8 - descriptorBytes % 8) % 8;
+
+        // images are referenced relative to the graph file where possible
+        std::string imagePath = frame.imagePath;
+        if (imagePath.empty() && !frame.image.empty())
+        {
+            if (!boost::filesystem::exists(imageDir))
+            {
+                boost::filesystem::create_directory(imageDir);
+            }
+
+            char imageFilename[255];
+            sprintf(imageFilename, "frame%lu.png", frameId);
+
+            imagePath = (imageDir / imageFilename).string();
+            cv::imwrite(imagePath.c_str(), frame.image);
+        }
+
+        std::string rootPrefix = rootDir.string() + "/";
+        if (imagePath.compare(0, rootPrefix.size(), rootPrefix) == 0)
+        {
+            imagePath = imagePath.substr(rootPrefix.size());
+        }
+
+        record.imagePathOffset = strings.size();
+        record.imagePathLength = imagePath.size();
+        strings += imagePath;
+    }
+
+    ColumnarHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, k_columnarMagic, sizeof(k_columnarMagic));
+    header.version = k_columnarVersion;
+    header.columnCount = COLUMN_COUNT;
+
+    header.counts[COLUMN_SEGMENTS] = segmentSizes.size();
+    header.counts[COLUMN_FRAME_SETS] = frameSetRecords.size();
+    header.counts[COLUMN_FRAME_SET_FRAMES] = frameSetFrameIds.size();
+    header.counts[COLUMN_FRAMES] = frameRecords.size();
+    header.counts[COLUMN_POSES] = poseRecords.size();
+    header.counts[COLUMN_ODOMETRY] = odometryRecords.size();
+    header.counts[COLUMN_KEYPOINTS] = m_featureCount;
+    header.counts[COLUMN_FEATURES] = m_featureCount;
+    header.counts[COLUMN_DESCRIPTORS] = descriptorBytes;
+    header.counts[COLUMN_LINKS] = m_links.size();
+    header.counts[COLUMN_SCENE_POINTS] = m_scenePoints.size();
+    header.counts[COLUMN_STRINGS] = strings.size();
+
+    uint64_t offset = sizeof(ColumnarHeader);
+    for (int i = 0; i < COLUMN_COUNT; ++i)
+    {
+        offset += (8 - offset % 8) % 8;
+        header.offsets[i] = offset;
+        offset += header.counts[i] * k_columnRecordSizes[i];
+    }
+
+    offset = 0;
+    writeRecords(ofs, &header, 1);
+    offset += sizeof(ColumnarHeader);
+
+    alignColumn(ofs, offset);
+    writeRecords(ofs, segmentSizes.data(), segmentSizes.size());
+    offset += segmentSizes.size() * sizeof(uint64_t);
+
+    alignColumn(ofs, offset);
+    writeRecords(ofs, frameSetRecords.data(), frameSetRecords.size());
+    offset += frameSetRecords.size() * sizeof(FrameSetRecord);
+
+    alignColumn(ofs, offset);
+    writeRecords(ofs, frameSetFrameIds.data(), frameSetFrameIds.size());
+    offset += frameSetFrameIds.size() * sizeof(int32_t);
+
+    alignColumn(ofs, offset);
+    writeRecords(ofs, frameRecords.data(), frameRecords.size());
+    offset += frameRecords.size() * sizeof(FrameRecord);
+
+    alignColumn(ofs, offset);
+    writeRecords(ofs, poseRecords.data(), poseRecords.size());
+    offset += poseRecords.size() * sizeof(PoseRecord);
+
+    alignColumn(ofs, offset);
+    writeRecords(ofs, odometryRecords.data(), odometryRecords.size());
+    offset += odometryRecords.size() * sizeof(OdometryRecord);
+
+    // the per-feature columns are written frame by frame to avoid
+    // duplicating them in memory
+    alignColumn(ofs, offset);
+    std::vector<KeypointRecord> keypointRecords;
+    for (size_t frameId = 0; frameId < m_frames.size(); ++frameId)
+    {
+        const Frame& frame = m_frames.at(frameId);
+
+        keypointRecords.resize(frame.keypoints.size());
+        for (size_t i = 0; i < frame.keypoints.size(); ++i)
+        {
+            const cv::KeyPoint& keypoint = frame.keypoints.at(i);
+            KeypointRecord& record = keypointRecords.at(i);
+
+            record.x = keypoint.pt.x;
+            record.y = keypoint.pt.y;
+            record.size = keypoint.size;
+            record.angle = keypoint.angle;
+            record.response = keypoint.response;
+            record.octave = keypoint.octave;
+            record.classId = keypoint.class_id;
+        }
+
+        writeRecords(ofs, keypointRecords.data(), keypointRecords.size());
+        offset += keypointRecords.size() * sizeof(KeypointRecord);
+    }
+
+    alignColumn(ofs, offset);
+    std::vector<FeatureRecord> featureRecords;
+    for (size_t frameId = 0; frameId < m_frames.size(); ++frameId)
+    {
+        const Frame& frame = m_frames.at(frameId);
+
+        featureRecords.resize(frame.keypoints.size());
+        for (size_t i = 0; i < frame.keypoints.size(); ++i)
+        {
+            FeatureRecord& record = featureRecords.at(i);
+
+            record.index = frame.indices.at(i);
+            record.bestPrevMatchId = frame.bestPrevMatchIds.at(i);
+            record.bestNextMatchId = frame.bestNextMatchIds.at(i);
+            record.scenePointId = frame.scenePointIds.at(i);
+            record.prevMatchOffset = frame.prevMatches.at(i).offset;
+            record.prevMatchCount = frame.prevMatches.at(i).count;
+            record.nextMatchOffset = frame.nextMatches.at(i).offset;
+            record.nextMatchCount = frame.nextMatches.at(i).count;
+        }
+
+        writeRecords(ofs, featureRecords.data(), featureRecords.size());
+        offset += featureRecords.size() * sizeof(FeatureRecord);
+    }
+
+    alignColumn(ofs, offset);
+    for (size_t frameId = 0; frameId < m_frames.size(); ++frameId)
+    {
+        const Frame& frame = m_frames.at(frameId);
+
+        for (int r = 0; r < frame.descriptors.rows; ++r)
+        {
+            writeRecords(ofs, frame.descriptors.ptr<char>(r),
+                         frame.descriptors.cols * frame.descriptors.elemSize());
+        }
+        offset += frame.descriptors.total() * frame.descriptors.elemSize();
+
+        alignColumn(ofs, offset);
+    }
+
+    alignColumn(ofs, offset);
+    writeRecords(ofs, m_links.data(), m_links.size());
+    offset += m_links.size() * sizeof(int32_t);
+
+    alignColumn(ofs, offset);
+    for (size_t i = 0; i < m_scenePoints.size(); ++i)
+    {
+        const ScenePoint& scenePoint = m_scenePoints.at(i);
+
+        ScenePointRecord record;
+        memcpy(record.point, scenePoint.point.data(), sizeof(record.point));
+        memcpy(record.pointCovariance, scenePoint.pointCovariance.data(), sizeof(record.pointCovariance));
+        record.weight = scenePoint.weight;
+        record.attributes = scenePoint.attributes;
+        record.featureCount = scenePoint.features2D.count;
+        record.featureOffset = scenePoint.features2D.offset;
+
+        writeRecords(ofs, &record, 1);
+    }
+    offset += m_scenePoints.size() * sizeof(ScenePointRecord);
+
+    alignColumn(ofs, offset);
+    ofs.write(strings.data(), strings.size());
+
+    ofs.close();
+
+    return !ofs.fail();
+}
+
+bool
+CompactSparseGraph::isColumnarFile(const std::string& filename)
+{
+    std::ifstream ifs(filename.c_str(), std::ios::in | std::ios::binary);
+    if (!ifs.is_open())
+    {
+        return false;
+    }
+
+    char magic[sizeof(k_columnarMagic)];
+    ifs.read(magic, sizeof(magic));
+
+    return ifs.good() && memcmp(magic, k_columnarMagic, sizeof(magic)) == 0;
+}
+
+CompactSparseGraph::LinkRange
+CompactSparseGraph::appendLinks(const std::vector<int>& featureIds)
+{
+    LinkRange range;
+    range.offset = m_links.size();
+    range.count = featureIds.size();
+
+    m_links.insert(m_links.end(), featureIds.begin(), featureIds.end());
+
+    return range;
+}
+
+template<typename T>
+void
+CompactSparseGraph::readData(std::ifstream& ifs, T& data) const
+{
+    ifs.read(reinterpret_cast<char*>(&data), sizeof(T));
+}
+
+}
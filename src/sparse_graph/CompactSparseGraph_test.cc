@@ -0,0 +1,435 @@
+#include <boost/filesystem.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/tuple/tuple.hpp>
+#include <boost/tuple/tuple_comparison.hpp>
+#include <camodocal/sparse_graph/CompactSparseGraph.h>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <iterator>
+#include <map>
+
+namespace camodocal
+{
+
+namespace
+{
+
+// segment, frame set, camera and feature index of a feature
+typedef boost::tuple<int,int,int,int> FeatureLocation;
+
+void
+createGraph(SparseGraph& graph)
+{
+    srand(0);
+
+    graph.frameSetSegments().resize(2);
+
+    std::vector<Point2DFeaturePtr> prevFeatures[2];
+    for (int segmentId = 0; segmentId < 2; ++segmentId)
+    {
+        FrameSetSegment& segment = graph.frameSetSegment(segmentId);
+
+        for (int frameSetId = 0; frameSetId < 4; ++frameSetId)
+        {
+            FrameSetPtr frameSet = boost::make_shared<FrameSet>();
+            frameSet->systemPose() = boost::make_shared<Odometry>();
+            frameSet->systemPose()->x() = frameSetId;
+
+            for (int cameraId = 0; cameraId < 2; ++cameraId)
+            {
+                // leave a gap in the rig
+                if (frameSetId == 2 && cameraId == 1)
+                {
+                    frameSet->frames().resize(2);
+                    continue;
+                }
+
+                FramePtr frame = boost::make_shared<Frame>();
+                frame->cameraId() = cameraId;
+                frame->cameraPose() = boost::make_shared<Pose>();
+                frame->systemPose() = frameSet->systemPose();
+
+                int nFeatures = (frameSetId == 1 && cameraId == 0) ? 0 : 5 + rand() % 10;
+
+                std::vector<Point2DFeaturePtr> features;
+                for (int i = 0; i < nFeatures; ++i)
+                {
+                    Point2DFeaturePtr feature = boost::make_shared<Point2DFeature>();
+                    feature->keypoint().pt.x = rand() % 640;
+                    feature->keypoint().pt.y = rand() % 480;
+                    feature->index() = i;
+                    feature->descriptor() = cv::Mat(1, 64, CV_32F);
+                    for (int j = 0; j < 64; ++j)
+                    {
+                        feature->descriptor().at<float>(0,j) = rand() / static_cast<float>(RAND_MAX);
+                    }
+                    feature->frame() = frame;
+
+                    std::vector<Point2DFeaturePtr>& prev = prevFeatures[cameraId];
+                    if (!prev.empty() && rand() % 2 == 0)
+                    {
+                        Point2DFeaturePtr& prevFeature = prev.at(rand() % prev.size());
+
+                        feature->prevMatches().push_back(prevFeature);
+                        feature->bestPrevMatchId() = 0;
+                        prevFeature->nextMatches().push_back(feature);
+                        prevFeature->bestNextMatchId() = prevFeature->nextMatches().size() - 1;
+
+                        Point3DFeaturePtr scenePoint = prevFeature->feature3D();
+                        if (scenePoint.get() == 0)
+                        {
+                            scenePoint = boost::make_shared<Point3DFeature>();
+                            scenePoint->point() = Eigen::Vector3d::Random();
+                            scenePoint->weight() = 0.5;
+                            scenePoint->features2D().push_back(prevFeature);
+                            prevFeature->feature3D() = scenePoint;
+                        }
+                        scenePoint->features2D().push_back(feature);
+                        feature->feature3D() = scenePoint;
+                    }
+
+                    features.push_back(feature);
+                }
+
+                frame->features2D() = features;
+                if (!features.empty())
+                {
+                    prevFeatures[cameraId] = features;
+                }
+
+                frameSet->frames().push_back(frame);
+            }
+
+            segment.push_back(frameSet);
+        }
+    }
+}
+
+void
+locateFeatures(const SparseGraph& graph,
+               std::map<const Point2DFeature*, FeatureLocation>& locations)
+{
+    for (size_t i = 0; i < graph.frameSetSegments().size(); ++i)
+    {
+        const FrameSetSegment& segment = graph.frameSetSegment(i);
+        for (size_t j = 0; j < segment.size(); ++j)
+        {
+            for (size_t k = 0; k < segment.at(j)->frames().size(); ++k)
+            {
+                const FramePtr& frame = segment.at(j)->frames().at(k);
+                if (frame.get() == 0)
+                {
+                    continue;
+                }
+
+                for (size_t l = 0; l < frame->features2D().size(); ++l)
+                {
+                    locations[frame->features2D().at(l).get()] = FeatureLocation(i, j, k, l);
+                }
+            }
+        }
+    }
+}
+
+FeatureLocation
+location(const std::map<const Point2DFeature*, FeatureLocation>& locations,
+         const Point2DFeatureWPtr& feature)
+{
+    return locations.find(feature.lock().get())->second;
+}
+
+void
+expectGraphsEqual(const SparseGraph& graph1, const SparseGraph& graph2)
+{
+    std::map<const Point2DFeature*, FeatureLocation> locations1, locations2;
+    locateFeatures(graph1, locations1);
+    locateFeatures(graph2, locations2);
+
+    ASSERT_EQ(graph1.frameSetSegments().size(), graph2.frameSetSegments().size());
+    ASSERT_EQ(graph1.scenePointCount(), graph2.scenePointCount());
+
+    for (size_t i = 0; i < graph1.frameSetSegments().size(); ++i)
+    {
+        const FrameSetSegment& segment1 = graph1.frameSetSegment(i);
+        const FrameSetSegment& segment2 = graph2.frameSetSegment(i);
+        ASSERT_EQ(segment1.size(), segment2.size());
+
+        for (size_t j = 0; j < segment1.size(); ++j)
+        {
+            const FrameSetPtr& frameSet1 = segment1.at(j);
+            const FrameSetPtr& frameSet2 = segment2.at(j);
+            ASSERT_EQ(frameSet1->frames().size(), frameSet2->frames().size());
+            EXPECT_EQ(frameSet1->systemPose()->x(), frameSet2->systemPose()->x());
+
+            for (size_t k = 0; k < frameSet1->frames().size(); ++k)
+            {
+                const FramePtr& frame1 = frameSet1->frames().at(k);
+                const FramePtr& frame2 = frameSet2->frames().at(k);
+                ASSERT_EQ(frame1.get() == 0, frame2.get() == 0);
+                if (frame1.get() == 0)
+                {
+                    continue;
+                }
+
+                EXPECT_EQ(frame1->cameraId(), frame2->cameraId());
+                ASSERT_EQ(frame1->features2D().size(), frame2->features2D().size());
+
+                for (size_t l = 0; l < frame1->features2D().size(); ++l)
+                {
+                    const Point2DFeaturePtr& feature1 = frame1->features2D().at(l);
+                    const Point2DFeaturePtr& feature2 = frame2->features2D().at(l);
+
+                    EXPECT_EQ(feature1->keypoint().pt.x, feature2->keypoint().pt.x);
+                    EXPECT_EQ(feature1->keypoint().pt.y, feature2->keypoint().pt.y);
+                    EXPECT_EQ(feature1->index(), feature2->index());
+                    EXPECT_EQ(feature1->bestPrevMatchId(), feature2->bestPrevMatchId());
+                    EXPECT_EQ(feature1->bestNextMatchId(), feature2->bestNextMatchId());
+                    EXPECT_EQ(frame2.get(), feature2->frame().lock().get());
+
+                    ASSERT_EQ(feature1->descriptor().cols, feature2->descriptor().cols);
+                    for (int c = 0; c < feature1->descriptor().cols; ++c)
+                    {
+                        EXPECT_EQ(feature1->descriptor().at<float>(0,c),
+                                  feature2->descriptor().at<float>(0,c));
+                    }
+
+                    ASSERT_EQ(feature1->prevMatches().size(), feature2->prevMatches().size());
+                    for (size_t m = 0; m < feature1->prevMatches().size(); ++m)
+                    {
+                        EXPECT_TRUE(location(locations1, feature1->prevMatches().at(m)) ==
+                                    location(locations2, feature2->prevMatches().at(m)));
+                    }
+
+                    ASSERT_EQ(feature1->nextMatches().size(), feature2->nextMatches().size());
+                    for (size_t m = 0; m < feature1->nextMatches().size(); ++m)
+                    {
+                        EXPECT_TRUE(location(locations1, feature1->nextMatches().at(m)) ==
+                                    location(locations2, feature2->nextMatches().at(m)));
+                    }
+
+                    const Point3DFeaturePtr& scenePoint1 = feature1->feature3D();
+                    const Point3DFeaturePtr& scenePoint2 = feature2->feature3D();
+                    ASSERT_EQ(scenePoint1.get() == 0, scenePoint2.get() == 0);
+                    if (scenePoint1.get() == 0)
+                    {
+                        continue;
+                    }
+
+                    EXPECT_EQ(scenePoint1->point(), scenePoint2->point());
+                    EXPECT_EQ(scenePoint1->weight(), scenePoint2->weight());
+                    ASSERT_EQ(scenePoint1->features2D().size(), scenePoint2->features2D().size());
+                    for (size_t m = 0; m < scenePoint1->features2D().size(); ++m)
+                    {
+                        EXPECT_TRUE(location(locations1, scenePoint1->features2D().at(m)) ==
+                                    location(locations2, scenePoint2->features2D().at(m)));
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+void
+writeFile(const std::string& filename, const std::vector<char>& data, size_t nBytes)
+{
+    std::ofstream ofs(filename.c_str(), std::ios::binary | std::ios::trunc);
+    ofs.write(&data[0], nBytes);
+}
+
+}
+
+TEST(CompactSparseGraph, conversion)
+{
+    SparseGraph graph;
+    createGraph(graph);
+
+    CompactSparseGraph compactGraph;
+    compactGraph.fromSparseGraph(graph);
+
+    EXPECT_EQ(graph.scenePointCount(), compactGraph.scenePoints().size());
+
+    // every feature id resolves to the frame holding it
+    for (size_t i = 0; i < compactGraph.frames().size(); ++i)
+    {
+        const CompactSparseGraph::Frame& frame = compactGraph.frames().at(i);
+        for (size_t j = 0; j < frame.keypoints.size(); ++j)
+        {
+            EXPECT_EQ(static_cast<int>(i), compactGraph.featureFrameId(frame.featureOffset + j));
+        }
+    }
+
+    SparseGraph graph2;
+    compactGraph.toSparseGraph(graph2);
+
+    expectGraphsEqual(graph, graph2);
+
+    SparseGraph graph3;
+    compactGraph.moveToSparseGraph(graph3);
+
+    expectGraphsEqual(graph, graph3);
+    EXPECT_TRUE(compactGraph.frames().empty());
+    EXPECT_EQ(0u, compactGraph.featureCount());
+}
+
+TEST(CompactSparseGraph, readFromBinaryFile)
+{
+    SparseGraph graph;
+    createGraph(graph);
+
+    boost::filesystem::path dir = boost::filesystem::temp_directory_path() /
+                                  boost::filesystem::unique_path();
+    boost::filesystem::create_directories(dir);
+
+    std::string filename = (dir / "graph.sg").string();
+    graph.writeToBinaryFile(filename);
+
+    CompactSparseGraph compactGraph;
+    ASSERT_TRUE(compactGraph.readFromBinaryFile(filename));
+
+    boost::filesystem::remove_all(dir);
+
+    SparseGraph graph2;
+    compactGraph.toSparseGraph(graph2);
+
+    expectGraphsEqual(graph, graph2);
+}
+
+TEST(CompactSparseGraph, contentHash)
+{
+    SparseGraph graph;
+    createGraph(graph);
+
+    boost::filesystem::path dir = boost::filesystem::temp_directory_path() /
+                                  boost::filesystem::unique_path();
+    boost::filesystem::create_directories(dir);
+
+    std::string binaryFilename = (dir / "graph.sg").string();
+    std::string columnarFilename = (dir / "graph.sgc").string();
+    graph.writeToBinaryFile(binaryFilename);
+
+    CompactSparseGraph compactGraph;
+    EXPECT_EQ(0u, compactGraph.contentHash());
+
+    ASSERT_TRUE(compactGraph.readFromFile(binaryFilename));
+    uint64_t binaryHash = compactGraph.contentHash();
+    uintmax_t binarySize = boost::filesystem::file_size(binaryFilename);
+
+    ASSERT_TRUE(compactGraph.writeToColumnarFile(columnarFilename));
+    ASSERT_TRUE(compactGraph.readFromFile(columnarFilename));
+    EXPECT_NE(binaryHash, compactGraph.contentHash());
+
+    // the hash does not depend on the modification time
+    std::time_t writeTime = boost::filesystem::last_write_time(binaryFilename);
+    boost::filesystem::last_write_time(binaryFilename, writeTime + 10);
+    ASSERT_TRUE(compactGraph.readFromFile(binaryFilename));
+    EXPECT_EQ(binaryHash, compactGraph.contentHash());
+
+    // but on every byte of a file of the same size and time
+    graph.frameSetSegment(1).back()->frames().back()->cameraPose()->translation()(2) += 1.0;
+    graph.writeToBinaryFile(binaryFilename);
+    boost::filesystem::last_write_time(binaryFilename, writeTime + 10);
+    ASSERT_EQ(binarySize, boost::filesystem::file_size(binaryFilename));
+
+    ASSERT_TRUE(compactGraph.readFromFile(binaryFilename));
+    EXPECT_NE(binaryHash, compactGraph.contentHash());
+
+    compactGraph.clear();
+    EXPECT_EQ(0u, compactGraph.contentHash());
+
+    boost::filesystem::remove_all(dir);
+}
+
+TEST(CompactSparseGraph, columnarFile)
+{
+    SparseGraph graph;
+    createGraph(graph);
+
+    boost::filesystem::path dir = boost::filesystem::temp_directory_path() /
+                                  boost::filesystem::unique_path();
+    boost::filesystem::create_directories(dir);
+
+    std::string filename = (dir / "graph.sgc").string();
+
+    SparseGraph graph2;
+    {
+        CompactSparseGraph compactGraph;
+        compactGraph.fromSparseGraph(graph);
+        ASSERT_TRUE(compactGraph.writeToColumnarFile(filename));
+
+        CompactSparseGraph mappedGraph;
+        ASSERT_TRUE(CompactSparseGraph::isColumnarFile(filename));
+        ASSERT_TRUE(mappedGraph.readFromFile(filename));
+        EXPECT_EQ(compactGraph.featureCount(), mappedGraph.featureCount());
+
+        // the graph built from the mapped file has to outlive the mapping
+        mappedGraph.moveToSparseGraph(graph2, false);
+    }
+
+    boost::filesystem::remove_all(dir);
+
+    expectGraphsEqual(graph, graph2);
+}
+
+TEST(CompactSparseGraph, corruptColumnarFile)
+{
+    SparseGraph graph;
+    createGraph(graph);
+
+    boost::filesystem::path dir = boost::filesystem::temp_directory_path() /
+                                  boost::filesystem::unique_path();
+    boost::filesystem::create_directories(dir);
+
+    std::string filename = (dir / "graph.sgc").string();
+    {
+        CompactSparseGraph compactGraph;
+        compactGraph.fromSparseGraph(graph);
+        ASSERT_TRUE(compactGraph.writeToColumnarFile(filename));
+    }
+
+    std::vector<char> data;
+    {
+        std::ifstream ifs(filename.c_str(), std::ios::binary);
+        data.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    }
+    ASSERT_EQ(0u, data.size() % sizeof(int32_t));
+
+    std::string corruptFilename = (dir / "corrupt.sgc").string();
+
+    writeFile(corruptFilename, data, data.size() / 2);
+    {
+        CompactSparseGraph compactGraph;
+        EXPECT_FALSE(compactGraph.readFromColumnarFile(corruptFilename));
+    }
+
+    // a file with any one word overwritten is either rejected, or all ids
+    // in it resolve when the SparseGraph is built
+    const int32_t values[] = {-2, 3, 0x7fffffff};
+
+    size_t nRejected = 0;
+    for (size_t offset = 0; offset < data.size(); offset += sizeof(int32_t))
+    {
+        for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i)
+        {
+            std::vector<char> corruptData(data);
+            memcpy(&corruptData.at(offset), &values[i], sizeof(int32_t));
+            writeFile(corruptFilename, corruptData, corruptData.size());
+
+            CompactSparseGraph compactGraph;
+            if (!compactGraph.readFromColumnarFile(corruptFilename))
+            {
+                ++nRejected;
+                continue;
+            }
+
+            SparseGraph graph2;
+            EXPECT_NO_THROW(compactGraph.toSparseGraph(graph2, false)) << "offset " << offset;
+        }
+    }
+
+    boost::filesystem::remove_all(dir);
+
+    EXPECT_LT(0u, nRejected);
+}
+
+}
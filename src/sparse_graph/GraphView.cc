@@ -0,0 +1,215 @@
+#include <camodocal/sparse_graph/GraphView.h>
+
+namespace camodocal
+{
+
+GraphView::~GraphView()
+{
+
+}
+
+SparseGraphView::SparseGraphView(const SparseGraph& graph)
+ : m_graph(graph)
+{
+
+}
+
+int
+SparseGraphView::frameSetSegmentCount(void) const
+{
+    return m_graph.frameSetSegments().size();
+}
+
+int
+SparseGraphView::frameSetCount(int segmentId) const
+{
+    return m_graph.frameSetSegment(segmentId).size();
+}
+
+const OdometryPtr&
+SparseGraphView::frameSetSystemPose(int segmentId, int frameSetId) const
+{
+    return frameSet(segmentId, frameSetId)->systemPose();
+}
+
+const OdometryPtr&
+SparseGraphView::frameSetOdometryMeasurement(int segmentId, int frameSetId) const
+{
+    return frameSet(segmentId, frameSetId)->odometryMeasurement();
+}
+
+int
+SparseGraphView::frameSlotCount(int segmentId, int frameSetId) const
+{
+    return frameSet(segmentId, frameSetId)->frames().size();
+}
+
+bool
+SparseGraphView::hasFrame(const FrameTag& frameTag) const
+{
+    return frame(frameTag).get() != 0;
+}
+
+int
+SparseGraphView::cameraId(const FrameTag& frameTag) const
+{
+    return frame(frameTag)->cameraId();
+}
+
+const OdometryPtr&
+SparseGraphView::systemPose(const FrameTag& frameTag) const
+{
+    return frame(frameTag)->systemPose();
+}
+
+int
+SparseGraphView::featureCount(const FrameTag& frameTag) const
+{
+    return frame(frameTag)->features2D().size();
+}
+
+const cv::KeyPoint&
+SparseGraphView::keypoint(const FeatureTag& featureTag) const
+{
+    return feature2D(featureTag)->keypoint();
+}
+
+cv::Mat
+SparseGraphView::descriptor(const FeatureTag& featureTag) const
+{
+    return feature2D(featureTag)->descriptor();
+}
+
+const Eigen::Vector3d*
+SparseGraphView::scenePoint(const FeatureTag& featureTag) const
+{
+    const Point3DFeaturePtr& feature3D = feature2D(featureTag)->feature3D();
+    if (!feature3D)
+    {
+        return 0;
+    }
+
+    return &feature3D->point();
+}
+
+const FramePtr&
+SparseGraphView::frame(const FrameTag& frameTag) const
+{
+    return frameSet(frameTag.frameSetSegmentId, frameTag.frameSetId)->frames().at(frameTag.frameId);
+}
+
+const Point2DFeaturePtr&
+SparseGraphView::feature2D(const FeatureTag& featureTag) const
+{
+    return frame(featureTag.frameTag)->features2D().at(featureTag.index);
+}
+
+const FrameSetPtr&
+SparseGraphView::frameSet(int segmentId, int frameSetId) const
+{
+    return m_graph.frameSetSegment(segmentId).at(frameSetId);
+}
+
+CompactSparseGraphView::CompactSparseGraphView(const CompactSparseGraph& graph)
+ : m_graph(graph)
+{
+
+}
+
+int
+CompactSparseGraphView::frameSetSegmentCount(void) const
+{
+    return m_graph.frameSetSegments().size();
+}
+
+int
+CompactSparseGraphView::frameSetCount(int segmentId) const
+{
+    return m_graph.frameSetSegments().at(segmentId).size();
+}
+
+const OdometryPtr&
+CompactSparseGraphView::frameSetSystemPose(int segmentId, int frameSetId) const
+{
+    return frameSet(segmentId, frameSetId).systemPose;
+}
+
+const OdometryPtr&
+CompactSparseGraphView::frameSetOdometryMeasurement(int segmentId, int frameSetId) const
+{
+    return frameSet(segmentId, frameSetId).odometryMeasurement;
+}
+
+int
+CompactSparseGraphView::frameSlotCount(int segmentId, int frameSetId) const
+{
+    return frameSet(segmentId, frameSetId).frameIds.size();
+}
+
+bool
+CompactSparseGraphView::hasFrame(const FrameTag& frameTag) const
+{
+    return frameId(frameTag) != -1;
+}
+
+int
+CompactSparseGraphView::cameraId(const FrameTag& frameTag) const
+{
+    return frame(frameTag).cameraId;
+}
+
+const OdometryPtr&
+CompactSparseGraphView::systemPose(const FrameTag& frameTag) const
+{
+    return frame(frameTag).systemPose;
+}
+
+int
+CompactSparseGraphView::featureCount(const FrameTag& frameTag) const
+{
+    return frame(frameTag).keypoints.size();
+}
+
+const cv::KeyPoint&
+CompactSparseGraphView::keypoint(const FeatureTag& featureTag) const
+{
+    return frame(featureTag.frameTag).keypoints.at(featureTag.index);
+}
+
+cv::Mat
+CompactSparseGraphView::descriptor(const FeatureTag& featureTag) const
+{
+    return frame(featureTag.frameTag).descriptors.row(featureTag.index);
+}
+
+const Eigen::Vector3d*
+CompactSparseGraphView::scenePoint(const FeatureTag& featureTag) const
+{
+    int scenePointId = frame(featureTag.frameTag).scenePointIds.at(featureTag.index);
+    if (scenePointId == -1)
+    {
+        return 0;
+    }
+
+    return &m_graph.scenePoints().at(scenePointId).point;
+}
+
+int
+CompactSparseGraphView::frameId(const FrameTag& frameTag) const
+{
+    return frameSet(frameTag.frameSetSegmentId, frameTag.frameSetId).frameIds.at(frameTag.frameId);
+}
+
+const CompactSparseGraph::FrameSet&
+CompactSparseGraphView::frameSet(int segmentId, int frameSetId) const
+{
+    return m_graph.frameSetSegments().at(segmentId).at(frameSetId);
+}
+
+const CompactSparseGraph::Frame&
+CompactSparseGraphView::frame(const FrameTag& frameTag) const
+{
+    return m_graph.frames().at(frameId(frameTag));
+}
+
+}
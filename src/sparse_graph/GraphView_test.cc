@@ -0,0 +1,159 @@
+#include <boost/make_shared.hpp>
+#include <camodocal/sparse_graph/GraphView.h>
+#include <gtest/gtest.h>
+
+namespace camodocal
+{
+
+namespace
+{
+
+void
+createGraph(SparseGraph& graph)
+{
+    srand(1);
+
+    graph.frameSetSegments().resize(2);
+
+    for (int segmentId = 0; segmentId < 2; ++segmentId)
+    {
+        FrameSetSegment& segment = graph.frameSetSegment(segmentId);
+
+        for (int frameSetId = 0; frameSetId < 3 + segmentId; ++frameSetId)
+        {
+            FrameSetPtr frameSet = boost::make_shared<FrameSet>();
+            frameSet->systemPose() = boost::make_shared<Odometry>();
+            frameSet->systemPose()->x() = frameSetId;
+            frameSet->odometryMeasurement() = boost::make_shared<Odometry>();
+            frameSet->odometryMeasurement()->y() = frameSetId;
+
+            for (int cameraId = 0; cameraId < 2; ++cameraId)
+            {
+                // leave a gap in the rig
+                if (frameSetId == 1 && cameraId == 0)
+                {
+                    frameSet->frames().push_back(FramePtr());
+                    continue;
+                }
+
+                FramePtr frame = boost::make_shared<Frame>();
+                frame->cameraId() = cameraId;
+                frame->systemPose() = frameSet->systemPose();
+
+                int nFeatures = (frameSetId == 2 && cameraId == 1) ? 0 : 3 + rand() % 5;
+                for (int i = 0; i < nFeatures; ++i)
+                {
+                    Point2DFeaturePtr feature = boost::make_shared<Point2DFeature>();
+                    feature->keypoint().pt.x = rand() % 640;
+                    feature->keypoint().pt.y = rand() % 480;
+                    feature->index() = i;
+                    feature->descriptor() = cv::Mat(1, 64, CV_32F);
+                    for (int j = 0; j < 64; ++j)
+                    {
+                        feature->descriptor().at<float>(0,j) = rand() / static_cast<float>(RAND_MAX);
+                    }
+                    feature->frame() = frame;
+
+                    if (rand() % 2 == 0)
+                    {
+                        Point3DFeaturePtr scenePoint = boost::make_shared<Point3DFeature>();
+                        scenePoint->point() = Eigen::Vector3d::Random();
+                        scenePoint->features2D().push_back(feature);
+                        feature->feature3D() = scenePoint;
+                    }
+
+                    frame->features2D().push_back(feature);
+                }
+
+                frameSet->frames().push_back(frame);
+            }
+
+            segment.push_back(frameSet);
+        }
+    }
+}
+
+}
+
+TEST(GraphView, compactGraphMatchesSparseGraph)
+{
+    SparseGraph graph;
+    createGraph(graph);
+
+    CompactSparseGraph compactGraph;
+    compactGraph.fromSparseGraph(graph);
+
+    SparseGraphView view(graph);
+    CompactSparseGraphView compactView(compactGraph);
+
+    ASSERT_EQ(2, view.frameSetSegmentCount());
+    ASSERT_EQ(view.frameSetSegmentCount(), compactView.frameSetSegmentCount());
+
+    int frameCount = 0;
+    for (int i = 0; i < view.frameSetSegmentCount(); ++i)
+    {
+        ASSERT_EQ(view.frameSetCount(i), compactView.frameSetCount(i));
+
+        for (int j = 0; j < view.frameSetCount(i); ++j)
+        {
+            // the views return the pose objects of the graphs, which the
+            // compact graph shares with the sparse graph
+            EXPECT_EQ(graph.frameSetSegment(i).at(j)->systemPose(),
+                      view.frameSetSystemPose(i, j));
+            EXPECT_EQ(view.frameSetSystemPose(i, j), compactView.frameSetSystemPose(i, j));
+            EXPECT_EQ(view.frameSetOdometryMeasurement(i, j),
+                      compactView.frameSetOdometryMeasurement(i, j));
+
+            ASSERT_EQ(view.frameSlotCount(i, j), compactView.frameSlotCount(i, j));
+
+            for (int k = 0; k < view.frameSlotCount(i, j); ++k)
+            {
+                FrameTag frameTag;
+                frameTag.frameSetSegmentId = i;
+                frameTag.frameSetId = j;
+                frameTag.frameId = k;
+
+                ASSERT_EQ(view.hasFrame(frameTag), compactView.hasFrame(frameTag));
+                if (!view.hasFrame(frameTag))
+                {
+                    EXPECT_EQ(-1, compactView.frameId(frameTag));
+                    continue;
+                }
+
+                ++frameCount;
+
+                EXPECT_EQ(view.cameraId(frameTag), compactView.cameraId(frameTag));
+                EXPECT_EQ(view.systemPose(frameTag), compactView.systemPose(frameTag));
+
+                ASSERT_EQ(view.featureCount(frameTag), compactView.featureCount(frameTag));
+
+                for (int l = 0; l < view.featureCount(frameTag); ++l)
+                {
+                    FeatureTag featureTag = {frameTag, l};
+
+                    EXPECT_EQ(view.feature2D(featureTag)->keypoint().pt,
+                              compactView.keypoint(featureTag).pt);
+                    EXPECT_EQ(view.keypoint(featureTag).pt, compactView.keypoint(featureTag).pt);
+
+                    cv::Mat descriptor = view.descriptor(featureTag);
+                    cv::Mat compactDescriptor = compactView.descriptor(featureTag);
+                    ASSERT_EQ(1, compactDescriptor.rows);
+                    EXPECT_EQ(0, cv::norm(descriptor, compactDescriptor, cv::NORM_INF));
+
+                    const Eigen::Vector3d* scenePoint = view.scenePoint(featureTag);
+                    const Eigen::Vector3d* compactScenePoint = compactView.scenePoint(featureTag);
+                    ASSERT_EQ(scenePoint == 0, compactScenePoint == 0);
+                    if (scenePoint != 0)
+                    {
+                        EXPECT_EQ(&view.feature2D(featureTag)->feature3D()->point(), scenePoint);
+                        EXPECT_EQ(*scenePoint, *compactScenePoint);
+                    }
+                }
+            }
+        }
+    }
+
+    EXPECT_EQ((int)compactGraph.frames().size(), frameCount);
+}
+
+}
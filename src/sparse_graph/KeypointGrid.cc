@@ -0,0 +1,198 @@
+#include <camodocal/sparse_graph/KeypointGrid.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace camodocal
+{
+
+KeypointGrid::KeypointGrid(const std::vector<cv::Point2f>& points,
+                           float cellSize)
+ : m_points(points)
+ , m_cellSize(cellSize)
+ , m_originX(0.0f)
+ , m_originY(0.0f)
+ , m_cols(1)
+ , m_rows(1)
+{
+    if (!m_points.empty())
+    {
+        float maxX = m_points.front().x;
+        float maxY = m_points.front().y;
+        m_originX = maxX;
+        m_originY = maxY;
+
+        for (size_t i = 1; i < m_points.size(); ++i)
+        {
+            m_originX = std::min(m_originX, m_points.at(i).x);
+            m_originY = std::min(m_originY, m_points.at(i).y);
+            maxX = std::max(maxX, m_points.at(i).x);
+            maxY = std::max(maxY, m_points.at(i).y);
+        }
+
+        m_cols = static_cast<int>((maxX - m_originX) / m_cellSize) + 1;
+        m_rows = static_cast<int>((maxY - m_originY) / m_cellSize) + 1;
+    }
+
+    // counting sort of the point indices by cell
+    std::vector<int> cellIds(m_points.size());
+    m_cellStart.assign(m_cols * m_rows + 1, 0);
+    for (size_t i = 0; i < m_points.size(); ++i)
+    {
+        int c = std::min(static_cast<int>((m_points.at(i).x - m_originX) / m_cellSize), m_cols - 1);
+        int r = std::min(static_cast<int>((m_points.at(i).y - m_originY) / m_cellSize), m_rows - 1);
+
+        cellIds.at(i) = r * m_cols + c;
+        ++m_cellStart.at(cellIds.at(i) + 1);
+    }
+
+    for (size_t i = 1; i < m_cellStart.size(); ++i)
+    {
+        m_cellStart.at(i) += m_cellStart.at(i - 1);
+    }
+
+    std::vector<int> fill(m_cellStart.begin(), m_cellStart.end() - 1);
+    m_cellIndices.resize(m_points.size());
+    for (size_t i = 0; i < m_points.size(); ++i)
+    {
+        m_cellIndices.at(fill.at(cellIds.at(i))++) = i;
+    }
+}
+
+size_t
+KeypointGrid::size(void) const
+{
+    return m_points.size();
+}
+
+void
+KeypointGrid::radiusSearch(const cv::Point2f& pt, float radius,
+                           std::vector<int>& indices) const
+{
+    indices.clear();
+
+    int c0, c1, r0, r1;
+    cellRange(pt, radius, radius, c0, c1, r0, r1);
+
+    float radius2 = radius * radius;
+    for (int r = r0; r <= r1; ++r)
+    {
+        for (int c = c0; c <= c1; ++c)
+        {
+            int cellId = r * m_cols + c;
+            for (int i = m_cellStart[cellId]; i < m_cellStart[cellId + 1]; ++i)
+            {
+                const cv::Point2f& p = m_points[m_cellIndices[i]];
+
+                float dx = p.x - pt.x;
+                float dy = p.y - pt.y;
+                if (dx * dx + dy * dy < radius2)
+                {
+                    indices.push_back(m_cellIndices[i]);
+                }
+            }
+        }
+    }
+
+    std::sort(indices.begin(), indices.end());
+}
+
+void
+KeypointGrid::boxSearch(const cv::Point2f& pt, float maxDeltaX, float maxDeltaY,
+                        std::vector<int>& indices) const
+{
+    indices.clear();
+
+    int c0, c1, r0, r1;
+    cellRange(pt, maxDeltaX, maxDeltaY, c0, c1, r0, r1);
+
+    for (int r = r0; r <= r1; ++r)
+    {
+        for (int c = c0; c <= c1; ++c)
+        {
+            int cellId = r * m_cols + c;
+            for (int i = m_cellStart[cellId]; i < m_cellStart[cellId + 1]; ++i)
+            {
+                const cv::Point2f& p = m_points[m_cellIndices[i]];
+
+                if (std::abs(p.x - pt.x) < maxDeltaX && std::abs(p.y - pt.y) < maxDeltaY)
+                {
+                    indices.push_back(m_cellIndices[i]);
+                }
+            }
+        }
+    }
+
+    std::sort(indices.begin(), indices.end());
+}
+
+int
+KeypointGrid::nearest(const cv::Point2f& pt, float radius) const
+{
+    int c0, c1, r0, r1;
+    cellRange(pt, radius, radius, c0, c1, r0, r1);
+
+    int bestIdx = -1;
+    float bestDist2 = radius * radius;
+    for (int r = r0; r <= r1; ++r)
+    {
+        for (int c = c0; c <= c1; ++c)
+        {
+            int cellId = r * m_cols + c;
+            for (int i = m_cellStart[cellId]; i < m_cellStart[cellId + 1]; ++i)
+            {
+                const cv::Point2f& p = m_points[m_cellIndices[i]];
+
+                float dx = p.x - pt.x;
+                float dy = p.y - pt.y;
+                float dist2 = dx * dx + dy * dy;
+                if (dist2 < bestDist2 ||
+                    (dist2 == bestDist2 && bestIdx != -1 && m_cellIndices[i] < bestIdx))
+                {
+                    bestDist2 = dist2;
+                    bestIdx = m_cellIndices[i];
+                }
+            }
+        }
+    }
+
+    return bestIdx;
+}
+
+void
+KeypointGrid::cellRange(const cv::Point2f& pt, float deltaX, float deltaY,
+                        int& c0, int& c1, int& r0, int& r1) const
+{
+    // empty range
+    c0 = 1;
+    c1 = 0;
+    r0 = 1;
+    r1 = 0;
+
+    if (m_points.empty() ||
+        !std::isfinite(pt.x) || !std::isfinite(pt.y) ||
+        !std::isfinite(deltaX) || !std::isfinite(deltaY))
+    {
+        return;
+    }
+
+    float x0 = std::floor((pt.x - deltaX - m_originX) / m_cellSize);
+    float x1 = std::floor((pt.x + deltaX - m_originX) / m_cellSize);
+    float y0 = std::floor((pt.y - deltaY - m_originY) / m_cellSize);
+    float y1 = std::floor((pt.y + deltaY - m_originY) / m_cellSize);
+
+    float maxCol = static_cast<float>(m_cols - 1);
+    float maxRow = static_cast<float>(m_rows - 1);
+    if (x1 < 0.0f || x0 > maxCol || y1 < 0.0f || y0 > maxRow)
+    {
+        return;
+    }
+
+    // clamp before casting so that the conversion is always defined
+    c0 = static_cast<int>(std::max(x0, 0.0f));
+    c1 = static_cast<int>(std::min(x1, maxCol));
+    r0 = static_cast<int>(std::max(y0, 0.0f));
+    r1 = static_cast<int>(std::min(y1, maxRow));
+}
+
+}
@@ -0,0 +1,225 @@
+#include <boost/random.hpp>
+#include <cmath>
+#include <gtest/gtest.h>
+#include <limits>
+
+#include "camodocal/sparse_graph/KeypointGrid.h"
+
+namespace camodocal
+{
+
+namespace
+{
+
+// points on the corners and edges of a 640 x 480 image, on cell
+// boundaries, and random points inside
+std::vector<cv::Point2f>
+createPoints(float cellSize, size_t randomPointCount)
+{
+    std::vector<cv::Point2f> points;
+    points.push_back(cv::Point2f(0.0f, 0.0f));
+    points.push_back(cv::Point2f(639.0f, 0.0f));
+    points.push_back(cv::Point2f(0.0f, 479.0f));
+    points.push_back(cv::Point2f(639.0f, 479.0f));
+    points.push_back(cv::Point2f(320.0f, 0.0f));
+    points.push_back(cv::Point2f(0.0f, 240.0f));
+    points.push_back(cv::Point2f(639.0f, 240.0f));
+    points.push_back(cv::Point2f(320.0f, 479.0f));
+    points.push_back(cv::Point2f(cellSize, cellSize));
+    points.push_back(cv::Point2f(2.0f * cellSize, 0.0f));
+    // duplicate
+    points.push_back(cv::Point2f(639.0f, 479.0f));
+
+    boost::mt19937 rng(42);
+    boost::uniform_real<float> x(0.0f, 639.0f);
+    boost::uniform_real<float> y(0.0f, 479.0f);
+    for (size_t i = 0; i < randomPointCount; ++i)
+    {
+        points.push_back(cv::Point2f(x(rng), y(rng)));
+    }
+
+    return points;
+}
+
+// query points include the points themselves and points outside the image
+std::vector<cv::Point2f>
+createQueries(const std::vector<cv::Point2f>& points)
+{
+    std::vector<cv::Point2f> queries(points);
+    queries.push_back(cv::Point2f(-5.0f, -5.0f));
+    queries.push_back(cv::Point2f(-0.5f, 240.0f));
+    queries.push_back(cv::Point2f(645.0f, 485.0f));
+    queries.push_back(cv::Point2f(639.5f, 100.0f));
+    queries.push_back(cv::Point2f(1000.0f, 1000.0f));
+
+    boost::mt19937 rng(7);
+    boost::uniform_real<float> x(-20.0f, 660.0f);
+    boost::uniform_real<float> y(-20.0f, 500.0f);
+    for (int i = 0; i < 200; ++i)
+    {
+        queries.push_back(cv::Point2f(x(rng), y(rng)));
+    }
+
+    return queries;
+}
+
+}
+
+TEST(KeypointGrid, radiusSearch)
+{
+    const float cellSizes[] = {1.0f, 8.0f, 50.0f, 1000.0f};
+    const float radii[] = {0.5f, 1.0f, 8.0f, 30.0f};
+
+    for (size_t c = 0; c < sizeof(cellSizes) / sizeof(cellSizes[0]); ++c)
+    {
+        std::vector<cv::Point2f> points = createPoints(cellSizes[c], 300);
+        std::vector<cv::Point2f> queries = createQueries(points);
+
+        KeypointGrid grid(points, cellSizes[c]);
+        ASSERT_EQ(points.size(), grid.size());
+
+        for (size_t r = 0; r < sizeof(radii) / sizeof(radii[0]); ++r)
+        {
+            float radius = radii[r];
+
+            for (size_t q = 0; q < queries.size(); ++q)
+            {
+                const cv::Point2f& pt = queries.at(q);
+
+                std::vector<int> expected;
+                int expectedNearest = -1;
+                float nearestDist2 = radius * radius;
+                for (size_t i = 0; i < points.size(); ++i)
+                {
+                    float dx = points.at(i).x - pt.x;
+                    float dy = points.at(i).y - pt.y;
+                    float dist2 = dx * dx + dy * dy;
+
+                    if (dist2 < radius * radius)
+                    {
+                        expected.push_back(i);
+                    }
+                    if (dist2 < nearestDist2)
+                    {
+                        nearestDist2 = dist2;
+                        expectedNearest = i;
+                    }
+                }
+
+                std::vector<int> indices;
+                grid.radiusSearch(pt, radius, indices);
+                EXPECT_EQ(expected, indices);
+
+                // ties go to the lowest index
+                EXPECT_EQ(expectedNearest, grid.nearest(pt, radius));
+            }
+        }
+    }
+}
+
+TEST(KeypointGrid, boxSearch)
+{
+    std::vector<cv::Point2f> points = createPoints(20.0f, 300);
+    std::vector<cv::Point2f> queries = createQueries(points);
+
+    KeypointGrid grid(points, 20.0f);
+
+    const float deltas[][2] = {{20.0f, 20.0f}, {5.0f, 40.0f}, {100.0f, 1.0f}};
+
+    for (size_t d = 0; d < sizeof(deltas) / sizeof(deltas[0]); ++d)
+    {
+        for (size_t q = 0; q < queries.size(); ++q)
+        {
+            const cv::Point2f& pt = queries.at(q);
+
+            std::vector<int> expected;
+            for (size_t i = 0; i < points.size(); ++i)
+            {
+                if (std::abs(points.at(i).x - pt.x) < deltas[d][0] &&
+                    std::abs(points.at(i).y - pt.y) < deltas[d][1])
+                {
+                    expected.push_back(i);
+                }
+            }
+
+            std::vector<int> indices;
+            grid.boxSearch(pt, deltas[d][0], deltas[d][1], indices);
+            EXPECT_EQ(expected, indices);
+        }
+    }
+}
+
+TEST(KeypointGrid, borders)
+{
+    // all points on a single row and column of the image border
+    std::vector<cv::Point2f> points;
+    points.push_back(cv::Point2f(0.0f, 0.0f));
+    points.push_back(cv::Point2f(639.0f, 0.0f));
+    points.push_back(cv::Point2f(0.0f, 479.0f));
+
+    KeypointGrid grid(points, 8.0f);
+
+    std::vector<int> indices;
+    grid.radiusSearch(cv::Point2f(639.0f, 0.0f), 1.0f, indices);
+    ASSERT_EQ(1u, indices.size());
+    EXPECT_EQ(1, indices.at(0));
+
+    // the grid ends at the outermost points
+    EXPECT_EQ(2, grid.nearest(cv::Point2f(0.0f, 482.0f), 4.0f));
+    EXPECT_EQ(1, grid.nearest(cv::Point2f(641.0f, -1.0f), 4.0f));
+    EXPECT_EQ(-1, grid.nearest(cv::Point2f(639.0f, 479.0f), 4.0f));
+
+    // the radius is exclusive
+    EXPECT_EQ(-1, grid.nearest(cv::Point2f(4.0f, 0.0f), 4.0f));
+    EXPECT_EQ(0, grid.nearest(cv::Point2f(3.5f, 0.0f), 4.0f));
+}
+
+TEST(KeypointGrid, empty)
+{
+    KeypointGrid grid(std::vector<cv::Point2f>(), 8.0f);
+
+    EXPECT_EQ(0u, grid.size());
+
+    std::vector<int> indices(1, 0);
+    grid.radiusSearch(cv::Point2f(0.0f, 0.0f), 10.0f, indices);
+    EXPECT_TRUE(indices.empty());
+
+    grid.boxSearch(cv::Point2f(0.0f, 0.0f), 10.0f, 10.0f, indices);
+    EXPECT_TRUE(indices.empty());
+
+    EXPECT_EQ(-1, grid.nearest(cv::Point2f(0.0f, 0.0f), 10.0f));
+}
+
+TEST(KeypointGrid, outOfRange)
+{
+    std::vector<cv::Point2f> points;
+    points.push_back(cv::Point2f(0.0f, 0.0f));
+    points.push_back(cv::Point2f(639.0f, 479.0f));
+
+    KeypointGrid grid(points, 8.0f);
+
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+    const float inf = std::numeric_limits<float>::infinity();
+
+    // non-finite queries find nothing
+    std::vector<int> indices(1, 0);
+    grid.radiusSearch(cv::Point2f(nan, 0.0f), 10.0f, indices);
+    EXPECT_TRUE(indices.empty());
+
+    grid.boxSearch(cv::Point2f(0.0f, -inf), 10.0f, 10.0f, indices);
+    EXPECT_TRUE(indices.empty());
+
+    EXPECT_EQ(-1, grid.nearest(cv::Point2f(0.0f, 0.0f), inf));
+    EXPECT_EQ(-1, grid.nearest(cv::Point2f(0.0f, 0.0f), nan));
+
+    // far away queries and huge radii stay within the grid
+    EXPECT_EQ(-1, grid.nearest(cv::Point2f(1e30f, -1e30f), 10.0f));
+
+    grid.radiusSearch(cv::Point2f(1e15f, 1e15f), 1e18f, indices);
+    ASSERT_EQ(2u, indices.size());
+
+    grid.boxSearch(cv::Point2f(320.0f, 240.0f), 3e38f, 3e38f, indices);
+    ASSERT_EQ(2u, indices.size());
+}
+
+}
@@ -1,14 +1,20 @@
 #include <camodocal/sparse_graph/SparseGraph.h>
 
+#include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/make_shared.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/unordered_set.hpp>
+#include <deque>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <opencv2/highgui/highgui.hpp>
 #include <sstream>
 
+#include "../gpl/TaskScheduler.h"
+
 namespace camodocal
 {
 
@@ -90,6 +96,45 @@ Frame::features2D(void) const
     return m_features2D;
 }
 
+// guards the lazily built feature grids of all frames; only held while
+// checking or swapping the grid pointer
+static boost::mutex s_featureGridMutex;
+
+KeypointGridConstPtr
+Frame::featureGrid(void) const
+{
+    {
+        boost::lock_guard<boost::mutex> lock(s_featureGridMutex);
+
+        if (m_featureGrid && m_featureGrid->size() == m_features2D.size())
+        {
+            return m_featureGrid;
+        }
+    }
+
+    std::vector<cv::Point2f> points(m_features2D.size());
+    for (size_t i = 0; i < m_features2D.size(); ++i)
+    {
+        points.at(i) = m_features2D.at(i)->keypoint().pt;
+    }
+
+    KeypointGridConstPtr grid = boost::make_shared<KeypointGrid>(points);
+
+    boost::lock_guard<boost::mutex> lock(s_featureGridMutex);
+
+    m_featureGrid = grid;
+
+    return grid;
+}
+
+void
+Frame::invalidateFeatureGrid(void)
+{
+    boost::lock_guard<boost::mutex> lock(s_featureGridMutex);
+
+    m_featureGrid.reset();
+}
+
 cv::Mat&
 Frame::image(void)
 {
@@ -428,6 +473,9 @@ FrameSet::gpsInsMeasurement(void) const
 }
 
 SparseGraph::SparseGraph()
+ : m_imageExtension(".png")
+ , m_imageCompressionLevel(-1)
+ , m_skipUnchangedImages(true)
 {
 
 }
@@ -892,6 +940,90 @@ SparseGraph::readFromBinaryFile(const std::string& filename)
     return true;
 }
 
+void
+SparseGraph::setImageWriteOptions(const std::string& extension,
+                                  int compressionLevel,
+                                  bool skipUnchanged)
+{
+    m_imageExtension = extension;
+    m_imageCompressionLevel = compressionLevel;
+    m_skipUnchangedImages = skipUnchanged;
+}
+
+// name of the file in each image directory that records the checksums of
+// the images written to it
+static const char* const k_imageChecksumFilename = "image_checksums.txt";
+
+typedef struct
+{
+    cv::Mat image;
+    std::string filename;
+    std::string path;
+    uint64_t checksum;
+} ImageWriteJob;
+
+// FNV-1a over the image header, pixels and encoding parameters
+static uint64_t
+imageChecksum(const cv::Mat& image, const std::vector<int>& params)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    int header[3] = {image.rows, image.cols, image.type()};
+    for (int i = 0; i < 3; ++i)
+    {
+        hash = (hash ^ static_cast<uint64_t>(header[i])) * 1099511628211ULL;
+    }
+    for (size_t i = 0; i < params.size(); ++i)
+    {
+        hash = (hash ^ static_cast<uint64_t>(params.at(i))) * 1099511628211ULL;
+    }
+
+    size_t rowBytes = image.cols * image.elemSize();
+    for (int r = 0; r < image.rows; ++r)
+    {
+        const unsigned char* row = image.ptr<unsigned char>(r);
+
+        // hash 8 bytes at a time; checksums only need to detect changes
+        size_t c = 0;
+        for (; c + 8 <= rowBytes; c += 8)
+        {
+            uint64_t word;
+            memcpy(&word, row + c, 8);
+            hash = (hash ^ word) * 1099511628211ULL;
+        }
+        for (; c < rowBytes; ++c)
+        {
+            hash = (hash ^ row[c]) * 1099511628211ULL;
+        }
+    }
+
+    return hash;
+}
+
+static void
+writeImage(ImageWriteJob& job, const std::vector<int>& params,
+           const boost::unordered_map<std::string,uint64_t>& checksums,
+           bool skipUnchanged)
+{
+    job.checksum = imageChecksum(job.image, params);
+
+    if (skipUnchanged)
+    {
+        boost::unordered_map<std::string,uint64_t>::const_iterator it = checksums.find(job.filename);
+        if (it != checksums.end() && it->second == job.checksum &&
+            boost::filesystem::exists(job.path))
+        {
+            return;
+        }
+    }
+
+    if (!cv::imwrite(job.path, job.image, params))
+    {
+        std::cout << "# WARNING: Unable to write " << job.path << std::endl;
+        job.checksum = 0;
+    }
+}
+
 void
 SparseGraph::writeToBinaryFile(const std::string& filename) const
 {
@@ -921,6 +1053,37 @@ SparseGraph::writeToBinaryFile(const std::string& filename) const
         return;
     }
 
+    std::vector<int> imageParams;
+    if (m_imageCompressionLevel >= 0)
+    {
+        std::string extension = boost::algorithm::to_lower_copy(m_imageExtension);
+        if (extension == ".png")
+        {
+            imageParams.push_back(cv::IMWRITE_PNG_COMPRESSION);
+            imageParams.push_back(m_imageCompressionLevel);
+        }
+        else if (extension == ".jpg" || extension == ".jpeg")
+        {
+            imageParams.push_back(cv::IMWRITE_JPEG_QUALITY);
+            imageParams.push_back(m_imageCompressionLevel);
+        }
+    }
+
+    boost::filesystem::path checksumPath = imageDir / k_imageChecksumFilename;
+
+    boost::unordered_map<std::string,uint64_t> imageChecksums;
+    if (m_skipUnchangedImages)
+    {
+        std::ifstream checksumFile(checksumPath.string().c_str());
+
+        std::string imageFilename;
+        uint64_t checksum;
+        while (checksumFile >> imageFilename >> std::hex >> checksum >> std::dec)
+        {
+            imageChecksums[imageFilename] = checksum;
+        }
+    }
+
     boost::unordered_map<Frame*,size_t> frameMap;
     boost::unordered_map<Pose*,size_t> poseMap;
     boost::unordered_map<Odometry*,size_t> odometryMap;
@@ -1027,6 +1190,12 @@ SparseGraph::writeToBinaryFile(const std::string& filename) const
         }
     }
 
+    // images are encoded by the task scheduler while the graph is written;
+    // appending to a deque keeps the jobs that the tasks refer to in place
+    std::deque<ImageWriteJob> imageWriteJobs;
+
+    TaskGroup imageWriters;
+
     writeData(ofs, frameMap.size());
     writeData(ofs, poseMap.size());
     writeData(ofs, odometryMap.size());
@@ -1047,13 +1216,22 @@ SparseGraph::writeToBinaryFile(const std::string& filename) const
         // attributes
         if (!frame->image().empty())
         {
-            char imageFilename[1024];
-            sprintf(imageFilename, "%s/%s.png",
-                    imageDir.string().c_str(), frameName);
-            cv::imwrite(imageFilename, frame->image());
+            imageWriteJobs.push_back(ImageWriteJob());
+
+            ImageWriteJob& job = imageWriteJobs.back();
+            job.image = frame->image();
+            job.filename = std::string(frameName) + m_imageExtension;
+            job.path = (imageDir / job.filename).string();
+            job.checksum = 0;
+
+            imageWriters.run(boost::bind(&writeImage, boost::ref(job),
+                                         boost::cref(imageParams),
+                                         boost::cref(imageChecksums),
+                                         m_skipUnchangedImages));
 
+            char imageFilename[1024];
             memset(imageFilename, 0, 1024);
-            sprintf(imageFilename, "%s/%s.png", filePath.stem().c_str(), frameName);
+            sprintf(imageFilename, "%s/%s", filePath.stem().c_str(), job.filename.c_str());
 
             size_t imageFilenameLen = strlen(imageFilename) + 1;
             writeData(ofs, imageFilenameLen);
@@ -1410,6 +1588,18 @@ SparseGraph::writeToBinaryFile(const std::string& filename) const
     }
 
     ofs.close();
+
+    imageWriters.wait();
+
+    std::ofstream checksumFile(checksumPath.string().c_str());
+    for (size_t i = 0; i < imageWriteJobs.size(); ++i)
+    {
+        const ImageWriteJob& job = imageWriteJobs.at(i);
+        if (job.checksum != 0)
+        {
+            checksumFile << job.filename << " " << std::hex << job.checksum << std::dec << std::endl;
+        }
+    }
 }
 
 template<typename T>
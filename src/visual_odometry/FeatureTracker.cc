@@ -1,3 +1,5 @@
+#include <limits>
+
 #include <boost/make_shared.hpp>
 #include <boost/thread.hpp>
 #include <Eigen/Dense>
@@ -474,6 +476,147 @@ FeatureTracker::windowedMatchingMask(const std::vector<cv::KeyPoint>& keypoints1
     }
 }
 
+void
+FeatureTracker::windowedMatchingCandidates(const std::vector<cv::KeyPoint>& keypoints1,
+                                           const std::vector<cv::KeyPoint>& keypoints2,
+                                           float maxDeltaX, float maxDeltaY,
+                                           std::vector<std::vector<int> >& candidates) const
+{
+    // keep the inner vectors so that their capacity is reused across frames
+    candidates.resize(keypoints1.size());
+
+    if (keypoints2.empty())
+    {
+        for (size_t i = 0; i < candidates.size(); ++i)
+        {
+            candidates.at(i).clear();
+        }
+        return;
+    }
+
+    std::vector<cv::Point2f> points2(keypoints2.size());
+    for (size_t i = 0; i < keypoints2.size(); ++i)
+    {
+        points2.at(i) = keypoints2.at(i).pt;
+    }
+
+    KeypointGrid grid(points2, std::max(maxDeltaX, maxDeltaY));
+
+    for (size_t i = 0; i < keypoints1.size(); ++i)
+    {
+        grid.boxSearch(keypoints1.at(i).pt, maxDeltaX, maxDeltaY, candidates.at(i));
+    }
+}
+
+static float
+descriptorDistance(const cv::Mat& dtor1, int i1,
+                   const cv::Mat& dtor2, int i2)
+{
+    if (dtor1.depth() == CV_32F)
+    {
+        const float* d1 = dtor1.ptr<float>(i1);
+        const float* d2 = dtor2.ptr<float>(i2);
+
+        float dist = 0.0f;
+        for (int k = 0; k < dtor1.cols; ++k)
+        {
+            float diff = d1[k] - d2[k];
+            dist += diff * diff;
+        }
+
+        return std::sqrt(dist);
+    }
+    else
+    {
+        // binary descriptors
+        return cv::norm(dtor1.row(i1), dtor2.row(i2), cv::NORM_HAMMING);
+    }
+}
+
+void
+FeatureTracker::matchPointFeaturesWithCandidates(const cv::Mat& dtor1,
+                                                 const cv::Mat& dtor2,
+                                                 const std::vector<std::vector<int> >& candidates,
+                                                 MatchTestType matchTestType,
+                                                 std::vector<std::vector<cv::DMatch> >& matches,
+                                                 float maxDistance) const
+{
+    double ts = timeInSeconds();
+
+    matches.clear();
+
+    size_t distanceCount = 0;
+    std::vector<cv::DMatch> radiusMatches;
+
+    for (int i = 0; i < static_cast<int>(candidates.size()); ++i)
+    {
+        const std::vector<int>& candidates1 = candidates.at(i);
+
+        // two nearest candidates
+        cv::DMatch best1(i, -1, std::numeric_limits<float>::max());
+        cv::DMatch best2(i, -1, std::numeric_limits<float>::max());
+        radiusMatches.clear();
+
+        for (size_t j = 0; j < candidates1.size(); ++j)
+        {
+            int trainIdx = candidates1.at(j);
+            float dist = descriptorDistance(dtor1, i, dtor2, trainIdx);
+
+            if (matchTestType == RADIUS)
+            {
+                if (dist < maxDistance)
+                {
+                    radiusMatches.push_back(cv::DMatch(i, trainIdx, dist));
+                }
+            }
+            else if (dist < best1.distance)
+            {
+                best2 = best1;
+                best1 = cv::DMatch(i, trainIdx, dist);
+            }
+            else if (dist < best2.distance)
+            {
+                best2 = cv::DMatch(i, trainIdx, dist);
+            }
+        }
+        distanceCount += candidates1.size();
+
+        std::vector<cv::DMatch> match;
+
+        switch (matchTestType)
+        {
+        case BEST_MATCH:
+            if (best1.trainIdx != -1)
+            {
+                match.push_back(best1);
+            }
+            break;
+        case RADIUS:
+            std::sort(radiusMatches.begin(), radiusMatches.end());
+            match = radiusMatches;
+            break;
+        case RATIO:
+        default:
+            if (best2.trainIdx != -1 &&
+                best1.distance / best2.distance < m_maxDistanceRatio)
+            {
+                match.push_back(best1);
+            }
+        }
+
+        if (!match.empty())
+        {
+            matches.push_back(match);
+        }
+    }
+
+    if (m_verbose)
+    {
+        std::cout << "# INFO: Descriptor matching took " << timeInSeconds() - ts
+                  << "s (" << distanceCount << " candidate pairs)." << std::endl;
+    }
+}
+
 /***************************************************/
 /* Temporal Feature Tracker                           */
 /***************************************************/
@@ -556,22 +699,23 @@ TemporalFeatureTracker::addFrame(FramePtr& frame, const cv::Mat& mask)
     {
         std::vector<std::vector<cv::DMatch> > matches;
 
-        windowedMatchingMask(m_kpts, m_kptsPrev, k_maxDelta, k_maxDelta, m_matchingMask);
+        if ((m_matchTestType & 0x10) == 0x10)
+        {
+            // GPU matchers take a dense mask
+            windowedMatchingMask(m_kpts, m_kptsPrev, k_maxDelta, k_maxDelta, m_matchingMask);
 
-        cv::Mat matchingMask_rOI(m_matchingMask, cv::Rect(0, 0, m_kptsPrev.size(), m_kpts.size()));
+            cv::Mat matchingMask_rOI(m_matchingMask, cv::Rect(0, 0, m_kptsPrev.size(), m_kpts.size()));
 
-        switch (m_matchTestType)
-        {
-        case BEST_MATCH:
-            matchPointFeaturesWithBestMatchTest(m_dtor, m_dtorPrev, matches, matchingMask_rOI);
-            break;
-        case RADIUS:
-            matchPointFeaturesWithRadiusTest(m_dtor, m_dtorPrev, matches, matchingMask_rOI);
-            break;
-        case RATIO:
-        default:
             matchPointFeaturesWithRatioTest(m_dtor, m_dtorPrev, matches, matchingMask_rOI);
         }
+        else
+        {
+            // only spatially plausible pairs are compared
+            windowedMatchingCandidates(m_kpts, m_kptsPrev, k_maxDelta, k_maxDelta, m_matchingCandidates);
+
+            matchPointFeaturesWithCandidates(m_dtor, m_dtorPrev, m_matchingCandidates,
+                                             m_matchTestType, matches);
+        }
 
         for (size_t i = 0; i < matches.size(); ++i)
         {
@@ -676,22 +820,25 @@ TemporalFeatureTracker::addFrame(FramePtr& frame, const cv::Mat& mask)
                 ++itF2D;
             }
         }
+
+        m_framePrev->invalidateFeatureGrid();
     }
 
     m_kptsPrev = m_kpts;
     m_dtor.copyTo(m_dtorPrev);
     m_framePrev = frame;
 
-    if (!m_image.empty())
-    {
-        m_image.copyTo(frame->image());
-    }
+    // hand the converted image over to the frame; m_image is reset so that
+    // the next frame is converted into a new buffer instead of this one
+    frame->image() = m_image;
+    m_image = cv::Mat();
 
     frame->features2D() = m_pointFeatures;
     for (size_t i = 0; i < m_pointFeatures.size(); ++i)
     {
         frame->features2D().at(i)->frame() = frame;
     }
+    frame->invalidateFeatureGrid();
 
     if (!m_init)
     {
@@ -739,7 +886,7 @@ TemporalFeatureTracker::addFrame(FramePtr& frame, const cv::Mat& mask)
         }
     }
 
-    cv::cvtColor(m_image, m_sketch, CV_GRAY2BGR);
+    cv::cvtColor(frame->image(), m_sketch, CV_GRAY2BGR);
     cv::drawKeypoints(m_sketch, m_kpts, m_sketch, cv::Scalar(0, 0, 255));
 
     visualizeTracks();
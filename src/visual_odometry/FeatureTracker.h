@@ -83,6 +83,22 @@ protected:
                               float maxDeltaX, float maxDeltaY,
                               cv::Mat& mask) const;
 
+    // Sparse alternative to windowedMatchingMask: candidates[i] holds the
+    // indices of keypoints2 within the window around keypoints1[i].
+    void windowedMatchingCandidates(const std::vector<cv::KeyPoint>& keypoints1,
+                                    const std::vector<cv::KeyPoint>& keypoints2,
+                                    float maxDeltaX, float maxDeltaY,
+                                    std::vector<std::vector<int> >& candidates) const;
+
+    // Applies the best match, radius or ratio test while only computing
+    // descriptor distances for the candidate pairs.
+    void matchPointFeaturesWithCandidates(const cv::Mat& dtor1,
+                                          const cv::Mat& dtor2,
+                                          const std::vector<std::vector<int> >& candidates,
+                                          MatchTestType matchTestType,
+                                          std::vector<std::vector<cv::DMatch> >& matches,
+                                          float maxDistance = 0.01f) const;
+
     int m_cameraIdx;
     cv::Mat m_cameraMatrix;
 
@@ -148,6 +164,7 @@ protected:
     std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d> > m_poses;
 
     cv::Mat m_matchingMask;
+    std::vector<std::vector<int> > m_matchingCandidates;
     const float k_maxDelta;
     const int k_minFeatureCorrespondences;
     const double k_nominalFocalLength;
@@ -0,0 +1,244 @@
+#include <algorithm>
+#include <gtest/gtest.h>
+
+#include "FeatureTracker.h"
+
+namespace camodocal
+{
+
+namespace
+{
+
+const float k_maxDelta = 80.0f;
+
+// exposes the matching functions of FeatureTracker
+class MatchingFeatureTracker: public FeatureTracker
+{
+public:
+    explicit MatchingFeatureTracker(DescriptorType descriptorType)
+     : FeatureTracker(descriptorType == ORB_DESCRIPTOR ? ORB_DETECTOR : SURF_DETECTOR,
+                      descriptorType)
+    {
+
+    }
+
+    cv::Ptr<cv::DescriptorMatcher>& descriptorMatcher(void)
+    {
+        return m_descriptorMatcher;
+    }
+
+    using FeatureTracker::matchPointFeaturesWithCandidates;
+    using FeatureTracker::matchPointFeaturesWithRadiusTest;
+    using FeatureTracker::matchPointFeaturesWithRatioTest;
+    using FeatureTracker::windowedMatchingCandidates;
+    using FeatureTracker::windowedMatchingMask;
+};
+
+// keypoints2 and dtor2 are noisy copies of keypoints1 and dtor1, followed
+// by unrelated features, so that most features have a match but some lie
+// outside the window
+void
+createFeatures(DescriptorType descriptorType,
+               std::vector<cv::KeyPoint>& keypoints1, cv::Mat& dtor1,
+               std::vector<cv::KeyPoint>& keypoints2, cv::Mat& dtor2)
+{
+    const int count = 300;
+    const int extraCount = 100;
+
+    cv::RNG rng(1);
+
+    bool binary = (descriptorType == ORB_DESCRIPTOR);
+    int dtorType = binary ? CV_8U : CV_32F;
+    int dtorSize = binary ? 32 : 64;
+    double dtorMax = binary ? 256.0 : 1.0;
+
+    dtor1 = cv::Mat(count, dtorSize, dtorType);
+    rng.fill(dtor1, cv::RNG::UNIFORM, 0.0, dtorMax);
+
+    dtor2 = cv::Mat(count + extraCount, dtorSize, dtorType);
+    rng.fill(dtor2, cv::RNG::UNIFORM, 0.0, dtorMax);
+
+    keypoints1.resize(count);
+    keypoints2.resize(count + extraCount);
+    for (int i = 0; i < count + extraCount; ++i)
+    {
+        // some keypoints on the image border
+        cv::Point2f pt(rng.uniform(0.0f, 639.0f), rng.uniform(0.0f, 479.0f));
+        if (i % 20 == 0)
+        {
+            pt.x = 0.0f;
+        }
+        else if (i % 20 == 1)
+        {
+            pt.y = 479.0f;
+        }
+
+        if (i >= count)
+        {
+            keypoints2.at(i).pt = pt;
+            continue;
+        }
+
+        keypoints1.at(i).pt = pt;
+        keypoints2.at(i).pt = pt + cv::Point2f(rng.uniform(-100.0f, 100.0f),
+                                               rng.uniform(-100.0f, 100.0f));
+
+        if (binary)
+        {
+            dtor1.row(i).copyTo(dtor2.row(i));
+
+            // flip a few bits
+            for (int k = 0; k < 8; ++k)
+            {
+                dtor2.at<uchar>(i, rng.uniform(0, dtorSize)) ^= 1 << rng.uniform(0, 8);
+            }
+        }
+        else
+        {
+            for (int k = 0; k < dtorSize; ++k)
+            {
+                dtor2.at<float>(i, k) = dtor1.at<float>(i, k) +
+                                        static_cast<float>(rng.gaussian(0.05));
+            }
+        }
+    }
+}
+
+bool
+trainIdxLess(const cv::DMatch& m1, const cv::DMatch& m2)
+{
+    return m1.trainIdx < m2.trainIdx;
+}
+
+// descriptor distances may differ in the last bits between the matchers
+void
+expectSameMatches(const std::vector<std::vector<cv::DMatch> >& expected,
+                  const std::vector<std::vector<cv::DMatch> >& matches)
+{
+    ASSERT_EQ(expected.size(), matches.size());
+
+    for (size_t i = 0; i < expected.size(); ++i)
+    {
+        // equally distant matches may be in any order
+        std::vector<cv::DMatch> expected1 = expected.at(i);
+        std::vector<cv::DMatch> matches1 = matches.at(i);
+        std::sort(expected1.begin(), expected1.end(), trainIdxLess);
+        std::sort(matches1.begin(), matches1.end(), trainIdxLess);
+
+        ASSERT_EQ(expected1.size(), matches1.size());
+        for (size_t j = 0; j < expected1.size(); ++j)
+        {
+            EXPECT_EQ(expected1.at(j).queryIdx, matches1.at(j).queryIdx);
+            EXPECT_EQ(expected1.at(j).trainIdx, matches1.at(j).trainIdx);
+            EXPECT_NEAR(expected1.at(j).distance, matches1.at(j).distance,
+                        1e-4f * expected1.at(j).distance);
+        }
+    }
+}
+
+void
+compareWithBruteForce(DescriptorType descriptorType, float maxDistance)
+{
+    MatchingFeatureTracker tracker(descriptorType);
+
+    std::vector<cv::KeyPoint> keypoints1, keypoints2;
+    cv::Mat dtor1, dtor2;
+    createFeatures(descriptorType, keypoints1, dtor1, keypoints2, dtor2);
+
+    cv::Mat mask;
+    tracker.windowedMatchingMask(keypoints1, keypoints2, k_maxDelta, k_maxDelta, mask);
+    ASSERT_EQ(static_cast<int>(keypoints1.size()), mask.rows);
+    ASSERT_EQ(static_cast<int>(keypoints2.size()), mask.cols);
+
+    std::vector<std::vector<int> > candidates;
+    tracker.windowedMatchingCandidates(keypoints1, keypoints2, k_maxDelta, k_maxDelta, candidates);
+
+    // the candidates are the nonzero entries of the mask
+    ASSERT_EQ(keypoints1.size(), candidates.size());
+    size_t candidateCount = 0;
+    for (int i = 0; i < mask.rows; ++i)
+    {
+        std::vector<int> expected;
+        for (int j = 0; j < mask.cols; ++j)
+        {
+            if (mask.at<uchar>(i, j))
+            {
+                expected.push_back(j);
+            }
+        }
+
+        EXPECT_EQ(expected, candidates.at(i));
+        candidateCount += expected.size();
+    }
+    EXPECT_LT(candidateCount, keypoints1.size() * keypoints2.size() / 4);
+
+    std::vector<std::vector<cv::DMatch> > expected, matches;
+
+    // ratio test
+    tracker.matchPointFeaturesWithRatioTest(dtor1, dtor2, expected, mask);
+    tracker.matchPointFeaturesWithCandidates(dtor1, dtor2, candidates, RATIO, matches);
+    EXPECT_FALSE(expected.empty());
+    expectSameMatches(expected, matches);
+
+    // radius test
+    tracker.matchPointFeaturesWithRadiusTest(dtor1, dtor2, expected, mask, maxDistance);
+    tracker.matchPointFeaturesWithCandidates(dtor1, dtor2, candidates, RADIUS, matches, maxDistance);
+    EXPECT_FALSE(expected.empty());
+    expectSameMatches(expected, matches);
+
+    // best match; matchPointFeaturesWithBestMatchTest does not take a mask
+    std::vector<cv::DMatch> rawMatches;
+    tracker.descriptorMatcher()->match(dtor1, dtor2, rawMatches, mask);
+    tracker.matchPointFeaturesWithCandidates(dtor1, dtor2, candidates, BEST_MATCH, matches);
+
+    ASSERT_EQ(rawMatches.size(), matches.size());
+    for (size_t i = 0; i < rawMatches.size(); ++i)
+    {
+        ASSERT_EQ(1u, matches.at(i).size());
+        EXPECT_EQ(rawMatches.at(i).queryIdx, matches.at(i).at(0).queryIdx);
+        EXPECT_NEAR(rawMatches.at(i).distance, matches.at(i).at(0).distance,
+                    1e-4f * rawMatches.at(i).distance);
+
+        // binary descriptors are often equally distant
+        if (descriptorType != ORB_DESCRIPTOR)
+        {
+            EXPECT_EQ(rawMatches.at(i).trainIdx, matches.at(i).at(0).trainIdx);
+        }
+    }
+}
+
+}
+
+TEST(FeatureTracker, candidateMatchingBinary)
+{
+    compareWithBruteForce(ORB_DESCRIPTOR, 100.5f);
+}
+
+TEST(FeatureTracker, candidateMatchingFloat)
+{
+    compareWithBruteForce(SURF_DESCRIPTOR, 2.0f);
+}
+
+TEST(FeatureTracker, emptyCandidates)
+{
+    MatchingFeatureTracker tracker(ORB_DESCRIPTOR);
+
+    std::vector<cv::KeyPoint> keypoints1(3);
+    std::vector<std::vector<int> > candidates(5, std::vector<int>(2, 0));
+
+    tracker.windowedMatchingCandidates(keypoints1, std::vector<cv::KeyPoint>(),
+                                       k_maxDelta, k_maxDelta, candidates);
+
+    ASSERT_EQ(3u, candidates.size());
+    for (size_t i = 0; i < candidates.size(); ++i)
+    {
+        EXPECT_TRUE(candidates.at(i).empty());
+    }
+
+    std::vector<std::vector<cv::DMatch> > matches;
+    tracker.matchPointFeaturesWithCandidates(cv::Mat(3, 32, CV_8U, cv::Scalar(0)),
+                                             cv::Mat(), candidates, RATIO, matches);
+    EXPECT_TRUE(matches.empty());
+}
+
+}
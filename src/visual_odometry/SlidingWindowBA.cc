@@ -12,7 +12,7 @@
 #include "../camera_models/CostFunctionFactory.h"
 #include "camodocal/EigenUtils.h"
 #include "../npoint/five-point/five-point.hpp"
-#include "../pose_estimation/P3P.h"
+#include "../pose_estimation/P3PRansac.h"
 
 namespace camodocal
 {
@@ -920,84 +920,21 @@ SlidingWindowBA::solveP3PRansac(const std::vector<std::vector<Point2DFeaturePtr>
 {
     inliers.clear();
 
-    double p = 0.99; // probability that at least one set of random samples does not contain an outlier
-    double v = 0.6; // probability of observing an outlier
-
-    double u = 1.0 - v;
-    int N = static_cast<int>(log(1.0 - p) / log(1.0 - u * u * u) + 0.5);
-
-    std::vector<size_t> indices;
+    // scene points and their observations, laid out for batch projection
+    Camera::Points3D scenePoints(correspondences.size(), 3);
+    Camera::Points2D imagePoints(correspondences.size(), 2);
     for (size_t i = 0; i < correspondences.size(); ++i)
     {
-        indices.push_back(i);
-    }
-
-    // run RANSAC to find best H
-    Eigen::Matrix4d H_best;
-    std::vector<size_t> inlierIds_best;
-    for (int i = 0; i < N; ++i)
-    {
-        std::random_shuffle(indices.begin(), indices.end());
-
-        std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > rays(3);
-        std::vector<Eigen::Vector3d, Eigen::aligned_allocator<Eigen::Vector3d> > worldPoints(3);
-        for (int j = 0; j < 3; ++j)
-        {
-            const std::vector<Point2DFeaturePtr>& corr = correspondences.at(indices.at(j));
-
-            worldPoints.at(j) = corr.at(0)->feature3D()->point();
-
-            const cv::KeyPoint& kpt2 = corr.at(1)->keypoint();
-
-            Eigen::Vector3d ray;
-            k_camera->liftSphere(Eigen::Vector2d(kpt2.pt.x, kpt2.pt.y), ray);
-
-            rays.at(j) = ray;
-        }
-
-        std::vector<Eigen::Matrix4d, Eigen::aligned_allocator<Eigen::Matrix4d> > solutions;
-        if (!solveP3P(rays, worldPoints, solutions))
-        {
-            continue;
-        }
-
-        for (size_t j = 0; j < solutions.size(); ++j)
-        {
-            Eigen::Matrix4d H_inv = solutions.at(j).inverse();
-
-            std::vector<size_t> inliersIds;
-            for (size_t k = 0; k < correspondences.size(); ++k)
-            {
-                const std::vector<Point2DFeaturePtr>& corr = correspondences.at(k);
-
-                Eigen::Vector3d P1 = corr.at(0)->feature3D()->point();
+        const std::vector<Point2DFeaturePtr>& corr = correspondences.at(i);
 
-                Eigen::Vector3d P2 = transformPoint(H_inv, P1);
-                Eigen::Vector2d p2_pred;
-                k_camera->spaceToPlane(P2, p2_pred);
+        scenePoints.row(i) = corr.at(0)->feature3D()->point().transpose();
 
-                const Point2DFeatureConstPtr& f2 = corr.at(1);
-
-                double err = hypot(f2->keypoint().pt.x - p2_pred(0),
-                                   f2->keypoint().pt.y - p2_pred(1));
-                if (err > k_reprojErrorThresh)
-                {
-                    continue;
-                }
-
-                inliersIds.push_back(k);
-            }
-
-            if (inliersIds.size() > inlierIds_best.size())
-            {
-                H_best = H_inv;
-                inlierIds_best = inliersIds;
-            }
-        }
+        const cv::KeyPoint& kpt2 = corr.at(1)->keypoint();
+        imagePoints.row(i) << kpt2.pt.x, kpt2.pt.y;
     }
 
-    H = H_best;
-    inliers = inlierIds_best;
+    P3PRansac ransac(k_camera, k_reprojErrorThresh);
+    ransac.estimate(scenePoints, imagePoints, H, inliers);
 }
 
 bool